@@ -151,6 +151,9 @@ typedef struct {
 
     i32 vlib_signal;
 
+    /* Create the vlib main input queue lock-free ("api-queue lockfree") */
+    int lockfree_input_queue;
+
     char *region_name;
     char *root_path;
 } api_main_t;
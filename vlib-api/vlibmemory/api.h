@@ -93,7 +93,7 @@ typedef struct msgbuf_ {
     u8 data[0];
 } msgbuf_t;
 
-#define VL_SHM_VERSION 2
+#define VL_SHM_VERSION 3
 
 #define VL_API_EPOCH_MASK 0xFF
 #define VL_API_EPOCH_SHIFT 8
@@ -115,7 +115,7 @@ static inline u32 vl_msg_api_handle_from_index_and_epoch (u32 index, u32 epoch)
     handle = (index<<VL_API_EPOCH_SHIFT) | (epoch & VL_API_EPOCH_MASK);
     return handle;
 }
-    
+
 void *vl_msg_api_alloc(int nbytes);
 void *vl_msg_api_alloc_as_if_client (int nbytes);
 void vl_msg_api_free(void *a);
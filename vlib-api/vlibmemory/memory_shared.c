@@ -330,9 +330,14 @@ int vl_map_shmem (char *region_name, int is_vlib)
     shmem_hdr->version = VL_SHM_VERSION;
 
     /* vlib main input queue */
-    shmem_hdr->vl_input_queue = 
-        unix_shared_memory_queue_init (1024, sizeof (uword), getpid(),
-                                       am->vlib_signal);
+    if (am->lockfree_input_queue)
+        shmem_hdr->vl_input_queue = 
+            unix_shared_memory_queue_init_lockfree (1024, sizeof (uword), 
+                                                    getpid(), am->vlib_signal);
+    else
+        shmem_hdr->vl_input_queue = 
+            unix_shared_memory_queue_init (1024, sizeof (uword), getpid(),
+                                           am->vlib_signal);
 
     /* Set up the msg ring allocator */
 #define _(sz,n)                                                 \
@@ -493,9 +498,10 @@ int vl_client_connect (char *name, int ctx_quota, int input_queue_size)
 
     pthread_mutex_lock (&svm->mutex);
     oldheap = svm_push_data_heap(svm);
+    /* Replies from vlib: lock-free, doorbell only when we sleep */
     vl_input_queue = 
-        unix_shared_memory_queue_init (input_queue_size, sizeof(uword), 
-                                       getpid(), 0);
+        unix_shared_memory_queue_init_lockfree (input_queue_size, 
+                                                sizeof(uword), getpid(), 0);
     pthread_mutex_unlock(&svm->mutex);
     svm_pop_heap (oldheap);
 
@@ -343,6 +343,9 @@ typedef enum {
 
 static u64 vector_rate_histogram[SLEEP_N_BUCKETS];
 
+/* Messages taken off the input queue per lock / per batch of CASes */
+#define MEMCLNT_BATCH_SIZE 16
+
 static void memclnt_queue_signal (int signum);
 static void memclnt_queue_callback (vlib_main_t *vm);
 
@@ -351,7 +354,6 @@ memclnt_process (vlib_main_t * vm,
                  vlib_node_runtime_t * node,
                  vlib_frame_t * f)
 {
-    uword mp;
     vl_shmem_hdr_t *shm;
     unix_shared_memory_queue_t *q;
     clib_error_t *e;
@@ -386,8 +388,8 @@ memclnt_process (vlib_main_t * vm,
     /* $$$ pay attention to frame size, control CPU usage */
     while (1) {
 	uword event_type __attribute__((unused));
-        i8 *headp;
-        int need_broadcast;
+        uword msgs[MEMCLNT_BATCH_SIZE];
+        int i, n_msgs;
 
         /*
          * There's a reason for checking the queue before
@@ -402,11 +404,17 @@ memclnt_process (vlib_main_t * vm,
         vector_rate = vlib_last_vector_length_per_node(vm);
         start_time = vlib_time_now (vm);
         while (1) {
-            pthread_mutex_lock (&q->mutex);
-            if (q->cursize == 0) {
-                vm->api_queue_nonempty = 0;
-                pthread_mutex_unlock (&q->mutex);
-                
+            /* 
+             * Clear the flag before looking, so a signal arriving
+             * from here on sets it again.
+             */
+            vm->api_queue_nonempty = 0;
+            n_msgs = unix_shared_memory_queue_sub_batch 
+                (q, (u8 *) msgs, ARRAY_LEN (msgs));
+            if (n_msgs == 0) {
+                if (unix_shared_memory_queue_prepare_to_sleep (q))
+                    continue;
+
                 if (TRACE_VLIB_MEMORY_QUEUE)
                 {
                     ELOG_TYPE_DECLARE (e) = {
@@ -421,20 +429,8 @@ memclnt_process (vlib_main_t * vm,
                 break;
             }
             
-            headp = (i8 *) (q->data + sizeof(uword)*q->head);
-            clib_memcpy (&mp, headp, sizeof(uword));
-            
-            q->head++;
-            need_broadcast = (q->cursize == q->maxsize/2);
-            q->cursize--;
-            
-            if (PREDICT_FALSE(q->head == q->maxsize))
-                q->head = 0;
-            pthread_mutex_unlock(&q->mutex);
-            if (need_broadcast)
-                (void) pthread_cond_broadcast(&q->condvar);
-            
-            vl_msg_api_handler_with_vm_node (am, (void *)mp, vm, node);
+            for (i = 0; i < n_msgs; i++)
+                vl_msg_api_handler_with_vm_node (am, (void *)msgs[i], vm, node);
 
             /* Allow no more than 10us without a pause */
             if (vlib_time_now(vm) > start_time + 10e-6) {
@@ -549,7 +545,7 @@ memclnt_process (vlib_main_t * vm,
             };
             struct { u32 len; } * ed;
             ed = ELOG_DATA (&vm->elog_main, e);
-            ed->len = q->cursize;
+            ed->len = unix_shared_memory_queue_len (q);
         }
     }
 
@@ -644,6 +640,23 @@ memclnt_queue_callback (vlib_main_t *vm)
         (vm, memclnt_node.index, /* event_type */ 0, /* event_data */ 0);
 }
 
+static clib_error_t *
+api_queue_config_fn (vlib_main_t * vm, unformat_input_t * input)
+{
+    api_main_t * am = &api_main;
+
+    while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT) {
+        if (unformat (input, "lockfree"))
+            am->lockfree_input_queue = 1;
+        else
+            return clib_error_return (0, "unknown input `%U'",
+                                      format_unformat_error, input);
+    }
+    return 0;
+}
+
+VLIB_CONFIG_FUNCTION (api_queue_config_fn, "api-queue");
+
 void vl_enable_disable_memory_api (vlib_main_t *vm, int enable)
 {
     vlib_node_set_state (vm, memclnt_node.index,
@@ -798,7 +811,8 @@ vl_api_client_command(vlib_main_t * vm,
                 health = "alive";
             }
             vlib_cli_output (vm, "%16s %8d %14d 0x%016llx %s\n",
-                             regp->name, q->consumer_pid, q->cursize, 
+                             regp->name, q->consumer_pid, 
+                             unix_shared_memory_queue_len (q),
                              q, health);
         } else {
             clib_warning ("NULL client registration index %d",
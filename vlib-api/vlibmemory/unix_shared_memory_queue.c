@@ -26,6 +26,10 @@
 #include <vppinfra/cache.h>
 #include <vlibmemory/unix_shared_memory_queue.h>
 #include <signal.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <limits.h>
+#include <linux/futex.h>
 
 /*
  * unix_shared_memory_queue_init
@@ -50,18 +54,19 @@
  * You probably want to be on an svm data heap before calling this 
  * function.
  */
-unix_shared_memory_queue_t *
-unix_shared_memory_queue_init(int nels, 
-                              int elsize, 
-                              int consumer_pid,
-                              int signal_when_queue_non_empty)
+static unix_shared_memory_queue_t *
+unix_shared_memory_queue_alloc (int nels, 
+                                int elsize, 
+                                int data_bytes,
+                                int consumer_pid,
+                                int signal_when_queue_non_empty)
 {
     unix_shared_memory_queue_t *q;
     pthread_mutexattr_t attr;
     pthread_condattr_t cattr;
 
     q = clib_mem_alloc_aligned(sizeof(unix_shared_memory_queue_t) 
-                               + nels*elsize, CLIB_CACHE_LINE_BYTES);
+                               + data_bytes, CLIB_CACHE_LINE_BYTES);
     memset(q, 0, sizeof (*q));
 
     q->elsize = elsize;
@@ -93,6 +98,293 @@ unix_shared_memory_queue_init(int nels,
     return(q);
 }
 
+unix_shared_memory_queue_t *
+unix_shared_memory_queue_init(int nels, 
+                              int elsize, 
+                              int consumer_pid,
+                              int signal_when_queue_non_empty)
+{
+    return unix_shared_memory_queue_alloc (nels, elsize, nels*elsize,
+                                           consumer_pid,
+                                           signal_when_queue_non_empty);
+}
+
+/*
+ * Lock-free queues
+ *
+ * A bounded ring of cells, each stamped with a sequence number
+ * (D. Vyukov's bounded queue). A producer claims the cell at
+ * enqueue_pos with a compare-and-swap once the cell's sequence says
+ * it is free, fills it, and publishes it by bumping the sequence; the
+ * consumer does the same at dequeue_pos. Any number of producers may
+ * add; with the usual single producer the CAS never fails, so a
+ * client's reply queue costs one uncontended atomic per message.
+ *
+ * Nobody sleeps holding anything. A consumer about to block sets
+ * consumer_sleeping and re-checks the ring; a producer that sees the
+ * flag after publishing rings the doorbell: the signal, for consumers
+ * that asked for one, or a futex wake. Producers waiting for space
+ * work the same way in the other direction. The mutex and condvar
+ * are still initialized but unused.
+ */
+typedef struct {
+    volatile u64 sequence;
+    u8 data[0];
+} unix_shared_memory_queue_cell_t;
+
+static inline unix_shared_memory_queue_cell_t *
+lockfree_cell (unix_shared_memory_queue_t *q, u64 pos)
+{
+    return (unix_shared_memory_queue_cell_t *)
+        (q->data + (pos & (q->maxsize - 1)) * q->cell_size);
+}
+
+static inline int
+lockfree_is_lockfree (unix_shared_memory_queue_t *q)
+{
+    return (q->flags & UNIX_SHARED_MEMORY_QUEUE_F_LOCKFREE) != 0;
+}
+
+static void
+lockfree_futex_wait (volatile u32 *addr, u32 val)
+{
+    /* Not FUTEX_PRIVATE: waiter and waker are different processes */
+    (void) syscall (SYS_futex, addr, FUTEX_WAIT, val, 0, 0, 0);
+}
+
+static void
+lockfree_futex_wake (volatile u32 *addr)
+{
+    (void) syscall (SYS_futex, addr, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+}
+
+unix_shared_memory_queue_t *
+unix_shared_memory_queue_init_lockfree (int nels,
+                                        int elsize,
+                                        int consumer_pid,
+                                        int signal_when_queue_non_empty)
+{
+    unix_shared_memory_queue_t *q;
+    unix_shared_memory_queue_cell_t *c;
+    int cell_size;
+    u64 i;
+
+    nels = 1 << max_log2 (nels);
+    cell_size = round_pow2 (sizeof (c[0]) + elsize, sizeof (u64));
+
+    q = unix_shared_memory_queue_alloc (nels, elsize, nels * cell_size,
+                                        consumer_pid, 
+                                        signal_when_queue_non_empty);
+    q->flags |= UNIX_SHARED_MEMORY_QUEUE_F_LOCKFREE;
+    q->cell_size = cell_size;
+
+    for (i = 0; i < nels; i++)
+        lockfree_cell (q, i)->sequence = i;
+
+    return q;
+}
+
+static inline int
+lockfree_try_add (unix_shared_memory_queue_t *q, u8 *elem)
+{
+    unix_shared_memory_queue_cell_t *c;
+    u64 pos = q->enqueue_pos;
+    i64 diff;
+
+    while (1) {
+        c = lockfree_cell (q, pos);
+        diff = (i64) (c->sequence - pos);
+        if (diff == 0) {
+            if (__sync_bool_compare_and_swap (&q->enqueue_pos, pos, pos + 1))
+                break;
+        } else if (diff < 0)
+            return -2;          /* full */
+        pos = q->enqueue_pos;
+    }
+
+    clib_memcpy (c->data, elem, q->elsize);
+    CLIB_MEMORY_BARRIER();
+    c->sequence = pos + 1;
+    return 0;
+}
+
+static inline int
+lockfree_try_sub (unix_shared_memory_queue_t *q, u8 *elem)
+{
+    unix_shared_memory_queue_cell_t *c;
+    u64 pos = q->dequeue_pos;
+    i64 diff;
+
+    while (1) {
+        c = lockfree_cell (q, pos);
+        diff = (i64) (c->sequence - (pos + 1));
+        if (diff == 0) {
+            if (__sync_bool_compare_and_swap (&q->dequeue_pos, pos, pos + 1))
+                break;
+        } else if (diff < 0)
+            return -2;          /* empty */
+        pos = q->dequeue_pos;
+    }
+
+    clib_memcpy (elem, c->data, q->elsize);
+    CLIB_MEMORY_BARRIER();
+    c->sequence = pos + q->maxsize;
+    return 0;
+}
+
+static inline int
+lockfree_is_empty (unix_shared_memory_queue_t *q)
+{
+    u64 pos = q->dequeue_pos;
+    return (i64) (lockfree_cell (q, pos)->sequence - (pos + 1)) < 0;
+}
+
+static inline int
+lockfree_is_full (unix_shared_memory_queue_t *q)
+{
+    u64 pos = q->enqueue_pos;
+    return (i64) (lockfree_cell (q, pos)->sequence - pos) < 0;
+}
+
+/* Producer side, after publishing: wake the consumer if it sleeps */
+static inline void
+lockfree_ring_consumer (unix_shared_memory_queue_t *q)
+{
+    CLIB_MEMORY_BARRIER();
+    if (PREDICT_TRUE (q->consumer_sleeping == 0))
+        return;
+    /* One producer rings, the rest see the flag clear */
+    if (! __sync_bool_compare_and_swap (&q->consumer_sleeping, 1, 0))
+        return;
+    __sync_fetch_and_add (&q->consumer_doorbell, 1);
+    if (q->signal_when_queue_non_empty)
+        kill (q->consumer_pid, q->signal_when_queue_non_empty);
+    else
+        lockfree_futex_wake (&q->consumer_doorbell);
+}
+
+/* Consumer side, after freeing cells: wake producers waiting for space */
+static inline void
+lockfree_ring_producers (unix_shared_memory_queue_t *q)
+{
+    CLIB_MEMORY_BARRIER();
+    if (PREDICT_TRUE (q->producers_sleeping == 0))
+        return;
+    __sync_fetch_and_add (&q->producer_doorbell, 1);
+    lockfree_futex_wake (&q->producer_doorbell);
+}
+
+static int
+lockfree_add (unix_shared_memory_queue_t *q, u8 *elem, int nowait)
+{
+    u32 doorbell;
+
+    while (lockfree_try_add (q, elem)) {
+        if (nowait)
+            return (-2);
+        doorbell = q->producer_doorbell;
+        __sync_fetch_and_add (&q->producers_sleeping, 1);
+        CLIB_MEMORY_BARRIER();
+        if (lockfree_is_full (q))
+            lockfree_futex_wait (&q->producer_doorbell, doorbell);
+        __sync_fetch_and_sub (&q->producers_sleeping, 1);
+    }
+
+    lockfree_ring_consumer (q);
+    return 0;
+}
+
+static int
+lockfree_sub (unix_shared_memory_queue_t *q, u8 *elem, int nowait)
+{
+    u32 doorbell;
+
+    while (lockfree_try_sub (q, elem)) {
+        if (nowait)
+            return (-2);
+        doorbell = q->consumer_doorbell;
+        q->consumer_sleeping = 1;
+        CLIB_MEMORY_BARRIER();
+        if (lockfree_is_empty (q))
+            lockfree_futex_wait (&q->consumer_doorbell, doorbell);
+        q->consumer_sleeping = 0;
+    }
+
+    lockfree_ring_producers (q);
+    return 0;
+}
+
+/*
+ * unix_shared_memory_queue_prepare_to_sleep
+ *
+ * For consumers which wait by other means, e.g. the vlib main input
+ * queue. Asks producers to ring the doorbell on the next add; returns
+ * non-zero if the queue is not empty after all, in which case the
+ * caller should drain it instead of sleeping.
+ */
+int unix_shared_memory_queue_prepare_to_sleep (unix_shared_memory_queue_t *q)
+{
+    if (! lockfree_is_lockfree (q))
+        return q->cursize != 0;
+
+    q->consumer_sleeping = 1;
+    CLIB_MEMORY_BARRIER();
+    if (lockfree_is_empty (q))
+        return 0;
+    q->consumer_sleeping = 0;
+    return 1;
+}
+
+/*
+ * unix_shared_memory_queue_sub_batch
+ *
+ * Dequeue up to max_elems without waiting, taking the mutex (if any)
+ * once. Returns the number of elements copied to elems.
+ */
+int unix_shared_memory_queue_sub_batch (unix_shared_memory_queue_t *q,
+                                        u8 *elems, int max_elems)
+{
+    int n = 0, need_broadcast;
+
+    if (lockfree_is_lockfree (q)) {
+        while (n < max_elems && lockfree_try_sub (q, elems + n*q->elsize) == 0)
+            n++;
+        if (n)
+            lockfree_ring_producers (q);
+        return n;
+    }
+
+    pthread_mutex_lock(&q->mutex);
+    need_broadcast = (q->cursize == q->maxsize);
+    while (n < max_elems && q->cursize > 0) {
+        clib_memcpy(elems + n*q->elsize, 
+                    &q->data[0] + q->elsize*q->head, q->elsize);
+        n++;
+        q->head++;
+        q->cursize--;
+        if (q->head == q->maxsize)
+            q->head = 0;
+    }
+    pthread_mutex_unlock(&q->mutex);
+
+    if (need_broadcast && n) 
+        (void) pthread_cond_broadcast(&q->condvar);
+
+    return n;
+}
+
+int unix_shared_memory_queue_len (unix_shared_memory_queue_t *q)
+{
+    i64 len;
+
+    if (! lockfree_is_lockfree (q))
+        return q->cursize;
+
+    /* A snapshot; either end may move while we look */
+    len = (i64) (q->enqueue_pos - q->dequeue_pos);
+    return len < 0 ? 0 : (len > q->maxsize ? q->maxsize : len);
+}
+
 /*
  * unix_shared_memory_queue_free
  */
@@ -105,16 +397,22 @@ void unix_shared_memory_queue_free(unix_shared_memory_queue_t *q)
 
 void unix_shared_memory_queue_lock (unix_shared_memory_queue_t *q)
 {
+    if (lockfree_is_lockfree (q))
+        return;
     pthread_mutex_lock(&q->mutex);
 }
 
 void unix_shared_memory_queue_unlock (unix_shared_memory_queue_t *q)
 {
+    if (lockfree_is_lockfree (q))
+        return;
     pthread_mutex_unlock(&q->mutex);
 }
 
 int unix_shared_memory_queue_is_full (unix_shared_memory_queue_t *q)
 {
+    if (lockfree_is_lockfree (q))
+        return lockfree_is_full (q);
     return q->cursize == q->maxsize;
 }
 
@@ -127,6 +425,9 @@ int unix_shared_memory_queue_add_nolock (unix_shared_memory_queue_t *q,
     i8 *tailp;
     int need_broadcast=0;
     
+    if (lockfree_is_lockfree (q))
+        return lockfree_add (q, elem, 0 /* nowait */);
+
     if (PREDICT_FALSE(q->cursize == q->maxsize)) {
         while(q->cursize == q->maxsize) {
             (void) pthread_cond_wait(&q->condvar, &q->mutex);
@@ -157,6 +458,8 @@ int unix_shared_memory_queue_add_raw (unix_shared_memory_queue_t *q,
 {
     i8 *tailp;
     
+    ASSERT (! lockfree_is_lockfree (q));
+
     if (PREDICT_FALSE(q->cursize == q->maxsize)) {
         while(q->cursize == q->maxsize)
             ;
@@ -183,6 +486,9 @@ int unix_shared_memory_queue_add (unix_shared_memory_queue_t *q,
     i8 *tailp;
     int need_broadcast=0;
     
+    if (lockfree_is_lockfree (q))
+        return lockfree_add (q, elem, nowait);
+
     if (nowait) {
         /* zero on success */
         if (pthread_mutex_trylock (&q->mutex)) {
@@ -231,6 +537,9 @@ int unix_shared_memory_queue_sub(unix_shared_memory_queue_t *q,
     i8 *headp;
     int need_broadcast=0;
     
+    if (lockfree_is_lockfree (q))
+        return lockfree_sub (q, elem, nowait);
+
     if (nowait) {
         /* zero on success */
         if (pthread_mutex_trylock (&q->mutex)) {
@@ -274,6 +583,8 @@ int unix_shared_memory_queue_sub_raw (unix_shared_memory_queue_t *q,
 {
     i8 *headp;
     
+    ASSERT (! lockfree_is_lockfree (q));
+
     if (PREDICT_FALSE(q->cursize == 0)) {
         while (q->cursize == 0) 
             ;
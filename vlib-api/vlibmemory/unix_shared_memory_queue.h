@@ -22,6 +22,7 @@
 
 #include <pthread.h>
 #include <vppinfra/mem.h>
+#include <vppinfra/cache.h>
 
 typedef struct _unix_shared_memory_queue {
     pthread_mutex_t mutex;      /* 8 bytes */
@@ -33,14 +34,40 @@ typedef struct _unix_shared_memory_queue {
     int elsize;
     int consumer_pid;
     int signal_when_queue_non_empty;
-    char data[0];
+    int flags;
+
+    /* 
+     * Lock-free queues only. Producers and the consumer each own a
+     * cache line; the doorbells are futex words, rung only when the
+     * other side said it was about to sleep.
+     */
+    CLIB_CACHE_LINE_ALIGN_MARK (producer_cacheline);
+    volatile u64 enqueue_pos;
+    volatile u32 producer_doorbell;
+    volatile u32 producers_sleeping;
+
+    CLIB_CACHE_LINE_ALIGN_MARK (consumer_cacheline);
+    volatile u64 dequeue_pos;
+    volatile u32 consumer_doorbell;
+    volatile u32 consumer_sleeping;
+    int cell_size;
+
+    char data[0] __attribute__((aligned(8)));
 } unix_shared_memory_queue_t;
 
+/* q->flags */
+#define UNIX_SHARED_MEMORY_QUEUE_F_LOCKFREE (1<<0)
+
 unix_shared_memory_queue_t *
 unix_shared_memory_queue_init(int nels, 
                               int elsize, 
                               int consumer_pid,
                               int signal_when_queue_non_empty);
+unix_shared_memory_queue_t *
+unix_shared_memory_queue_init_lockfree (int nels,
+                                        int elsize,
+                                        int consumer_pid,
+                                        int signal_when_queue_non_empty);
 void unix_shared_memory_queue_free(unix_shared_memory_queue_t *q);
 int unix_shared_memory_queue_add (unix_shared_memory_queue_t *q, 
                                   u8 *elem, int nowait);
@@ -51,6 +78,10 @@ void unix_shared_memory_queue_unlock (unix_shared_memory_queue_t *q);
 int unix_shared_memory_queue_is_full (unix_shared_memory_queue_t *q);
 int unix_shared_memory_queue_add_nolock (unix_shared_memory_queue_t *q, 
                                          u8 *elem);
+int unix_shared_memory_queue_sub_batch (unix_shared_memory_queue_t *q,
+                                        u8 *elems, int max_elems);
+int unix_shared_memory_queue_len (unix_shared_memory_queue_t *q);
+int unix_shared_memory_queue_prepare_to_sleep (unix_shared_memory_queue_t *q);
 
 int unix_shared_memory_queue_sub_raw (unix_shared_memory_queue_t *q, 
                                       u8 *elem);
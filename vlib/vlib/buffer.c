@@ -1071,6 +1071,69 @@ void vlib_buffer_free_no_next (vlib_main_t * vm,
   vlib_buffer_free_inline (vm, buffers, n_buffers, /* follow_buffer_next */ 0);
 }
 
+/* Full copy of a buffer chain, ~0 if out of buffers. */
+static u32
+vlib_buffer_copy_chain (vlib_main_t * vm, vlib_buffer_t * s)
+{
+  vlib_buffer_t * d, * prev = 0;
+  u32 bi, first = ~0;
+
+  while (1)
+    {
+      if (vlib_buffer_alloc (vm, &bi, 1) != 1)
+	{
+	  if (first != ~0)
+	    vlib_buffer_free_one (vm, first);
+	  return ~0;
+	}
+
+      d = vlib_get_buffer (vm, bi);
+      if (prev)
+	{
+	  prev->next_buffer = bi;
+	  prev->flags |= VLIB_BUFFER_NEXT_PRESENT;
+	  d->current_data = s->current_data;
+	  d->current_length = s->current_length;
+	}
+      else
+	{
+	  first = bi;
+	  vlib_buffer_copy_metadata (d, s);
+	}
+
+      clib_memcpy (vlib_buffer_get_current (d),
+		   vlib_buffer_get_current (s), s->current_length);
+
+      if (! (s->flags & VLIB_BUFFER_NEXT_PRESENT))
+	return first;
+
+      prev = d;
+      s = vlib_get_buffer (vm, s->next_buffer);
+    }
+}
+
+/* No reference counts on these buffers: every copy is a full copy
+   and the source itself is the last one. */
+u16 vlib_buffer_clone (vlib_main_t * vm, u32 src_buffer, u32 * buffers,
+		       u16 n_buffers, u16 head_end_offset)
+{
+  vlib_buffer_t * s = vlib_get_buffer (vm, src_buffer);
+  u16 i;
+
+  if (n_buffers == 0)
+    return 0;
+
+  for (i = 0; i < n_buffers - 1; i++)
+    {
+      buffers[i] = vlib_buffer_copy_chain (vm, s);
+      if (buffers[i] == ~0)
+	break;
+    }
+
+  buffers[i] = src_buffer;
+  return i + 1;
+}
+
 /* Copy template packet data into buffers as they are allocated. */
 static void
 vlib_packet_template_buffer_init (vlib_main_t * vm,
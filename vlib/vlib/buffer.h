@@ -309,6 +309,11 @@ typedef struct {
   /* List of free-lists needing Blue Light Special announcements */
   vlib_buffer_free_list_t **announce_list;
 
+  /* Set when some interface can only transmit single segment buffers;
+     vlib_buffer_clone then makes full copies instead of sharing the
+     payload. */
+  u8 no_multi_seg_tx;
+
   /*  Vector of rte_mempools per socket */
 #if DPDK == 1
   struct rte_mempool ** pktmbuf_pools;
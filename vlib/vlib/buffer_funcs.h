@@ -321,6 +321,52 @@ vlib_buffer_free_one (vlib_main_t * vm, u32 buffer_index)
   vlib_buffer_free (vm, &buffer_index, /* n_buffers */ 1);
 }
 
+/** \brief Copy buffer metadata (not packet data) to a new buffer
+
+    Everything a graph node may look at is copied except the chain
+    link: the caller sets next_buffer and VLIB_BUFFER_NEXT_PRESENT.
+
+    @param d - (vlib_buffer_t *) destination buffer
+    @param s - (vlib_buffer_t *) source buffer
+*/
+always_inline void
+vlib_buffer_copy_metadata (vlib_buffer_t * d, vlib_buffer_t * s)
+{
+  d->current_data = s->current_data;
+  d->current_length = s->current_length;
+  d->flags = s->flags & ~VLIB_BUFFER_NEXT_PRESENT;
+  d->total_length_not_including_first_buffer =
+    s->total_length_not_including_first_buffer;
+  d->trace_index = s->trace_index;
+  d->clone_count = 0;
+  d->error = s->error;
+  clib_memcpy (d->opaque, s->opaque, sizeof (s->opaque));
+  clib_memcpy (d->opaque2, s->opaque2, sizeof (s->opaque2));
+}
+
+/** \brief Replicate a buffer, sharing its payload where possible
+
+    Each copy gets a private header buffer holding the first
+    head_end_offset bytes of the packet and its own metadata; the rest
+    of the packet is shared, reference counted, by all the copies.
+    Nodes may rewrite anything in the header part of a copy but must
+    treat the shared payload as read-only.  Small packets, and chains
+    whose first segment is too short to split, are copied outright,
+    the source buffer then being one of the copies.
+
+    Without reference counted buffers (no DPDK), or when some interface
+    cannot transmit chained buffers, every copy is a full copy.
+
+    @param vm - (vlib_main_t *) vlib main data structure pointer
+    @param src_buffer - (u32) buffer to replicate, consumed
+    @param buffers - (u32 *) returns the copies
+    @param n_buffers - (u16) number of copies wanted
+    @param head_end_offset - (u16) private bytes per copy
+    @return - (u16) number of copies made, 0 if src_buffer was left alone
+*/
+u16 vlib_buffer_clone (vlib_main_t * vm, u32 src_buffer, u32 * buffers,
+		       u16 n_buffers, u16 head_end_offset);
+
 /* Add/delete buffer free lists. */
 u32 vlib_buffer_create_free_list (vlib_main_t * vm, u32 n_data_bytes, char * fmt, ...);
 void vlib_buffer_delete_free_list (vlib_main_t * vm, u32 free_list_index);
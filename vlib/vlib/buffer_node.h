@@ -80,6 +80,64 @@ do {									\
     }									\
 } while (0)
 
+#define vlib_validate_buffer_enqueue_x4(vm,node,next_index,to_next,n_left_to_next,bi0,bi1,bi2,bi3,next0,next1,next2,next3) \
+do {									\
+  /* After the fact: check the [speculative] enqueue to "next" */	\
+  u32 fix_speculation = ((next_index ^ next0) | (next_index ^ next1)	\
+			 | (next_index ^ next2) | (next_index ^ next3)); \
+  if (PREDICT_FALSE (fix_speculation))					\
+    {									\
+      /* rewind... */							\
+      to_next -= 4;							\
+      n_left_to_next += 4;						\
+									\
+      /* If bi0 belongs to "next", send it there */			\
+      if (next_index == next0)						\
+	{								\
+	  to_next[0] = bi0;						\
+	  to_next++;							\
+	  n_left_to_next--;						\
+	}								\
+      else		/* send it where it needs to go */		\
+	vlib_set_next_frame_buffer (vm, node, next0, bi0);		\
+									\
+      if (next_index == next1)						\
+	{								\
+	  to_next[0] = bi1;						\
+	  to_next++;							\
+	  n_left_to_next--;						\
+	}								\
+      else								\
+	vlib_set_next_frame_buffer (vm, node, next1, bi1);		\
+									\
+      if (next_index == next2)						\
+	{								\
+	  to_next[0] = bi2;						\
+	  to_next++;							\
+	  n_left_to_next--;						\
+	}								\
+      else								\
+	vlib_set_next_frame_buffer (vm, node, next2, bi2);		\
+									\
+      if (next_index == next3)						\
+	{								\
+	  to_next[0] = bi3;						\
+	  to_next++;							\
+	  n_left_to_next--;						\
+	}								\
+      else								\
+	vlib_set_next_frame_buffer (vm, node, next3, bi3);		\
+									\
+      /* Change speculation: last 2 packets went to the same node */	\
+      if (next2 == next3)						\
+	{								\
+	  vlib_put_next_frame (vm, node, next_index, n_left_to_next);	\
+	  next_index = next3;						\
+	  vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next); \
+	}								\
+    }									\
+} while (0)
+
 #define vlib_validate_buffer_enqueue_x1(vm,node,next_index,to_next,n_left_to_next,bi0,next0) \
 do {									\
   if (PREDICT_FALSE (next0 != next_index))				\
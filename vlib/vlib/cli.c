@@ -591,6 +591,91 @@ VLIB_CLI_COMMAND (show_memory_usage_command, static) = {
   .function = show_memory_usage,
 };
 
+static clib_error_t *
+show_memory_numa (vlib_main_t * vm,
+                  unformat_input_t * input,
+                  vlib_cli_command_t * cmd)
+{
+  vlib_thread_main_t * tm = vlib_get_thread_main ();
+  vlib_worker_thread_t * w;
+  uword * heap_index_by_heap = hash_create (0, sizeof (uword));
+  uword ** pages_by_node_by_heap = 0;
+  uword * log2_page_size_by_heap = 0;
+  uword * p, * pages_by_node, local, remote;
+  uword log2_page_size, index, node;
+  mheap_t * h;
+  void * heap;
+
+  vlib_cli_output (vm, "%=6s%=20s%=6s%=6s%=14s%=14s%=14s", "Thread", "Name",
+                   "Cpu", "Node", "Page", "Local", "Remote");
+
+  vec_foreach (w, vlib_worker_threads)
+    {
+      heap = w->thread_mheap;
+      if (! heap)
+        continue;
+
+      /* Workers may share a heap, look at each one only once */
+      p = hash_get (heap_index_by_heap, heap);
+      if (p)
+        index = p[0];
+      else
+        {
+          index = vec_len (pages_by_node_by_heap);
+          hash_set (heap_index_by_heap, heap, index);
+          vec_validate (pages_by_node_by_heap, index);
+          vec_validate (log2_page_size_by_heap, index);
+
+          log2_page_size = 0;
+          for (node = 0; node < vec_len (tm->numa_heap_by_node); node++)
+            if (tm->numa_heap_by_node[node] == heap)
+              log2_page_size = tm->numa_heap_log2_page_size_by_node[node];
+          if (log2_page_size == 0)
+            log2_page_size = min_log2 (clib_mem_get_page_size ());
+          log2_page_size_by_heap[index] = log2_page_size;
+
+          h = mheap_header (heap);
+          if (clib_mem_vm_get_numa_pages ((u8 *) h - h->vm_alloc_offset_from_header,
+                                          h->vm_alloc_size, log2_page_size,
+                                          &pages_by_node_by_heap[index]) < 0)
+            {
+              vlib_cli_output (vm, "move_pages: %s", strerror (errno));
+              goto done;
+            }
+        }
+
+      pages_by_node = pages_by_node_by_heap[index];
+      log2_page_size = log2_page_size_by_heap[index];
+      local = remote = 0;
+      for (node = 0; node < vec_len (pages_by_node); node++)
+        if (node == w->numa_node)
+          local += pages_by_node[node] << log2_page_size;
+        else
+          remote += pages_by_node[node] << log2_page_size;
+
+      vlib_cli_output (vm, "%=6d%=20v%=6d%=6d%=14U%=14U%=14U",
+                       w - vlib_worker_threads, w->name, w->cpu_id,
+                       w->numa_node, format_memory_size,
+                       (uword) 1 << log2_page_size,
+                       format_memory_size, local,
+                       format_memory_size, remote);
+    }
+
+ done:
+  for (index = 0; index < vec_len (pages_by_node_by_heap); index++)
+    vec_free (pages_by_node_by_heap[index]);
+  vec_free (pages_by_node_by_heap);
+  vec_free (log2_page_size_by_heap);
+  hash_free (heap_index_by_heap);
+  return 0;
+}
+
+VLIB_CLI_COMMAND (show_memory_numa_command, static) = {
+  .path = "show memory numa",
+  .short_help = "Show worker heap pages on local and remote NUMA nodes",
+  .function = show_memory_numa,
+};
+
 static clib_error_t *
 enable_disable_memory_trace (vlib_main_t * vm,
 			     unformat_input_t * input,
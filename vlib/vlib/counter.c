@@ -39,48 +39,26 @@
 
 #include <vlib/vlib.h>
 
+/*
+ * Clearing only snapshots the current totals, the per-thread counters
+ * keep running so workers never see their counters written under them.
+ */
 void vlib_clear_simple_counters (vlib_simple_counter_main_t * cm)
 {
   uword i, j;
-  u16 * my_minis;
-
-  for (i = 0; i < vec_len(cm->minis); i++)
-    {
-      my_minis = cm->minis[i];
-      
-      for (j = 0; j < vec_len (my_minis); j++)
-        {
-          cm->maxi[j] += my_minis[j];
-          my_minis[j] = 0;
-        }
-    }
 
-  j = vec_len (cm->maxi);
+  j = vlib_counter_len (cm);
   if (j > 0)
     vec_validate (cm->value_at_last_clear, j - 1);
   for (i = 0; i < j; i++)
-    cm->value_at_last_clear[i] = cm->maxi[i];
+    cm->value_at_last_clear[i] = vlib_get_simple_counter_total (cm, i);
 }
 
 void vlib_clear_combined_counters (vlib_combined_counter_main_t * cm)
 {
   uword i, j;
-  vlib_mini_counter_t * my_minis;
 
-  for (i = 0; i < vec_len(cm->minis); i++)
-    {
-      my_minis = cm->minis[i];
-      
-      for (j = 0; j < vec_len (my_minis); j++)
-        {
-          cm->maxi[j].packets += my_minis[j].packets;
-          cm->maxi[j].bytes += my_minis[j].bytes;
-          my_minis[j].packets = 0;
-          my_minis[j].bytes = 0;
-        }
-    }
-
-  j = vec_len (cm->maxi);
+  j = vlib_counter_len (cm);
   if (j > 0)
     vec_validate (cm->value_at_last_clear, j - 1);
 
@@ -88,7 +66,7 @@ void vlib_clear_combined_counters (vlib_combined_counter_main_t * cm)
     {
       vlib_counter_t * c = vec_elt_at_index (cm->value_at_last_clear, i);
 
-      c[0] = cm->maxi[i];
+      vlib_get_combined_counter_total (cm, i, c);
     }
 }
 
@@ -97,10 +75,9 @@ void vlib_validate_simple_counter (vlib_simple_counter_main_t *cm, u32 index)
   vlib_thread_main_t * tm = vlib_get_thread_main();
   int i;
 
-  vec_validate (cm->minis, tm->n_vlib_mains - 1);
+  vec_validate (cm->counters, tm->n_vlib_mains - 1);
   for (i = 0; i < tm->n_vlib_mains; i++)
-    vec_validate_aligned (cm->minis[i], index, CLIB_CACHE_LINE_BYTES);
-  vec_validate_aligned (cm->maxi, index, CLIB_CACHE_LINE_BYTES);
+    vec_validate_aligned (cm->counters[i], index, CLIB_CACHE_LINE_BYTES);
 }
 
 void vlib_validate_combined_counter (vlib_combined_counter_main_t *cm, u32 index)
@@ -108,10 +85,26 @@ void vlib_validate_combined_counter (vlib_combined_counter_main_t *cm, u32 index
   vlib_thread_main_t * tm = vlib_get_thread_main();
   int i;
 
-  vec_validate (cm->minis, tm->n_vlib_mains - 1);
+  vec_validate (cm->counters, tm->n_vlib_mains - 1);
   for (i = 0; i < tm->n_vlib_mains ; i++)
-    vec_validate_aligned (cm->minis[i], index, CLIB_CACHE_LINE_BYTES);
-  vec_validate_aligned (cm->maxi, index, CLIB_CACHE_LINE_BYTES);
+    vec_validate_aligned (cm->counters[i], index, CLIB_CACHE_LINE_BYTES);
+}
+
+/* Would validating index move any thread's counters? */
+int vlib_validate_combined_counter_will_expand (vlib_combined_counter_main_t *cm,
+                                                u32 index)
+{
+  vlib_thread_main_t * tm = vlib_get_thread_main();
+  int i;
+
+  if (vec_len (cm->counters) < tm->n_vlib_mains)
+    return 1;
+
+  for (i = 0; i < tm->n_vlib_mains; i++)
+    if (index >= vec_max_len (cm->counters[i]))
+      return 1;
+
+  return 0;
 }
 
 void serialize_vlib_simple_counter_main (serialize_main_t * m, va_list * va)
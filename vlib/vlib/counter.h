@@ -40,18 +40,20 @@
 #ifndef included_vlib_counter_h
 #define included_vlib_counter_h
 
-/* 
+/*
+ * Each thread owns a cache line aligned vector of full width counters
+ * and bumps them with plain, non-atomic adds.  Readers sum over the
+ * threads without locks or barriers: an aligned u64 load never tears,
+ * so a reader sees a thread's count either before or after an add.
+ *
  * Annoyingly enough, counters are created long before
  * the CPU configuration is available, so we have to
- * preallocate the mini-counter per-cpu vectors
+ * preallocate the per-cpu vectors
  */
 
 typedef struct {
-  /* Compact counters that (rarely) can overflow. */
-  u16 ** minis;
-
-  /* Counters to hold overflow. */
-  u64 * maxi;
+  /* Per-thread counters. */
+  u64 ** counters;
 
   /* Counter values as of last clear. */
   u64 * value_at_last_clear;
@@ -72,42 +74,35 @@ vlib_increment_simple_counter (vlib_simple_counter_main_t * cm,
 			       u32 index,
 			       u32 increment)
 {
-  u16 * my_minis;
-  u16 * mini;
-  u32 old, new;
+  u64 * my_counters;
 
-  my_minis = cm->minis[cpu_index];
-  mini = vec_elt_at_index (my_minis, index);
-  old = mini[0];
-  new = old + increment;
-  mini[0] = new;
-
-  if (PREDICT_FALSE (mini[0] != new))
-    {
-      __sync_fetch_and_add (&cm->maxi[index], new);
-      my_minis[index] = 0;
-    }
+  my_counters = cm->counters[cpu_index];
+  my_counters[index] += increment;
 }
 
+/* Sum of all threads, not corrected for the last clear */
 always_inline u64
-vlib_get_simple_counter (vlib_simple_counter_main_t * cm, u32 index)
+vlib_get_simple_counter_total (vlib_simple_counter_main_t * cm, u32 index)
 {
-  u16 *my_minis, *mini;
   u64 v;
   int i;
 
-  ASSERT (index < vec_len (cm->maxi));
+  ASSERT (index < vec_len (cm->counters[0]));
 
   v = 0;
 
-  for (i = 0; i < vec_len(cm->minis); i++)
-    {
-      my_minis = cm->minis[i];
-      mini = vec_elt_at_index (my_minis, index);
-      v += mini[0];
-    }
+  for (i = 0; i < vec_len(cm->counters); i++)
+    v += cm->counters[i][index];
 
-  v += cm->maxi[index];
+  return v;
+}
+
+always_inline u64
+vlib_get_simple_counter (vlib_simple_counter_main_t * cm, u32 index)
+{
+  u64 v;
+
+  v = vlib_get_simple_counter_total (cm, index);
 
   if (index < vec_len (cm->value_at_last_clear))
     {
@@ -121,25 +116,17 @@ vlib_get_simple_counter (vlib_simple_counter_main_t * cm, u32 index)
 always_inline void
 vlib_zero_simple_counter (vlib_simple_counter_main_t * cm, u32 index)
 {
-  u16 * my_minis;
   int i;
 
-  ASSERT (index < vec_len (cm->maxi));
+  ASSERT (index < vec_len (cm->counters[0]));
 
-  for (i = 0; i < vec_len(cm->minis); i++)
-    {
-      my_minis = cm->minis[i];
-      my_minis[index] = 0;
-    }
-
-  cm->maxi[index] = 0;
+  for (i = 0; i < vec_len(cm->counters); i++)
+    cm->counters[i][index] = 0;
 
   if (index < vec_len (cm->value_at_last_clear))
     cm->value_at_last_clear[index] = 0;
 }
 
-/* Combined counters hold both packets and byte differences. */
-/* Maxi-packet/byte counter. */
 typedef struct {
   u64 packets, bytes;
 } vlib_counter_t;
@@ -164,24 +151,9 @@ always_inline void
 vlib_counter_zero (vlib_counter_t * a)
 { a->packets = a->bytes = 0; }
 
-/* Micro-counter: 16 bits of packets and 16 bits of byte difference. */
-typedef struct {
-  /* Packet count. */
-  u16 packets;
-
-  /* The average packet size hack doesn't work in a multi-core config */
-  i16 bytes;
-} vlib_mini_counter_t;
-
 typedef struct {
-  /* Compact counters that (rarely) can overflow. */
-  vlib_mini_counter_t ** minis;
-
-  /* Counters to hold overflow. */
-  vlib_counter_t * maxi;
-
-  /* Debug counters for testing. */
-  vlib_counter_t * debug;
+  /* Per-thread counters. */
+  vlib_counter_t ** counters;
 
   /* Counter values as of last clear. */
   vlib_counter_t * value_at_last_clear;
@@ -192,12 +164,6 @@ typedef struct {
   /* Last counter index serialized incrementally. */
   u32 last_incremental_serialize_index;
 
-  /* Average packet sizes used in mini-counter byte differences. */
-  u32 ave_packet_size;
-
-  /* Current summed packets and bytes for average computation. */
-  u32 ave_packets, ave_bytes;
-
   /* Counter name. */
   char * name;
 
@@ -213,61 +179,43 @@ vlib_increment_combined_counter (vlib_combined_counter_main_t * cm,
 				 u32 packet_increment,
 				 u32 byte_increment)
 {
-  vlib_mini_counter_t * my_minis, * mini;
-  u32 old_packets, new_packets;
-  i32 old_bytes, new_bytes;
+  vlib_counter_t * my_counters;
 
-  /* Use this CPU's mini counter array */
-  my_minis = cm->minis[cpu_index];
+  /* Use this CPU's counter array */
+  my_counters = cm->counters[cpu_index];
 
-  mini = vec_elt_at_index (my_minis, index);
-  old_packets = mini->packets;
-  old_bytes = mini->bytes;
+  my_counters[index].packets += packet_increment;
+  my_counters[index].bytes += byte_increment;
+}
 
-  new_packets = old_packets + packet_increment;
-  new_bytes = old_bytes + byte_increment;
+/* Sum of all threads, not corrected for the last clear */
+always_inline void
+vlib_get_combined_counter_total (vlib_combined_counter_main_t * cm,
+				 u32 index,
+				 vlib_counter_t * result)
+{
+  vlib_counter_t * my_counters, * counter;
+  int i;
 
-  mini->packets = new_packets;
-  mini->bytes = new_bytes;
+  result->packets = 0;
+  result->bytes = 0;
 
-  /* Bytes always overflow before packets.. */
-  if (PREDICT_FALSE (mini->bytes != new_bytes))
+  for (i = 0; i < vec_len(cm->counters); i++)
     {
-      vlib_counter_t * maxi = vec_elt_at_index (cm->maxi, index);
+      my_counters = cm->counters[i];
 
-      __sync_fetch_and_add (&maxi->packets, new_packets);
-      __sync_fetch_and_add (&maxi->bytes, new_bytes);
-
-      mini->packets = 0;
-      mini->bytes = 0;
+      counter = vec_elt_at_index (my_counters, index);
+      result->packets += counter->packets;
+      result->bytes += counter->bytes;
     }
 }
 
-/* This is never done in the speed path */
 static inline void
 vlib_get_combined_counter (vlib_combined_counter_main_t * cm,
 			   u32 index,
 			   vlib_counter_t * result)
 {
-  vlib_mini_counter_t * my_minis, * mini;
-  vlib_counter_t * maxi;
-  int i;
-
-  result->packets = 0;
-  result->bytes = 0;
-
-  for (i = 0; i < vec_len(cm->minis); i++)
-    {
-      my_minis = cm->minis[i];
-
-      mini = vec_elt_at_index (my_minis, index);
-      result->packets += mini->packets;
-      result->bytes += mini->bytes;
-    }
-
-  maxi = vec_elt_at_index (cm->maxi, index);
-  result->packets += maxi->packets;
-  result->bytes += maxi->bytes;
+  vlib_get_combined_counter_total (cm, index, result);
 
   if (index < vec_len (cm->value_at_last_clear))
     vlib_counter_sub (result, &cm->value_at_last_clear[index]);
@@ -277,28 +225,25 @@ always_inline void
 vlib_zero_combined_counter (vlib_combined_counter_main_t * cm,
 			    u32 index)
 {
-  vlib_mini_counter_t * mini, * my_minis;
+  vlib_counter_t * my_counters;
   int i;
 
-  for (i = 0; i < vec_len(cm->minis); i++)
+  for (i = 0; i < vec_len(cm->counters); i++)
     {
-      my_minis = cm->minis[i];
-
-      mini = vec_elt_at_index (my_minis, index);
-      mini->packets = 0;
-      mini->bytes = 0;
+      my_counters = cm->counters[i];
+      vlib_counter_zero (&my_counters[index]);
     }
 
-  vlib_counter_zero (&cm->maxi[index]);
   if (index < vec_len (cm->value_at_last_clear))
     vlib_counter_zero (&cm->value_at_last_clear[index]);
 }
 
 void vlib_validate_simple_counter (vlib_simple_counter_main_t *cm, u32 index);
 void vlib_validate_combined_counter (vlib_combined_counter_main_t *cm, u32 index);
+int vlib_validate_combined_counter_will_expand (vlib_combined_counter_main_t *cm, u32 index);
 
 /* Number of simple/combined counters allocated. */
-#define vlib_counter_len(cm) vec_len((cm)->maxi)
+#define vlib_counter_len(cm) ((cm)->counters ? vec_len((cm)->counters[0]) : 0)
 
 serialize_function_t serialize_vlib_simple_counter_main, unserialize_vlib_simple_counter_main;
 serialize_function_t serialize_vlib_combined_counter_main, unserialize_vlib_combined_counter_main;
@@ -755,6 +755,156 @@ void vlib_buffer_free_no_next (vlib_main_t * vm,
   vlib_buffer_free_inline (vm, buffers, n_buffers, /* follow_buffer_next */ 0);
 }
 
+/* Full copy of a buffer chain, ~0 if out of buffers. */
+static u32
+vlib_buffer_copy_chain (vlib_main_t * vm, vlib_buffer_t * s)
+{
+  vlib_buffer_t * d, * prev = 0;
+  struct rte_mbuf * mb, * first_mb = 0;
+  u32 bi, first = ~0;
+
+  while (1)
+    {
+      if (vlib_buffer_alloc (vm, &bi, 1) != 1)
+	{
+	  if (first != ~0)
+	    vlib_buffer_free_one (vm, first);
+	  return ~0;
+	}
+
+      d = vlib_get_buffer (vm, bi);
+      mb = rte_mbuf_from_vlib_buffer (d);
+      if (prev)
+	{
+	  prev->next_buffer = bi;
+	  prev->flags |= VLIB_BUFFER_NEXT_PRESENT;
+	  rte_mbuf_from_vlib_buffer (prev)->next = mb;
+	  first_mb->nb_segs++;
+	  d->current_data = s->current_data;
+	  d->current_length = s->current_length;
+	}
+      else
+	{
+	  first = bi;
+	  first_mb = mb;
+	  vlib_buffer_copy_metadata (d, s);
+	  mb->pkt_len = vlib_buffer_length_in_chain (vm, s);
+	  mb->nb_segs = 1;
+	  mb->port = rte_mbuf_from_vlib_buffer (s)->port;
+	}
+
+      clib_memcpy (vlib_buffer_get_current (d),
+		   vlib_buffer_get_current (s), s->current_length);
+      mb->data_off = RTE_PKTMBUF_HEADROOM + d->current_data;
+      mb->data_len = d->current_length;
+
+      if (! (s->flags & VLIB_BUFFER_NEXT_PRESENT))
+	return first;
+
+      prev = d;
+      s = vlib_get_buffer (vm, s->next_buffer);
+    }
+}
+
+u16 vlib_buffer_clone (vlib_main_t * vm, u32 src_buffer, u32 * buffers,
+		       u16 n_buffers, u16 head_end_offset)
+{
+  vlib_buffer_t * s = vlib_get_buffer (vm, src_buffer);
+  vlib_buffer_t * d, * seg;
+  struct rte_mbuf * smb, * mb;
+  u32 n_alloc, total;
+  u16 i;
+
+  if (n_buffers <= 1)
+    {
+      buffers[0] = src_buffer;
+      return n_buffers;
+    }
+
+  /* Full copies of a chain when some port would send only the head of
+     a shared payload copy, or when splitting the first segment would
+     leave an empty payload segment. */
+  if (PREDICT_FALSE ((s->flags & VLIB_BUFFER_NEXT_PRESENT)
+		     && (vm->buffer_main->no_multi_seg_tx
+			 || s->current_length <= head_end_offset)))
+    {
+      for (i = 0; i < n_buffers - 1; i++)
+	{
+	  buffers[i] = vlib_buffer_copy_chain (vm, s);
+	  if (buffers[i] == ~0)
+	    break;
+	}
+      buffers[i] = src_buffer;
+      return i + 1;
+    }
+
+  /* Small packet: copying it beats a second segment per copy. */
+  if (! (s->flags & VLIB_BUFFER_NEXT_PRESENT)
+      && (s->current_length <= head_end_offset + 2 * CLIB_CACHE_LINE_BYTES
+	  || vm->buffer_main->no_multi_seg_tx))
+    {
+      n_alloc = vlib_buffer_alloc (vm, buffers, n_buffers - 1);
+      for (i = 0; i < n_alloc; i++)
+	{
+	  d = vlib_get_buffer (vm, buffers[i]);
+	  vlib_buffer_copy_metadata (d, s);
+	  clib_memcpy (vlib_buffer_get_current (d),
+		       vlib_buffer_get_current (s), s->current_length);
+	  mb = rte_mbuf_from_vlib_buffer (d);
+	  mb->data_off = RTE_PKTMBUF_HEADROOM + d->current_data;
+	  mb->data_len = mb->pkt_len = d->current_length;
+	}
+      buffers[n_alloc] = src_buffer;
+      return n_alloc + 1;
+    }
+
+  n_alloc = vlib_buffer_alloc (vm, buffers, n_buffers);
+  if (n_alloc == 0)
+    return 0;
+
+  total = vlib_buffer_length_in_chain (vm, s);
+  smb = rte_mbuf_from_vlib_buffer (s);
+
+  for (i = 0; i < n_alloc; i++)
+    {
+      d = vlib_get_buffer (vm, buffers[i]);
+      vlib_buffer_copy_metadata (d, s);
+      clib_memcpy (vlib_buffer_get_current (d),
+		   vlib_buffer_get_current (s), head_end_offset);
+      d->current_length = head_end_offset;
+      d->total_length_not_including_first_buffer = total - head_end_offset;
+      d->flags |= VLIB_BUFFER_NEXT_PRESENT | VLIB_BUFFER_TOTAL_LENGTH_VALID;
+      d->next_buffer = src_buffer;
+
+      mb = rte_mbuf_from_vlib_buffer (d);
+      mb->data_off = RTE_PKTMBUF_HEADROOM + d->current_data;
+      mb->data_len = head_end_offset;
+      mb->pkt_len = total;
+      mb->nb_segs = smb->nb_segs + 1;
+      mb->port = smb->port;
+      mb->next = smb;
+    }
+
+  /* What is left of the source is the shared payload. */
+  vlib_buffer_advance (s, head_end_offset);
+  smb->data_off = RTE_PKTMBUF_HEADROOM + s->current_data;
+  smb->data_len = s->current_length;
+  smb->pkt_len = total - head_end_offset;
+
+  /* rte_pktmbuf_free drops one reference per segment, so every segment
+     of the payload gets one reference per copy. */
+  seg = s;
+  while (1)
+    {
+      rte_mbuf_refcnt_update (rte_mbuf_from_vlib_buffer (seg), n_alloc - 1);
+      if (! (seg->flags & VLIB_BUFFER_NEXT_PRESENT))
+	break;
+      seg = vlib_get_buffer (vm, seg->next_buffer);
+    }
+
+  return n_alloc;
+}
+
 /* Copy template packet data into buffers as they are allocated. */
 __attribute__((unused)) static void
 vlib_packet_template_buffer_init (vlib_main_t * vm,
@@ -69,6 +69,9 @@ typedef struct vlib_main_t {
   /* Incremented once for each main loop. */
   u32 main_loop_count;
 
+  /* Last rcu epoch this thread saw at a quiescent point, see threads.h */
+  volatile u64 rcu_epoch_seen;
+
   /* Count of vectors processed this main loop. */
   u32 main_loop_vectors_processed;
   u32 main_loop_nodes_processed;
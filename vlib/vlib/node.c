@@ -267,6 +267,19 @@ static void node_elog_init (vlib_main_t * vm, uword ni)
 #define STACK_ALIGN CLIB_CACHE_LINE_BYTES
 #endif
 
+vlib_node_fn_registration_t *
+vlib_node_best_function_variant (vlib_node_t * n)
+{
+  vlib_node_fn_registration_t * fnr, * best = 0;
+
+  for (fnr = n->node_fn_registrations; fnr; fnr = fnr->next_registration)
+    if (fnr->is_supported ()
+	&& (best == 0 || fnr->priority > best->priority))
+      best = fnr;
+
+  return best;
+}
+
 static void register_node (vlib_main_t * vm,
 			   vlib_node_registration_t * r)
 {
@@ -313,6 +326,13 @@ static void register_node (vlib_main_t * vm,
   r->index = n->index;		/* save index in registration */
   n->function = r->function;
 
+  /* Use the best instruction set variant this cpu can run. */
+  n->generic_function = r->function;
+  n->node_fn_registrations = r->node_fn_registrations;
+  n->function_variant = vlib_node_best_function_variant (n);
+  if (n->function_variant)
+    n->function = n->function_variant->function;
+
   /* Node index of next sibling will be filled in by vlib_node_main_init. */
   n->sibling_of = r->sibling_of;
 
@@ -40,6 +40,7 @@
 #ifndef included_vlib_node_h
 #define included_vlib_node_h
 
+#include <vppinfra/cpu.h>
 #include <vppinfra/longjmp.h>
 #include <vppinfra/timing_wheel.h>
 #include <vlib/trace.h>		/* for vlib_trace_filter_t */
@@ -73,6 +74,23 @@ typedef enum {
   VLIB_N_NODE_TYPE,
 } vlib_node_type_t;
 
+/* Instruction set specific variant of a node function. */
+typedef struct _vlib_node_fn_registration {
+  vlib_node_function_t * function;
+
+  /* Variant name, e.g. "avx2". */
+  char * name;
+
+  /* Higher wins when more than one variant is supported. */
+  int priority;
+
+  /* Non-zero if this cpu can run the variant. */
+  int (* is_supported) (void);
+
+  /* Constructor link-list. */
+  struct _vlib_node_fn_registration * next_registration;
+} vlib_node_fn_registration_t;
+
 typedef struct _vlib_node_registration {
   /* Vector processing function for this node. */
   vlib_node_function_t * function;
@@ -132,6 +150,9 @@ typedef struct _vlib_node_registration {
   /* Constructor link-list, don't ask... */
   struct _vlib_node_registration * next_registration;
 
+  /* Instruction set variants of function, see VLIB_NODE_FUNCTION_MULTIARCH. */
+  vlib_node_fn_registration_t * node_fn_registrations;
+
   /* Names of next nodes which this node feeds into. */
   char * next_nodes[];
 
@@ -149,6 +170,47 @@ static void __vlib_add_node_registration_##x (void)                     \
 }                                                                       \
 __VA_ARGS__ vlib_node_registration_t x 
 
+/*
+ * Compile fn again for each instruction set in foreach_march_variant.
+ * The clone is flattened, so fn and the inline helpers it calls are
+ * generated with the wider instructions.  register_node picks the best
+ * variant the cpu supports; "set node function" overrides the choice.
+ */
+#define VLIB_NODE_FUNCTION_CLONE_TEMPLATE(arch, fn, tgt, prio)		\
+  static uword								\
+  __attribute__ ((flatten))						\
+  __attribute__ ((target (tgt)))					\
+  CLIB_CPU_OPTIMIZED							\
+  fn ## _ ## arch (struct vlib_main_t * vm,				\
+		   struct vlib_node_runtime_t * node,			\
+		   struct vlib_frame_t * frame)				\
+  { return fn (vm, node, frame); }
+
+#define VLIB_NODE_FUNCTION_MULTIARCH_CLONE(fn)				\
+  foreach_march_variant (VLIB_NODE_FUNCTION_CLONE_TEMPLATE, fn)
+
+#define VLIB_NODE_FUNCTION_REGISTER_VARIANT(arch, node, fn, tgt, prio) \
+static vlib_node_fn_registration_t					\
+  __vlib_node_fn_registration_##node##_##arch = {			\
+  .function = fn ## _ ## arch,						\
+  .name = #arch,							\
+  .priority = prio,							\
+  .is_supported = clib_cpu_march_##arch,				\
+};									\
+static void __vlib_node_fn_add_##node##_##arch (void)			\
+    __attribute__((__constructor__)) ;					\
+static void __vlib_node_fn_add_##node##_##arch (void)			\
+{									\
+  vlib_node_fn_registration_t * r =					\
+    &__vlib_node_fn_registration_##node##_##arch;			\
+  r->next_registration = node.node_fn_registrations;			\
+  node.node_fn_registrations = r;					\
+}
+
+#define VLIB_NODE_FUNCTION_MULTIARCH(node, fn)				\
+  VLIB_NODE_FUNCTION_MULTIARCH_CLONE (fn)				\
+  foreach_march_variant (VLIB_NODE_FUNCTION_REGISTER_VARIANT, node, fn)
+
 always_inline vlib_node_registration_t *
 vlib_node_next_registered (vlib_node_registration_t * c)
 {
@@ -183,6 +245,12 @@ typedef struct vlib_node_t {
   /* Vector processing function for this node. */
   vlib_node_function_t * function;
 
+  /* Instruction set variants of function and the one in use
+     (zero for the generic function). */
+  vlib_node_function_t * generic_function;
+  vlib_node_fn_registration_t * node_fn_registrations;
+  vlib_node_fn_registration_t * function_variant;
+
   /* Node name. */
   u8 * name;
 
@@ -444,5 +444,128 @@ VLIB_CLI_COMMAND (clear_node_runtime_command, static) = {
   .function = clear_node_runtime,
 };
 
+static void
+show_node_variants_one (vlib_main_t * vm, vlib_node_t * n)
+{
+  vlib_node_fn_registration_t * fnr;
+  u8 * s = 0;
+
+  s = format (s, "%s%s ", n->function_variant ? "" : "*", "generic");
+  for (fnr = n->node_fn_registrations; fnr; fnr = fnr->next_registration)
+    s = format (s, "%s%s%s ", fnr == n->function_variant ? "*" : "",
+		fnr->name, fnr->is_supported () ? "" : "(unsupported)");
+
+  vlib_cli_output (vm, "%-30v %v", n->name, s);
+  vec_free (s);
+}
+
+static clib_error_t *
+show_node_variants (vlib_main_t * vm,
+		    unformat_input_t * input,
+		    vlib_cli_command_t * cmd)
+{
+  vlib_node_main_t * nm = &vm->node_main;
+  vlib_node_t * n;
+  u32 node_index;
+  int i;
+
+  vlib_cli_output (vm, "CPU flags: %U", format_cpu_flags);
+
+  if (unformat (input, "%U", unformat_vlib_node, vm, &node_index))
+    {
+      show_node_variants_one (vm, vlib_get_node (vm, node_index));
+      return 0;
+    }
+
+  vlib_cli_output (vm, "%-30s %s", "Node", "Variants (* = active)");
+  for (i = 0; i < vec_len (nm->nodes); i++)
+    {
+      n = nm->nodes[i];
+      if (n->node_fn_registrations)
+	show_node_variants_one (vm, n);
+    }
+
+  return 0;
+}
+
+VLIB_CLI_COMMAND (show_node_variants_command, static) = {
+  .path = "show node variants",
+  .short_help = "show node variants [<node-name>]",
+  .function = show_node_variants,
+};
+
+static clib_error_t *
+set_node_function (vlib_main_t * vm,
+		   unformat_input_t * input,
+		   vlib_cli_command_t * cmd)
+{
+  vlib_node_fn_registration_t * fnr, * variant = 0;
+  vlib_main_t * this_vm;
+  vlib_node_t * n;
+  vlib_node_runtime_t * rt;
+  vlib_node_function_t * function;
+  clib_error_t * error = 0;
+  u32 node_index;
+  u8 * name = 0;
+  int i;
+
+  if (! unformat (input, "%U %s", unformat_vlib_node, vm, &node_index, &name))
+    return clib_error_return (0, "expected <node-name> <variant>, got `%U'",
+			      format_unformat_error, input);
+
+  n = vlib_get_node (vm, node_index);
+  vec_add1 (name, 0);
+
+  if (n->type == VLIB_NODE_TYPE_PROCESS)
+    error = clib_error_return (0, "`%v' is a process node", n->name);
+  else if (!strcmp ((char *) name, "best"))
+    variant = vlib_node_best_function_variant (n);
+  else if (strcmp ((char *) name, "generic"))
+    {
+      for (fnr = n->node_fn_registrations; fnr; fnr = fnr->next_registration)
+	if (!strcmp ((char *) name, fnr->name))
+	  break;
+
+      if (fnr == 0)
+	error = clib_error_return (0, "node `%v' has no `%s' variant",
+				   n->name, name);
+      else if (! fnr->is_supported ())
+	error = clib_error_return (0, "this cpu can't run the `%s' variant",
+				   fnr->name);
+      variant = fnr;
+    }
+  vec_free (name);
+
+  if (error)
+    return error;
+
+  function = variant ? variant->function : n->generic_function;
+
+  vlib_worker_thread_barrier_sync (vm);
+
+  /* Workers have their own copies of the node and its runtime */
+  for (i = 0; i < clib_max (vec_len (vlib_mains), 1); i++)
+    {
+      this_vm = vec_len (vlib_mains) ? vlib_mains[i] : vm;
+      if (this_vm == 0)
+	continue;
+      n = vlib_get_node (this_vm, node_index);
+      n->function = function;
+      n->function_variant = variant;
+      rt = vlib_node_get_runtime (this_vm, node_index);
+      rt->function = function;
+    }
+
+  vlib_worker_thread_barrier_release (vm);
+
+  return 0;
+}
+
+VLIB_CLI_COMMAND (set_node_function_command, static) = {
+  .path = "set node function",
+  .short_help = "set node function <node-name> [generic|best|<variant>]",
+  .function = set_node_function,
+};
+
 /* Dummy function to get us linked in. */
 void vlib_node_cli_reference (void) {}
@@ -947,6 +947,11 @@ u32 vlib_register_node (vlib_main_t * vm, vlib_node_registration_t * r);
 /* Register all static nodes registered via VLIB_REGISTER_NODE. */
 void vlib_register_all_static_nodes (vlib_main_t * vm);
 
+/* Highest priority instruction set variant of the node function
+   this cpu supports, zero if there is none. */
+vlib_node_fn_registration_t *
+vlib_node_best_function_variant (vlib_node_t * n);
+
 /* Start a process. */
 void vlib_start_process (vlib_main_t * vm, uword process_index);
 
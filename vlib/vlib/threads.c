@@ -198,6 +198,8 @@ vlib_thread_init (vlib_main_t * vm)
   w->thread_stack = vlib_thread_stacks[0];
   w->dpdk_lcore_id = -1;
   w->lwp = syscall(SYS_gettid);
+  w->cpu_id = tm->main_lcore;
+  w->numa_node = clib_mem_cpu_numa_node (w->cpu_id);
   tm->n_vlib_mains = 1;
 
   /* assign threads to cores and set n_vlib_mains */
@@ -277,6 +279,8 @@ vlib_alloc_thread (vlib_main_t * vm)
     }
   vec_add2 (vlib_worker_threads, w, 1);
   w->thread_stack = vlib_thread_stacks[w - vlib_worker_threads];
+  w->cpu_id = -1;
+  w->numa_node = -1;
   return w;
 }
 
@@ -488,6 +492,22 @@ void *vlib_worker_thread_bootstrap_fn (void *arg)
     }
 #endif
 
+  /*
+   * The heap was picked from the worker's coremask cpu when start_workers
+   * cloned the data structures into it, which has to happen before the
+   * thread exists.  Check that we actually landed on that node.
+   */
+  {
+    int cpu = sched_getcpu ();
+    int node = cpu >= 0 ? clib_mem_cpu_numa_node (cpu) : -1;
+
+    if (w->numa_node >= 0 && node >= 0 && node != w->numa_node)
+      clib_warning ("thread %d runs on cpu %d node %d, its heap is on node %d",
+                    w - vlib_worker_threads, cpu, node, w->numa_node);
+    if (cpu >= 0)
+      w->cpu_id = cpu;
+  }
+
   rv = (void *) clib_calljmp 
       ((uword (*)(uword)) w->thread_function, 
        (uword) arg, w->thread_stack + VLIB_THREAD_STACK_SIZE);
@@ -523,6 +543,73 @@ vlib_launch_thread (void *fp, vlib_worker_thread_t *w, unsigned lcore_id)
   }
 }
 
+/* cpu the k-th thread of a registration gets launched on, -1 if not pinned */
+static int
+vlib_thread_registration_cpu (vlib_thread_registration_t * tr, int k)
+{
+  vlib_thread_main_t * tm = &vlib_thread_main;
+  uword c;
+
+  if (tr->use_pthreads || tm->use_pthreads)
+    return -1;
+
+  clib_bitmap_foreach (c, tr->coremask, ({
+    if (k-- == 0)
+      return c;
+  }));
+
+  return -1;
+}
+
+/* 
+ * Heap for a new worker: a private one if the registration asks for it,
+ * with "numa-heaps" the heap shared by the workers on w->numa_node,
+ * otherwise the main heap.
+ */
+static void *
+vlib_worker_thread_heap (vlib_thread_registration_t * tr,
+                         vlib_worker_thread_t * w, void * main_heap)
+{
+  vlib_thread_main_t * tm = &vlib_thread_main;
+  uword size, log2_page_size;
+  void * memory, * heap;
+  int node = w->numa_node;
+
+  if (tr->mheap_size)
+    return mheap_alloc (0 /* use VM */, tr->mheap_size);
+
+  if (! tm->numa_heaps || node < 0)
+    return main_heap;
+
+  vec_validate (tm->numa_heap_by_node, node);
+  vec_validate (tm->numa_heap_log2_page_size_by_node, node);
+
+  if (tm->numa_heap_by_node[node] == 0)
+    {
+      size = tm->numa_heap_size;
+      log2_page_size = tm->numa_heap_log2_page_size;
+      memory = clib_mem_vm_alloc_numa (&size, node, &log2_page_size);
+      heap = memory ? mheap_alloc (memory, size) : 0;
+      if (heap == 0)
+        {
+          clib_warning ("node %d heap of %U failed, using the main heap",
+                        node, format_memory_size, size);
+          return main_heap;
+        }
+      if (log2_page_size != tm->numa_heap_log2_page_size)
+        clib_warning ("node %d heap: no huge pages, using normal pages",
+                      node);
+
+      /* Shared by all workers on the node, set up like the main heap */
+      mheap_header (heap)->flags |= 
+        MHEAP_FLAG_THREAD_SAFE | MHEAP_FLAG_CPU_CACHE;
+      tm->numa_heap_by_node[node] = heap;
+      tm->numa_heap_log2_page_size_by_node[node] = log2_page_size;
+    }
+
+  return tm->numa_heap_by_node[node];
+}
+
 static clib_error_t * start_workers (vlib_main_t * vm)
 {
   int i, j;
@@ -563,9 +650,10 @@ static clib_error_t * start_workers (vlib_main_t * vm)
   /* 
    * Truth of the matter: we always use at least two
    * threads. So, make the main heap thread-safe 
-   * and make the event log thread-safe.
+   * and make the event log thread-safe.  Small objects go
+   * through per-cpu caches so workers rarely take the heap lock.
    */
-  main_heap_header->flags |= MHEAP_FLAG_THREAD_SAFE;
+  main_heap_header->flags |= MHEAP_FLAG_THREAD_SAFE | MHEAP_FLAG_CPU_CACHE;
   vm->elog_main.lock = 
     clib_mem_alloc_aligned (CLIB_CACHE_LINE_BYTES, 
                             CLIB_CACHE_LINE_BYTES);
@@ -586,6 +674,9 @@ static clib_error_t * start_workers (vlib_main_t * vm)
         clib_mem_alloc_aligned (sizeof (u32), CLIB_CACHE_LINE_BYTES);
       vlib_worker_threads->workers_at_barrier =
         clib_mem_alloc_aligned (sizeof (u32), CLIB_CACHE_LINE_BYTES);
+      vlib_worker_threads->rcu_epoch =
+        clib_mem_alloc_aligned (sizeof (u64), CLIB_CACHE_LINE_BYTES);
+      *vlib_worker_threads->rcu_epoch = 0;
 
       /* Ask for an initial barrier sync */
       *vlib_worker_threads->workers_at_barrier = 0;
@@ -609,10 +700,10 @@ static clib_error_t * start_workers (vlib_main_t * vm)
           for (k = 0; k < tr->count; k++)
           {
             vec_add2 (vlib_worker_threads, w, 1);
-            if (tr->mheap_size)
-              w->thread_mheap = mheap_alloc (0 /* use VM */, tr->mheap_size);
-            else
-              w->thread_mheap = main_heap;
+            w->cpu_id = vlib_thread_registration_cpu (tr, k);
+            w->numa_node = w->cpu_id >= 0 ? 
+              clib_mem_cpu_numa_node (w->cpu_id) : -1;
+            w->thread_mheap = vlib_worker_thread_heap (tr, w, main_heap);
             w->thread_stack = vlib_thread_stacks[w - vlib_worker_threads];
             w->thread_function = tr->function;
             w->thread_function_arg = w;
@@ -741,10 +832,10 @@ static clib_error_t * start_workers (vlib_main_t * vm)
           for (j = 0; j < tr->count; j++)
             {
               vec_add2 (vlib_worker_threads, w, 1);
-              if (tr->mheap_size)
-                w->thread_mheap = mheap_alloc (0 /* use VM */, tr->mheap_size);
-              else
-                w->thread_mheap = main_heap;
+              w->cpu_id = vlib_thread_registration_cpu (tr, j);
+              w->numa_node = w->cpu_id >= 0 ? 
+                clib_mem_cpu_numa_node (w->cpu_id) : -1;
+              w->thread_mheap = vlib_worker_thread_heap (tr, w, main_heap);
               w->thread_stack = vlib_thread_stacks[w - vlib_worker_threads];
               w->thread_function = tr->function;
               w->thread_function_arg = w;
@@ -968,6 +1059,7 @@ cpu_config (vlib_main_t * vm, unformat_input_t * input)
   u8 * name;
   u64 coremask;
   uword * bitmap;
+  uword page_size;
   u32 count;
 
   tm->thread_registrations_by_name = hash_create_string (0, sizeof (uword));
@@ -993,6 +1085,20 @@ cpu_config (vlib_main_t * vm, unformat_input_t * input)
           ;
       else if (unformat (input, "skip-cores %u", &tm->skip_cores))
           ;
+      else if (unformat (input, "numa-heaps"))
+        tm->numa_heaps = 1;
+      else if (unformat (input, "numa-heap-size %U", unformat_memory_size,
+                         &tm->numa_heap_size))
+        tm->numa_heaps = 1;
+      else if (unformat (input, "numa-heap-page-size %U", unformat_memory_size,
+                         &page_size))
+        tm->numa_heap_log2_page_size = min_log2 (page_size);
+      else if (unformat (input, "table-numa-node %d",
+                         &clib_mem_table_policy.numa_node))
+        ;
+      else if (unformat (input, "table-page-size %U", unformat_memory_size,
+                         &page_size))
+        clib_mem_table_policy.log2_page_size = min_log2 (page_size);
       else if (unformat (input, "coremask-%s %llx", &name, &coremask))
         {
           p = hash_get_mem (tm->thread_registrations_by_name, name);
@@ -1046,6 +1152,9 @@ cpu_config (vlib_main_t * vm, unformat_input_t * input)
   if (!tm->thread_prefix)
     tm->thread_prefix = format(0, "vpp");
 
+  if (tm->numa_heaps && tm->numa_heap_size == 0)
+    tm->numa_heap_size = VLIB_NUMA_HEAP_SIZE_DEFAULT;
+
   while (tr)
     {
       tm->n_thread_stacks += tr->count;
@@ -1118,6 +1227,11 @@ void vlib_worker_thread_barrier_sync(vlib_main_t *vm)
   deadline = vlib_time_now (vm) + BARRIER_SYNC_TIMEOUT;
 
   *vlib_worker_threads->wait_at_barrier = 1;
+
+  /* A sleeping worker would only see the barrier when it wakes up */
+  if (vlib_thread_main.worker_wakeup_fn)
+    vlib_thread_main.worker_wakeup_fn ();
+
   while (*vlib_worker_threads->workers_at_barrier != count)
     {
       if (vlib_time_now(vm) > deadline)
@@ -1152,6 +1266,63 @@ void vlib_worker_thread_barrier_release(vlib_main_t * vm)
     }
 }
 
+/* Start a new epoch; objects unlinked before this call are covered */
+u64 vlib_rcu_advance (void)
+{
+  if (!vlib_mains)
+      return 0;
+
+  ASSERT (os_get_cpu_number() == 0);
+
+  /* The unlink must be visible before the new epoch is */
+  CLIB_MEMORY_BARRIER();
+  return ++(*vlib_worker_threads->rcu_epoch);
+}
+
+int vlib_rcu_is_done (u64 epoch)
+{
+  int i;
+
+  if (!vlib_mains)
+      return 1;
+
+  /* Workers held at the barrier have nothing in flight */
+  if (vlib_worker_threads[0].recursion_level > 0)
+      return 1;
+
+  for (i = 1; i < vec_len (vlib_mains); i++)
+    if (vlib_mains[i] && vlib_mains[i]->rcu_epoch_seen < epoch)
+      return 0;
+
+  return 1;
+}
+
+/* Wait for a grace period, for callers that cannot defer the free */
+void vlib_rcu_synchronize (vlib_main_t * vm)
+{
+  f64 deadline;
+  u64 epoch;
+
+  epoch = vlib_rcu_advance ();
+
+  deadline = vlib_time_now (vm) + RCU_SYNCHRONIZE_SPIN_TIME;
+
+  while (!vlib_rcu_is_done (epoch))
+    {
+      /*
+       * Workers which have not entered their main loop yet, or are stuck
+       * waiting on a full handoff queue, never report; a trip through
+       * the barrier is just as good
+       */
+      if (vlib_time_now(vm) > deadline)
+        {
+          vlib_worker_thread_barrier_sync (vm);
+          vlib_worker_thread_barrier_release (vm);
+          return;
+        }
+    }
+}
+
 static clib_error_t *
 show_threads_fn (vlib_main_t * vm,
        unformat_input_t * input,
@@ -64,6 +64,9 @@ typedef struct vlib_thread_registration_ {
 #define VLIB_LOG2_THREAD_STACK_SIZE (20)
 #define VLIB_THREAD_STACK_SIZE (1<<VLIB_LOG2_THREAD_STACK_SIZE)
 
+/* Size of each per-NUMA-node worker heap unless configured */
+#define VLIB_NUMA_HEAP_SIZE_DEFAULT (256ULL<<20)
+
 typedef enum {
     VLIB_FRAME_QUEUE_ELT_DISPATCH_FRAME,
 } vlib_frame_queue_msg_type_t;
@@ -85,7 +88,8 @@ typedef struct {
   /* First cache line */
   volatile u32 *wait_at_barrier;
   volatile u32 *workers_at_barrier;
-  u8 pad0[CLIB_CACHE_LINE_BYTES - (2 * sizeof (u32 *))];
+  volatile u64 *rcu_epoch;
+  u8 pad0[CLIB_CACHE_LINE_BYTES - (3 * sizeof (u32 *))];
 
   /* Second Cache Line */
   void *thread_mheap;
@@ -101,6 +105,10 @@ typedef struct {
 
   long lwp;
   int dpdk_lcore_id;
+
+  /* cpu the thread is pinned to and its NUMA node, -1 if unknown */
+  int cpu_id;
+  int numa_node;
 } vlib_worker_thread_t;
 
 vlib_worker_thread_t *vlib_worker_threads;
@@ -179,6 +187,9 @@ void vlib_worker_thread_init (vlib_worker_thread_t * w);
 #define BARRIER_SYNC_TIMEOUT (1.0)
 #endif
 
+/* How long vlib_rcu_synchronize spins before tripping the barrier */
+#define RCU_SYNCHRONIZE_SPIN_TIME (100e-6)
+
 void vlib_worker_thread_barrier_sync(vlib_main_t *vm);
 void vlib_worker_thread_barrier_release(vlib_main_t *vm);
 
@@ -209,6 +220,25 @@ static inline void vlib_worker_thread_barrier_check (void)
     }
 }
 
+/*
+ * Quiescent state based reclamation, for structures the workers read
+ * without locks (ip4 mtrie plies, adjacencies).  The main thread
+ * unlinks an object, takes an epoch from vlib_rcu_advance and keeps it
+ * with the object.  Once vlib_rcu_is_done (epoch), every worker has
+ * been back to the top of its main loop since the unlink, so none can
+ * still hold a reference and the object can be freed.  Anything that
+ * reallocates memory the workers index into still needs the barrier.
+ */
+static inline void vlib_worker_thread_rcu_quiescent (vlib_main_t * vm)
+{
+    CLIB_MEMORY_BARRIER();
+    vm->rcu_epoch_seen = *vlib_worker_threads->rcu_epoch;
+}
+
+u64 vlib_rcu_advance (void);
+int vlib_rcu_is_done (u64 epoch);
+void vlib_rcu_synchronize (vlib_main_t * vm);
+
 #define foreach_vlib_main(body)			                        \
 do {                                                                    \
     vlib_main_t ** __vlib_mains = 0, *this_vlib_main;                   \
@@ -300,7 +330,19 @@ typedef struct {
   /* Bitmap of available CPU sockets (NUMA nodes) */
   uword * cpu_socket_bitmap;
 
+  /* Give workers a heap on their own NUMA node ("numa-heaps") */
+  int numa_heaps;
+  uword numa_heap_size;
+  uword numa_heap_log2_page_size;
+
+  /* Per-node worker heaps and the page size each actually got */
+  void ** numa_heap_by_node;
+  uword * numa_heap_log2_page_size_by_node;
+
   vlib_efd_t efd;
+
+  /* Wakes workers that sleep when idle, called by barrier sync */
+  void (*worker_wakeup_fn) (void);
   
 } vlib_thread_main_t;
 
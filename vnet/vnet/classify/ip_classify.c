@@ -246,33 +246,23 @@ ip_classify_inline (vlib_main_t * vm,
                 }
               else
                 {
-                  while (1)
+                  e0 = vnet_classify_find_entry_chain (vcm, t0, (u8 *) h0,
+                                                       now, &t0);
+                  if (e0)
                     {
-                      if (t0->next_table_index != ~0)
-                        t0 = pool_elt_at_index (vcm->tables,
-                                                t0->next_table_index);
-                      else
-                        {
-                          next0 = (t0->miss_next_index < IP_LOOKUP_N_NEXT)?
-                                   t0->miss_next_index:next0;
-                          misses++;
-                          break;
-                        }
-
-                      hash0 = vnet_classify_hash_packet (t0, (u8 *) h0);
-                      e0 = vnet_classify_find_entry
-                        (t0, (u8 *) h0, hash0, now);
-                      if (e0)
-                        {
-                          vnet_buffer(b0)->l2_classify.opaque_index
-                            = e0->opaque_index;
-                          vlib_buffer_advance (b0, e0->advance);
-                          next0 = (e0->next_index < node->n_next_nodes)?
-                                   e0->next_index:next0;
-                          hits++;
-                          chain_hits++;
-                          break;
-                        }
+                      vnet_buffer(b0)->l2_classify.opaque_index
+                        = e0->opaque_index;
+                      vlib_buffer_advance (b0, e0->advance);
+                      next0 = (e0->next_index < node->n_next_nodes)?
+                               e0->next_index:next0;
+                      hits++;
+                      chain_hits++;
+                    }
+                  else
+                    {
+                      next0 = (t0->miss_next_index < IP_LOOKUP_N_NEXT)?
+                               t0->miss_next_index:next0;
+                      misses++;
                     }
                 }
             }
@@ -329,6 +319,8 @@ VLIB_REGISTER_NODE (ip4_classify_node) = {
   .next_nodes = IP4_LOOKUP_NEXT_NODES,
 };
 
+VLIB_NODE_FUNCTION_MULTIARCH (ip4_classify_node, ip4_classify)
+
 static uword
 ip6_classify (vlib_main_t * vm,
               vlib_node_runtime_t * node,
@@ -350,6 +342,8 @@ VLIB_REGISTER_NODE (ip6_classify_node) = {
   .next_nodes = IP6_LOOKUP_NEXT_NODES,
 };
 
+VLIB_NODE_FUNCTION_MULTIARCH (ip6_classify_node, ip6_classify)
+
 static clib_error_t *
 ip_classify_init (vlib_main_t * vm)
 {
@@ -101,6 +101,7 @@ vnet_classify_new_table (vnet_classify_main_t *cm,
                          u32 skip_n_vectors,
                          u32 match_n_vectors)
 {
+  vlib_thread_main_t * tm = vlib_get_thread_main();
   vnet_classify_table_t * t;
   void * oldheap;
     
@@ -119,9 +120,11 @@ vnet_classify_new_table (vnet_classify_main_t *cm,
   t->skip_n_vectors = skip_n_vectors;
   t->entries_per_page = 2;
 
-  t->mheap = mheap_alloc (0 /* use VM */, memory_size);
+  t->mheap = clib_mem_table_heap_alloc (memory_size);
 
   vec_validate_aligned (t->buckets, nbuckets - 1, CLIB_CACHE_LINE_BYTES);
+  vec_validate_aligned (t->per_cpu_stats, clib_max (tm->n_vlib_mains, 1) - 1,
+                        CLIB_CACHE_LINE_BYTES);
   oldheap = clib_mem_set_heap (t->mheap);
 
   t->writer_lock = clib_mem_alloc_aligned (CLIB_CACHE_LINE_BYTES, 
@@ -136,6 +139,7 @@ void vnet_classify_delete_table_index (vnet_classify_main_t *cm,
                                        u32 table_index)
 {
   vnet_classify_table_t * t;
+  int i;
 
   /* Tolerate multiple frees, up to a point */
   if (pool_is_free_index (cm->tables, table_index))
@@ -147,6 +151,11 @@ void vnet_classify_delete_table_index (vnet_classify_main_t *cm,
 
   vec_free (t->mask);
   vec_free (t->buckets);
+  vec_free (t->chain);
+  for (i = 0; i < vec_len (t->per_cpu_stats); i++)
+    vec_free (t->per_cpu_stats[i].stats);
+  vec_free (t->per_cpu_stats);
+  vec_free (t->free_stats_indices);
   mheap_free (t->mheap);
   
   pool_put (cm->tables, t);
@@ -230,6 +239,65 @@ vnet_classify_entry_free (vnet_classify_table_t * t,
     t->freelists[free_list_index] = v;
 }
 
+/* 
+ * Hand out a zeroed set of hit counters for a new session.  The
+ * per-thread vectors grow under the barrier, since workers write them
+ * without a lock.
+ */
+static u32
+vnet_classify_stats_index_alloc (vnet_classify_table_t * t)
+{
+  vnet_classify_per_cpu_stats_t * ps;
+  u32 index, n;
+
+  if (vec_len (t->free_stats_indices))
+    index = vec_pop (t->free_stats_indices);
+  else
+    index = t->n_stats_indices++;
+
+  ps = t->per_cpu_stats;
+  if (index >= vec_len (ps[0].stats))
+    {
+      n = clib_max (2 * vec_len (ps[0].stats), 64);
+      vlib_worker_thread_barrier_sync (vnet_classify_main.vlib_main);
+      vec_foreach (ps, t->per_cpu_stats)
+        vec_validate_aligned (ps->stats, n - 1, CLIB_CACHE_LINE_BYTES);
+      vlib_worker_thread_barrier_release (vnet_classify_main.vlib_main);
+    }
+
+  vec_foreach (ps, t->per_cpu_stats)
+    memset (ps->stats + index, 0, sizeof (ps->stats[0]));
+
+  return index;
+}
+
+static void
+vnet_classify_stats_index_free (vnet_classify_table_t * t, u32 index)
+{
+  if (index < t->n_stats_indices)
+    vec_add1 (t->free_stats_indices, index);
+}
+
+void vnet_classify_entry_get_stats (vnet_classify_table_t * t,
+                                    vnet_classify_entry_t * e,
+                                    u64 * hits, f64 * last_heard)
+{
+  vnet_classify_per_cpu_stats_t * ps;
+  vnet_classify_entry_stats_t * s;
+
+  *hits = 0;
+  *last_heard = 0;
+
+  vec_foreach (ps, t->per_cpu_stats)
+    {
+      if (e->stats_index >= vec_len (ps->stats))
+        continue;
+      s = ps->stats + e->stats_index;
+      *hits += s->hits;
+      *last_heard = clib_max (*last_heard, s->last_heard);
+    }
+}
+
 static inline void make_working_copy
 (vnet_classify_table_t * t, vnet_classify_bucket_t * b)
 {
@@ -408,6 +476,7 @@ int vnet_classify_add_del (vnet_classify_table_t * t,
       clib_memcpy (v, add_v, sizeof (vnet_classify_entry_t) +
               t->match_n_vectors * sizeof (u32x4));
       v->flags &= ~(VNET_CLASSIFY_ENTRY_FREE);
+      v->stats_index = vnet_classify_stats_index_alloc (t);
 
       tmp_b.as_u64 = 0;
       tmp_b.offset = vnet_classify_get_offset (t, v);
@@ -436,9 +505,13 @@ int vnet_classify_add_del (vnet_classify_table_t * t,
 
           if (!memcmp (v->key, add_v->key, t->match_n_vectors * sizeof (u32x4)))
             {
+              /* Replacing a session keeps its counters */
+              u32 stats_index = v->stats_index;
+
               clib_memcpy (v, add_v, sizeof (vnet_classify_entry_t) +
                       t->match_n_vectors * sizeof(u32x4));
               v->flags &= ~(VNET_CLASSIFY_ENTRY_FREE);
+              v->stats_index = stats_index;
 
               CLIB_MEMORY_BARRIER();
               /* Restore the previous (k,v) pairs */
@@ -455,6 +528,7 @@ int vnet_classify_add_del (vnet_classify_table_t * t,
               clib_memcpy (v, add_v, sizeof (vnet_classify_entry_t) +
                       t->match_n_vectors * sizeof(u32x4));
               v->flags &= ~(VNET_CLASSIFY_ENTRY_FREE);
+              v->stats_index = vnet_classify_stats_index_alloc (t);
               CLIB_MEMORY_BARRIER();
               b->as_u64 = t->saved_bucket.as_u64;
               t->active_elements ++;
@@ -471,6 +545,7 @@ int vnet_classify_add_del (vnet_classify_table_t * t,
 
           if (!memcmp (v->key, add_v->key, t->match_n_vectors * sizeof (u32x4)))
             {
+              vnet_classify_stats_index_free (t, v->stats_index);
               memset (v, 0xff, sizeof (vnet_classify_entry_t) +
                       t->match_n_vectors * sizeof(u32x4));
               v->flags |= VNET_CLASSIFY_ENTRY_FREE;
@@ -516,6 +591,7 @@ int vnet_classify_add_del (vnet_classify_table_t * t,
           clib_memcpy (new_v, add_v, sizeof (vnet_classify_entry_t) +
                   t->match_n_vectors * sizeof(u32x4));
           new_v->flags &= ~(VNET_CLASSIFY_ENTRY_FREE);
+          new_v->stats_index = vnet_classify_stats_index_alloc (t);
           goto expand_ok;
         }
     }
@@ -557,10 +633,67 @@ vnet_classify_find_entry (vnet_classify_table_t * t,
   return vnet_classify_find_entry_inline (t, h, hash, now);
 }
 
+/* 
+ * Look h up in the tables chained after t, in chain order, and return
+ * the first hit.  Tables are taken VNET_CLASSIFY_CHAIN_BATCH at a time:
+ * hash them all and prefetch the buckets, prefetch the entries, then
+ * probe, so the cache misses of a batch overlap instead of being paid
+ * one table after another.  Empty tables are skipped without hashing.
+ * *tp is set to the table which hit or, on a miss, the last table in
+ * the chain, whose miss_next_index applies.
+ */
+vnet_classify_entry_t *
+vnet_classify_find_entry_chain (vnet_classify_main_t * cm,
+                                vnet_classify_table_t * t,
+                                u8 * h, f64 now,
+                                vnet_classify_table_t ** tp)
+{
+  vnet_classify_table_t * ts[VNET_CLASSIFY_CHAIN_BATCH];
+  u64 hashes[VNET_CLASSIFY_CHAIN_BATCH];
+  vnet_classify_entry_t * e;
+  u32 * chain = t->chain;
+  u32 n_left = vec_len (chain);
+  u32 i, n;
+
+  *tp = t;
+
+  while (n_left > 0)
+    {
+      for (n = 0; n_left > 0 && n < VNET_CLASSIFY_CHAIN_BATCH; n_left--)
+        {
+          t = pool_elt_at_index (cm->tables, chain[0]);
+          chain++;
+          *tp = t;
+          if (t->active_elements == 0)
+            continue;
+          ts[n] = t;
+          hashes[n] = vnet_classify_hash_packet_inline (t, h);
+          vnet_classify_prefetch_bucket (t, hashes[n]);
+          n++;
+        }
+
+      for (i = 0; i < n; i++)
+        vnet_classify_prefetch_entry (ts[i], hashes[i]);
+
+      for (i = 0; i < n; i++)
+        {
+          e = vnet_classify_find_entry_inline (ts[i], h, hashes[i], now);
+          if (e)
+            {
+              *tp = ts[i];
+              return e;
+            }
+        }
+    }
+  return 0;
+}
+
 static u8 * format_classify_entry (u8 * s, va_list * args)
   {
   vnet_classify_table_t * t = va_arg (*args, vnet_classify_table_t *);
   vnet_classify_entry_t * e = va_arg (*args, vnet_classify_entry_t *);
+  u64 hits;
+  f64 last_heard;
 
   s = format
     (s, "[%u]: next_index %d advance %d opaque %d\n",
@@ -572,8 +705,11 @@ static u8 * format_classify_entry (u8 * s, va_list * args)
               t->match_n_vectors * sizeof(u32x4));
   
   if (vnet_classify_entry_is_busy (e))
-    s = format (s, "        hits %lld, last_heard %.2f\n",
-                e->hits, e->last_heard);
+    {
+      vnet_classify_entry_get_stats (t, e, &hits, &last_heard);
+      s = format (s, "        hits %lld, last_heard %.2f\n",
+                  hits, last_heard);
+    }
   else
     s = format (s, "  entry is free\n");
   return s;
@@ -636,6 +772,55 @@ u8 * format_classify_table (u8 * s, va_list * args)
   return s;
 }
 
+/* 
+ * Flatten every table's next_table_index chain into t->chain, for
+ * vnet_classify_find_entry_chain.  Rebuilt whenever a table comes or
+ * goes; a stale index or a loop ends the chain.
+ */
+static void
+vnet_classify_compile_chains (vnet_classify_main_t * cm)
+{
+  vnet_classify_table_t * t, * nt;
+  u32 ** chains = 0, * chain;
+  uword * seen = 0;
+  u32 i;
+
+  vec_validate (chains, vec_len (cm->tables));
+
+  pool_foreach (t, cm->tables,
+  ({
+    chain = 0;
+    clib_bitmap_zero (seen);
+    seen = clib_bitmap_set (seen, t - cm->tables, 1);
+
+    i = t->next_table_index;
+    while (i != ~0 && !pool_is_free_index (cm->tables, i)
+           && !clib_bitmap_get (seen, i))
+      {
+        vec_add1 (chain, i);
+        seen = clib_bitmap_set (seen, i, 1);
+        nt = pool_elt_at_index (cm->tables, i);
+        i = nt->next_table_index;
+      }
+    chains[t - cm->tables] = chain;
+  }));
+
+  /* Workers may be walking the old chains */
+  vlib_worker_thread_barrier_sync (cm->vlib_main);
+  pool_foreach (t, cm->tables,
+  ({
+    chain = t->chain;
+    t->chain = chains[t - cm->tables];
+    chains[t - cm->tables] = chain;
+  }));
+  vlib_worker_thread_barrier_release (cm->vlib_main);
+
+  for (i = 0; i < vec_len (chains); i++)
+    vec_free (chains[i]);
+  vec_free (chains);
+  clib_bitmap_free (seen);
+}
+
 int vnet_classify_add_del_table (vnet_classify_main_t * cm,
                                  u8 * mask, 
                                  u32 nbuckets,
@@ -663,10 +848,12 @@ int vnet_classify_add_del_table (vnet_classify_main_t * cm,
       t->next_table_index = next_table_index;
       t->miss_next_index = miss_next_index;
       *table_index = t - cm->tables;
+      vnet_classify_compile_chains (cm);
       return 0;
     }
   
   vnet_classify_delete_table_index (cm, *table_index);
+  vnet_classify_compile_chains (cm);
   return 0;
 }
 
@@ -1154,6 +1341,7 @@ classify_table_command_fn (vlib_main_t * vm,
   u32 next_table_index = ~0;
   u32 miss_next_index = ~0;
   u32 memory_size = 2<<20;
+  u32 hit_sample = 0;
   u32 tmp;
 
   u8 * mask = 0;
@@ -1180,6 +1368,8 @@ classify_table_command_fn (vlib_main_t * vm,
       memory_size = tmp<<30;
     else if (unformat (input, "next-table %d", &next_table_index))
       ;
+    else if (unformat (input, "hit-sample %d", &hit_sample))
+      ;
     else if (unformat (input, "miss-next %U", unformat_ip_next_index,
                        &miss_next_index))
       ;
@@ -1206,6 +1396,9 @@ classify_table_command_fn (vlib_main_t * vm,
   if (!is_add && table_index == ~0)
     return clib_error_return (0, "table index required for delete");
 
+  if (hit_sample > 16)
+    return clib_error_return (0, "hit-sample must be 0-16");
+
   rv = vnet_classify_add_del_table (cm, mask, nbuckets, memory_size,
         skip, match, next_table_index, miss_next_index,
         &table_index, is_add);
@@ -1218,6 +1411,11 @@ classify_table_command_fn (vlib_main_t * vm,
       return clib_error_return (0, "vnet_classify_add_del_table returned %d",
                                 rv);
     }
+
+  /* Count 1 in 2^hit_sample matches, scaled up */
+  if (is_add)
+    pool_elt_at_index (cm->tables, table_index)->hit_sample_mask =
+      pow2_mask (hit_sample);
   return 0;
 }
 
@@ -1225,7 +1423,8 @@ VLIB_CLI_COMMAND (classify_table, static) = {
   .path = "classify table",
   .short_help = 
   "classify table [miss-next|l2-miss_next|acl-miss-next <next_index>]"
-  "\n mask <mask-value> buckets <nn> [skip <n>] [match <n>] [del]",
+  "\n mask <mask-value> buckets <nn> [skip <n>] [match <n>]"
+  "\n [hit-sample <log2>] [del]",
   .function = classify_table_command_fn,
 };
 
@@ -1718,8 +1917,8 @@ int vnet_classify_add_del_session (vnet_classify_main_t * cm,
   e->next_index = hit_next_index;
   e->opaque_index = opaque_index;
   e->advance = advance;
-  e->hits = 0;
-  e->last_heard = 0;
+  e->stats_index = ~0;
+  e->pad = 0;
   e->flags = 0;
 
   /* Copy key data, honoring skip_n_vectors */
@@ -2078,4 +2277,170 @@ VLIB_CLI_COMMAND (test_classify_command, static) = {
     "test classify [src <ip>] [sessions <nn>] [buckets <nn>] [table <nn>] [del]",
     .function = test_classify_command_fn,
 };
+
+/* 
+ * Time chained lookups, table by table vs. vnet_classify_find_entry_chain.
+ * Every table keys on the source address with a different prefix length
+ * and holds one decoy session; the real sessions all live in the last
+ * table, so each lookup walks the whole chain.
+ */
+static void
+test_classify_chain_one (vlib_main_t * vm, u32 n_masks, u32 sessions,
+                         u32 iterations)
+{
+  vnet_classify_main_t * cm = &vnet_classify_main;
+  classify_data_or_mask_t * mask, * data;
+  vnet_classify_table_t * head, * t;
+  vnet_classify_entry_t * e;
+  u8 *mp = 0, *dp = 0;
+  u32 table_index = ~0, next_table_index = ~0, tail_index = ~0;
+  u32 * table_indices = 0;
+  u32 i, j, n_hits[2];
+  u64 hash, t0, clocks[2];
+  ip4_address_t * srcs = 0;
+  u32 plen;
+  int rv;
+
+  vec_validate_aligned (mp, 3 * sizeof(u32x4), sizeof(u32x4));
+  vec_validate_aligned (dp, 3 * sizeof(u32x4), sizeof(u32x4));
+  mask = (classify_data_or_mask_t *) mp;
+  data = (classify_data_or_mask_t *) dp;
+
+  for (i = 0; i < n_masks; i++)
+    {
+      memset (mp, 0, vec_len (mp));
+      plen = 32 - (i % 32);
+      mask->ip.src_address.as_u32 =
+        clib_host_to_net_u32 (pow2_mask (plen) << (32 - plen));
+      if (i >= 32)
+        mask->ip.dst_address.as_u32 = ~0;
+
+      /* Only the last table in the chain needs room for the sessions */
+      rv = vnet_classify_add_del_table (cm, mp, i ? 2 : 2 * sessions,
+                                        i ? 1<<20 : 64<<20,
+                                        0 /* skip */, 3 /* match */,
+                                        next_table_index,
+                                        IP_LOOKUP_NEXT_LOCAL,
+                                        &table_index, 1 /* is_add */);
+      if (rv)
+        {
+          vlib_cli_output (vm, "table add returned %d", rv);
+          goto out;
+        }
+      vec_add1 (table_indices, table_index);
+      next_table_index = table_index;
+      if (i == 0)
+        tail_index = table_index;
+
+      memset (dp, 0, vec_len (dp));
+      data->ip.src_address.as_u32 = ~0;
+      vnet_classify_add_del_session (cm, table_index, dp,
+                                     IP_LOOKUP_NEXT_DROP, ~0, 0, 1);
+    }
+  head = pool_elt_at_index (cm->tables, table_index);
+
+  for (i = 0; i < sessions; i++)
+    {
+      ip4_address_t * a;
+
+      vec_add2 (srcs, a, 1);
+      a->as_u32 = clib_host_to_net_u32 (0x0a000000 + i);
+      memset (dp, 0, vec_len (dp));
+      data->ip.src_address.as_u32 = a->as_u32;
+      vnet_classify_add_del_session (cm, tail_index, dp,
+                                     IP_LOOKUP_NEXT_DROP, i, 0, 1);
+    }
+
+  memset (dp, 0, vec_len (dp));
+  memset (n_hits, 0, sizeof (n_hits));
+
+  /* Table by table */
+  t0 = clib_cpu_time_now ();
+  for (j = 0; j < iterations; j++)
+    for (i = 0; i < sessions; i++)
+      {
+        data->ip.src_address.as_u32 = srcs[i].as_u32;
+        t = head;
+        while (1)
+          {
+            hash = vnet_classify_hash_packet (t, dp);
+            e = vnet_classify_find_entry (t, dp, hash, 0 /* now */);
+            if (e || t->next_table_index == ~0)
+              break;
+            t = pool_elt_at_index (cm->tables, t->next_table_index);
+          }
+        n_hits[0] += e != 0;
+      }
+  clocks[0] = clib_cpu_time_now () - t0;
+
+  /* Flattened chain */
+  t0 = clib_cpu_time_now ();
+  for (j = 0; j < iterations; j++)
+    for (i = 0; i < sessions; i++)
+      {
+        data->ip.src_address.as_u32 = srcs[i].as_u32;
+        hash = vnet_classify_hash_packet (head, dp);
+        e = vnet_classify_find_entry (head, dp, hash, 0 /* now */);
+        if (e == 0)
+          e = vnet_classify_find_entry_chain (cm, head, dp, 0 /* now */, &t);
+        n_hits[1] += e != 0;
+      }
+  clocks[1] = clib_cpu_time_now () - t0;
+
+  vlib_cli_output (vm, "%2d masks: walk %.2f chain %.2f clocks/lookup, "
+                   "hits %d/%d",
+                   n_masks,
+                   (f64) clocks[0] / ((f64) iterations * sessions),
+                   (f64) clocks[1] / ((f64) iterations * sessions),
+                   n_hits[0], n_hits[1]);
+
+ out:
+  /* Tail first, so each delete frees just the one table */
+  for (i = 0; i < vec_len (table_indices); i++)
+    vnet_classify_add_del_table (cm, 0, 0, 0, 0, 0, 0, 0, &table_indices[i],
+                                 0 /* is_add */);
+  vec_free (table_indices);
+  vec_free (srcs);
+  vec_free (mp);
+  vec_free (dp);
+}
+
+static clib_error_t *
+test_classify_chain_command_fn (vlib_main_t * vm,
+                                unformat_input_t * input,
+                                vlib_cli_command_t * cmd)
+{
+  u32 n_masks = 0, sessions = 1024, iterations = 100;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "masks %d", &n_masks))
+        ;
+      else if (unformat (input, "sessions %d", &sessions))
+        ;
+      else if (unformat (input, "iterations %d", &iterations))
+        ;
+      else
+        return clib_error_return (0, "unknown input `%U'",
+                                  format_unformat_error, input);
+    }
+
+  if (n_masks > 64 || sessions == 0 || iterations == 0)
+    return clib_error_return (0, "masks 1-64, sessions and iterations > 0");
+
+  if (n_masks)
+    test_classify_chain_one (vm, n_masks, sessions, iterations);
+  else
+    for (n_masks = 1; n_masks <= 64; n_masks *= 2)
+      test_classify_chain_one (vm, n_masks, sessions, iterations);
+
+  return 0;
+}
+
+VLIB_CLI_COMMAND (test_classify_chain_command, static) = {
+    .path = "test classify chain",
+    .short_help = 
+    "test classify chain [masks <1-64>] [sessions <nn>] [iterations <nn>]",
+    .function = test_classify_chain_command_fn,
+};
 #endif /* TEST_CODE */
@@ -74,13 +74,14 @@ typedef CLIB_PACKED(struct _vnet_classify_entry {
   u32 flags;
 #define VNET_CLASSIFY_ENTRY_FREE	(1<<0)
 
-  /* Hit counter, last heard time */
+  /* Index of this session's hit counters, see vnet_classify_entry_hit */
   union {
-    u64 hits;
+    u32 stats_index;
     struct _vnet_classify_entry * next_free;
   };
-    
-  f64 last_heard;
+
+  /* Keeps the key 16-octet aligned */
+  u64 pad;
 
   /* Must be aligned to a 16-octet boundary */
   u32x4 key[0];
@@ -117,6 +118,22 @@ typedef struct {
   };
 } vnet_classify_bucket_t;
 
+/* Per-thread hit accounting for one session */
+typedef struct {
+  u64 hits;
+  f64 last_heard;
+} vnet_classify_entry_stats_t;
+
+typedef struct {
+  CLIB_CACHE_LINE_ALIGN_MARK(cacheline0);
+
+  /* Indexed by entry stats_index */
+  vnet_classify_entry_stats_t * stats;
+
+  /* Matches seen since the last sample */
+  u32 sample_tick;
+} vnet_classify_per_cpu_stats_t;
+
 typedef struct {
   /* Mask to apply after skipping N vectors */
   u32x4 *mask;
@@ -133,6 +150,9 @@ typedef struct {
   u32 active_elements;
   /* Index of next table to try */
   u32 next_table_index;
+
+  /* Tables after this one in the next_table_index chain, flattened */
+  u32 * chain;
   
   /* Miss next index, return if next_table_index = 0 */
   u32 miss_next_index;
@@ -148,6 +168,15 @@ typedef struct {
   
   /* Private allocation arena, protected by the writer lock */
   void * mheap;
+
+  /* 
+   * Session hit counters, one set per thread so lookups never write
+   * the entries.  Count 1 in (hit_sample_mask + 1) matches.
+   */
+  vnet_classify_per_cpu_stats_t * per_cpu_stats;
+  u32 * free_stats_indices;
+  u32 n_stats_indices;
+  u32 hit_sample_mask;
   
   /* Writer (only) lock for this table */
   volatile u32 * writer_lock;
@@ -321,10 +350,45 @@ vnet_classify_prefetch_entry (vnet_classify_table_t * t,
   CLIB_PREFETCH(e, CLIB_CACHE_LINE_BYTES, LOAD);
 }
 
+static inline void
+vnet_classify_entry_hit (vnet_classify_table_t * t,
+                         vnet_classify_entry_t * v, f64 now)
+{
+  vnet_classify_per_cpu_stats_t * ps;
+  vnet_classify_entry_stats_t * s;
+
+  ps = vec_elt_at_index (t->per_cpu_stats, os_get_cpu_number());
+
+  if (PREDICT_FALSE (t->hit_sample_mask != 0)
+      && (++ps->sample_tick & t->hit_sample_mask) != 0)
+    return;
+
+  /* Counters may lag a session added a moment ago */
+  if (PREDICT_FALSE (v->stats_index >= vec_len (ps->stats)))
+    return;
+
+  s = ps->stats + v->stats_index;
+  s->hits += t->hit_sample_mask + 1;
+  s->last_heard = now;
+}
+
+void vnet_classify_entry_get_stats (vnet_classify_table_t * t,
+                                    vnet_classify_entry_t * e,
+                                    u64 * hits, f64 * last_heard);
+
 vnet_classify_entry_t *
 vnet_classify_find_entry (vnet_classify_table_t * t,
                           u8 * h, u64 hash, f64 now);
 
+/* Chained tables hashed and prefetched together on a first-table miss */
+#define VNET_CLASSIFY_CHAIN_BATCH 8
+
+vnet_classify_entry_t *
+vnet_classify_find_entry_chain (vnet_classify_main_t * cm,
+                                vnet_classify_table_t * t,
+                                u8 * h, f64 now,
+                                vnet_classify_table_t ** tp);
+
 static inline vnet_classify_entry_t *
 vnet_classify_find_entry_inline (vnet_classify_table_t * t,
                                  u8 * h, u64 hash, f64 now)
@@ -380,10 +444,8 @@ vnet_classify_find_entry_inline (vnet_classify_table_t * t,
       }
 
       if (u32x4_zero_byte_mask (result.as_u32x4) == 0xffff) {
-        if (PREDICT_TRUE(now)) {
-          v->hits++;
-          v->last_heard = now;
-        }
+        if (PREDICT_TRUE(now))
+          vnet_classify_entry_hit (t, v, now);
         return (v);
       }
       v = vnet_classify_entry_at_index (t, v, 1);
@@ -423,10 +485,8 @@ vnet_classify_find_entry_inline (vnet_classify_table_t * t,
       }
 
       if (result.as_u64[0] == 0 && result.as_u64[1] == 0) {
-        if (PREDICT_TRUE(now)) {
-          v->hits++;
-          v->last_heard = now;
-        }
+        if (PREDICT_TRUE(now))
+          vnet_classify_entry_hit (t, v, now);
         return (v);
       }
 
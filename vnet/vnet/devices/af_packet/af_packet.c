@@ -37,13 +37,14 @@
 #define AF_PACKET_TX_BLOCK_SIZE	 	(AF_PACKET_TX_FRAME_SIZE * \
 					 AF_PACKET_TX_FRAMES_PER_BLOCK)
 
-#define AF_PACKET_RX_FRAMES_PER_BLOCK	1024
+/* rx blocks are retired to user space when full or after the timeout */
+#define AF_PACKET_RX_BLOCK_SIZE		(1 << 20)
+#define AF_PACKET_RX_BLOCK_NR		8
 #define AF_PACKET_RX_FRAME_SIZE	 	(2048 * 5)
-#define AF_PACKET_RX_BLOCK_NR		1
 #define AF_PACKET_RX_FRAME_NR		(AF_PACKET_RX_BLOCK_NR * \
-					 AF_PACKET_RX_FRAMES_PER_BLOCK)
-#define AF_PACKET_RX_BLOCK_SIZE		(AF_PACKET_RX_FRAME_SIZE * \
-					 AF_PACKET_RX_FRAMES_PER_BLOCK)
+					 (AF_PACKET_RX_BLOCK_SIZE / \
+					  AF_PACKET_RX_FRAME_SIZE))
+#define AF_PACKET_RX_RETIRE_TOV_MS	1
 
 #if AF_PACKET_DEBUG_SOCKET == 1
 #define DBG_SOCK(args...) clib_warning(args);
@@ -54,7 +55,7 @@
 /*defined in net/if.h but clashes with dpdk headers */
 unsigned int if_nametoindex(const char *ifname);
 
-typedef struct tpacket_req tpacket_req_t;
+typedef struct tpacket_req3 tpacket_req3_t;
 
 static u32
 af_packet_eth_flag_change (vnet_main_t * vnm, vnet_hw_interface_t * hi, u32 flags)
@@ -78,25 +79,18 @@ static clib_error_t * af_packet_fd_read_ready (unix_file_t * uf)
 }
 
 static int
-create_packet_v2_sock(u8 * name, tpacket_req_t * rx_req, tpacket_req_t * tx_req,
-		      int *fd, u8 ** ring)
+create_packet_v3_sock(int host_if_index, tpacket_req3_t * rx_req,
+		      tpacket_req3_t * tx_req, int *fd, u8 ** ring,
+		      int fanout_id, u8 qdisc_bypass)
 {
   int ret, err;
   struct sockaddr_ll sll;
-  uint host_if_index;
-  int ver = TPACKET_V2;
-  socklen_t req_sz = sizeof(struct tpacket_req);
+  int ver = TPACKET_V3;
+  socklen_t req_sz = sizeof(struct tpacket_req3);
   u32 ring_sz = rx_req->tp_block_size * rx_req->tp_block_nr +
 		tx_req->tp_block_size * tx_req->tp_block_nr;
 
-  host_if_index = if_nametoindex((const char *) name);
-
-  if (!host_if_index)
-    {
-      DBG_SOCK("Wrong host interface name");
-      ret = VNET_API_ERROR_INVALID_INTERFACE;
-      goto error;
-    }
+  *ring = MAP_FAILED;
 
   if ((*fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) < 0)
     {
@@ -115,11 +109,24 @@ create_packet_v2_sock(u8 * name, tpacket_req_t * rx_req, tpacket_req_t * tx_req,
   int opt = 1;
   if ((err = setsockopt(*fd, SOL_PACKET, PACKET_LOSS, &opt, sizeof(opt))) < 0)
     {
-      DBG_SOCK("Failed to set rx packet interface version");
+      DBG_SOCK("Failed to set packet loss option");
       ret = VNET_API_ERROR_SYSCALL_ERROR_1;
       goto error;
     }
 
+  if (qdisc_bypass)
+    {
+#ifdef PACKET_QDISC_BYPASS
+      if ((err = setsockopt(*fd, SOL_PACKET, PACKET_QDISC_BYPASS, &opt,
+			    sizeof(opt))) < 0)
+#endif
+	{
+	  DBG_SOCK("Failed to set qdisc bypass");
+	  ret = VNET_API_ERROR_SYSCALL_ERROR_1;
+	  goto error;
+	}
+    }
+
   if ((err = setsockopt(*fd, SOL_PACKET, PACKET_RX_RING, rx_req, req_sz)) < 0)
     {
       DBG_SOCK("Failed to set packet rx ring options");
@@ -129,7 +136,7 @@ create_packet_v2_sock(u8 * name, tpacket_req_t * rx_req, tpacket_req_t * tx_req,
 
   if ((err = setsockopt(*fd, SOL_PACKET, PACKET_TX_RING, tx_req, req_sz)) < 0)
     {
-      DBG_SOCK("Failed to set packet rx ring options");
+      DBG_SOCK("Failed to set packet tx ring options");
       ret = VNET_API_ERROR_SYSCALL_ERROR_1;
       goto error;
     }
@@ -154,21 +161,136 @@ create_packet_v2_sock(u8 * name, tpacket_req_t * rx_req, tpacket_req_t * tx_req,
       goto error;
     }
 
+  /* fanout can only be joined once the socket is bound */
+  if (fanout_id >= 0)
+    {
+      int fanout = (fanout_id & 0xffff) |
+	((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+
+      if ((err = setsockopt(*fd, SOL_PACKET, PACKET_FANOUT, &fanout,
+			    sizeof(fanout))) < 0)
+	{
+	  DBG_SOCK("Failed to join packet fanout group");
+	  ret = VNET_API_ERROR_SYSCALL_ERROR_1;
+	  goto error;
+	}
+    }
+
   return 0;
 error:
-  close(*fd);
+  if (*ring != MAP_FAILED)
+    munmap(*ring, ring_sz);
+  *ring = 0;
+  if (*fd >= 0)
+    close(*fd);
   *fd = -1;
   return ret;
 }
 
+static u32
+af_packet_ring_size (tpacket_req3_t * rx_req, tpacket_req3_t * tx_req)
+{
+  return rx_req->tp_block_size * rx_req->tp_block_nr +
+	 tx_req->tp_block_size * tx_req->tp_block_nr;
+}
+
+static void
+af_packet_queue_free (af_packet_queue_t * q, u32 ring_sz)
+{
+  if (q->unix_file_index != ~0)
+    {
+      unix_file_del(&unix_main, unix_main.file_pool + q->unix_file_index);
+      q->unix_file_index = ~0;
+    }
+  if (q->rx_ring && munmap(q->rx_ring, ring_sz))
+    clib_warning("could not free rx/tx ring");
+  q->rx_ring = 0;
+  q->tx_ring = 0;
+  if (q->fd >= 0)
+    close(q->fd);
+  q->fd = -1;
+  if (q->tx_lockp)
+    clib_mem_free ((void *) q->tx_lockp);
+  q->tx_lockp = 0;
+}
+
+/*
+ * Queues go round robin over the worker threads, or all stay on the
+ * main thread when there are none.  Worker queues are polled, main
+ * thread queues are driven by the socket fd and vlib switches the
+ * input node between interrupt and polling mode based on vector rate.
+ */
+static u32
+af_packet_queue_cpu (af_packet_main_t * apm)
+{
+  vlib_thread_main_t * tm = vlib_get_thread_main();
+
+  if (tm->n_vlib_mains == 1)
+    return 0;
+
+  return 1 + (apm->next_queue_cpu++ % (tm->n_vlib_mains - 1));
+}
+
+static void
+af_packet_queues_register (vlib_main_t * vm, af_packet_if_t * apif,
+			   u32 if_index)
+{
+  af_packet_main_t * apm = &af_packet_main;
+  af_packet_queue_t * q;
+  af_packet_queue_ref_t * ref;
+
+  vec_foreach (q, apif->queues)
+    {
+      vec_validate (apm->queues_by_cpu, q->cpu_index);
+      vec_add2 (apm->queues_by_cpu[q->cpu_index], ref, 1);
+      ref->if_index = if_index;
+      ref->queue_id = q - apif->queues;
+
+      if (q->cpu_index != 0)
+	vlib_node_set_state (vlib_mains[q->cpu_index],
+			     af_packet_input_node.index,
+			     VLIB_NODE_STATE_POLLING);
+    }
+}
+
+static void
+af_packet_queues_unregister (vlib_main_t * vm, u32 if_index)
+{
+  af_packet_main_t * apm = &af_packet_main;
+  af_packet_queue_ref_t * ref;
+  u32 cpu;
+
+  for (cpu = 0; cpu < vec_len (apm->queues_by_cpu); cpu++)
+    {
+      for (ref = apm->queues_by_cpu[cpu];
+	   ref < vec_end (apm->queues_by_cpu[cpu]);)
+	{
+	  if (ref->if_index == if_index)
+	    vec_delete (apm->queues_by_cpu[cpu], 1,
+			ref - apm->queues_by_cpu[cpu]);
+	  else
+	    ref++;
+	}
+
+      if (cpu != 0 && vec_len (apm->queues_by_cpu[cpu]) == 0)
+	vlib_node_set_state (vlib_mains[cpu], af_packet_input_node.index,
+			     VLIB_NODE_STATE_DISABLED);
+    }
+
+  apm->pending_input_bitmap =
+    clib_bitmap_set (apm->pending_input_bitmap, if_index, 0);
+}
+
 int
-af_packet_create_if(vlib_main_t * vm, u8 * host_if_name, u8 * hw_addr_set)
+af_packet_create_if(vlib_main_t * vm, u8 * host_if_name, u8 * hw_addr_set,
+		    u32 n_queues, u8 qdisc_bypass)
 {
   af_packet_main_t * apm = &af_packet_main;
-  int ret, fd = -1;
-  struct tpacket_req * rx_req = 0;
-  struct tpacket_req * tx_req = 0;
-  u8 * ring = 0;
+  vlib_thread_main_t * tm = vlib_get_thread_main();
+  int ret;
+  struct tpacket_req3 * rx_req = 0;
+  struct tpacket_req3 * tx_req = 0;
+  af_packet_queue_t * queues = 0, * q;
   af_packet_if_t * apif = 0;
   u8 hw_addr[6];
   clib_error_t * error;
@@ -176,6 +298,7 @@ af_packet_create_if(vlib_main_t * vm, u8 * host_if_name, u8 * hw_addr_set)
   vnet_main_t *vnm = vnet_get_main();
   uword * p;
   uword if_index;
+  uint host_if_index;
 
   p = mhash_get (&apm->if_index_by_host_if_name, host_if_name);
   if (p)
@@ -183,45 +306,92 @@ af_packet_create_if(vlib_main_t * vm, u8 * host_if_name, u8 * hw_addr_set)
       return VNET_API_ERROR_SUBIF_ALREADY_EXISTS;
     }
 
+  if (n_queues == 0)
+    n_queues = 1;
+
+  if (n_queues > AF_PACKET_MAX_QUEUES)
+    {
+      ret = VNET_API_ERROR_INVALID_VALUE;
+      goto error;
+    }
+
+  host_if_index = if_nametoindex((const char *) host_if_name);
+
+  if (!host_if_index)
+    {
+      DBG_SOCK("Wrong host interface name");
+      ret = VNET_API_ERROR_INVALID_INTERFACE;
+      goto error;
+    }
+
   vec_validate(rx_req, 0);
   rx_req->tp_block_size = AF_PACKET_RX_BLOCK_SIZE;
   rx_req->tp_frame_size = AF_PACKET_RX_FRAME_SIZE;
   rx_req->tp_block_nr = AF_PACKET_RX_BLOCK_NR;
   rx_req->tp_frame_nr = AF_PACKET_RX_FRAME_NR;
+  rx_req->tp_retire_blk_tov = AF_PACKET_RX_RETIRE_TOV_MS;
+  rx_req->tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
 
+  /* TPACKET_V3 tx rings are plain frame rings, block fields stay zero */
   vec_validate(tx_req, 0);
   tx_req->tp_block_size = AF_PACKET_TX_BLOCK_SIZE;
   tx_req->tp_frame_size = AF_PACKET_TX_FRAME_SIZE;
   tx_req->tp_block_nr = AF_PACKET_TX_BLOCK_NR;
   tx_req->tp_frame_nr = AF_PACKET_TX_FRAME_NR;
 
-  ret = create_packet_v2_sock(host_if_name, rx_req, tx_req, &fd, &ring);
+  vec_validate_aligned (queues, n_queues - 1, CLIB_CACHE_LINE_BYTES);
+  vec_foreach (q, queues)
+    {
+      q->fd = -1;
+      q->unix_file_index = ~0;
+    }
+
+  vec_foreach (q, queues)
+    {
+      ret = create_packet_v3_sock(host_if_index, rx_req, tx_req, &q->fd,
+				  &q->rx_ring, n_queues > 1 ? host_if_index : -1,
+				  qdisc_bypass);
+      if (ret != 0)
+	goto error;
 
-  if (ret != 0)
-    goto error;
+      q->tx_ring = q->rx_ring + rx_req->tp_block_size * rx_req->tp_block_nr;
+    }
 
   /* So far everything looks good, let's create interface */
+  vlib_worker_thread_barrier_sync (vm);
+
   pool_get (apm->interfaces, apif);
   if_index = apif - apm->interfaces;
 
-  apif->fd = fd;
-  apif->rx_ring = ring;
-  apif->tx_ring = ring + rx_req->tp_block_size * rx_req->tp_block_nr;
+  apif->queues = queues;
   apif->rx_req = rx_req;
   apif->tx_req = tx_req;
   apif->host_if_name = host_if_name;
   apif->per_interface_next_index = ~0;
-  apif->next_tx_frame = 0;
-  apif->next_rx_frame = 0;
-
-  {
-    unix_file_t template = {0};
-    template.read_function = af_packet_fd_read_ready;
-    template.file_descriptor = fd;
-    template.private_data = if_index;
-    template.flags = UNIX_FILE_EVENT_EDGE_TRIGGERED;
-    apif->unix_file_index = unix_file_add (&unix_main, &template);
-  }
+  apif->qdisc_bypass = qdisc_bypass;
+
+  vec_foreach (q, apif->queues)
+    {
+      q->cpu_index = af_packet_queue_cpu (apm);
+
+      /* threads share a tx queue when there are more threads than queues */
+      if (tm->n_vlib_mains > n_queues)
+	{
+	  q->tx_lockp = clib_mem_alloc_aligned (CLIB_CACHE_LINE_BYTES,
+						CLIB_CACHE_LINE_BYTES);
+	  memset ((void *) q->tx_lockp, 0, CLIB_CACHE_LINE_BYTES);
+	}
+
+      if (q->cpu_index == 0)
+	{
+	  unix_file_t template = {0};
+	  template.read_function = af_packet_fd_read_ready;
+	  template.file_descriptor = q->fd;
+	  template.private_data = if_index;
+	  template.flags = UNIX_FILE_EVENT_EDGE_TRIGGERED;
+	  q->unix_file_index = unix_file_add (&unix_main, &template);
+	}
+    }
 
   /*use configured or generate random MAC address */
   if (hw_addr_set)
@@ -246,6 +416,7 @@ af_packet_create_if(vlib_main_t * vm, u8 * host_if_name, u8 * hw_addr_set)
     {
       memset(apif, 0, sizeof(*apif));
       pool_put(apm->interfaces, apif);
+      vlib_worker_thread_barrier_release (vm);
       clib_error_report (error);
       ret = VNET_API_ERROR_SYSCALL_ERROR_1;
       goto error;
@@ -254,6 +425,10 @@ af_packet_create_if(vlib_main_t * vm, u8 * host_if_name, u8 * hw_addr_set)
   sw = vnet_get_hw_sw_interface (vnm, apif->hw_if_index);
   apif->sw_if_index = sw->sw_if_index;
 
+  af_packet_queues_register (vm, apif, if_index);
+
+  vlib_worker_thread_barrier_release (vm);
+
   vnet_hw_interface_set_flags (vnm, apif->hw_if_index,
 			       VNET_HW_INTERFACE_FLAG_LINK_UP);
 
@@ -262,6 +437,10 @@ af_packet_create_if(vlib_main_t * vm, u8 * host_if_name, u8 * hw_addr_set)
   return 0;
 
 error:
+  if (rx_req && tx_req)
+    vec_foreach (q, queues)
+      af_packet_queue_free (q, af_packet_ring_size (rx_req, tx_req));
+  vec_free(queues);
   vec_free(host_if_name);
   vec_free(rx_req);
   vec_free(tx_req);
@@ -274,6 +453,7 @@ af_packet_delete_if(vlib_main_t *vm, u8 *host_if_name)
   vnet_main_t *vnm = vnet_get_main();
   af_packet_main_t *apm = &af_packet_main;
   af_packet_if_t *apif;
+  af_packet_queue_t *q;
   uword *p;
   uword if_index;
   u32 ring_sz;
@@ -289,19 +469,15 @@ af_packet_delete_if(vlib_main_t *vm, u8 *host_if_name)
   /* bring down the interface */
   vnet_hw_interface_set_flags(vnm, apif->hw_if_index, 0);
 
+  /* stop polling before the rings go away */
+  vlib_worker_thread_barrier_sync (vm);
+  af_packet_queues_unregister (vm, if_index);
+
   /* clean up */
-  if (apif->unix_file_index != ~0) {
-    unix_file_del(&unix_main, unix_main.file_pool + apif->unix_file_index);
-    apif->unix_file_index = ~0;
-  }
-  ring_sz = apif->rx_req->tp_block_size * apif->rx_req->tp_block_nr +
-            apif->tx_req->tp_block_size * apif->tx_req->tp_block_nr;
-  if (munmap(apif->rx_ring, ring_sz))
-    clib_warning("Host interface %s could not free rx/tx ring", host_if_name);
-  apif->rx_ring = NULL;
-  apif->tx_ring = NULL;
-  close(apif->fd);
-  apif->fd = -1;
+  ring_sz = af_packet_ring_size (apif->rx_req, apif->tx_req);
+  vec_foreach (q, apif->queues)
+    af_packet_queue_free (q, ring_sz);
+  vec_free(apif->queues);
 
   vec_free(apif->rx_req);
   apif->rx_req = NULL;
@@ -317,6 +493,8 @@ af_packet_delete_if(vlib_main_t *vm, u8 *host_if_name)
 
   pool_put(apm->interfaces, apif);
 
+  vlib_worker_thread_barrier_release (vm);
+
   return 0;
 }
 
@@ -325,8 +503,14 @@ af_packet_init (vlib_main_t * vm)
 {
   af_packet_main_t * apm = &af_packet_main;
 
+  vlib_thread_main_t * tm = vlib_get_thread_main();
+
   memset (apm, 0, sizeof (af_packet_main_t));
 
+  vec_validate (apm->queues_by_cpu, tm->n_vlib_mains - 1);
+  vec_validate_aligned (apm->rx_buffers, tm->n_vlib_mains - 1,
+			CLIB_CACHE_LINE_BYTES);
+
   mhash_init_vec_string (&apm->if_index_by_host_if_name, sizeof (uword));
 
   return 0;
@@ -17,34 +17,66 @@
  *------------------------------------------------------------------
  */
 
+/*
+ * Each queue is its own PACKET socket.  With more than one queue the
+ * sockets join a PACKET_FANOUT_HASH group, so the kernel spreads flows
+ * across them and every queue can be polled by a different thread.
+ */
 typedef struct {
   CLIB_CACHE_LINE_ALIGN_MARK(cacheline0);
-  u8 * host_if_name;
   int fd;
-  struct tpacket_req * rx_req;
-  struct tpacket_req * tx_req;
+  u32 unix_file_index;
+
+  /* TPACKET_V3 rx blocks followed by tx frames, one mmap */
   u8 * rx_ring;
   u8 * tx_ring;
-  u32 hw_if_index;
-  u32 sw_if_index;
-  u32 unix_file_index;
 
-  u32 next_rx_frame;
+  /* rx position: block, packets consumed and offset within it */
+  u32 next_rx_block;
+  u32 rx_block_n_done;
+  u32 rx_block_offset;
+
   u32 next_tx_frame;
+  volatile u32 * tx_lockp;
+
+  /* thread polling this queue */
+  u32 cpu_index;
+} af_packet_queue_t;
+
+typedef struct {
+  u32 if_index;
+  u32 queue_id;
+} af_packet_queue_ref_t;
+
+typedef struct {
+  CLIB_CACHE_LINE_ALIGN_MARK(cacheline0);
+  u8 * host_if_name;
+  struct tpacket_req3 * rx_req;
+  struct tpacket_req3 * tx_req;
+  af_packet_queue_t * queues;
+  u32 hw_if_index;
+  u32 sw_if_index;
 
   u32 per_interface_next_index;
   u8 is_admin_up;
+  u8 qdisc_bypass;
 } af_packet_if_t;
 
 typedef struct {
   CLIB_CACHE_LINE_ALIGN_MARK(cacheline0);
   af_packet_if_t * interfaces;
 
-  /* bitmap of pending rx interfaces */
+  /* bitmap of pending rx interfaces, main thread only */
   uword * pending_input_bitmap;
 
-  /* rx buffer cache */
-  u32 * rx_buffers;
+  /* per-thread rx queues to poll */
+  af_packet_queue_ref_t ** queues_by_cpu;
+
+  /* per-thread rx buffer cache */
+  u32 ** rx_buffers;
+
+  /* round robin placement of queues on workers */
+  u32 next_queue_cpu;
 
   /* hash of host interface names */
   mhash_t if_index_by_host_if_name;
@@ -54,5 +86,8 @@ af_packet_main_t af_packet_main;
 extern vnet_device_class_t af_packet_device_class;
 extern vlib_node_registration_t af_packet_input_node;
 
-int af_packet_create_if(vlib_main_t * vm, u8 * host_if_name, u8 * hw_addr_set);
+#define AF_PACKET_MAX_QUEUES	16
+
+int af_packet_create_if(vlib_main_t * vm, u8 * host_if_name, u8 * hw_addr_set,
+			u32 n_queues, u8 qdisc_bypass);
 int af_packet_delete_if(vlib_main_t * vm, u8 * host_if_name);
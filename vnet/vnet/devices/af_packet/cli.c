@@ -40,6 +40,8 @@ af_packet_create_command_fn (vlib_main_t * vm, unformat_input_t * input,
   u8 * host_if_name = NULL;
   u8 hwaddr [6];
   u8 * hw_addr_ptr = 0;
+  u32 n_queues = 1;
+  u8 qdisc_bypass = 0;
   int r;
 
   /* Get a line of input. */
@@ -52,6 +54,10 @@ af_packet_create_command_fn (vlib_main_t * vm, unformat_input_t * input,
 	;
       else if (unformat (line_input, "hw-addr %U", unformat_ethernet_address, hwaddr))
 	hw_addr_ptr = hwaddr;
+      else if (unformat (line_input, "queues %d", &n_queues))
+	;
+      else if (unformat (line_input, "qdisc-bypass"))
+	qdisc_bypass = 1;
       else
 	return clib_error_return (0, "unknown input `%U'", format_unformat_error, input);
     }
@@ -60,7 +66,8 @@ af_packet_create_command_fn (vlib_main_t * vm, unformat_input_t * input,
   if (host_if_name == NULL)
       return clib_error_return (0, "missing host interface name");
 
-  r = af_packet_create_if(vm, host_if_name, hw_addr_ptr);
+  r = af_packet_create_if(vm, host_if_name, hw_addr_ptr, n_queues,
+			  qdisc_bypass);
 
   if (r == VNET_API_ERROR_SYSCALL_ERROR_1)
     return clib_error_return(0, "%s (errno %d)", strerror (errno), errno);
@@ -71,12 +78,17 @@ af_packet_create_command_fn (vlib_main_t * vm, unformat_input_t * input,
   if (r == VNET_API_ERROR_SUBIF_ALREADY_EXISTS)
     return clib_error_return(0, "Interface elready exists");
 
+  if (r == VNET_API_ERROR_INVALID_VALUE)
+    return clib_error_return(0, "Number of queues must be 1 - %d",
+			     AF_PACKET_MAX_QUEUES);
+
   return 0;
 }
 
 VLIB_CLI_COMMAND (af_packet_create_command, static) = {
   .path = "create host-interface",
-  .short_help = "create host-interface name <interface name> [hw-addr <mac>]",
+  .short_help = "create host-interface name <interface name> [hw-addr <mac>] "
+		"[queues <n>] [qdisc-bypass]",
   .function = af_packet_create_command_fn,
 };
 
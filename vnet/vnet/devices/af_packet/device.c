@@ -55,7 +55,18 @@ static u8 * format_af_packet_device_name (u8 * s, va_list * args)
 
 static u8 * format_af_packet_device (u8 * s, va_list * args)
 {
-  s = format (s, "Linux PACKET socket interface");
+  u32 i = va_arg (*args, u32);
+  CLIB_UNUSED (int verbose) = va_arg (*args, int);
+  af_packet_main_t * apm = &af_packet_main;
+  af_packet_if_t * apif = pool_elt_at_index (apm->interfaces, i);
+  uword indent = format_get_indent (s);
+  af_packet_queue_t * q;
+
+  s = format (s, "Linux PACKET socket interface, TPACKET_V3%s",
+	      apif->qdisc_bypass ? ", qdisc bypass" : "");
+  vec_foreach (q, apif->queues)
+    s = format (s, "\n%Uqueue %d fd %d thread %d", format_white_space,
+		indent + 2, q - apif->queues, q->fd, q->cpu_index);
   return s;
 }
 
@@ -76,15 +87,25 @@ af_packet_interface_tx (vlib_main_t * vm,
   u32 n_sent = 0;
   vnet_interface_output_runtime_t * rd = (void *) node->runtime_data;
   af_packet_if_t * apif = pool_elt_at_index (apm->interfaces, rd->dev_instance);
+  af_packet_queue_t * q = vec_elt_at_index (apif->queues, os_get_cpu_number()
+					    % vec_len (apif->queues));
   int block = 0;
   u32 block_size = apif->tx_req->tp_block_size;
   u32 frame_size = apif->tx_req->tp_frame_size;
   u32 frame_num = apif->tx_req->tp_frame_nr;
-  u8 * block_start = apif->tx_ring + block * block_size;
-  u32 tx_frame = apif->next_tx_frame;
-  struct tpacket2_hdr * tph;
+  u8 * block_start = q->tx_ring + block * block_size;
+  u32 tx_frame;
+  struct tpacket3_hdr * tph;
   u32 frame_not_ready = 0;
 
+  if (PREDICT_FALSE(q->tx_lockp != 0))
+    {
+      while (__sync_lock_test_and_set (q->tx_lockp, 1))
+	;
+    }
+
+  tx_frame = q->next_tx_frame;
+
   while(n_left > 0)
     {
       u32 len;
@@ -94,7 +115,7 @@ af_packet_interface_tx (vlib_main_t * vm,
       u32 bi = buffers[0];
       buffers++;
 
-      tph = (struct tpacket2_hdr *) (block_start + tx_frame * frame_size);
+      tph = (struct tpacket3_hdr *) (block_start + tx_frame * frame_size);
 
       if(tph->tp_status & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING))
 	{
@@ -106,13 +127,14 @@ af_packet_interface_tx (vlib_main_t * vm,
 	{
 	  b0 = vlib_get_buffer (vm, bi);
 	  len = b0->current_length;
-	  clib_memcpy((u8 *) tph + TPACKET_ALIGN(sizeof(struct tpacket2_hdr)) + offset,
+	  clib_memcpy((u8 *) tph + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)) + offset,
 		 vlib_buffer_get_current(b0), len);
 	  offset += len;
 	}
       while ((bi = b0->next_buffer));
 
       tph->tp_len = tph->tp_snaplen = offset;
+      tph->tp_next_offset = 0;
       tph->tp_status = TP_STATUS_SEND_REQUEST;
       n_sent++;
 next:
@@ -123,11 +145,14 @@ next:
 
   if (n_sent)
     {
-      apif->next_tx_frame = tx_frame;
-      if (sendto(apif->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) == -1)
+      q->next_tx_frame = tx_frame;
+      if (sendto(q->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) == -1)
 	clib_unix_error("tx sendto failure");
     }
 
+  if (PREDICT_FALSE(q->tx_lockp != 0))
+    *q->tx_lockp = 0;
+
   if (frame_not_ready)
     vlib_error_count (vm, node->node_index, AF_PACKET_TX_ERROR_FRAME_NOT_READY,
 		      frame_not_ready);
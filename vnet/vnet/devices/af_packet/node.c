@@ -25,6 +25,7 @@
 #include <vnet/ethernet/ethernet.h>
 
 #include <vnet/devices/af_packet/af_packet.h>
+#include <vnet/unix/pcap_capture.h>
 
 #define foreach_af_packet_input_error
 
@@ -50,8 +51,8 @@ enum {
 typedef struct {
   u32 next_index;
   u32 hw_if_index;
-  int block;
-  struct tpacket2_hdr tph;
+  u32 queue_id;
+  struct tpacket3_hdr tph;
 } af_packet_input_trace_t;
 
 static u8 * format_af_packet_input_trace (u8 * s, va_list * args)
@@ -61,11 +62,11 @@ static u8 * format_af_packet_input_trace (u8 * s, va_list * args)
   af_packet_input_trace_t * t = va_arg (*args, af_packet_input_trace_t *);
   uword indent = format_get_indent (s);
 
-  s = format (s, "af_packet: hw_if_index %d next-index %d",
-	      t->hw_if_index, t->next_index);
+  s = format (s, "af_packet: hw_if_index %d queue %d next-index %d",
+	      t->hw_if_index, t->queue_id, t->next_index);
 
-  s = format (s, "\n%Utpacket2_hdr:\n%Ustatus 0x%x len %u snaplen %u mac %u net %u"
-	      "\n%Usec 0x%x nsec 0x%x vlan_tci %u"
+  s = format (s, "\n%Utpacket3_hdr:\n%Ustatus 0x%x len %u snaplen %u mac %u net %u"
+	      "\n%Usec 0x%x nsec 0x%x rxhash 0x%x vlan_tci %u"
 #ifdef TP_STATUS_VLAN_TPID_VALID
 	      " vlan_tpid %u"
 #endif
@@ -80,9 +81,10 @@ static u8 * format_af_packet_input_trace (u8 * s, va_list * args)
 	      format_white_space, indent + 4,
 	      t->tph.tp_sec,
 	      t->tph.tp_nsec,
-	      t->tph.tp_vlan_tci,
+	      t->tph.hv1.tp_rxhash,
+	      t->tph.hv1.tp_vlan_tci,
 #ifdef TP_STATUS_VLAN_TPID_VALID
-	      t->tph.tp_vlan_tpid,
+	      t->tph.hv1.tp_vlan_tpid,
 #endif
 	      t->tph.tp_net);
   return s;
@@ -117,50 +119,60 @@ buffer_add_to_chain(vlib_main_t *vm, u32 bi, u32 first_bi, u32 prev_bi)
 #endif
 }
 
+/*
+ * TPACKET_V3 hands over whole blocks of packets.  A block is given back
+ * to the kernel only once every packet in it has been copied out, so
+ * the position inside a partly consumed block is kept in the queue.
+ */
 always_inline uword
 af_packet_device_input_fn  (vlib_main_t * vm, vlib_node_runtime_t * node,
-			    vlib_frame_t * frame, u32 device_idx)
+			    vlib_frame_t * frame, u32 device_idx, u32 queue_id)
 {
   af_packet_main_t * apm = &af_packet_main;
   af_packet_if_t * apif = pool_elt_at_index(apm->interfaces, device_idx);
-  struct tpacket2_hdr *tph;
+  af_packet_queue_t * q = vec_elt_at_index (apif->queues, queue_id);
+  u32 cpu_index = os_get_cpu_number();
+  struct tpacket_block_desc * bd;
+  struct tpacket3_hdr *tph;
   u32 next_index = AF_PACKET_INPUT_NEXT_ETHERNET_INPUT;
-  u32 block = 0;
-  u32 rx_frame;
   u32 n_free_bufs;
   u32 n_rx_packets = 0;
   u32 n_rx_bytes = 0;
   u32 * to_next = 0;
   u32 block_size = apif->rx_req->tp_block_size;
-  u32 frame_size = apif->rx_req->tp_frame_size;
-  u32 frame_num = apif->rx_req->tp_frame_nr;
-  u8 * block_start = apif->rx_ring + block * block_size;
+  u32 block_num = apif->rx_req->tp_block_nr;
+  u32 rx_block = q->next_rx_block;
   uword n_trace = vlib_get_trace_count (vm, node);
   u32 n_buffer_bytes = vlib_buffer_free_list_buffer_size (vm,
     VLIB_BUFFER_DEFAULT_FREE_LIST_INDEX);
   u32 min_bufs = apif->rx_req->tp_frame_size / n_buffer_bytes;
+  u32 * rx_buffers = apm->rx_buffers[cpu_index];
 
   if (apif->per_interface_next_index != ~0)
       next_index = apif->per_interface_next_index;
 
-  n_free_bufs = vec_len (apm->rx_buffers);
+  n_free_bufs = vec_len (rx_buffers);
   if (PREDICT_FALSE(n_free_bufs < VLIB_FRAME_SIZE))
     {
-      vec_validate(apm->rx_buffers, VLIB_FRAME_SIZE + n_free_bufs - 1);
-      n_free_bufs += vlib_buffer_alloc(vm, &apm->rx_buffers[n_free_bufs], VLIB_FRAME_SIZE);
-      _vec_len (apm->rx_buffers) = n_free_bufs;
+      vec_validate(rx_buffers, VLIB_FRAME_SIZE + n_free_bufs - 1);
+      n_free_bufs += vlib_buffer_alloc(vm, &rx_buffers[n_free_bufs], VLIB_FRAME_SIZE);
+      _vec_len (rx_buffers) = n_free_bufs;
     }
 
-  rx_frame = apif->next_rx_frame;
-  tph = (struct tpacket2_hdr *) (block_start + rx_frame * frame_size);
-  while ((tph->tp_status & TP_STATUS_USER) && (n_free_bufs > min_bufs))
+  bd = (struct tpacket_block_desc *) (q->rx_ring + rx_block * block_size);
+  while ((bd->hdr.bh1.block_status & TP_STATUS_USER) && (n_free_bufs > min_bufs))
     {
       vlib_buffer_t * b0, * first_b0 = 0;
       u32 next0 = next_index;
+      u32 n_pkts = bd->hdr.bh1.num_pkts;
+
+      if (q->rx_block_n_done == 0)
+	q->rx_block_offset = bd->hdr.bh1.offset_to_first_pkt;
+      tph = (struct tpacket3_hdr *) ((u8 *) bd + q->rx_block_offset);
 
       u32 n_left_to_next;
       vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
-      while ((tph->tp_status & TP_STATUS_USER) && (n_free_bufs > min_bufs) &&
+      while ((q->rx_block_n_done < n_pkts) && (n_free_bufs > min_bufs) &&
 	     n_left_to_next)
 	{
 	  u32 data_len = tph->tp_snaplen;
@@ -170,11 +182,11 @@ af_packet_device_input_fn  (vlib_main_t * vm, vlib_node_runtime_t * node,
 	  while (data_len)
 	    {
 	      /* grab free buffer */
-	      u32 last_empty_buffer = vec_len (apm->rx_buffers) - 1;
+	      u32 last_empty_buffer = vec_len (rx_buffers) - 1;
 	      prev_bi0 = bi0;
-	      bi0 = apm->rx_buffers[last_empty_buffer];
+	      bi0 = rx_buffers[last_empty_buffer];
 	      b0 = vlib_get_buffer (vm, bi0);
-	      _vec_len (apm->rx_buffers) = last_empty_buffer;
+	      _vec_len (rx_buffers) = last_empty_buffer;
 	      n_free_bufs--;
 
 	      /* copy data */
@@ -212,6 +224,9 @@ af_packet_device_input_fn  (vlib_main_t * vm, vlib_node_runtime_t * node,
 	  to_next += 1;
 	  n_left_to_next--;
 
+	  if (PREDICT_FALSE (pcap_capture_main.flags & PCAP_CAPTURE_F_RX))
+	    pcap_capture_rx_buffer (vm, first_b0, 0);
+
 	  /* trace */
 	  VLIB_BUFFER_TRACE_TRAJECTORY_INIT(first_b0);
 	  if (PREDICT_FALSE(n_trace > 0))
@@ -222,47 +237,80 @@ af_packet_device_input_fn  (vlib_main_t * vm, vlib_node_runtime_t * node,
 	      tr = vlib_add_trace (vm, node, first_b0, sizeof (*tr));
 	      tr->next_index = next0;
 	      tr->hw_if_index = apif->hw_if_index;
-	      clib_memcpy(&tr->tph, tph, sizeof(struct tpacket2_hdr));
+	      tr->queue_id = queue_id;
+	      clib_memcpy(&tr->tph, tph, sizeof(struct tpacket3_hdr));
 	    }
 	  /* enque and take next packet */
 	  vlib_validate_buffer_enqueue_x1 (vm, node, next_index, to_next,
 					   n_left_to_next, first_bi0, next0);
 
 	   /* next packet */
-	  tph->tp_status = TP_STATUS_KERNEL;
-	  rx_frame = (rx_frame + 1) % frame_num;
-	  tph = (struct tpacket2_hdr *) (block_start + rx_frame * frame_size);
+	  q->rx_block_n_done++;
+	  q->rx_block_offset += tph->tp_next_offset;
+	  tph = (struct tpacket3_hdr *) ((u8 *) bd + q->rx_block_offset);
 	}
 
       vlib_put_next_frame (vm, node, next_index, n_left_to_next);
+
+      /* whole block consumed, give it back and move on */
+      if (q->rx_block_n_done == n_pkts)
+	{
+	  CLIB_MEMORY_BARRIER();
+	  bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+	  q->rx_block_n_done = 0;
+	  rx_block = (rx_block + 1) % block_num;
+	  bd = (struct tpacket_block_desc *) (q->rx_ring + rx_block * block_size);
+	}
     }
 
-  apif->next_rx_frame = rx_frame;
+  q->next_rx_block = rx_block;
+  apm->rx_buffers[cpu_index] = rx_buffers;
 
   vlib_increment_combined_counter
     (vnet_get_main()->interface_main.combined_sw_if_counters
      + VNET_INTERFACE_COUNTER_RX,
-     os_get_cpu_number(),
+     cpu_index,
      apif->hw_if_index,
      n_rx_packets, n_rx_bytes);
 
   return n_rx_packets;
 }
 
+/*
+ * Worker threads always poll their queues.  On the main thread the node
+ * starts in interrupt mode and only looks at interfaces whose fd fired;
+ * once vlib switches it to polling because of vector rate, every main
+ * thread queue is walked until it drops back to interrupt mode.
+ */
 static uword
 af_packet_input_fn (vlib_main_t * vm, vlib_node_runtime_t * node,
 		    vlib_frame_t * frame)
 {
   int i;
   u32 n_rx_packets = 0;
-
+  u32 cpu_index = os_get_cpu_number();
   af_packet_main_t * apm = &af_packet_main;
+  af_packet_queue_ref_t * ref;
+  af_packet_if_t * apif;
+  af_packet_queue_t * q;
+
+  if (cpu_index == 0 && node->state == VLIB_NODE_STATE_INTERRUPT)
+    {
+      clib_bitmap_foreach (i, apm->pending_input_bitmap,
+	({
+	  clib_bitmap_set (apm->pending_input_bitmap, i, 0);
+	  apif = pool_elt_at_index (apm->interfaces, i);
+	  vec_foreach (q, apif->queues)
+	    if (q->cpu_index == 0)
+	      n_rx_packets += af_packet_device_input_fn(vm, node, frame, i,
+							q - apif->queues);
+	}));
+      return n_rx_packets;
+    }
 
-  clib_bitmap_foreach (i, apm->pending_input_bitmap,
-    ({
-      clib_bitmap_set (apm->pending_input_bitmap, i, 0);
-      n_rx_packets += af_packet_device_input_fn(vm, node, frame, i);
-    }));
+  vec_foreach (ref, apm->queues_by_cpu[cpu_index])
+    n_rx_packets += af_packet_device_input_fn(vm, node, frame, ref->if_index,
+					      ref->queue_id);
 
   return n_rx_packets;
 }
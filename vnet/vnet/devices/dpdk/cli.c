@@ -938,7 +938,8 @@ show_dpdk_if_placement (vlib_main_t *vm, unformat_input_t *input,
         {
           u32 hw_if_index = dm->devices[dq->device].vlib_hw_if_index;
           vnet_hw_interface_t * hi =  vnet_get_hw_interface(dm->vnet_main, hw_if_index);
-          vlib_cli_output(vm, "  %v queue %u", hi->name, dq->queue_id);
+          vlib_cli_output(vm, "  %v queue %u rx packets %llu", hi->name,
+                          dq->queue_id, dq->rx_packets);
         }
     }
   return 0;
@@ -950,37 +951,16 @@ VLIB_CLI_COMMAND (cmd_show_dpdk_if_placement,static) = {
     .function = show_dpdk_if_placement,
 };
 
-static int
-dpdk_device_queue_sort(void * a1, void * a2)
-{
-  dpdk_device_and_queue_t * dq1 = a1;
-  dpdk_device_and_queue_t * dq2 = a2;
-
-  if (dq1->device > dq2->device)
-    return 1;
-  else if (dq1->device < dq2->device)
-    return -1;
-  else if (dq1->queue_id > dq2->queue_id)
-    return 1;
-  else if (dq1->queue_id < dq2->queue_id)
-    return -1;
-  else
-    return 0;
-}
-
 static clib_error_t *
 set_dpdk_if_placement (vlib_main_t *vm, unformat_input_t *input,
           vlib_cli_command_t *cmd)
 {
   unformat_input_t _line_input, * line_input = &_line_input;
   dpdk_main_t * dm = &dpdk_main;
-  dpdk_device_and_queue_t * dq;
-  vnet_hw_interface_t * hw;
-  dpdk_device_t * xd;
   u32 hw_if_index = (u32) ~0;
   u32 queue = (u32) 0;
   u32 cpu = (u32) ~0;
-  int i;
+  int rv;
 
   if (! unformat_user (input, unformat_line_input, line_input))
     return 0;
@@ -1007,46 +987,22 @@ set_dpdk_if_placement (vlib_main_t *vm, unformat_input_t *input,
       cpu >= (dm->input_cpu_first_index + dm->input_cpu_count))
     return clib_error_return (0, "please specify valid thread id");
 
-  hw = vnet_get_hw_interface (dm->vnet_main, hw_if_index);
-  xd = vec_elt_at_index (dm->devices, hw->dev_instance);
+  rv = dpdk_set_rx_queue_placement (hw_if_index, queue, cpu);
 
-  for(i = 0; i < vec_len(dm->devices_by_cpu); i++)
+  switch (rv)
     {
-      vec_foreach(dq, dm->devices_by_cpu[i])
-        {
-          if (hw_if_index == dm->devices[dq->device].vlib_hw_if_index &&
-              queue == dq->queue_id)
-            {
-              if (cpu == i) /* nothing to do */
-                return 0;
-
-              vec_del1(dm->devices_by_cpu[i], dq - dm->devices_by_cpu[i]);
-              vec_add2(dm->devices_by_cpu[cpu], dq, 1);
-              dq->queue_id = queue;
-              dq->device = xd->device_index;
-              xd->cpu_socket_id_by_queue[queue] =
-                rte_lcore_to_socket_id(vlib_worker_threads[cpu].dpdk_lcore_id);
-
-              vec_sort_with_function(dm->devices_by_cpu[i],
-                                     dpdk_device_queue_sort);
+    case 0:
+      break;
 
-              vec_sort_with_function(dm->devices_by_cpu[cpu],
-                                     dpdk_device_queue_sort);
+    case VNET_API_ERROR_NO_SUCH_ENTRY:
+      return clib_error_return (0, "not found");
 
-              if (vec_len(dm->devices_by_cpu[i]) == 0)
-                vlib_node_set_state (vlib_mains[i], dpdk_input_node.index,
-                                     VLIB_NODE_STATE_DISABLED);
-
-              if (vec_len(dm->devices_by_cpu[cpu]) == 1)
-                vlib_node_set_state (vlib_mains[cpu], dpdk_input_node.index,
-                                     VLIB_NODE_STATE_POLLING);
-
-              return 0;
-            }
-        }
+    default:
+      return clib_error_return (0, "dpdk_set_rx_queue_placement returned %d",
+                                rv);
     }
 
-  return clib_error_return (0, "not found");
+  return 0;
 }
 
 VLIB_CLI_COMMAND (cmd_set_dpdk_if_placement,static) = {
@@ -1055,6 +1011,177 @@ VLIB_CLI_COMMAND (cmd_set_dpdk_if_placement,static) = {
     .function = set_dpdk_if_placement,
 };
 
+static clib_error_t *
+set_dpdk_adaptive_polling (vlib_main_t * vm, unformat_input_t * input,
+                           vlib_cli_command_t * cmd)
+{
+  unformat_input_t _line_input, * line_input = &_line_input;
+  dpdk_main_t * dm = &dpdk_main;
+  u32 idle_poll_loops = dm->idle_poll_loops;
+  u32 max_sleep_usec = dm->max_sleep_usec;
+  u8 enable = dm->adaptive_polling;
+  int rv;
+
+  if (! unformat_user (input, unformat_line_input, line_input))
+    return 0;
+
+  while (unformat_check_input (line_input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (line_input, "on"))
+        enable = 1;
+      else if (unformat (line_input, "off"))
+        enable = 0;
+      else if (unformat (line_input, "idle-poll-loops %d", &idle_poll_loops))
+        ;
+      else if (unformat (line_input, "max-sleep-usec %d", &max_sleep_usec))
+        ;
+      else
+        return clib_error_return (0, "parse error: '%U'",
+                                  format_unformat_error, line_input);
+    }
+
+  unformat_free (line_input);
+
+  rv = dpdk_set_adaptive_polling (enable, idle_poll_loops, max_sleep_usec);
+  if (rv)
+    return clib_error_return (0, "max-sleep-usec must be %d..%d "
+                              "and idle-poll-loops non-zero",
+                              DPDK_MIN_SLEEP_USEC, DPDK_MAX_SLEEP_USEC);
+
+  return 0;
+}
+
+VLIB_CLI_COMMAND (cmd_set_dpdk_adaptive_polling,static) = {
+    .path = "set dpdk adaptive-polling",
+    .short_help = "set dpdk adaptive-polling [on|off] [idle-poll-loops <n>] "
+                  "[max-sleep-usec <n>]",
+    .function = set_dpdk_adaptive_polling,
+};
+
+static clib_error_t *
+show_dpdk_adaptive_polling (vlib_main_t * vm, unformat_input_t * input,
+                            vlib_cli_command_t * cmd)
+{
+  dpdk_main_t * dm = &dpdk_main;
+  dpdk_worker_t * dw;
+  u64 now = clib_cpu_time_now ();
+  f64 spc = vm->clib_time.seconds_per_clock;
+  u64 poll_clocks, total;
+  int i;
+
+  vlib_cli_output (vm, "adaptive polling %s, idle-poll-loops %d, "
+                   "max-sleep-usec %d",
+                   dm->adaptive_polling ? "on" : "off",
+                   dm->idle_poll_loops, dm->max_sleep_usec);
+
+  vlib_cli_output (vm, "%-7s%-14s%-14s%-9s%-12s%-12s",
+                   "Thread", "Polling(s)", "Sleeping(s)", "Asleep",
+                   "Sleeps", "Doorbells");
+
+  /* thread 0 runs the control plane and never sleeps here */
+  for (i = 1; i < vec_len (dm->workers); i++)
+    {
+      dw = vec_elt_at_index (dm->workers, i);
+
+      poll_clocks = dw->poll_clocks;
+      if (! dw->sleeping && dw->last_wakeup_time && now > dw->last_wakeup_time)
+        poll_clocks += now - dw->last_wakeup_time;
+
+      total = poll_clocks + dw->sleep_clocks;
+
+      vlib_cli_output (vm, "%-7d%-14.3f%-14.3f%-8.1f%%%-12lld%-12lld",
+                       i, poll_clocks * spc, dw->sleep_clocks * spc,
+                       total ? 100.0 * dw->sleep_clocks / total : 0.0,
+                       dw->n_sleeps, dw->n_doorbell_wakeups);
+    }
+
+  return 0;
+}
+
+VLIB_CLI_COMMAND (cmd_show_dpdk_adaptive_polling,static) = {
+    .path = "show dpdk adaptive-polling",
+    .short_help = "show dpdk adaptive-polling",
+    .function = show_dpdk_adaptive_polling,
+};
+
+static clib_error_t *
+set_dpdk_rx_balance (vlib_main_t * vm, unformat_input_t * input,
+                     vlib_cli_command_t * cmd)
+{
+  unformat_input_t _line_input, * line_input = &_line_input;
+  dpdk_main_t * dm = &dpdk_main;
+  f64 interval = dm->rx_balance_interval;
+  u32 threshold_pct = dm->rx_balance_threshold_pct;
+  int rv;
+
+  if (! unformat_user (input, unformat_line_input, line_input))
+    return 0;
+
+  while (unformat_check_input (line_input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (line_input, "off"))
+        interval = 0;
+      else if (unformat (line_input, "interval %f", &interval))
+        ;
+      else if (unformat (line_input, "threshold %d", &threshold_pct))
+        ;
+      else
+        return clib_error_return (0, "parse error: '%U'",
+                                  format_unformat_error, line_input);
+    }
+
+  unformat_free (line_input);
+
+  rv = dpdk_set_rx_balance (interval, threshold_pct);
+  if (rv)
+    return clib_error_return (0, "interval must be 0 (off) or >= %.1f, "
+                              "threshold 1..100",
+                              DPDK_RX_BALANCE_MIN_INTERVAL);
+
+  return 0;
+}
+
+VLIB_CLI_COMMAND (cmd_set_dpdk_rx_balance,static) = {
+    .path = "set dpdk rx-balance",
+    .short_help = "set dpdk rx-balance [off] [interval <sec>] "
+                  "[threshold <percent>]",
+    .function = set_dpdk_rx_balance,
+};
+
+static clib_error_t *
+show_dpdk_rx_balance (vlib_main_t * vm, unformat_input_t * input,
+                      vlib_cli_command_t * cmd)
+{
+  dpdk_main_t * dm = &dpdk_main;
+  f64 spc = vm->clib_time.seconds_per_clock;
+  int i;
+
+  if (dm->rx_balance_interval > 0)
+    vlib_cli_output (vm, "rx-balance every %.1fs, threshold %d%%, "
+                     "%lld queues moved", dm->rx_balance_interval,
+                     dm->rx_balance_threshold_pct, dm->rx_balance_moves);
+  else
+    vlib_cli_output (vm, "rx-balance off, %lld queues moved",
+                     dm->rx_balance_moves);
+
+  vlib_cli_output (vm, "%-7s%-14s%-8s", "Thread", "Busy(s)", "Queues");
+
+  for (i = dm->input_cpu_first_index;
+       i < dm->input_cpu_first_index + dm->input_cpu_count &&
+         i < vec_len (dm->workers); i++)
+    vlib_cli_output (vm, "%-7d%-14.3f%-8d", i,
+                     dm->workers[i].busy_clocks * spc,
+                     vec_len (dm->devices_by_cpu[i]));
+
+  return 0;
+}
+
+VLIB_CLI_COMMAND (cmd_show_dpdk_rx_balance,static) = {
+    .path = "show dpdk rx-balance",
+    .short_help = "show dpdk rx-balance",
+    .function = show_dpdk_rx_balance,
+};
+
 clib_error_t *
 dpdk_cli_init (vlib_main_t * vm)
 {
@@ -27,8 +27,7 @@
 #define foreach_dpdk_tx_func_error			\
   _(BAD_RETVAL, "DPDK tx function returned an error")	\
   _(RING_FULL, "Tx packet drops (ring full)")	        \
-  _(PKT_DROP, "Tx packet drops (dpdk tx failure)")	\
-  _(REPL_FAIL, "Tx packet drops (replication failure)")
+  _(PKT_DROP, "Tx packet drops (dpdk tx failure)")
 
 typedef enum {
 #define _(f,s) DPDK_TX_FUNC_ERROR_##f,
@@ -77,144 +76,6 @@ dpdk_set_mc_filter (vnet_hw_interface_t * hi,
   }
 }
 
-struct rte_mbuf * dpdk_replicate_packet_mb (vlib_buffer_t * b)
-{
-  vlib_main_t * vm = vlib_get_main();
-  vlib_buffer_main_t * bm = vm->buffer_main;
-  struct rte_mbuf * first_mb = 0, * new_mb, * pkt_mb, ** prev_mb_next = 0;
-  u8 nb_segs, nb_segs_left;
-  u32 copy_bytes;
-  unsigned socket_id = rte_socket_id();
-
-  ASSERT (bm->pktmbuf_pools[socket_id]);
-  pkt_mb = rte_mbuf_from_vlib_buffer(b);
-  nb_segs = pkt_mb->nb_segs;
-  for (nb_segs_left = nb_segs; nb_segs_left; nb_segs_left--)
-    {
-      if (PREDICT_FALSE(pkt_mb == 0))
-	{
-	  clib_warning ("Missing %d mbuf chain segment(s):   "
-			"(nb_segs = %d, nb_segs_left = %d)!",
-			nb_segs - nb_segs_left, nb_segs, nb_segs_left);
-	  if (first_mb)
-	    rte_pktmbuf_free(first_mb);
-	  return NULL;
-	}
-      new_mb = rte_pktmbuf_alloc (bm->pktmbuf_pools[socket_id]);
-      if (PREDICT_FALSE(new_mb == 0))
-	{
-	  if (first_mb)
-	    rte_pktmbuf_free(first_mb);
-	  return NULL;
-	}
-      
-      /*
-       * Copy packet info into 1st segment.
-       */
-      if (first_mb == 0)
-	{
-	  first_mb = new_mb;
-	  rte_pktmbuf_pkt_len (first_mb) = pkt_mb->pkt_len;
-	  first_mb->nb_segs = pkt_mb->nb_segs;
-	  first_mb->port = pkt_mb->port;
-#ifdef DAW_FIXME // TX Offload support TBD
-	  first_mb->vlan_macip = pkt_mb->vlan_macip;
-	  first_mb->hash = pkt_mb->hash;
-	  first_mb->ol_flags = pkt_mb->ol_flags
-#endif
-	}
-      else
-	{
-	  ASSERT(prev_mb_next != 0);
-	  *prev_mb_next = new_mb;
-	}
-      
-      /*
-       * Copy packet segment data into new mbuf segment.
-       */
-      rte_pktmbuf_data_len (new_mb) = pkt_mb->data_len;
-      copy_bytes = pkt_mb->data_len + RTE_PKTMBUF_HEADROOM;
-      ASSERT(copy_bytes <= pkt_mb->buf_len);
-      clib_memcpy(new_mb->buf_addr, pkt_mb->buf_addr, copy_bytes);
-
-      prev_mb_next = &new_mb->next;
-      pkt_mb = pkt_mb->next;
-    }
-
-  ASSERT(pkt_mb == 0);
-  __rte_mbuf_sanity_check(first_mb, 1);
-
-  return first_mb;
-}
-
-struct rte_mbuf * dpdk_zerocopy_replicate_packet_mb (vlib_buffer_t * b)
-{
-  vlib_main_t * vm = vlib_get_main();
-  vlib_buffer_main_t * bm = vm->buffer_main;
-  struct rte_mbuf * first_mb = 0, * new_mb, * pkt_mb, ** prev_mb_next = 0;
-  u8 nb_segs, nb_segs_left;
-  unsigned socket_id = rte_socket_id();
-
-  ASSERT (bm->pktmbuf_pools[socket_id]);
-  pkt_mb = rte_mbuf_from_vlib_buffer(b);
-  nb_segs = pkt_mb->nb_segs;
-  for (nb_segs_left = nb_segs; nb_segs_left; nb_segs_left--)
-    {
-      if (PREDICT_FALSE(pkt_mb == 0))
-	{
-	  clib_warning ("Missing %d mbuf chain segment(s):   "
-			"(nb_segs = %d, nb_segs_left = %d)!",
-			nb_segs - nb_segs_left, nb_segs, nb_segs_left);
-	  if (first_mb)
-	    rte_pktmbuf_free(first_mb);
-	  return NULL;
-	}
-      new_mb = rte_pktmbuf_clone(pkt_mb, bm->pktmbuf_pools[socket_id]);
-      if (PREDICT_FALSE(new_mb == 0))
-	{
-	  if (first_mb)
-	    rte_pktmbuf_free(first_mb);
-	  return NULL;
-	}
-      
-      /*
-       * Copy packet info into 1st segment.
-       */
-      if (first_mb == 0)
-	{
-	  first_mb = new_mb;
-	  rte_pktmbuf_pkt_len (first_mb) = pkt_mb->pkt_len;
-	  first_mb->nb_segs = pkt_mb->nb_segs;
-	  first_mb->port = pkt_mb->port;
-#ifdef DAW_FIXME // TX Offload support TBD
-	  first_mb->vlan_macip = pkt_mb->vlan_macip;
-	  first_mb->hash = pkt_mb->hash;
-	  first_mb->ol_flags = pkt_mb->ol_flags
-#endif
-	}
-      else
-	{
-	  ASSERT(prev_mb_next != 0);
-	  *prev_mb_next = new_mb;
-	}
-      
-      /*
-       * Copy packet segment data into new mbuf segment.
-       */
-      rte_pktmbuf_data_len (new_mb) = pkt_mb->data_len;
-
-      prev_mb_next = &new_mb->next;
-      pkt_mb = pkt_mb->next;
-    }
-
-  ASSERT(pkt_mb == 0);
-  __rte_mbuf_sanity_check(first_mb, 1);
-
-  return first_mb;
-
-
-}
-
 static void
 dpdk_tx_trace_buffer (dpdk_main_t * dm,
 		      vlib_node_runtime_t * node,
@@ -647,7 +508,6 @@ dpdk_interface_tx (vlib_main_t * vm,
       i16 delta0, delta1;
       u16 new_data_len0, new_data_len1;
       u16 new_pkt_len0, new_pkt_len1;
-      u32 any_clone;
 
       pi0 = from[2];
       pi1 = from[3];
@@ -672,41 +532,8 @@ dpdk_interface_tx (vlib_main_t * vm,
       mb0 = rte_mbuf_from_vlib_buffer(b0);
       mb1 = rte_mbuf_from_vlib_buffer(b1);
 
-      any_clone = b0->clone_count | b1->clone_count;
-      if (PREDICT_FALSE(any_clone != 0))
-        {
-          if (PREDICT_FALSE(b0->clone_count != 0))
-	    {
-	      struct rte_mbuf * mb0_new = dpdk_replicate_packet_mb (b0);
-	      if (PREDICT_FALSE(mb0_new == 0))
-		{
-		  vlib_error_count (vm, node->node_index,
-				    DPDK_TX_FUNC_ERROR_REPL_FAIL, 1);
-		  b0->flags |= VLIB_BUFFER_REPL_FAIL;
-		}
-	      else
-		mb0 = mb0_new;
-	      vec_add1 (dm->recycle[my_cpu], bi0);
-	    }
-          if (PREDICT_FALSE(b1->clone_count != 0))
-	    {
-	      struct rte_mbuf * mb1_new = dpdk_replicate_packet_mb (b1);
-	      if (PREDICT_FALSE(mb1_new == 0))
-		{
-		  vlib_error_count (vm, node->node_index,
-				    DPDK_TX_FUNC_ERROR_REPL_FAIL, 1);
-		  b1->flags |= VLIB_BUFFER_REPL_FAIL;
-		}
-	      else
-		mb1 = mb1_new;
-	      vec_add1 (dm->recycle[my_cpu], bi1);
-	    }
-	}
-
-      delta0 = PREDICT_FALSE(b0->flags & VLIB_BUFFER_REPL_FAIL) ? 0 :
-	vlib_buffer_length_in_chain (vm, b0) - (i16) mb0->pkt_len;
-      delta1 = PREDICT_FALSE(b1->flags & VLIB_BUFFER_REPL_FAIL) ? 0 :
-	vlib_buffer_length_in_chain (vm, b1) - (i16) mb1->pkt_len;
+      delta0 = vlib_buffer_length_in_chain (vm, b0) - (i16) mb0->pkt_len;
+      delta1 = vlib_buffer_length_in_chain (vm, b1) - (i16) mb1->pkt_len;
       
       new_data_len0 = (u16)((i16) mb0->data_len + delta0);
       new_data_len1 = (u16)((i16) mb1->data_len + delta1);
@@ -720,10 +547,8 @@ dpdk_interface_tx (vlib_main_t * vm,
       mb0->pkt_len = new_pkt_len0;
       mb1->pkt_len = new_pkt_len1;
 
-      mb0->data_off = (PREDICT_FALSE(b0->flags & VLIB_BUFFER_REPL_FAIL)) ?
-	mb0->data_off : (u16)(RTE_PKTMBUF_HEADROOM + b0->current_data);
-      mb1->data_off = (PREDICT_FALSE(b1->flags & VLIB_BUFFER_REPL_FAIL)) ?
-	mb1->data_off : (u16)(RTE_PKTMBUF_HEADROOM + b1->current_data);
+      mb0->data_off = (u16)(RTE_PKTMBUF_HEADROOM + b0->current_data);
+      mb1->data_off = (u16)(RTE_PKTMBUF_HEADROOM + b1->current_data);
 
       if (PREDICT_FALSE(node->flags & VLIB_NODE_FLAG_TRACE))
 	{
@@ -733,28 +558,11 @@ dpdk_interface_tx (vlib_main_t * vm,
 	    dpdk_tx_trace_buffer (dm, node, xd, queue_id, bi1, b1);
 	}
 
-      if (PREDICT_TRUE(any_clone == 0))
-        {
-	  tx_vector[i % DPDK_TX_RING_SIZE] = mb0;
-          i++;
-	  tx_vector[i % DPDK_TX_RING_SIZE] = mb1;
-          i++;
-        }
-      else
-        {
-          /* cloning was done, need to check for failure */
-          if (PREDICT_TRUE((b0->flags & VLIB_BUFFER_REPL_FAIL) == 0))
-            {
-	      tx_vector[i % DPDK_TX_RING_SIZE] = mb0;
-              i++;
-            }
-          if (PREDICT_TRUE((b1->flags & VLIB_BUFFER_REPL_FAIL) == 0))
-            {
-	      tx_vector[i % DPDK_TX_RING_SIZE] = mb1;
-              i++;
-            }
-        }
-      
+      tx_vector[i % DPDK_TX_RING_SIZE] = mb0;
+      i++;
+      tx_vector[i % DPDK_TX_RING_SIZE] = mb1;
+      i++;
+
       n_left -= 2;
     }
   while (n_left > 0)
@@ -772,22 +580,8 @@ dpdk_interface_tx (vlib_main_t * vm,
       b0 = vlib_get_buffer (vm, bi0);
 
       mb0 = rte_mbuf_from_vlib_buffer(b0);
-      if (PREDICT_FALSE(b0->clone_count != 0))
-	{
-	  struct rte_mbuf * mb0_new = dpdk_replicate_packet_mb (b0);
-	  if (PREDICT_FALSE(mb0_new == 0))
-	    {
-	      vlib_error_count (vm, node->node_index,
-				DPDK_TX_FUNC_ERROR_REPL_FAIL, 1);
-	      b0->flags |= VLIB_BUFFER_REPL_FAIL;
-	    }
-	  else
-	    mb0 = mb0_new;
-	  vec_add1 (dm->recycle[my_cpu], bi0);
-	}
 
-      delta0 = PREDICT_FALSE(b0->flags & VLIB_BUFFER_REPL_FAIL) ? 0 :
-	vlib_buffer_length_in_chain (vm, b0) - (i16) mb0->pkt_len;
+      delta0 = vlib_buffer_length_in_chain (vm, b0) - (i16) mb0->pkt_len;
       
       new_data_len0 = (u16)((i16) mb0->data_len + delta0);
       new_pkt_len0 = (u16)((i16) mb0->pkt_len + delta0);
@@ -795,18 +589,14 @@ dpdk_interface_tx (vlib_main_t * vm,
       b0->current_length = new_data_len0;
       mb0->data_len = new_data_len0;
       mb0->pkt_len = new_pkt_len0;
-      mb0->data_off = (PREDICT_FALSE(b0->flags & VLIB_BUFFER_REPL_FAIL)) ?
-	mb0->data_off : (u16)(RTE_PKTMBUF_HEADROOM + b0->current_data);
+      mb0->data_off = (u16)(RTE_PKTMBUF_HEADROOM + b0->current_data);
 
       if (PREDICT_FALSE(node->flags & VLIB_NODE_FLAG_TRACE))
 	if (b0->flags & VLIB_BUFFER_IS_TRACED)
 	  dpdk_tx_trace_buffer (dm, node, xd, queue_id, bi0, b0);
 
-      if (PREDICT_TRUE((b0->flags & VLIB_BUFFER_REPL_FAIL) == 0))
-        {
-	  tx_vector[i % DPDK_TX_RING_SIZE] = mb0;
-          i++;
-        }
+      tx_vector[i % DPDK_TX_RING_SIZE] = mb0;
+      i++;
       n_left--;
     }
 
@@ -862,13 +652,6 @@ dpdk_interface_tx (vlib_main_t * vm,
       ring->tx_tail = 0;
     }
 
-  /* Recycle replicated buffers */
-  if (PREDICT_FALSE(vec_len(dm->recycle[my_cpu])))
-    {
-      vlib_buffer_free (vm, dm->recycle[my_cpu], vec_len(dm->recycle[my_cpu]));
-      _vec_len(dm->recycle[my_cpu]) = 0;
-    }
-
   ASSERT(ring->tx_head >= ring->tx_tail);
 
   return tx_pkts;
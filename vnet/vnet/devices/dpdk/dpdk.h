@@ -52,6 +52,8 @@
 #include <rte_version.h>
 #include <rte_eth_bond.h>
 
+#include <sys/eventfd.h>
+
 #include <vnet/unix/pcap.h>
 #include <vnet/devices/virtio/vhost-user.h>
 
@@ -279,18 +281,54 @@ typedef struct {
 #define DPDK_LINK_POLL_INTERVAL       (3.0)
 #define DPDK_MIN_LINK_POLL_INTERVAL   (0.001) /* 1msec */
 
+/* Adaptive polling defaults, see dpdk_worker_idle */
+#define DPDK_IDLE_POLL_LOOPS_DEFAULT   (1 << 12)
+#define DPDK_MIN_SLEEP_USEC            (10)
+#define DPDK_MAX_SLEEP_USEC_DEFAULT    (1000)
+/* Keep well clear of BARRIER_SYNC_TIMEOUT */
+#define DPDK_MAX_SLEEP_USEC            (10000)
+
 typedef struct {
   CLIB_CACHE_LINE_ALIGN_MARK(cacheline0);
 
   /* total input packet counter */
   u64 aggregate_rx_packets;
+
+  /* adaptive polling: main loops in a row without a vector */
+  u32 idle_loops;
+
+  /* next sleep, doubles up to dm->max_sleep_usec while idle */
+  u32 sleep_usec;
+
+  /* eventfd, rung by handoff enqueues while the worker sleeps */
+  int doorbell_fd;
+  volatile u32 sleeping;
+
+  /* polling vs sleeping, in cpu clocks */
+  u64 poll_clocks;
+  u64 sleep_clocks;
+  u64 last_wakeup_time;
+  u64 n_sleeps;
+  u64 n_doorbell_wakeups;
+
+  /* clocks spent in main loops which processed at least one vector */
+  u64 busy_clocks;
 } dpdk_worker_t;
 
 typedef struct {
   u32 device;
   u16 queue_id;
+
+  /* packets received, only written by the worker polling this queue */
+  u64 rx_packets;
+
+  /* rx_packets at the last rx-balance sample, main thread only */
+  u64 rx_packets_last;
 } dpdk_device_and_queue_t;
 
+#define DPDK_RX_BALANCE_MIN_INTERVAL           (1.0)
+#define DPDK_RX_BALANCE_THRESHOLD_PCT_DEFAULT  (20)
+
 /* Early-Fast-Discard (EFD) */
 #define DPDK_EFD_DISABLED                       0
 #define DPDK_EFD_DISCARD_ENABLED                (1 << 0)
@@ -313,9 +351,6 @@ typedef struct {
   dpdk_device_t * devices;
   dpdk_device_and_queue_t ** devices_by_cpu;
 
-  /* per-thread recycle lists */
-  u32 ** recycle;
-
   /* buffer flags template, configurable to enable/disable tcp / udp cksum */
   u32 buffer_flags_template;
 
@@ -400,6 +435,16 @@ typedef struct {
   f64 link_state_poll_interval;
   f64 stat_poll_interval;
 
+  /* adaptive polling: workers sleep when idle, 0 = always busy poll */
+  u8 adaptive_polling;
+  u32 idle_poll_loops;
+  u32 max_sleep_usec;
+
+  /* rx queue auto-balancing, 0 interval = disabled */
+  f64 rx_balance_interval;
+  u32 rx_balance_threshold_pct;
+  u64 rx_balance_moves;
+
   /* for frame queue tracing */
   frame_queue_trace_t        *frame_queue_traces;
   frame_queue_nelt_counter_t *frame_queue_histogram;
@@ -464,13 +509,30 @@ u32 dpdk_interface_tx_vector (vlib_main_t * vm, u32 dev_instance);
 
 vlib_frame_queue_elt_t * vlib_get_handoff_queue_elt (u32 vlib_worker_index);
 
+/* Wake a worker sleeping in dpdk_worker_idle, after queueing work for it */
+always_inline void
+dpdk_worker_wakeup (dpdk_main_t * dm, u32 cpu_index)
+{
+  dpdk_worker_t * dw = vec_elt_at_index (dm->workers, cpu_index);
+
+  /* Pairs with the barrier after dw->sleeping is set */
+  CLIB_MEMORY_BARRIER();
+  if (PREDICT_FALSE (dw->sleeping))
+    eventfd_write (dw->doorbell_fd, (eventfd_t) 1);
+}
+
+void dpdk_worker_wakeup_all (void);
+
+int dpdk_set_adaptive_polling (u8 enable, u32 idle_poll_loops,
+                               u32 max_sleep_usec);
+
+int dpdk_set_rx_queue_placement (u32 hw_if_index, u16 queue, u32 cpu);
+int dpdk_set_rx_balance (f64 interval, u32 threshold_pct);
+
 u32 dpdk_get_handoff_node_index (void);
 
 void set_efd_bitmap (u8 *bitmap, u32 value, u32 op);
 
-struct rte_mbuf * dpdk_replicate_packet_mb (vlib_buffer_t * b);
-struct rte_mbuf * dpdk_zerocopy_replicate_packet_mb (vlib_buffer_t * b);
-
 #define foreach_dpdk_error						\
   _(NONE, "no error")							\
   _(RX_PACKET_ERROR, "Rx packet errors")				\
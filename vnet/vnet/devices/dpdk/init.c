@@ -275,6 +275,15 @@ dpdk_lib_init (dpdk_main_t * dm)
   vec_validate_aligned (dm->workers, tm->n_vlib_mains - 1,
                         CLIB_CACHE_LINE_BYTES);
 
+  /* Doorbells for adaptive polling, see dpdk_worker_idle */
+  for (i = 0; i < vec_len (dm->workers); i++)
+    {
+      dm->workers[i].doorbell_fd = eventfd (0, EFD_NONBLOCK);
+      if (dm->workers[i].doorbell_fd < 0)
+        return clib_error_return_unix (0, "eventfd");
+    }
+  tm->worker_wakeup_fn = dpdk_worker_wakeup_all;
+
 #ifdef NETMAP
   if(rte_netmap_probe() < 0)
     return clib_error_return (0, "rte netmap probe failed");
@@ -481,6 +490,10 @@ dpdk_lib_init (dpdk_main_t * dm)
 
       }
 
+      /* Replicated packets must not share a payload segment here */
+      if (xd->tx_conf.txq_flags & ETH_TXQ_FLAGS_NOMULTSEGS)
+        vm->buffer_main->no_multi_seg_tx = 1;
+
       /*
        * Ensure default mtu is not > the mtu read from the hardware.
        * Otherwise rte_eth_dev_configure() will fail and the port will
@@ -567,6 +580,7 @@ dpdk_lib_init (dpdk_main_t * dm)
           vec_add2(dm->devices_by_cpu[cpu], dq, 1);
           dq->device = xd->device_index;
           dq->queue_id = q;
+          dq->rx_packets = dq->rx_packets_last = 0;
 
           next_cpu++;
           if (next_cpu == dm->input_cpu_count)
@@ -678,6 +692,7 @@ dpdk_lib_init (dpdk_main_t * dm)
       vec_add2(dm->devices_by_cpu[dm->input_cpu_first_index], dq, 1);
       dq->device = xd->device_index;
       dq->queue_id = 0;
+      dq->rx_packets = dq->rx_packets_last = 0;
 
       vec_validate_aligned (xd->tx_vectors, tm->n_vlib_mains,
                             CLIB_CACHE_LINE_BYTES);
@@ -904,6 +919,18 @@ dpdk_config (vlib_main_t * vm, unformat_input_t * input)
         dm->use_virtio_vhost = 0;
       else if (unformat (input, "rss %d", &dm->use_rss))
         ;
+      else if (unformat (input, "adaptive-polling"))
+        dm->adaptive_polling = 1;
+      else if (unformat (input, "idle-poll-loops %d", &dm->idle_poll_loops))
+        ;
+      else if (unformat (input, "max-sleep-usec %d", &dm->max_sleep_usec))
+        ;
+      else if (unformat (input, "rx-balance-interval %f",
+                         &dm->rx_balance_interval))
+        ;
+      else if (unformat (input, "rx-balance-threshold %d",
+                         &dm->rx_balance_threshold_pct))
+        ;
 
 #define _(a)                                    \
       else if (unformat(input, #a))             \
@@ -965,6 +992,27 @@ dpdk_config (vlib_main_t * vm, unformat_input_t * input)
 	    }
     }
 
+  if (dpdk_set_adaptive_polling (dm->adaptive_polling, dm->idle_poll_loops,
+                                 dm->max_sleep_usec))
+    {
+      error = clib_error_return (0, "max-sleep-usec must be %d..%d "
+                                 "and idle-poll-loops non-zero",
+                                 DPDK_MIN_SLEEP_USEC, DPDK_MAX_SLEEP_USEC);
+      goto done;
+    }
+
+  /* Same limits as dpdk_set_rx_balance, the process is not up yet */
+  if ((dm->rx_balance_interval != 0
+       && dm->rx_balance_interval < DPDK_RX_BALANCE_MIN_INTERVAL)
+      || dm->rx_balance_threshold_pct == 0
+      || dm->rx_balance_threshold_pct > 100)
+    {
+      error = clib_error_return (0, "rx-balance-interval must be 0 (off) or "
+                                 ">= %.1f, rx-balance-threshold 1..100",
+                                 DPDK_RX_BALANCE_MIN_INTERVAL);
+      goto done;
+    }
+
   if (!dm->uio_driver_name)
     dm->uio_driver_name = format (0, "igb_uio%c", 0);
 
@@ -1550,6 +1598,279 @@ int dpdk_set_link_state_poll_interval (f64 interval)
   return 0;
 }
 
+int dpdk_set_adaptive_polling (u8 enable, u32 idle_poll_loops,
+                               u32 max_sleep_usec)
+{
+  if (idle_poll_loops == 0 || max_sleep_usec < DPDK_MIN_SLEEP_USEC
+      || max_sleep_usec > DPDK_MAX_SLEEP_USEC)
+      return (VNET_API_ERROR_INVALID_VALUE);
+
+  dpdk_main.idle_poll_loops = idle_poll_loops;
+  dpdk_main.max_sleep_usec = max_sleep_usec;
+  dpdk_main.adaptive_polling = enable;
+
+  return 0;
+}
+
+static int
+dpdk_device_queue_sort (void * a1, void * a2)
+{
+  dpdk_device_and_queue_t * dq1 = a1;
+  dpdk_device_and_queue_t * dq2 = a2;
+
+  if (dq1->device > dq2->device)
+    return 1;
+  else if (dq1->device < dq2->device)
+    return -1;
+  else if (dq1->queue_id > dq2->queue_id)
+    return 1;
+  else if (dq1->queue_id < dq2->queue_id)
+    return -1;
+  else
+    return 0;
+}
+
+/* Carry the per-queue counters over from a vector about to be retired */
+static void
+dpdk_device_queue_copy_counters (dpdk_device_and_queue_t * dst,
+                                 dpdk_device_and_queue_t * src)
+{
+  dpdk_device_and_queue_t * d, * s;
+
+  vec_foreach (d, dst)
+    vec_foreach (s, src)
+      if (d->device == s->device && d->queue_id == s->queue_id)
+        {
+          d->rx_packets = s->rx_packets;
+          d->rx_packets_last = s->rx_packets_last;
+        }
+}
+
+/*
+ * Move an rx queue to another worker.  The new per-cpu (device, queue)
+ * vectors are built off to the side; the workers are only stopped to
+ * swap them in.
+ */
+int dpdk_set_rx_queue_placement (u32 hw_if_index, u16 queue, u32 cpu)
+{
+  dpdk_main_t * dm = &dpdk_main;
+  vnet_main_t * vnm = dm->vnet_main;
+  vlib_main_t * vm = vlib_get_main();
+  dpdk_device_and_queue_t * dq, * from, * to, * old_from, * old_to;
+  dpdk_device_and_queue_t moved = { 0 };
+  vnet_hw_interface_t * hw;
+  dpdk_device_t * xd;
+  u32 i, from_cpu = ~0;
+
+  if (pool_is_free_index (vnm->interface_main.hw_interfaces, hw_if_index))
+    return VNET_API_ERROR_INVALID_SW_IF_INDEX;
+
+  hw = vnet_get_hw_interface (vnm, hw_if_index);
+  if (hw->dev_class_index != dpdk_device_class.index)
+    return VNET_API_ERROR_INVALID_INTERFACE;
+
+  if (dm->have_io_threads ||
+      cpu < dm->input_cpu_first_index ||
+      cpu >= (dm->input_cpu_first_index + dm->input_cpu_count))
+    return VNET_API_ERROR_INVALID_VALUE;
+
+  xd = vec_elt_at_index (dm->devices, hw->dev_instance);
+
+  for (i = 0; i < vec_len (dm->devices_by_cpu) && from_cpu == ~0; i++)
+    vec_foreach (dq, dm->devices_by_cpu[i])
+      if (dq->device == xd->device_index && dq->queue_id == queue)
+        {
+          from_cpu = i;
+          moved = dq[0];
+          break;
+        }
+
+  if (from_cpu == ~0)
+    return VNET_API_ERROR_NO_SUCH_ENTRY;
+
+  if (from_cpu == cpu) /* nothing to do */
+    return 0;
+
+  from = vec_dup (dm->devices_by_cpu[from_cpu]);
+  for (i = 0; i < vec_len (from); i++)
+    if (from[i].device == moved.device && from[i].queue_id == moved.queue_id)
+      {
+        vec_delete (from, 1, i);
+        break;
+      }
+
+  to = vec_dup (dm->devices_by_cpu[cpu]);
+  vec_add1 (to, moved);
+  vec_sort_with_function (to, dpdk_device_queue_sort);
+
+  vlib_worker_thread_barrier_sync (vm);
+
+  old_from = dm->devices_by_cpu[from_cpu];
+  old_to = dm->devices_by_cpu[cpu];
+
+  /* Pick up whatever was counted since the copies were taken */
+  dpdk_device_queue_copy_counters (from, old_from);
+  dpdk_device_queue_copy_counters (to, old_from);
+  dpdk_device_queue_copy_counters (to, old_to);
+
+  dm->devices_by_cpu[from_cpu] = from;
+  dm->devices_by_cpu[cpu] = to;
+
+  xd->cpu_socket_id_by_queue[queue] =
+    rte_lcore_to_socket_id (vlib_worker_threads[cpu].dpdk_lcore_id);
+
+  if (vec_len (from) == 0)
+    vlib_node_set_state (vlib_mains[from_cpu], dpdk_input_node.index,
+                         VLIB_NODE_STATE_DISABLED);
+
+  if (vec_len (to) == 1)
+    vlib_node_set_state (vlib_mains[cpu], dpdk_input_node.index,
+                         VLIB_NODE_STATE_POLLING);
+
+  vlib_worker_thread_barrier_release (vm);
+
+  vec_free (old_from);
+  vec_free (old_to);
+
+  return 0;
+}
+
+static uword
+dpdk_rx_balance_process (vlib_main_t * vm,
+                         vlib_node_runtime_t * rt,
+                         vlib_frame_t * f)
+{
+  dpdk_main_t * dm = &dpdk_main;
+  dpdk_device_and_queue_t * dq, * best;
+  u64 * busy_clocks_last = 0;
+  f64 * load = 0;
+  f64 last_time = 0, now, dt, gap, share, new_gap, best_gap;
+  u64 n_packets;
+  u32 i, lo, hi;
+  uword * event_data = 0;
+
+  while (1)
+    {
+      if (dm->rx_balance_interval > 0)
+        vlib_process_wait_for_event_or_clock (vm, dm->rx_balance_interval);
+      else
+        vlib_process_wait_for_event (vm);
+
+      vlib_process_get_events (vm, &event_data);
+      vec_reset_length (event_data);
+
+      /*
+       * Only worker threads polling their own queues can be balanced;
+       * wait for dpdk-process to place the queues in the first place.
+       */
+      if (dm->rx_balance_interval <= 0 || dm->io_thread_release == 0 ||
+          dm->have_io_threads || dm->input_cpu_count < 2)
+        {
+          last_time = 0;
+          continue;
+        }
+
+      now = vlib_time_now (vm);
+      dt = now - last_time;
+      lo = hi = dm->input_cpu_first_index;
+
+      /* Share of each worker's time spent on main loops with work */
+      vec_validate (busy_clocks_last, vec_len (dm->workers) - 1);
+      vec_validate (load, vec_len (dm->workers) - 1);
+      for (i = dm->input_cpu_first_index;
+           i < dm->input_cpu_first_index + dm->input_cpu_count; i++)
+        {
+          u64 busy = dm->workers[i].busy_clocks;
+
+          load[i] = (busy - busy_clocks_last[i]) /
+            (dt * vm->clib_time.clocks_per_second);
+          busy_clocks_last[i] = busy;
+
+          if (load[i] > load[hi])
+            hi = i;
+          if (load[i] < load[lo])
+            lo = i;
+        }
+
+      /* The first pass only takes the samples */
+      if (last_time == 0)
+        {
+          last_time = now;
+          for (i = 0; i < vec_len (dm->devices_by_cpu); i++)
+            vec_foreach (dq, dm->devices_by_cpu[i])
+              dq->rx_packets_last = dq->rx_packets;
+          continue;
+        }
+      last_time = now;
+
+      /*
+       * Split the busiest worker's load across its queues by packet
+       * rate, i.e. its clocks per packet times each queue's packets,
+       * and move the one queue that best evens out the busiest and
+       * idlest workers.  One move per interval, so the next sample
+       * sees its effect.  A single queue which is heavier than the gap
+       * stays put; RSS has to split it, not us.
+       */
+      n_packets = 0;
+      vec_foreach (dq, dm->devices_by_cpu[hi])
+        n_packets += dq->rx_packets - dq->rx_packets_last;
+
+      gap = load[hi] - load[lo];
+      best = 0;
+      best_gap = gap;
+
+      if (gap * 100 >= dm->rx_balance_threshold_pct && n_packets > 0 &&
+          vec_len (dm->devices_by_cpu[hi]) > 1)
+        vec_foreach (dq, dm->devices_by_cpu[hi])
+          {
+            share = load[hi] * (dq->rx_packets - dq->rx_packets_last)
+              / n_packets;
+            new_gap = gap > 2 * share ? gap - 2 * share : 2 * share - gap;
+            if (new_gap < best_gap)
+              {
+                best_gap = new_gap;
+                best = dq;
+              }
+          }
+
+      if (best)
+        {
+          dpdk_device_t * xd = vec_elt_at_index (dm->devices, best->device);
+
+          if (dpdk_set_rx_queue_placement (xd->vlib_hw_if_index,
+                                           best->queue_id, lo) == 0)
+            dm->rx_balance_moves++;
+        }
+
+      for (i = 0; i < vec_len (dm->devices_by_cpu); i++)
+        vec_foreach (dq, dm->devices_by_cpu[i])
+          dq->rx_packets_last = dq->rx_packets;
+    }
+
+  return 0;
+}
+
+VLIB_REGISTER_NODE (dpdk_rx_balance_node,static) = {
+    .function = dpdk_rx_balance_process,
+    .type = VLIB_NODE_TYPE_PROCESS,
+    .name = "dpdk-rx-balance",
+};
+
+int dpdk_set_rx_balance (f64 interval, u32 threshold_pct)
+{
+  if ((interval != 0 && interval < DPDK_RX_BALANCE_MIN_INTERVAL)
+      || threshold_pct == 0 || threshold_pct > 100)
+      return (VNET_API_ERROR_INVALID_VALUE);
+
+  dpdk_main.rx_balance_interval = interval;
+  dpdk_main.rx_balance_threshold_pct = threshold_pct;
+
+  /* kick the process so a new interval takes effect now */
+  vlib_process_signal_event (vlib_get_main(), dpdk_rx_balance_node.index,
+                             0, 0);
+  return 0;
+}
+
 clib_error_t *
 dpdk_init (vlib_main_t * vm)
 {
@@ -1581,9 +1902,6 @@ dpdk_init (vlib_main_t * vm)
   dm->vu_sw_if_index_by_listener_fd = hash_create (0, sizeof (uword));
   dm->vu_sw_if_index_by_sock_fd = hash_create (0, sizeof (uword));
 
-  /* $$$ use n_thread_stacks since it's known-good at this point */
-  vec_validate (dm->recycle, tm->n_thread_stacks - 1);
-
   /* initialize EFD (early fast discard) default settings */
   dm->efd.enabled = DPDK_EFD_DISABLED;
   dm->efd.queue_hi_thresh = ((DPDK_EFD_DEFAULT_DEVICE_QUEUE_HI_THRESH_PCT *
@@ -1604,6 +1922,13 @@ dpdk_init (vlib_main_t * vm)
   dm->stat_poll_interval = DPDK_STATS_POLL_INTERVAL;
   dm->link_state_poll_interval = DPDK_LINK_POLL_INTERVAL;
 
+  /* adaptive polling is off until configured */
+  dm->idle_poll_loops = DPDK_IDLE_POLL_LOOPS_DEFAULT;
+  dm->max_sleep_usec = DPDK_MAX_SLEEP_USEC_DEFAULT;
+
+  /* rx queue balancing is off until an interval is configured */
+  dm->rx_balance_threshold_pct = DPDK_RX_BALANCE_THRESHOLD_PCT_DEFAULT;
+
   /* init CLI */
   if ((error = vlib_call_init_function (vm, dpdk_cli_init)))
     return error;
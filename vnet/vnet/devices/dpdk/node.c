@@ -20,6 +20,7 @@
 
 #include <vnet/ethernet/ethernet.h>
 #include <vnet/devices/dpdk/dpdk.h>
+#include <vnet/unix/pcap_capture.h>
 #include <vnet/classify/vnet_classify.h>
 #include <vnet/mpls-gre/packet.h>
 
@@ -725,6 +726,9 @@ static inline u32 dpdk_device_input ( dpdk_main_t * dm,
            */
           VLIB_BUFFER_TRACE_TRAJECTORY_INIT(b0);
 
+          if (PREDICT_FALSE (pcap_capture_main.flags & PCAP_CAPTURE_F_RX))
+            pcap_capture_rx_buffer (vm, b0, l3_offset0);
+
           vlib_validate_buffer_enqueue_x1 (vm, node, next_index,
                                            to_next, n_left_to_next,
                                            bi0, next0);
@@ -785,6 +789,7 @@ dpdk_input (vlib_main_t * vm,
   uword n_rx_packets = 0;
   dpdk_device_and_queue_t * dq;
   u32 cpu_index = os_get_cpu_number();
+  u32 n;
 
   /*
    * Poll all devices on this cpu for input/interrupts.
@@ -793,7 +798,9 @@ dpdk_input (vlib_main_t * vm,
     {
       xd = vec_elt_at_index(dm->devices, dq->device);
       ASSERT(dq->queue_id == 0);
-      n_rx_packets += dpdk_device_input (dm, xd, node, cpu_index, 0);
+      n = dpdk_device_input (dm, xd, node, cpu_index, 0);
+      dq->rx_packets += n;
+      n_rx_packets += n;
     }
 
   VIRL_SPEED_LIMIT()
@@ -811,6 +818,7 @@ dpdk_input_rss (vlib_main_t * vm,
   uword n_rx_packets = 0;
   dpdk_device_and_queue_t * dq;
   u32 cpu_index = os_get_cpu_number();
+  u32 n;
 
   /*
    * Poll all devices on this cpu for input/interrupts.
@@ -818,7 +826,9 @@ dpdk_input_rss (vlib_main_t * vm,
   vec_foreach (dq, dm->devices_by_cpu[cpu_index])
     {
       xd = vec_elt_at_index(dm->devices, dq->device);
-      n_rx_packets += dpdk_device_input (dm, xd, node, cpu_index, dq->queue_id);
+      n = dpdk_device_input (dm, xd, node, cpu_index, dq->queue_id);
+      dq->rx_packets += n;
+      n_rx_packets += n;
     }
 
   VIRL_SPEED_LIMIT()
@@ -1160,6 +1170,7 @@ void dpdk_io_thread (vlib_worker_thread_t * w,
       u8 efd_discard_burst;
 
       vlib_worker_thread_barrier_check ();
+      vlib_worker_thread_rcu_quiescent (vm);
 
       /* Invoke callback if supplied */
       if (PREDICT_FALSE(callback != NULL))
@@ -1400,6 +1411,9 @@ void dpdk_io_thread (vlib_worker_thread_t * w,
                * which nodes they've visited... See main.c...
                */
               VLIB_BUFFER_TRACE_TRAJECTORY_INIT(b0);
+
+              if (PREDICT_FALSE (pcap_capture_main.flags & PCAP_CAPTURE_F_RX))
+                pcap_capture_rx_buffer (vm, b0, l3_offset0);
  
               if (PREDICT_FALSE (n_trace > mb_index))
                 vec_add1 (xd->d_trace_buffers, bi0);
@@ -1473,6 +1487,7 @@ void dpdk_io_thread (vlib_worker_thread_t * w,
                 {
                   hf->n_vectors = VLIB_FRAME_SIZE;
                   vlib_put_handoff_queue_elt(hf);
+                  dpdk_worker_wakeup (dm, next_worker_index);
                   current_worker_index = ~0;
                   handoff_queue_elt_by_worker_index[next_worker_index] = 0;
                   hf = 0;
@@ -1517,6 +1532,7 @@ void dpdk_io_thread (vlib_worker_thread_t * w,
               if (1 || hf->n_vectors == hf->last_n_vectors)
                 {
                   vlib_put_handoff_queue_elt(hf);
+                  dpdk_worker_wakeup (dm, i);
                   handoff_queue_elt_by_worker_index[i] = 0;
                 }
               else
@@ -1801,6 +1817,9 @@ dpdk_io_input (vlib_main_t * vm,
            * which nodes they've visited... See main.c...
            */
           VLIB_BUFFER_TRACE_TRAJECTORY_INIT(b0);
+
+          if (PREDICT_FALSE (pcap_capture_main.flags & PCAP_CAPTURE_F_RX))
+            pcap_capture_rx_buffer (vm, b0, l3_offset0);
  
           if (PREDICT_FALSE (n_trace > mb_index))
             vec_add1 (xd->d_trace_buffers, bi0);
@@ -1874,6 +1893,7 @@ dpdk_io_input (vlib_main_t * vm,
             {
               hf->n_vectors = VLIB_FRAME_SIZE;
               vlib_put_handoff_queue_elt(hf);
+              dpdk_worker_wakeup (dm, next_worker_index);
               current_worker_index = ~0;
               handoff_queue_elt_by_worker_index[next_worker_index] = 0;
               hf = 0;
@@ -1919,6 +1939,7 @@ dpdk_io_input (vlib_main_t * vm,
           if (1 || hf->n_vectors == hf->last_n_vectors)
             {
               vlib_put_handoff_queue_elt(hf);
+              dpdk_worker_wakeup (dm, i);
               handoff_queue_elt_by_worker_index[i] = 0;
             }
           else
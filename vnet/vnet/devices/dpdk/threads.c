@@ -12,6 +12,9 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#define _GNU_SOURCE
+#include <poll.h>
+
 #include <vnet/vnet.h>
 #include <vppinfra/vec.h>
 #include <vppinfra/error.h>
@@ -171,6 +174,71 @@ int dpdk_frame_queue_dequeue (vlib_main_t *vm)
   return vlib_frame_queue_dequeue_internal (vm);
 }
 
+/*
+ * Adaptive polling.  After dm->idle_poll_loops main loops without a
+ * vector, the worker sleeps, doubling the sleep up to
+ * dm->max_sleep_usec each time it wakes to nothing.  Handoff enqueues
+ * and barrier sync ring the doorbell; RX queues are only looked at
+ * again on wakeup, so max_sleep_usec is the added latency for the first
+ * packet of a burst.
+ */
+static never_inline u64
+dpdk_worker_idle (vlib_main_t * vm, dpdk_worker_t * dw, u64 now)
+{
+  dpdk_main_t * dm = &dpdk_main;
+  vlib_frame_queue_t * fq = vlib_frame_queues[vm->cpu_index];
+  struct timespec ts;
+  struct pollfd pfd;
+  eventfd_t v;
+  int n;
+
+  dw->sleeping = 1;
+  CLIB_MEMORY_BARRIER();
+
+  /* Work queued, or the barrier wanted, while we were deciding */
+  if (fq->head != fq->tail || *vlib_worker_threads->wait_at_barrier)
+    {
+      dw->sleeping = 0;
+      return now;
+    }
+
+  dw->poll_clocks += now - dw->last_wakeup_time;
+
+  ts.tv_sec = dw->sleep_usec / 1000000;
+  ts.tv_nsec = (dw->sleep_usec % 1000000) * 1000;
+  pfd.fd = dw->doorbell_fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+
+  n = ppoll (&pfd, 1, &ts, 0);
+
+  dw->sleeping = 0;
+
+  if (n > 0)
+    {
+      eventfd_read (dw->doorbell_fd, &v);
+      dw->n_doorbell_wakeups++;
+      dw->sleep_usec = DPDK_MIN_SLEEP_USEC;
+    }
+  else
+    dw->sleep_usec = clib_min (2 * dw->sleep_usec, dm->max_sleep_usec);
+
+  dw->n_sleeps++;
+  dw->last_wakeup_time = clib_cpu_time_now ();
+  dw->sleep_clocks += dw->last_wakeup_time - now;
+  return dw->last_wakeup_time;
+}
+
+/* Barrier sync: get every sleeping worker to the barrier now */
+void dpdk_worker_wakeup_all (void)
+{
+  dpdk_main_t * dm = &dpdk_main;
+  u32 i;
+
+  for (i = 1; i < vec_len (dm->workers); i++)
+    dpdk_worker_wakeup (dm, i);
+}
+
 /*
  * dpdk_worker_thread - Contains the main loop of a worker thread.
  *
@@ -189,12 +257,21 @@ dpdk_worker_thread_internal (vlib_main_t *vm,
                              int have_io_threads)
 {
   vlib_node_main_t * nm = &vm->node_main;
+  dpdk_main_t * dm = &dpdk_main;
+  dpdk_worker_t * dw = vec_elt_at_index (dm->workers, vm->cpu_index);
   u64 cpu_time_now = clib_cpu_time_now ();
+  u64 loop_start_time;
+  u32 n_vectors;
+
+  dw->sleep_usec = DPDK_MIN_SLEEP_USEC;
+  dw->last_wakeup_time = cpu_time_now;
 
   while (1)
     {
       vlib_worker_thread_barrier_check ();
+      vlib_worker_thread_rcu_quiescent (vm);
 
+      loop_start_time = cpu_time_now;
       vlib_frame_queue_dequeue_internal (vm);
 
       /* Invoke callback if supplied */
@@ -226,11 +303,27 @@ dpdk_worker_thread_internal (vlib_main_t *vm,
           }
           _vec_len (nm->pending_frames) = 0;
         }
+      n_vectors = vm->main_loop_vectors_processed;
       vlib_increment_main_loop_counter (vm);
 
       /* Record time stamp in case there are no enabled nodes and above
          calls do not update time stamp. */
       cpu_time_now = clib_cpu_time_now ();
+
+      /* Load estimate for the rx queue balancer */
+      if (n_vectors)
+        dw->busy_clocks += cpu_time_now - loop_start_time;
+
+      if (PREDICT_FALSE (dm->adaptive_polling))
+        {
+          if (n_vectors)
+            {
+              dw->idle_loops = 0;
+              dw->sleep_usec = DPDK_MIN_SLEEP_USEC;
+            }
+          else if (++dw->idle_loops >= dm->idle_poll_loops)
+            cpu_time_now = dpdk_worker_idle (vm, dw, cpu_time_now);
+        }
     }
 }
 
@@ -386,6 +386,7 @@ dpdk_create_vhost_user_if_internal (u32 * hw_if_index, u32 if_id, u8 *hwaddr)
       vec_add2(dm->devices_by_cpu[cpu], dq, 1);
       dq->device = xd->device_index;
       dq->queue_id = q;
+      dq->rx_packets = dq->rx_packets_last = 0;
       DBG_SOCK("CPU for %d = %d. QID: %d", *hw_if_index, cpu, dq->queue_id);
 
       // start polling if it was not started yet (because of no phys ifaces)
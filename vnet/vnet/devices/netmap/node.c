@@ -20,6 +20,7 @@
 #include <vnet/ethernet/ethernet.h>
 
 #include <vnet/devices/netmap/netmap.h>
+#include <vnet/unix/pcap_capture.h>
 
 #define foreach_netmap_input_error
 
@@ -202,6 +203,9 @@ netmap_device_input_fn  (vlib_main_t * vm, vlib_node_runtime_t * node,
 		  data_len -= bytes_to_copy;
 		}
 
+	      if (PREDICT_FALSE (pcap_capture_main.flags & PCAP_CAPTURE_F_RX))
+		pcap_capture_rx_buffer (vm, first_b0, 0);
+
 	      /* trace */
 	      VLIB_BUFFER_TRACE_TRAJECTORY_INIT(first_b0);
 	      if (PREDICT_FALSE(n_trace > 0))
@@ -38,6 +38,7 @@
 #include <vnet/ethernet/ethernet.h>
 
 #include <vnet/devices/virtio/vhost-user.h>
+#include <vnet/unix/pcap_capture.h>
 
 #define VHOST_USER_DEBUG_SOCKET 0
 #define VHOST_USER_DEBUG_VQ 0
@@ -1037,6 +1038,9 @@ static u32 vhost_user_if_input ( vlib_main_t * vm,
       vnet_buffer (b_head)->sw_if_index[VLIB_TX] = (u32)~0;
       b_head->error = node->errors[error];
 
+      if (PREDICT_FALSE (pcap_capture_main.flags & PCAP_CAPTURE_F_RX))
+        pcap_capture_rx_buffer (vm, b_head, 0);
+
       if (PREDICT_FALSE (n_trace > n_rx_packets))
         vec_add1 (vui->d_trace_buffers, bi_head);
 
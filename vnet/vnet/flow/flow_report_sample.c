@@ -236,7 +236,11 @@ static vlib_frame_t * send_flows (flow_report_main_t * frm,
               
               /* Add packetTotalCount manually */
               {
-                u64 packets = clib_host_to_net_u64 (v->hits);
+                u64 packets;
+                f64 last_heard;
+
+                vnet_classify_entry_get_stats (t, v, &packets, &last_heard);
+                packets = clib_host_to_net_u64 (packets);
                 clib_memcpy (b0->data + next_offset, &packets, sizeof (packets));
                 next_offset += sizeof (packets);
               }
@@ -38,6 +38,7 @@
  */
 
 #include <vnet/vnet.h>
+#include <vnet/unix/pcap_capture.h>
 
 typedef struct {
   u32 sw_if_index;
@@ -239,6 +240,9 @@ vnet_interface_output_node (vlib_main_t * vm,
 				    node->node_index,
 				    VNET_INTERFACE_OUTPUT_ERROR_INTERFACE_DELETED);
 
+  if (PREDICT_FALSE (pcap_capture_main.flags & PCAP_CAPTURE_F_TX))
+    pcap_capture_frame (vm, from, n_buffers, rt->sw_if_index);
+
   si = vnet_get_sw_interface (vnm, rt->sw_if_index);
   hi = vnet_get_sup_hw_interface (vnm, rt->sw_if_index);
   if (! (si->flags & VNET_SW_INTERFACE_FLAG_ADMIN_UP) ||
@@ -426,6 +430,9 @@ vnet_interface_output_node_no_flatten (vlib_main_t * vm,
 				    node->node_index,
 				    VNET_INTERFACE_OUTPUT_ERROR_INTERFACE_DELETED);
 
+  if (PREDICT_FALSE (pcap_capture_main.flags & PCAP_CAPTURE_F_TX))
+    pcap_capture_frame (vm, from, n_buffers, rt->sw_if_index);
+
   si = vnet_get_sw_interface (vnm, rt->sw_if_index);
   hi = vnet_get_sup_hw_interface (vnm, rt->sw_if_index);
   if (! (si->flags & VNET_SW_INTERFACE_FLAG_ADMIN_UP) ||
@@ -44,6 +44,33 @@ static inline int will_reallocate (ip_adjacency_t * adjs, u32 n)
   return 1;
 }
 
+/* Put blocks whose grace period is over back on the freelists */
+static void aa_reclaim (ip_adjacency_t * adjs)
+{
+  aa_header_t * ah = aa_header (adjs);
+  aa_retired_t * r;
+  u32 n = 0;
+
+  vec_foreach (r, ah->retired)
+    {
+      if (!vlib_rcu_is_done (r->epoch))
+        break;
+
+      if (CLIB_DEBUG > 0)
+        {
+          memset (adjs + r->index, 0xfe, r->n_adj * sizeof (adjs[0]));
+          adjs[r->index].heap_handle = 0;
+          adjs[r->index].n_adj = r->n_adj;
+        }
+
+      vec_add1 (ah->free_indices_by_size[r->n_adj], r->index);
+      n++;
+    }
+
+  if (n > 0)
+    vec_delete (ah->retired, n, 0);
+}
+
 ip_adjacency_t * 
 aa_alloc (ip_adjacency_t * adjs, ip_adjacency_t **blockp, u32 n)
 {
@@ -55,6 +82,8 @@ aa_alloc (ip_adjacency_t * adjs, ip_adjacency_t **blockp, u32 n)
   
   ASSERT(os_get_cpu_number() == 0);
   ASSERT (clib_mem_is_heap_object (_vec_find(ah)));
+
+  aa_reclaim (adjs);
   
   /* If we don't have a freelist of size N, fresh allocation is required */
   if (vec_len (ah->free_indices_by_size) <= n)
@@ -104,12 +133,18 @@ aa_alloc (ip_adjacency_t * adjs, ip_adjacency_t **blockp, u32 n)
 void aa_free (ip_adjacency_t * adjs, ip_adjacency_t * adj)
 {
   aa_header_t * ah = aa_header (adjs);
+  aa_retired_t * r;
   
   ASSERT (adjs && adj && (adj->heap_handle < vec_len (adjs)));
   ASSERT (adj->n_adj < vec_len (ah->free_indices_by_size));
   ASSERT (adj->heap_handle != 0);
   
-  vec_add1 (ah->free_indices_by_size[adj->n_adj], adj->heap_handle);
+  /* Workers may still be forwarding through it, see aa_reclaim */
+  vec_add2 (ah->retired, r, 1);
+  r->index = adj->heap_handle;
+  r->n_adj = adj->n_adj;
+  r->epoch = vlib_rcu_advance ();
+
   adj->heap_handle = 0;
 }
 
@@ -147,7 +182,7 @@ u8 * format_adjacency_alloc (u8 * s, va_list * args)
   int verbose = va_arg (*args, int);
   ip_adjacency_t * adj;
   u32 inuse = 0, freed = 0;
-  u32 on_freelist = 0;
+  u32 on_freelist = 0, on_grace = 0;
   int i, j;
   aa_header_t * ah = aa_header (adjs);
 
@@ -170,8 +205,12 @@ u8 * format_adjacency_alloc (u8 * s, va_list * args)
         }
     }
       
-  s = format (s, "adjs: %d total, %d in use, %d free, %d on freelists\n",
-              vec_len(adjs), inuse, freed, on_freelist);
+  for (i = 0; i < vec_len (ah->retired); i++)
+    on_grace += ah->retired[i].n_adj;
+
+  s = format (s, "adjs: %d total, %d in use, %d free, %d on freelists, "
+              "%d awaiting grace period\n",
+              vec_len(adjs), inuse, freed, on_freelist, on_grace);
   if (verbose)
     {
       for (i = 0; i < vec_len (adjs); i += adj->n_adj)
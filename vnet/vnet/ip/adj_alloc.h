@@ -30,8 +30,17 @@
 #include <vlib/vlib.h>
 #include <vnet/ip/lookup.h>
 
+typedef struct {
+  u32 index;
+  u32 n_adj;
+  /* see vlib_rcu_advance */
+  u64 epoch;
+} aa_retired_t;
+
 typedef struct {
   u32 ** free_indices_by_size;
+  /* Freed blocks the workers may still be looking at, oldest first */
+  aa_retired_t * retired;
 } aa_header_t;
 
 #define aa_aligned_header_bytes \
@@ -155,6 +155,9 @@ typedef struct ip4_main_t {
   /* Seed for Jenkins hash used to compute ip4 flow hash. */
   u32 flow_hash_seed;
 
+  /* Mtrie layout used for newly created FIBs. */
+  ip4_fib_mtrie_layout_t mtrie_layout;
+
   struct {
     /* TTL to use for host generated packets. */
     u8 ttl;
@@ -365,6 +368,9 @@ int vnet_set_ip4_flow_hash (u32 table_id, u32 flow_hash_config);
 
 void ip4_mtrie_init (ip4_fib_mtrie_t * m);
 
+int vnet_set_ip4_fib_mtrie_layout (u32 table_id,
+                                   ip4_fib_mtrie_layout_t layout);
+
 int vnet_set_ip4_classify_intfc (vlib_main_t * vm, u32 sw_if_index, 
                                  u32 table_index);
 
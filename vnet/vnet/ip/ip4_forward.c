@@ -84,13 +84,23 @@ create_fib_with_table_id (ip4_main_t * im, u32 table_id)
 {
   ip4_fib_t * fib;
   hash_set (im->fib_index_by_table_id, table_id, vec_len (im->fibs));
-  vec_add2 (im->fibs, fib, 1);
+  /* Workers index im->fibs, so moving it needs the barrier */
+  if (vec_len (im->fibs) >= vec_max_len (im->fibs))
+    {
+      vlib_main_t * vm = vlib_get_main ();
+
+      vlib_worker_thread_barrier_sync (vm);
+      vec_add2 (im->fibs, fib, 1);
+      vlib_worker_thread_barrier_release (vm);
+    }
+  else
+    vec_add2 (im->fibs, fib, 1);
   fib->table_id = table_id;
   fib->index = fib - im->fibs;
   fib->flow_hash_config = IP_FLOW_HASH_DEFAULT;
   fib->fwd_classify_table_index = ~0;
   fib->rev_classify_table_index = ~0;
-  ip4_mtrie_init (&fib->mtrie);
+  ip4_mtrie_init_with_layout (&fib->mtrie, im->mtrie_layout);
   return fib;
 }
 
@@ -713,10 +723,8 @@ ip4_lookup_inline (vlib_main_t * vm,
 	      mtrie0 = &vec_elt_at_index (im->fibs, fib_index0)->mtrie;
 	      mtrie1 = &vec_elt_at_index (im->fibs, fib_index1)->mtrie;
 
-	      leaf0 = leaf1 = IP4_FIB_MTRIE_LEAF_ROOT;
-
-	      leaf0 = ip4_fib_mtrie_lookup_step (mtrie0, leaf0, dst_addr0, 0);
-	      leaf1 = ip4_fib_mtrie_lookup_step (mtrie1, leaf1, dst_addr1, 0);
+	      leaf0 = ip4_fib_mtrie_lookup_step_one (mtrie0, dst_addr0);
+	      leaf1 = ip4_fib_mtrie_lookup_step_one (mtrie1, dst_addr1);
 	    }
 
 	  tcp0 = (void *) (ip0 + 1);
@@ -890,9 +898,7 @@ ip4_lookup_inline (vlib_main_t * vm,
 	    {
 	      mtrie0 = &vec_elt_at_index (im->fibs, fib_index0)->mtrie;
 
-	      leaf0 = IP4_FIB_MTRIE_LEAF_ROOT;
-
-	      leaf0 = ip4_fib_mtrie_lookup_step (mtrie0, leaf0, dst_addr0, 0);
+	      leaf0 = ip4_fib_mtrie_lookup_step_one (mtrie0, dst_addr0);
 	    }
 
 	  tcp0 = (void *) (ip0 + 1);
@@ -1346,6 +1352,8 @@ VLIB_REGISTER_NODE (ip4_lookup_node) = {
   .next_nodes = IP4_LOOKUP_NEXT_NODES,
 };
 
+VLIB_NODE_FUNCTION_MULTIARCH (ip4_lookup_node, ip4_lookup)
+
 static uword
 ip4_indirect (vlib_main_t * vm,
                vlib_node_runtime_t * node,
@@ -2735,6 +2743,8 @@ VLIB_REGISTER_NODE (ip4_rewrite_node) = {
   },
 };
 
+VLIB_NODE_FUNCTION_MULTIARCH (ip4_rewrite_node, ip4_rewrite_transit)
+
 VLIB_REGISTER_NODE (ip4_rewrite_local_node,static) = {
   .function = ip4_rewrite_local,
   .name = "ip4-rewrite-local",
@@ -2751,6 +2761,8 @@ VLIB_REGISTER_NODE (ip4_rewrite_local_node,static) = {
   },
 };
 
+VLIB_NODE_FUNCTION_MULTIARCH (ip4_rewrite_local_node, ip4_rewrite_local)
+
 static clib_error_t *
 add_del_interface_table (vlib_main_t * vm,
 			 unformat_input_t * input,
@@ -3177,6 +3189,89 @@ VLIB_CLI_COMMAND (set_ip_flow_hash_command, static) = {
   .function = set_ip_flow_hash_command_fn,
 };
  
+int vnet_set_ip4_fib_mtrie_layout (u32 table_id,
+                                   ip4_fib_mtrie_layout_t layout)
+{
+  ip4_main_t * im4 = &ip4_main;
+  ip4_fib_t * fib;
+  uword * p = hash_get (im4->fib_index_by_table_id, table_id);
+  int i;
+
+  if (p == 0)
+    {
+      ip4_fib_mtrie_layout_t save = im4->mtrie_layout;
+
+      im4->mtrie_layout = layout;
+      find_ip4_fib_by_table_index_or_id (im4, table_id,
+                                         IP4_ROUTE_FLAG_TABLE_ID);
+      im4->mtrie_layout = save;
+      return 0;
+    }
+
+  fib = vec_elt_at_index (im4->fibs, p[0]);
+
+  if (ip4_fib_mtrie_get_layout (&fib->mtrie) == layout)
+    return 0;
+
+  /* Changing layout means rebuilding the mtrie under the forwarding
+     path; only allow it before any routes have been added. */
+  for (i = 0; i < ARRAY_LEN (fib->adj_index_by_dst_address); i++)
+    if (hash_elts (fib->adj_index_by_dst_address[i]))
+      return VNET_API_ERROR_FIB_NOT_EMPTY;
+
+  vlib_worker_thread_barrier_sync (vlib_get_main());
+  ip4_mtrie_free (&fib->mtrie);
+  ip4_mtrie_init_with_layout (&fib->mtrie, layout);
+  vlib_worker_thread_barrier_release (vlib_get_main());
+  return 0;
+}
+
+static clib_error_t *
+set_ip_fib_mtrie_layout_command_fn (vlib_main_t * vm,
+                                    unformat_input_t * input,
+                                    vlib_cli_command_t * cmd)
+{
+  u32 table_id = 0;
+  ip4_fib_mtrie_layout_t layout = IP4_FIB_MTRIE_LAYOUT_8_8_8_8;
+  int layout_set = 0;
+  int rv;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT) {
+    if (unformat (input, "table %d", &table_id))
+      ;
+    else if (unformat (input, "%U", unformat_ip4_fib_mtrie_layout, &layout))
+      layout_set = 1;
+    else
+      return clib_error_return (0, "unknown input `%U'",
+                                format_unformat_error, input);
+  }
+
+  if (layout_set == 0)
+    return clib_error_return (0, "mtrie layout must be specified");
+
+  rv = vnet_set_ip4_fib_mtrie_layout (table_id, layout);
+
+  switch (rv)
+    {
+    case 0:
+      break;
+
+    case VNET_API_ERROR_FIB_NOT_EMPTY:
+      return clib_error_return (0, "FIB table %d has routes", table_id);
+
+    default:
+      return clib_error_return (0, "vnet_set_ip4_fib_mtrie_layout "
+                                "returned %d", rv);
+    }
+  return 0;
+}
+
+VLIB_CLI_COMMAND (set_ip_fib_mtrie_layout_command, static) = {
+  .path = "set ip fib mtrie-layout",
+  .short_help = "set ip fib mtrie-layout [table <fib-id>] 8-8-8-8 | 16-8-8",
+  .function = set_ip_fib_mtrie_layout_command_fn,
+};
+
 int vnet_set_ip4_classify_intfc (vlib_main_t * vm, u32 sw_if_index, 
                                  u32 table_index)
 {
@@ -3247,3 +3342,160 @@ VLIB_CLI_COMMAND (set_ip_classify_command, static) = {
     .function = set_ip_classify_command_fn,
 };
 
+
+always_inline u32
+test_ip4_mtrie_lookup (ip4_fib_mtrie_t * m, ip4_address_t * a)
+{
+  ip4_fib_mtrie_leaf_t leaf;
+
+  leaf = ip4_fib_mtrie_lookup_step_one (m, a);
+  leaf = ip4_fib_mtrie_lookup_step (m, leaf, a, 1);
+  leaf = ip4_fib_mtrie_lookup_step (m, leaf, a, 2);
+  leaf = ip4_fib_mtrie_lookup_step (m, leaf, a, 3);
+  leaf = (leaf == IP4_FIB_MTRIE_LEAF_EMPTY ? m->default_leaf : leaf);
+  return ip4_fib_mtrie_leaf_get_adj_index (leaf);
+}
+
+/* Prefix length mix roughly as seen in a global ip4 table. */
+static u8 test_ip4_prefix_lengths[] = {
+  8, 12, 14, 16, 16, 17, 18, 19, 19, 20, 20, 20, 21, 21, 22, 22,
+  22, 22, 22, 23, 23, 23, 23, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+  24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 32,
+};
+
+static clib_error_t *
+test_ip4_mtrie_command_fn (vlib_main_t * vm,
+                           unformat_input_t * input,
+                           vlib_cli_command_t * cmd)
+{
+  ip4_main_t * im = &ip4_main;
+  ip4_fib_t fibs[2];
+  ip4_fib_mtrie_layout_t layouts[2] = {
+    IP4_FIB_MTRIE_LAYOUT_8_8_8_8, IP4_FIB_MTRIE_LAYOUT_16_8_8,
+  };
+  ip4_address_t * routes = 0, * addrs = 0;
+  u8 * lengths = 0;
+  u32 * results[2] = { 0, 0 };
+  u32 n_routes = 800000, n_lookups = 10000000, seed = 0xdeadbeef;
+  u32 i, l, errors = 0;
+  u64 t0, t1;
+  f64 dt;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT) {
+      if (unformat (input, "routes %d", &n_routes))
+	;
+      else if (unformat (input, "lookups %d", &n_lookups))
+	;
+      else if (unformat (input, "seed %d", &seed))
+	;
+      else
+        return clib_error_return (0, "unknown input `%U'",
+                                  format_unformat_error, input);
+  }
+
+  if (n_routes == 0 || n_lookups == 0)
+    return clib_error_return (0, "need at least one route and lookup");
+
+  vec_validate (routes, n_routes - 1);
+  vec_validate (lengths, n_routes - 1);
+  for (i = 0; i < n_routes; i++)
+    {
+      lengths[i] = test_ip4_prefix_lengths
+        [random_u32 (&seed) % ARRAY_LEN (test_ip4_prefix_lengths)];
+      /* Unicast space, 1.0.0.0 - 223.255.255.255 */
+      routes[i].as_u32 = clib_host_to_net_u32
+        (((1 + random_u32 (&seed) % 223) << 24)
+         | (random_u32 (&seed) & 0xffffff));
+      routes[i].as_u32 &= im->fib_masks[lengths[i]];
+    }
+
+  /* 7 of 8 lookups hit a route, the rest are random. */
+  vec_validate (addrs, n_lookups - 1);
+  for (i = 0; i < n_lookups; i++)
+    {
+      u32 r = random_u32 (&seed) % n_routes;
+      addrs[i].as_u32 = random_u32 (&seed);
+      if (i % 8)
+        addrs[i].as_u32 = (routes[r].as_u32
+                           | (addrs[i].as_u32 & ~im->fib_masks[lengths[r]]));
+    }
+
+  for (l = 0; l < ARRAY_LEN (layouts); l++)
+    {
+      ip4_fib_t * fib = &fibs[l];
+      ip4_fib_mtrie_t * m = &fib->mtrie;
+
+      /* Scratch FIB: adds only touch the mtrie. */
+      memset (fib, 0, sizeof (fib[0]));
+      ip4_mtrie_init_with_layout (m, layouts[l]);
+
+      t0 = clib_cpu_time_now ();
+      for (i = 0; i < n_routes; i++)
+        ip4_fib_mtrie_add_del_route (fib, routes[i], lengths[i],
+                                     1 + (i % 4096), /* is_del */ 0);
+      t1 = clib_cpu_time_now ();
+      dt = (f64)(t1 - t0) * vm->clib_time.seconds_per_clock;
+
+      vlib_cli_output (vm, "%U: %d routes in %.3f sec, %d plies, "
+                       "memory usage %U",
+                       format_ip4_fib_mtrie_layout, layouts[l],
+                       n_routes, dt, pool_elts (m->ply_pool),
+                       format_memory_size, ip4_fib_mtrie_memory_usage (m));
+
+      vec_validate (results[l], n_lookups - 1);
+      t0 = clib_cpu_time_now ();
+      for (i = 0; i < n_lookups; i++)
+        results[l][i] = test_ip4_mtrie_lookup (m, &addrs[i]);
+      t1 = clib_cpu_time_now ();
+      dt = (f64)(t1 - t0) * vm->clib_time.seconds_per_clock;
+
+      vlib_cli_output (vm, "%U: %d lookups, %.2f clocks/lookup, "
+                       "%.2e lookups/sec",
+                       format_ip4_fib_mtrie_layout, layouts[l], n_lookups,
+                       (f64)(t1 - t0) / n_lookups, n_lookups / dt);
+    }
+
+  for (i = 0; i < n_lookups; i++)
+    errors += results[0][i] != results[1][i];
+
+  if (errors)
+    vlib_cli_output (vm, "%d of %d lookups differ between layouts",
+                     errors, n_lookups);
+  else
+    vlib_cli_output (vm, "layouts agree on all %d lookups", n_lookups);
+
+  for (l = 0; l < ARRAY_LEN (layouts); l++)
+    {
+      ip4_mtrie_free (&fibs[l].mtrie);
+      vec_free (results[l]);
+    }
+  vec_free (routes);
+  vec_free (lengths);
+  vec_free (addrs);
+  return 0;
+}
+
+VLIB_CLI_COMMAND (test_ip4_mtrie_command, static) = {
+    .path = "test ip4 mtrie",
+    .short_help = "test ip4 mtrie [routes <nn>] [lookups <nn>] [seed <nn>]",
+    .function = test_ip4_mtrie_command_fn,
+};
+
+static clib_error_t *
+ip4_config (vlib_main_t * vm, unformat_input_t * input)
+{
+  ip4_main_t * im = &ip4_main;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT) {
+    if (unformat (input, "mtrie-layout %U", unformat_ip4_fib_mtrie_layout,
+                  &im->mtrie_layout))
+      ;
+    else
+      return clib_error_return (0, "unknown input '%U'",
+                                format_unformat_error, input);
+  }
+
+  return 0;
+}
+
+VLIB_EARLY_CONFIG_FUNCTION (ip4_config, "ip4");
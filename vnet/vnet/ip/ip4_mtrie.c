@@ -86,13 +86,43 @@ ply_init (ip4_fib_mtrie_ply_t * p, ip4_fib_mtrie_leaf_t init, uword prefix_len)
 #endif
 }
 
+/* Retired plies held before the route code waits for the workers */
+#define IP4_FIB_MTRIE_MAX_RETIRED_PLIES 1024
+
+/* Would the next pool_get move the ply pool out from under the workers? */
+static uword
+ply_pool_will_expand (ip4_fib_mtrie_t * m)
+{
+  uword header_bytes, new_bytes;
+
+  if (! m->ply_pool)
+    return 1;
+
+  if (vec_len (pool_header (m->ply_pool)->free_indices) > 0)
+    return 0;
+
+  header_bytes = vec_header_bytes (pool_aligned_header_bytes);
+  new_bytes = (vec_len (m->ply_pool) + 1) * sizeof (m->ply_pool[0]) + header_bytes;
+
+  return new_bytes > clib_mem_size ((void *) m->ply_pool - header_bytes);
+}
+
 static ip4_fib_mtrie_leaf_t
 ply_create (ip4_fib_mtrie_t * m, ip4_fib_mtrie_leaf_t init_leaf, uword prefix_len)
 {
+  vlib_main_t * vm = vlib_get_main ();
   ip4_fib_mtrie_ply_t * p;
 
-  /* Get cache aligned ply. */
-  pool_get_aligned (m->ply_pool, p, sizeof (p[0]));
+  /* Get cache aligned ply.  Only a pool resize needs the barrier; the
+     new ply is not reachable until the caller links it in. */
+  if (ply_pool_will_expand (m))
+    {
+      vlib_worker_thread_barrier_sync (vm);
+      pool_get_aligned (m->ply_pool, p, sizeof (p[0]));
+      vlib_worker_thread_barrier_release (vm);
+    }
+  else
+    pool_get_aligned (m->ply_pool, p, sizeof (p[0]));
 
   ply_init (p, init_leaf, prefix_len);
   return ip4_fib_mtrie_leaf_set_next_ply_index (p - m->ply_pool);
@@ -107,6 +137,52 @@ get_next_ply_for_leaf (ip4_fib_mtrie_t * m, ip4_fib_mtrie_leaf_t l)
   return pool_elt_at_index (m->ply_pool, n);
 }
 
+/* Caller is unlinking p; it is freed by ply_reclaim after a grace period */
+static void
+ply_retire (ip4_fib_mtrie_t * m, ip4_fib_mtrie_ply_t * p)
+{
+  ip4_fib_mtrie_retired_ply_t * r;
+
+  vec_add2 (m->retired_plies, r, 1);
+  r->ply_index = p - m->ply_pool;
+  r->epoch = ~0ULL;
+}
+
+/* Stamp plies retired by this route change, now that they are unlinked */
+static void
+ply_retire_commit (ip4_fib_mtrie_t * m)
+{
+  word i;
+  u64 epoch;
+
+  i = vec_len (m->retired_plies) - 1;
+  if (i < 0 || m->retired_plies[i].epoch != ~0ULL)
+    return;
+
+  epoch = vlib_rcu_advance ();
+  for (; i >= 0 && m->retired_plies[i].epoch == ~0ULL; i--)
+    m->retired_plies[i].epoch = epoch;
+}
+
+static void
+ply_reclaim (ip4_fib_mtrie_t * m)
+{
+  ip4_fib_mtrie_retired_ply_t * r;
+  uword n = 0;
+
+  /* Oldest first, epochs only go up */
+  vec_foreach (r, m->retired_plies)
+    {
+      if (r->epoch == ~0ULL || ! vlib_rcu_is_done (r->epoch))
+	break;
+      pool_put_index (m->ply_pool, r->ply_index);
+      n++;
+    }
+
+  if (n > 0)
+    vec_delete (m->retired_plies, n, 0);
+}
+
 static void
 ply_free (ip4_fib_mtrie_t * m, ip4_fib_mtrie_ply_t * p)
 {
@@ -127,25 +203,50 @@ ply_free (ip4_fib_mtrie_t * m, ip4_fib_mtrie_ply_t * p)
     pool_put (m->ply_pool, p);
 }
 
+static void
+ply_16_init (ip4_fib_mtrie_16_ply_t * p)
+{
+  uword i;
+
+  for (i = 0; i < ARRAY_LEN (p->leaves); i++)
+    p->leaves[i] = IP4_FIB_MTRIE_LEAF_EMPTY;
+  memset (p->dst_address_bits_of_leaves, 0, sizeof (p->dst_address_bits_of_leaves));
+}
+
 void ip4_fib_free (ip4_fib_mtrie_t * m)
 {
   ip4_fib_mtrie_ply_t * root_ply = pool_elt_at_index (m->ply_pool, 0);
+  ip4_fib_mtrie_16_ply_t * p = m->root_ply_16;
+
   ply_free (m, root_ply);
+
+  if (p)
+    {
+      uword i;
+
+      for (i = 0; i < ARRAY_LEN (p->leaves); i++)
+	if (ip4_fib_mtrie_leaf_is_next_ply (p->leaves[i]))
+	  ply_free (m, get_next_ply_for_leaf (m, p->leaves[i]));
+      ply_16_init (p);
+    }
 }
 
 u32 ip4_mtrie_lookup_address (ip4_fib_mtrie_t * m, ip4_address_t dst)
 {
-  ip4_fib_mtrie_ply_t * p = pool_elt_at_index (m->ply_pool, 0);
+  ip4_fib_mtrie_ply_t * p;
   ip4_fib_mtrie_leaf_t l;
 
-  l = p->leaves[dst.as_u8[0]];
+  l = ip4_fib_mtrie_lookup_step_one (m, &dst);
   if (ip4_fib_mtrie_leaf_is_terminal (l))
     return ip4_fib_mtrie_leaf_get_adj_index (l);
 
-  p = get_next_ply_for_leaf (m, l);
-  l = p->leaves[dst.as_u8[1]];
-  if (ip4_fib_mtrie_leaf_is_terminal (l))
-    return ip4_fib_mtrie_leaf_get_adj_index (l);
+  if (! m->root_ply_16)
+    {
+      p = get_next_ply_for_leaf (m, l);
+      l = p->leaves[dst.as_u8[1]];
+      if (ip4_fib_mtrie_leaf_is_terminal (l))
+	return ip4_fib_mtrie_leaf_get_adj_index (l);
+    }
 
   p = get_next_ply_for_leaf (m, l);
   l = p->leaves[dst.as_u8[2]];
@@ -339,7 +440,7 @@ unset_leaf (ip4_fib_mtrie_t * m,
 	  ASSERT (old_ply->n_non_empty_leafs >= 0);
 	  if (old_ply->n_non_empty_leafs == 0 && dst_address_byte_index > 0)
 	    {
-	      pool_put (m->ply_pool, old_ply);
+	      ply_retire (m, old_ply);
 	      /* Old ply was deleted. */
 	      return 1;
 	    }
@@ -350,13 +451,146 @@ unset_leaf (ip4_fib_mtrie_t * m,
   return 0;
 }
 
-void ip4_mtrie_init (ip4_fib_mtrie_t * m)
+/* Same as set_leaf for the 16 bit root ply of a 16-8-8 mtrie. */
+static void
+set_root_16_leaf (ip4_fib_mtrie_t * m,
+		  ip4_fib_mtrie_set_unset_leaf_args_t * a)
+{
+  ip4_fib_mtrie_16_ply_t * root = m->root_ply_16;
+  ip4_fib_mtrie_leaf_t old_leaf, new_leaf;
+  i32 n_dst_bits_next_plies;
+  u16 dst_half;
+
+  ASSERT (a->dst_address_length > 0 && a->dst_address_length <= 32);
+
+  n_dst_bits_next_plies = a->dst_address_length - 16;
+
+  dst_half = clib_net_to_host_u16 (a->dst_address.as_u16[0]);
+
+  /* Number of bits next plies <= 0 => insert leaves this ply. */
+  if (n_dst_bits_next_plies <= 0)
+    {
+      uword i, n_dst_bits_this_ply, old_leaf_is_terminal;
+
+      n_dst_bits_this_ply = -n_dst_bits_next_plies;
+      ASSERT ((dst_half & pow2_mask (n_dst_bits_this_ply)) == 0);
+
+      for (i = dst_half; i < dst_half + (1 << n_dst_bits_this_ply); i++)
+	{
+	  old_leaf = root->leaves[i];
+	  old_leaf_is_terminal = ip4_fib_mtrie_leaf_is_terminal (old_leaf);
+
+	  /* Is leaf to be inserted more specific? */
+	  if (a->dst_address_length >= root->dst_address_bits_of_leaves[i])
+	    {
+	      new_leaf = ip4_fib_mtrie_leaf_set_adj_index (a->adj_index);
+
+	      if (old_leaf_is_terminal)
+		{
+		  root->dst_address_bits_of_leaves[i] = a->dst_address_length;
+                  __sync_val_compare_and_swap (&root->leaves[i], old_leaf,
+                                               new_leaf);
+                  ASSERT(root->leaves[i] == new_leaf);
+		}
+	      else
+		set_ply_with_more_specific_leaf (m, get_next_ply_for_leaf (m, old_leaf),
+						 new_leaf, a->dst_address_length);
+	    }
+	}
+    }
+  else
+    {
+      ip4_fib_mtrie_ply_t * new_ply;
+
+      old_leaf = root->leaves[dst_half];
+      if (ip4_fib_mtrie_leaf_is_terminal (old_leaf))
+	{
+	  new_leaf = ply_create (m, old_leaf, root->dst_address_bits_of_leaves[dst_half]);
+	  new_ply = get_next_ply_for_leaf (m, new_leaf);
+
+          __sync_val_compare_and_swap (&root->leaves[dst_half], old_leaf,
+                                       new_leaf);
+          ASSERT(root->leaves[dst_half] == new_leaf);
+	  root->dst_address_bits_of_leaves[dst_half] = 0;
+	}
+      else
+	new_ply = get_next_ply_for_leaf (m, old_leaf);
+
+      set_leaf (m, a, new_ply - m->ply_pool, /* dst_address_byte_index */ 2);
+    }
+}
+
+/* Same as unset_leaf for the 16 bit root ply of a 16-8-8 mtrie. */
+static void
+unset_root_16_leaf (ip4_fib_mtrie_t * m,
+		    ip4_fib_mtrie_set_unset_leaf_args_t * a)
+{
+  ip4_fib_mtrie_16_ply_t * root = m->root_ply_16;
+  ip4_fib_mtrie_leaf_t old_leaf, del_leaf;
+  i32 n_dst_bits_next_plies;
+  uword i, n_dst_bits_this_ply, old_leaf_is_terminal;
+  u16 dst_half;
+
+  ASSERT (a->dst_address_length > 0 && a->dst_address_length <= 32);
+
+  n_dst_bits_next_plies = a->dst_address_length - 16;
+
+  dst_half = clib_net_to_host_u16 (a->dst_address.as_u16[0]);
+  if (n_dst_bits_next_plies < 0)
+    dst_half &= ~pow2_mask (-n_dst_bits_next_plies);
+
+  n_dst_bits_this_ply = n_dst_bits_next_plies <= 0 ? -n_dst_bits_next_plies : 0;
+
+  del_leaf = ip4_fib_mtrie_leaf_set_adj_index (a->adj_index);
+
+  for (i = dst_half; i < dst_half + (1 << n_dst_bits_this_ply); i++)
+    {
+      old_leaf = root->leaves[i];
+      old_leaf_is_terminal = ip4_fib_mtrie_leaf_is_terminal (old_leaf);
+
+      if (old_leaf == del_leaf
+	  || (! old_leaf_is_terminal
+	      && unset_leaf (m, a, get_next_ply_for_leaf (m, old_leaf), 2)))
+	{
+	  root->leaves[i] = IP4_FIB_MTRIE_LEAF_EMPTY;
+	  root->dst_address_bits_of_leaves[i] = 0;
+	}
+    }
+}
+
+void ip4_mtrie_init_with_layout (ip4_fib_mtrie_t * m,
+				 ip4_fib_mtrie_layout_t layout)
 {
   ip4_fib_mtrie_leaf_t root;
   memset (m, 0, sizeof (m[0]));
   m->default_leaf = IP4_FIB_MTRIE_LEAF_EMPTY;
+
+  /* Ply index zero is reserved for the 8 bit root even when the 16 bit
+     root is in use, so that a next ply index of zero is never valid. */
   root = ply_create (m, IP4_FIB_MTRIE_LEAF_EMPTY, /* dst_address_bits_of_leaves */ 0);
   ASSERT (ip4_fib_mtrie_leaf_get_next_ply_index (root) == 0);
+
+  if (layout == IP4_FIB_MTRIE_LAYOUT_16_8_8)
+    {
+      m->root_ply_16 = clib_mem_alloc_aligned (sizeof (m->root_ply_16[0]),
+					       CLIB_CACHE_LINE_BYTES);
+      ply_16_init (m->root_ply_16);
+    }
+}
+
+void ip4_mtrie_init (ip4_fib_mtrie_t * m)
+{
+  ip4_mtrie_init_with_layout (m, IP4_FIB_MTRIE_LAYOUT_8_8_8_8);
+}
+
+void ip4_mtrie_free (ip4_fib_mtrie_t * m)
+{
+  pool_free (m->ply_pool);
+  vec_free (m->retired_plies);
+  if (m->root_ply_16)
+    clib_mem_free (m->root_ply_16);
+  m->root_ply_16 = 0;
+  m->default_leaf = IP4_FIB_MTRIE_LEAF_EMPTY;
 }
 
 void
@@ -373,6 +607,8 @@ ip4_fib_mtrie_add_del_route (ip4_fib_t * fib,
 
   ASSERT(m->ply_pool != 0);
 
+  ply_reclaim (m);
+
   root_ply = pool_elt_at_index (m->ply_pool, 0);
 
   /* Honor dst_address_length. Fib masks are in network byte order */
@@ -385,6 +621,8 @@ ip4_fib_mtrie_add_del_route (ip4_fib_t * fib,
     {
       if (dst_address_length == 0)
 	m->default_leaf = ip4_fib_mtrie_leaf_set_adj_index (adj_index);
+      else if (m->root_ply_16)
+	set_root_16_leaf (m, &a);
       else
 	set_leaf (m, &a, /* ply_index */ 0, /* dst_address_byte_index */ 0);
     }
@@ -398,7 +636,10 @@ ip4_fib_mtrie_add_del_route (ip4_fib_t * fib,
 	  ip4_main_t * im = &ip4_main;
 	  uword i;
 
-	  unset_leaf (m, &a, root_ply, 0);
+	  if (m->root_ply_16)
+	    unset_root_16_leaf (m, &a);
+	  else
+	    unset_leaf (m, &a, root_ply, 0);
 
 	  /* Find next less specific route and insert into mtrie. */
 	  for (i = ARRAY_LEN (fib->adj_index_by_dst_address) - 1; i >= 1; i--)
@@ -416,12 +657,25 @@ ip4_fib_mtrie_add_del_route (ip4_fib_t * fib,
 		  a.dst_address = key;
 		  a.dst_address_length = i;
 		  a.adj_index = p[0];
-		  set_leaf (m, &a, /* ply_index */ 0, /* dst_address_byte_index */ 0);
+		  if (m->root_ply_16)
+		    set_root_16_leaf (m, &a);
+		  else
+		    set_leaf (m, &a, /* ply_index */ 0, /* dst_address_byte_index */ 0);
 		  break;
 		}
 	    }
 	}
     }
+
+  ply_retire_commit (m);
+
+  /* Don't let a worker that stops reporting pin an unbounded number of
+     plies; wait the grace period out instead. */
+  if (vec_len (m->retired_plies) > IP4_FIB_MTRIE_MAX_RETIRED_PLIES)
+    {
+      vlib_rcu_synchronize (vlib_get_main ());
+      ply_reclaim (m);
+    }
 }
 
 always_inline uword
@@ -464,21 +718,19 @@ void ip4_mtrie_maybe_remap_adjacencies (ip_lookup_main_t * lm, ip4_fib_mtrie_t *
 {
   ip4_fib_mtrie_ply_t * ply;
   pool_foreach (ply, m->ply_pool, maybe_remap_ply (lm, ply));
+  if (m->root_ply_16)
+    {
+      u32 i;
+      for (i = 0; i < ARRAY_LEN (m->root_ply_16->leaves); i++)
+	maybe_remap_leaf (lm, &m->root_ply_16->leaves[i]);
+    }
   maybe_remap_leaf (lm, &m->default_leaf);
 }
 
-/* Returns number of bytes of memory used by mtrie. */
 static uword mtrie_memory_usage (ip4_fib_mtrie_t * m, ip4_fib_mtrie_ply_t * p)
 {
   uword bytes, i;
 
-  if (! p)
-    {
-      if (pool_is_free_index (m->ply_pool, 0))
-	return 0;
-      p = pool_elt_at_index (m->ply_pool, 0);
-    }
-
   bytes = sizeof (p[0]);
   for (i = 0 ; i < ARRAY_LEN (p->leaves); i++)
     {
@@ -490,6 +742,56 @@ static uword mtrie_memory_usage (ip4_fib_mtrie_t * m, ip4_fib_mtrie_ply_t * p)
   return bytes;
 }
 
+uword ip4_fib_mtrie_memory_usage (ip4_fib_mtrie_t * m)
+{
+  ip4_fib_mtrie_16_ply_t * p = m->root_ply_16;
+  uword bytes, i;
+
+  if (pool_is_free_index (m->ply_pool, 0))
+    return 0;
+
+  bytes = mtrie_memory_usage (m, pool_elt_at_index (m->ply_pool, 0));
+
+  if (p)
+    {
+      bytes += sizeof (p[0]);
+      for (i = 0; i < ARRAY_LEN (p->leaves); i++)
+	if (ip4_fib_mtrie_leaf_is_next_ply (p->leaves[i]))
+	  bytes += mtrie_memory_usage (m, get_next_ply_for_leaf (m, p->leaves[i]));
+    }
+
+  return bytes;
+}
+
+u8 * format_ip4_fib_mtrie_layout (u8 * s, va_list * va)
+{
+  ip4_fib_mtrie_layout_t layout = va_arg (*va, ip4_fib_mtrie_layout_t);
+
+  switch (layout)
+    {
+    case IP4_FIB_MTRIE_LAYOUT_8_8_8_8:
+      return format (s, "8-8-8-8");
+    case IP4_FIB_MTRIE_LAYOUT_16_8_8:
+      return format (s, "16-8-8");
+    default:
+      return format (s, "unknown %d", layout);
+    }
+}
+
+uword unformat_ip4_fib_mtrie_layout (unformat_input_t * input, va_list * va)
+{
+  ip4_fib_mtrie_layout_t * result = va_arg (*va, ip4_fib_mtrie_layout_t *);
+
+  if (unformat (input, "8-8-8-8"))
+    *result = IP4_FIB_MTRIE_LAYOUT_8_8_8_8;
+  else if (unformat (input, "16-8-8"))
+    *result = IP4_FIB_MTRIE_LAYOUT_16_8_8;
+  else
+    return 0;
+
+  return 1;
+}
+
 static u8 * format_ip4_fib_mtrie_leaf (u8 * s, va_list * va)
 {
   ip4_fib_mtrie_leaf_t l = va_arg (*va, ip4_fib_mtrie_leaf_t);
@@ -551,11 +853,42 @@ u8 * format_ip4_fib_mtrie (u8 * s, va_list * va)
 {
   ip4_fib_mtrie_t * m = va_arg (*va, ip4_fib_mtrie_t *);
 
-  s = format (s, "%d plies, memory usage %U",
+  s = format (s, "%U layout, %d plies, memory usage %U",
+	      format_ip4_fib_mtrie_layout, ip4_fib_mtrie_get_layout (m),
 	      pool_elts (m->ply_pool),
-	      format_memory_size, mtrie_memory_usage (m, 0));
+	      format_memory_size, ip4_fib_mtrie_memory_usage (m));
+
+  if (m->root_ply_16)
+    {
+      ip4_fib_mtrie_16_ply_t * p = m->root_ply_16;
+      uword i, indent;
+
+      indent = format_get_indent (s);
+      for (i = 0; i < ARRAY_LEN (p->leaves); i++)
+	{
+	  ip4_fib_mtrie_leaf_t l = p->leaves[i];
+	  ip4_address_t ia;
+
+	  if (ip4_fib_mtrie_leaf_is_empty (l))
+	    continue;
+
+	  ia.as_u32 = clib_host_to_net_u32 (i << 16);
+	  s = format (s, "\n%U%20U %U",
+		      format_white_space, indent + 2,
+		      format_ip4_address_and_length, &ia,
+		      (ip4_fib_mtrie_leaf_is_terminal (l)
+		       ? p->dst_address_bits_of_leaves[i] : 16),
+		      format_ip4_fib_mtrie_leaf, l);
 
-  if (pool_elts (m->ply_pool) > 0)
+	  if (ip4_fib_mtrie_leaf_is_next_ply (l))
+	    s = format (s, "\n%U%U",
+			format_white_space, indent + 4,
+			format_ip4_fib_mtrie_ply, m, i << 16,
+			ip4_fib_mtrie_leaf_get_next_ply_index (l),
+			/* dst_address_byte_index */ 2);
+	}
+    }
+  else if (pool_elts (m->ply_pool) > 0)
     {
       ip4_address_t base_address;
       base_address.as_u32 = 0;
@@ -45,7 +45,7 @@
 #include <vnet/ip/lookup.h>
 #include <vnet/ip/ip4_packet.h>	/* for ip4_address_t */
 
-/* ip4 fib leafs: 4 ply 8-8-8-8 mtrie.
+/* ip4 fib leafs: 4 ply 8-8-8-8 mtrie or 3 ply 16-8-8 mtrie.
    1 + 2*adj_index for terminal leaves.
    0 + 2*next_ply_index for non-terminals.
    1 => empty (adjacency index of zero is special miss adjacency). */
@@ -115,16 +115,63 @@ typedef struct {
 	 - 1 * sizeof (i32)];
 } ip4_fib_mtrie_ply_t;
 
+/* 64K entry root ply for the 16-8-8 layout.  Never freed while the
+   mtrie exists, so no leaf count is kept. */
 typedef struct {
-  /* Pool of plies.  Index zero is root ply. */
+  ip4_fib_mtrie_leaf_t leaves[1 << 16];
+
+  /* Prefix length for terminal leaves. */
+  u8 dst_address_bits_of_leaves[1 << 16];
+} ip4_fib_mtrie_16_ply_t;
+
+typedef enum {
+  /* 4 dependent loads for host routes; smallest empty table. */
+  IP4_FIB_MTRIE_LAYOUT_8_8_8_8,
+  /* 16 bit root ply: /16 and shorter resolve in 1 load, /24 in 2. */
+  IP4_FIB_MTRIE_LAYOUT_16_8_8,
+} ip4_fib_mtrie_layout_t;
+
+typedef struct {
+  u32 ply_index;
+
+  /* rcu epoch, ~0 until the unlinking route change is complete */
+  u64 epoch;
+} ip4_fib_mtrie_retired_ply_t;
+
+typedef struct {
+  /* Pool of plies.  Index zero is root ply for the 8-8-8-8 layout
+     and unused for 16-8-8. */
   ip4_fib_mtrie_ply_t * ply_pool;
 
+  /* Plies unlinked from the trie.  Workers may still be walking them,
+     they go back to the pool once vlib_rcu_is_done says so. */
+  ip4_fib_mtrie_retired_ply_t * retired_plies;
+
+  /* Root ply for 16-8-8 layout; zero for 8-8-8-8. */
+  ip4_fib_mtrie_16_ply_t * root_ply_16;
+
   /* Special case leaf for default route 0.0.0.0/0. */
   ip4_fib_mtrie_leaf_t default_leaf;
 } ip4_fib_mtrie_t;
 
 void ip4_fib_mtrie_init (ip4_fib_mtrie_t * m);
 
+void ip4_mtrie_init_with_layout (ip4_fib_mtrie_t * m,
+				 ip4_fib_mtrie_layout_t layout);
+
+void ip4_mtrie_free (ip4_fib_mtrie_t * m);
+
+always_inline ip4_fib_mtrie_layout_t
+ip4_fib_mtrie_get_layout (ip4_fib_mtrie_t * m)
+{
+  return (m->root_ply_16
+	  ? IP4_FIB_MTRIE_LAYOUT_16_8_8
+	  : IP4_FIB_MTRIE_LAYOUT_8_8_8_8);
+}
+
+format_function_t format_ip4_fib_mtrie_layout;
+unformat_function_t unformat_ip4_fib_mtrie_layout;
+
 struct ip4_fib_t;
 
 void ip4_fib_mtrie_add_del_route (struct ip4_fib_t * f,
@@ -138,9 +185,25 @@ u32 ip4_mtrie_lookup_address (ip4_fib_mtrie_t * m, ip4_address_t dst);
 
 void ip4_mtrie_maybe_remap_adjacencies (ip_lookup_main_t * lm, ip4_fib_mtrie_t * m);
 
+/* Returns number of bytes of memory used by mtrie. */
+uword ip4_fib_mtrie_memory_usage (ip4_fib_mtrie_t * m);
+
 format_function_t format_ip4_fib_mtrie;
 
-/* Lookup step.  Processes 1 byte of 4 byte ip4 address. */
+/* Lookup step one.  Processes the root ply: 1 byte for 8-8-8-8,
+   2 bytes for 16-8-8. */
+always_inline ip4_fib_mtrie_leaf_t
+ip4_fib_mtrie_lookup_step_one (ip4_fib_mtrie_t * m,
+			       ip4_address_t * dst_address)
+{
+  if (m->root_ply_16)
+    return m->root_ply_16->leaves[clib_net_to_host_u16 (dst_address->as_u16[0])];
+
+  return m->ply_pool[0].leaves[dst_address->as_u8[0]];
+}
+
+/* Lookup step.  Processes 1 byte of 4 byte ip4 address.
+   Byte 1 is a no-op for 16-8-8 since the root ply already consumed it. */
 always_inline ip4_fib_mtrie_leaf_t
 ip4_fib_mtrie_lookup_step (ip4_fib_mtrie_t * m,
 			   ip4_fib_mtrie_leaf_t current_leaf,
@@ -149,7 +212,18 @@ ip4_fib_mtrie_lookup_step (ip4_fib_mtrie_t * m,
 {
   ip4_fib_mtrie_leaf_t next_leaf;
   ip4_fib_mtrie_ply_t * ply;
-  uword current_is_terminal = ip4_fib_mtrie_leaf_is_terminal (current_leaf);
+  uword current_is_terminal;
+
+  if (dst_address_byte_index == 0)
+    {
+      ASSERT (current_leaf == IP4_FIB_MTRIE_LEAF_ROOT);
+      return ip4_fib_mtrie_lookup_step_one (m, dst_address);
+    }
+
+  if (dst_address_byte_index == 1 && m->root_ply_16)
+    return current_leaf;
+
+  current_is_terminal = ip4_fib_mtrie_leaf_is_terminal (current_leaf);
 
   ply = m->ply_pool + (current_is_terminal ? 0 : (current_leaf >> 1));
   next_leaf = ply->leaves[dst_address->as_u8[dst_address_byte_index]];
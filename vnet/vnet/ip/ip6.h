@@ -42,6 +42,7 @@
 
 #include <vlib/mc.h>
 #include <vnet/ip/ip6_packet.h>
+#include <vnet/ip/ip6_mtrie.h>
 #include <vnet/ip/lookup.h>
 
 #include <vppinfra/bihash_24_8.h>
@@ -59,7 +60,11 @@ typedef struct {
   u32 vrf_index;
 } ip6_fib_key_t;
 
-typedef struct {
+typedef struct ip6_fib_t {
+  /* Mtrie for fast lookups.  Bihash is used to maintain overlapping
+     prefixes and exact match queries. */
+  ip6_fib_mtrie_t mtrie;
+
   /* Table ID (hash key) for this FIB. */
   u32 table_id;
 
@@ -204,6 +209,8 @@ typedef union {
 u32 ip6_fib_lookup (ip6_main_t * im, u32 sw_if_index, ip6_address_t * dst);
 u32 ip6_fib_lookup_with_table (ip6_main_t * im, u32 fib_index, 
                                ip6_address_t * dst);
+u32 ip6_fib_lookup_with_table_hash (ip6_main_t * im, u32 fib_index, 
+                                    ip6_address_t * dst);
 ip6_fib_t * find_ip6_fib_by_table_index_or_id (ip6_main_t * im, 
                                                u32 table_index_or_id, 
                                                u32 flags);
@@ -57,8 +57,14 @@ static void compute_prefix_lengths_in_search_order (ip6_main_t * im)
   }));
 }
 
+/* 
+ * Reference lookup: probe the bihash once per populated prefix length.
+ * The forwarding path uses the per-fib mtrie instead; this is kept to
+ * validate and benchmark it.
+ */
 u32 
-ip6_fib_lookup_with_table (ip6_main_t * im, u32 fib_index, ip6_address_t * dst)
+ip6_fib_lookup_with_table_hash (ip6_main_t * im, u32 fib_index,
+                                ip6_address_t * dst)
 {
   ip_lookup_main_t * lm = &im->lookup_main;
   int i, len;
@@ -91,6 +97,14 @@ ip6_fib_lookup_with_table (ip6_main_t * im, u32 fib_index, ip6_address_t * dst)
   return lm->miss_adj_index;
 }
 
+u32 
+ip6_fib_lookup_with_table (ip6_main_t * im, u32 fib_index, ip6_address_t * dst)
+{
+  ip6_fib_t * fib = vec_elt_at_index (im->fibs, fib_index);
+
+  return ip6_fib_mtrie_lookup (&fib->mtrie, dst);
+}
+
 u32 ip6_fib_lookup (ip6_main_t * im, u32 sw_if_index, ip6_address_t * dst)
 {
     u32 fib_index = vec_elt (im->fib_index_by_sw_if_index, sw_if_index);
@@ -173,10 +187,21 @@ create_fib_with_table_id (ip6_main_t * im, u32 table_id)
 {
   ip6_fib_t * fib;
   hash_set (im->fib_index_by_table_id, table_id, vec_len (im->fibs));
-  vec_add2 (im->fibs, fib, 1);
+  /* Workers index im->fibs, so moving it needs the barrier */
+  if (vec_len (im->fibs) >= vec_max_len (im->fibs))
+    {
+      vlib_main_t * vm = vlib_get_main ();
+
+      vlib_worker_thread_barrier_sync (vm);
+      vec_add2 (im->fibs, fib, 1);
+      vlib_worker_thread_barrier_release (vm);
+    }
+  else
+    vec_add2 (im->fibs, fib, 1);
   fib->table_id = table_id;
   fib->index = fib - im->fibs;
   fib->flow_hash_config = IP_FLOW_HASH_DEFAULT;
+  ip6_mtrie_init (&fib->mtrie);
   vnet_ip6_fib_init (im, fib->index);
   return fib;
 }
@@ -270,6 +295,11 @@ void ip6_add_del_route (ip6_main_t * im, ip6_add_del_route_args_t * a)
       BV(clib_bihash_add_del) (&im->ip6_lookup_table, &kv, 1 /* is_add */);
     }
 
+  if (! is_del || old_adj_index != ~0)
+    ip6_fib_mtrie_add_del_route (fib, &dst_address, dst_address_length,
+                                 is_del ? old_adj_index : adj_index,
+                                 is_del);
+
   /* Avoid spurious reference count increments */
   if (old_adj_index == adj_index 
       && adj_index != ~0
@@ -667,66 +697,131 @@ ip6_lookup_inline (vlib_main_t * vm,
       vlib_get_next_frame (vm, node, next,
 			   to_next, n_left_to_next);
 
-      while (n_left_from >= 4 && n_left_to_next >= 2)
+      while (n_left_from >= 8 && n_left_to_next >= 4)
 	{
-	  vlib_buffer_t * p0, * p1;
-	  u32 pi0, pi1, adj_index0, adj_index1, wrong_next;
-	  ip_lookup_next_t next0, next1;
-	  ip6_header_t * ip0, * ip1;
-	  ip_adjacency_t * adj0, * adj1;
-	  ip6_address_t * dst_addr0, * dst_addr1;
-          u32 fib_index0, fib_index1;
+	  vlib_buffer_t * p0, * p1, * p2, * p3;
+	  u32 pi0, pi1, pi2, pi3, adj_index0, adj_index1, adj_index2, adj_index3;
+	  ip_lookup_next_t next0, next1, next2, next3;
+	  ip6_header_t * ip0, * ip1, * ip2, * ip3;
+	  ip_adjacency_t * adj0, * adj1, * adj2, * adj3;
+	  ip6_address_t * dst_addr0, * dst_addr1, * dst_addr2, * dst_addr3;
+          u32 fib_index0, fib_index1, fib_index2, fib_index3;
           u32 flow_hash_config0, flow_hash_config1;
+          u32 flow_hash_config2, flow_hash_config3;
+	  ip6_fib_mtrie_t * mtrie0, * mtrie1, * mtrie2, * mtrie3;
+	  ip6_fib_mtrie_leaf_t leaf0, leaf1, leaf2, leaf3;
+	  u32 i;
 
 	  /* Prefetch next iteration. */
 	  {
-	    vlib_buffer_t * p2, * p3;
-
-	    p2 = vlib_get_buffer (vm, from[2]);
-	    p3 = vlib_get_buffer (vm, from[3]);
-
-	    vlib_prefetch_buffer_header (p2, LOAD);
-	    vlib_prefetch_buffer_header (p3, LOAD);
-	    CLIB_PREFETCH (p2->data, sizeof (ip0[0]), LOAD);
-	    CLIB_PREFETCH (p3->data, sizeof (ip0[0]), LOAD);
+	    vlib_buffer_t * p4, * p5, * p6, * p7;
+
+	    p4 = vlib_get_buffer (vm, from[4]);
+	    p5 = vlib_get_buffer (vm, from[5]);
+	    p6 = vlib_get_buffer (vm, from[6]);
+	    p7 = vlib_get_buffer (vm, from[7]);
+
+	    vlib_prefetch_buffer_header (p4, LOAD);
+	    vlib_prefetch_buffer_header (p5, LOAD);
+	    vlib_prefetch_buffer_header (p6, LOAD);
+	    vlib_prefetch_buffer_header (p7, LOAD);
+	    CLIB_PREFETCH (p4->data, sizeof (ip0[0]), LOAD);
+	    CLIB_PREFETCH (p5->data, sizeof (ip0[0]), LOAD);
+	    CLIB_PREFETCH (p6->data, sizeof (ip0[0]), LOAD);
+	    CLIB_PREFETCH (p7->data, sizeof (ip0[0]), LOAD);
 	  }
 
 	  pi0 = to_next[0] = from[0];
 	  pi1 = to_next[1] = from[1];
+	  pi2 = to_next[2] = from[2];
+	  pi3 = to_next[3] = from[3];
 
 	  p0 = vlib_get_buffer (vm, pi0);
 	  p1 = vlib_get_buffer (vm, pi1);
+	  p2 = vlib_get_buffer (vm, pi2);
+	  p3 = vlib_get_buffer (vm, pi3);
 
 	  ip0 = vlib_buffer_get_current (p0);
 	  ip1 = vlib_buffer_get_current (p1);
+	  ip2 = vlib_buffer_get_current (p2);
+	  ip3 = vlib_buffer_get_current (p3);
 
 	  if (is_indirect)
 	    {
-	      ip_adjacency_t * iadj0, * iadj1;
+	      ip_adjacency_t * iadj0, * iadj1, * iadj2, * iadj3;
 	      iadj0 = ip_get_adjacency (lm, vnet_buffer(p0)->ip.adj_index[VLIB_TX]);
 	      iadj1 = ip_get_adjacency (lm, vnet_buffer(p1)->ip.adj_index[VLIB_TX]);
+	      iadj2 = ip_get_adjacency (lm, vnet_buffer(p2)->ip.adj_index[VLIB_TX]);
+	      iadj3 = ip_get_adjacency (lm, vnet_buffer(p3)->ip.adj_index[VLIB_TX]);
 	      dst_addr0 = &iadj0->indirect.next_hop.ip6;
 	      dst_addr1 = &iadj1->indirect.next_hop.ip6;
+	      dst_addr2 = &iadj2->indirect.next_hop.ip6;
+	      dst_addr3 = &iadj3->indirect.next_hop.ip6;
 	    }
 	  else
 	    {
 	      dst_addr0 = &ip0->dst_address;
 	      dst_addr1 = &ip1->dst_address;
+	      dst_addr2 = &ip2->dst_address;
+	      dst_addr3 = &ip3->dst_address;
 	    }
 
 	  fib_index0 = vec_elt (im->fib_index_by_sw_if_index, vnet_buffer (p0)->sw_if_index[VLIB_RX]);
 	  fib_index1 = vec_elt (im->fib_index_by_sw_if_index, vnet_buffer (p1)->sw_if_index[VLIB_RX]);
+	  fib_index2 = vec_elt (im->fib_index_by_sw_if_index, vnet_buffer (p2)->sw_if_index[VLIB_RX]);
+	  fib_index3 = vec_elt (im->fib_index_by_sw_if_index, vnet_buffer (p3)->sw_if_index[VLIB_RX]);
 
           fib_index0 = (vnet_buffer(p0)->sw_if_index[VLIB_TX] == (u32)~0) ?
             fib_index0 : vnet_buffer(p0)->sw_if_index[VLIB_TX];
           fib_index1 = (vnet_buffer(p1)->sw_if_index[VLIB_TX] == (u32)~0) ?
             fib_index1 : vnet_buffer(p1)->sw_if_index[VLIB_TX];
+          fib_index2 = (vnet_buffer(p2)->sw_if_index[VLIB_TX] == (u32)~0) ?
+            fib_index2 : vnet_buffer(p2)->sw_if_index[VLIB_TX];
+          fib_index3 = (vnet_buffer(p3)->sw_if_index[VLIB_TX] == (u32)~0) ?
+            fib_index3 : vnet_buffer(p3)->sw_if_index[VLIB_TX];
+
+	  mtrie0 = &vec_elt_at_index (im->fibs, fib_index0)->mtrie;
+	  mtrie1 = &vec_elt_at_index (im->fibs, fib_index1)->mtrie;
+	  mtrie2 = &vec_elt_at_index (im->fibs, fib_index2)->mtrie;
+	  mtrie3 = &vec_elt_at_index (im->fibs, fib_index3)->mtrie;
+
+	  /* Walk the four mtries in lock step, prefetching the leaf each
+	     lookup needs next so the dependent loads overlap. */
+	  leaf0 = leaf1 = leaf2 = leaf3 = IP6_FIB_MTRIE_LEAF_ROOT;
+
+	  for (i = 0; i < ARRAY_LEN (dst_addr0->as_u8); i++)
+	    {
+	      leaf0 = ip6_fib_mtrie_lookup_step (mtrie0, leaf0, dst_addr0, i);
+	      leaf1 = ip6_fib_mtrie_lookup_step (mtrie1, leaf1, dst_addr1, i);
+	      leaf2 = ip6_fib_mtrie_lookup_step (mtrie2, leaf2, dst_addr2, i);
+	      leaf3 = ip6_fib_mtrie_lookup_step (mtrie3, leaf3, dst_addr3, i);
+
+	      /* All four terminal? */
+	      if (ip6_fib_mtrie_leaf_is_terminal (leaf0 & leaf1 & leaf2 & leaf3))
+		break;
+
+	      ip6_fib_mtrie_prefetch_step (mtrie0, leaf0, dst_addr0, i + 1);
+	      ip6_fib_mtrie_prefetch_step (mtrie1, leaf1, dst_addr1, i + 1);
+	      ip6_fib_mtrie_prefetch_step (mtrie2, leaf2, dst_addr2, i + 1);
+	      ip6_fib_mtrie_prefetch_step (mtrie3, leaf3, dst_addr3, i + 1);
+	    }
+
+	  /* Handle default route. */
+	  leaf0 = (leaf0 == IP6_FIB_MTRIE_LEAF_EMPTY ? mtrie0->default_leaf : leaf0);
+	  leaf1 = (leaf1 == IP6_FIB_MTRIE_LEAF_EMPTY ? mtrie1->default_leaf : leaf1);
+	  leaf2 = (leaf2 == IP6_FIB_MTRIE_LEAF_EMPTY ? mtrie2->default_leaf : leaf2);
+	  leaf3 = (leaf3 == IP6_FIB_MTRIE_LEAF_EMPTY ? mtrie3->default_leaf : leaf3);
+
+	  adj_index0 = ip6_fib_mtrie_leaf_get_adj_index (leaf0);
+	  adj_index1 = ip6_fib_mtrie_leaf_get_adj_index (leaf1);
+	  adj_index2 = ip6_fib_mtrie_leaf_get_adj_index (leaf2);
+	  adj_index3 = ip6_fib_mtrie_leaf_get_adj_index (leaf3);
 
-	  adj_index0 = ip6_fib_lookup_with_table (im, fib_index0, dst_addr0);
-	  adj_index1 = ip6_fib_lookup_with_table (im, fib_index1, dst_addr1);
 
 	  adj0 = ip_get_adjacency (lm, adj_index0);
 	  adj1 = ip_get_adjacency (lm, adj_index1);
+	  adj2 = ip_get_adjacency (lm, adj_index2);
+	  adj3 = ip_get_adjacency (lm, adj_index3);
 
           if (PREDICT_FALSE (adj0->explicit_fib_index != ~0))
             {
@@ -740,18 +835,38 @@ ip6_lookup_inline (vlib_main_t * vm,
                 (im, adj1->explicit_fib_index, dst_addr1);
               adj1 = ip_get_adjacency (lm, adj_index1);
             }
+          if (PREDICT_FALSE (adj2->explicit_fib_index != ~0))
+            {
+              adj_index2 = ip6_fib_lookup_with_table 
+                (im, adj2->explicit_fib_index, dst_addr2);
+              adj2 = ip_get_adjacency (lm, adj_index2);
+            }
+          if (PREDICT_FALSE (adj3->explicit_fib_index != ~0))
+            {
+              adj_index3 = ip6_fib_lookup_with_table 
+                (im, adj3->explicit_fib_index, dst_addr3);
+              adj3 = ip_get_adjacency (lm, adj_index3);
+            }
 
 	  next0 = adj0->lookup_next_index;
 	  next1 = adj1->lookup_next_index;
+	  next2 = adj2->lookup_next_index;
+	  next3 = adj3->lookup_next_index;
 
           /* Process hop-by-hop options if present */
           next0 = (ip0->protocol == IP_PROTOCOL_IP6_HOP_BY_HOP_OPTIONS) ?
               IP_LOOKUP_NEXT_HOP_BY_HOP : next0;
           next1 = (ip1->protocol == IP_PROTOCOL_IP6_HOP_BY_HOP_OPTIONS) ?
               IP_LOOKUP_NEXT_HOP_BY_HOP : next1;
+          next2 = (ip2->protocol == IP_PROTOCOL_IP6_HOP_BY_HOP_OPTIONS) ?
+              IP_LOOKUP_NEXT_HOP_BY_HOP : next2;
+          next3 = (ip3->protocol == IP_PROTOCOL_IP6_HOP_BY_HOP_OPTIONS) ?
+              IP_LOOKUP_NEXT_HOP_BY_HOP : next3;
 
           vnet_buffer (p0)->ip.flow_hash = 
             vnet_buffer(p1)->ip.flow_hash = 0;
+          vnet_buffer (p2)->ip.flow_hash = 
+            vnet_buffer(p3)->ip.flow_hash = 0;
 
           if (PREDICT_FALSE(adj0->n_adj > 1))
             {
@@ -764,21 +879,47 @@ ip6_lookup_inline (vlib_main_t * vm,
           if (PREDICT_FALSE(adj1->n_adj > 1))
             {
               flow_hash_config1 = 
-                vec_elt_at_index (im->fibs,fib_index0)->flow_hash_config;
+                vec_elt_at_index (im->fibs,fib_index1)->flow_hash_config;
 
               vnet_buffer (p1)->ip.flow_hash = 
                 ip6_compute_flow_hash (ip1, flow_hash_config1);
             }
 
+          if (PREDICT_FALSE(adj2->n_adj > 1))
+            {
+              flow_hash_config2 = 
+                vec_elt_at_index (im->fibs,fib_index2)->flow_hash_config;
+
+              vnet_buffer (p2)->ip.flow_hash = 
+                ip6_compute_flow_hash (ip2, flow_hash_config2);
+            }
+
+          if (PREDICT_FALSE(adj3->n_adj > 1))
+            {
+              flow_hash_config3 = 
+                vec_elt_at_index (im->fibs,fib_index3)->flow_hash_config;
+
+              vnet_buffer (p3)->ip.flow_hash = 
+                ip6_compute_flow_hash (ip3, flow_hash_config3);
+            }
+
 	  ASSERT (adj0->n_adj > 0);
 	  ASSERT (adj1->n_adj > 0);
+	  ASSERT (adj2->n_adj > 0);
+	  ASSERT (adj3->n_adj > 0);
 	  ASSERT (is_pow2 (adj0->n_adj));
 	  ASSERT (is_pow2 (adj1->n_adj));
+	  ASSERT (is_pow2 (adj2->n_adj));
+	  ASSERT (is_pow2 (adj3->n_adj));
 	  adj_index0 += (vnet_buffer (p0)->ip.flow_hash & (adj0->n_adj - 1));
 	  adj_index1 += (vnet_buffer (p1)->ip.flow_hash & (adj1->n_adj - 1));
+	  adj_index2 += (vnet_buffer (p2)->ip.flow_hash & (adj2->n_adj - 1));
+	  adj_index3 += (vnet_buffer (p3)->ip.flow_hash & (adj3->n_adj - 1));
 
 	  vnet_buffer (p0)->ip.adj_index[VLIB_TX] = adj_index0;
 	  vnet_buffer (p1)->ip.adj_index[VLIB_TX] = adj_index1;
+	  vnet_buffer (p2)->ip.adj_index[VLIB_TX] = adj_index2;
+	  vnet_buffer (p3)->ip.adj_index[VLIB_TX] = adj_index3;
 
 	  vlib_increment_combined_counter 
               (cm, cpu_index, adj_index0, 1,
@@ -786,47 +927,22 @@ ip6_lookup_inline (vlib_main_t * vm,
 	  vlib_increment_combined_counter 
               (cm, cpu_index, adj_index1, 1,
                vlib_buffer_length_in_chain (vm, p1));
+	  vlib_increment_combined_counter 
+              (cm, cpu_index, adj_index2, 1,
+               vlib_buffer_length_in_chain (vm, p2));
+	  vlib_increment_combined_counter 
+              (cm, cpu_index, adj_index3, 1,
+               vlib_buffer_length_in_chain (vm, p3));
 
-	  from += 2;
-	  to_next += 2;
-	  n_left_to_next -= 2;
-	  n_left_from -= 2;
+	  from += 4;
+	  to_next += 4;
+	  n_left_to_next -= 4;
+	  n_left_from -= 4;
 
-	  wrong_next = (next0 != next) + 2*(next1 != next);
-	  if (PREDICT_FALSE (wrong_next != 0))
-            {
-	      switch (wrong_next)
-		{
-		case 1:
-		  /* A B A */
-		  to_next[-2] = pi1;
-		  to_next -= 1;
-		  n_left_to_next += 1;
-		  vlib_set_next_frame_buffer (vm, node, next0, pi0);
-		  break;
-
-		case 2:
-		  /* A A B */
-		  to_next -= 1;
-		  n_left_to_next += 1;
-		  vlib_set_next_frame_buffer (vm, node, next1, pi1);
-		  break;
-
-		case 3:
-		  /* A B C */
-		  to_next -= 2;
-		  n_left_to_next += 2;
-		  vlib_set_next_frame_buffer (vm, node, next0, pi0);
-		  vlib_set_next_frame_buffer (vm, node, next1, pi1);
-		  if (next0 == next1)
-		    {
-		      /* A B B */
-		      vlib_put_next_frame (vm, node, next, n_left_to_next);
-		      next = next1;
-		      vlib_get_next_frame (vm, node, next, to_next, n_left_to_next);
-		    }
-		}
-	    }
+	  vlib_validate_buffer_enqueue_x4 (vm, node, next,
+					   to_next, n_left_to_next,
+					   pi0, pi1, pi2, pi3,
+					   next0, next1, next2, next3);
 	}
     
       while (n_left_from > 0 && n_left_to_next > 0)
@@ -864,7 +980,8 @@ ip6_lookup_inline (vlib_main_t * vm,
           flow_hash_config0 = 
               vec_elt_at_index (im->fibs,fib_index0)->flow_hash_config;
 
-	  adj_index0 = ip6_fib_lookup_with_table (im, fib_index0, dst_addr0);
+	  adj_index0 = ip6_fib_mtrie_lookup
+            (&vec_elt_at_index (im->fibs, fib_index0)->mtrie, dst_addr0);
 
 	  adj0 = ip_get_adjacency (lm, adj_index0);
 
@@ -2770,6 +2887,252 @@ VLIB_CLI_COMMAND (set_ip6_classify_command, static) = {
     .function = set_ip6_classify_command_fn,
 };
 
+/* Four lookups in lock step, as done by the ip6-lookup node. */
+static void
+ip6_mtrie_lookup_x4 (ip6_fib_mtrie_t * m, ip6_address_t * a, u32 * result)
+{
+  ip6_fib_mtrie_leaf_t leaf0, leaf1, leaf2, leaf3;
+  u32 i;
+
+  leaf0 = leaf1 = leaf2 = leaf3 = IP6_FIB_MTRIE_LEAF_ROOT;
+
+  for (i = 0; i < ARRAY_LEN (a->as_u8); i++)
+    {
+      leaf0 = ip6_fib_mtrie_lookup_step (m, leaf0, a + 0, i);
+      leaf1 = ip6_fib_mtrie_lookup_step (m, leaf1, a + 1, i);
+      leaf2 = ip6_fib_mtrie_lookup_step (m, leaf2, a + 2, i);
+      leaf3 = ip6_fib_mtrie_lookup_step (m, leaf3, a + 3, i);
+
+      if (ip6_fib_mtrie_leaf_is_terminal (leaf0 & leaf1 & leaf2 & leaf3))
+        break;
+
+    }
+
+  leaf0 = (leaf0 == IP6_FIB_MTRIE_LEAF_EMPTY ? m->default_leaf : leaf0);
+  leaf1 = (leaf1 == IP6_FIB_MTRIE_LEAF_EMPTY ? m->default_leaf : leaf1);
+  leaf2 = (leaf2 == IP6_FIB_MTRIE_LEAF_EMPTY ? m->default_leaf : leaf2);
+  leaf3 = (leaf3 == IP6_FIB_MTRIE_LEAF_EMPTY ? m->default_leaf : leaf3);
+
+  result[0] = ip6_fib_mtrie_leaf_get_adj_index (leaf0);
+  result[1] = ip6_fib_mtrie_leaf_get_adj_index (leaf1);
+  result[2] = ip6_fib_mtrie_leaf_get_adj_index (leaf2);
+  result[3] = ip6_fib_mtrie_leaf_get_adj_index (leaf3);
+}
+
+/* Prefix lengths roughly as seen in a global ip6 table. */
+static u8 test_ip6_prefix_lengths[] = {
+  19, 20, 24, 28, 29, 30, 32, 32, 32, 32, 32, 32, 33, 34, 35, 36,
+  40, 40, 44, 44, 46, 47, 48, 48, 48, 48, 48, 48, 48, 48, 48, 48,
+  48, 48, 48, 48, 52, 56, 56, 60, 62, 63, 64, 64, 64, 96, 127, 128,
+};
+
+static clib_error_t *
+test_ip6_lookup_command_fn (vlib_main_t * vm,
+                            unformat_input_t * main_input,
+                            vlib_cli_command_t * cmd)
+{
+  unformat_input_t _line_input, * line_input = &_line_input;
+  ip6_main_t * im = &ip6_main;
+  ip_lookup_main_t * lm = &im->lookup_main;
+  ip6_add_del_route_args_t a;
+  ip6_fib_t * fib;
+  ip6_address_t * blocks = 0, * routes = 0, * addrs = 0;
+  u8 * lengths = 0;
+  u32 * adjs = 0, * results = 0;
+  u32 table_id = 0, n_routes = 100000, n_lookups = 1000000, n_adjs = 16;
+  u32 seed = 0xdeadbeef, fib_index, i, j, adj_index, n_blocks, errors = 0;
+  u64 t0, t1;
+  f64 clocks_hash, clocks_mtrie, clocks_mtrie_x4;
+  int keep = 0;
+
+  /* Get a line of input, if any. */
+  if (unformat_user (main_input, unformat_line_input, line_input))
+    {
+      while (unformat_check_input (line_input) != UNFORMAT_END_OF_INPUT)
+        {
+          if (unformat (line_input, "table %d", &table_id))
+            ;
+          else if (unformat (line_input, "routes %d", &n_routes))
+            ;
+          else if (unformat (line_input, "lookups %d", &n_lookups))
+            ;
+          else if (unformat (line_input, "seed %d", &seed))
+            ;
+          else if (unformat (line_input, "keep"))
+            keep = 1;
+          else
+            return clib_error_return (0, "unknown input `%U'",
+                                      format_unformat_error, line_input);
+        }
+      unformat_free (line_input);
+    }
+
+  if (n_routes == 0)
+    return clib_error_return (0, "need at least one route");
+
+  n_lookups = round_pow2 (clib_max (n_lookups, 4), 4);
+
+  fib = find_ip6_fib_by_table_index_or_id (im, table_id,
+                                           IP6_ROUTE_FLAG_TABLE_ID);
+  fib_index = fib - im->fibs;
+
+  for (i = 0; i < n_adjs; i++)
+    {
+      ip_adjacency_t * adj;
+      adj = ip_add_adjacency (lm, /* template */ 0, /* block size */ 1,
+                              &adj_index);
+      adj->lookup_next_index = IP_LOOKUP_NEXT_DROP;
+      vec_add1 (adjs, adj_index);
+    }
+
+  /* 
+   * Global unicast prefixes, clustered the way real tables are:
+   * a few registry /12s, provider /32s inside those, and more specifics
+   * carved out of the provider blocks.
+   */
+  n_blocks = clib_max (1, n_routes / 16);
+  vec_validate (blocks, n_blocks - 1);
+  for (i = 0; i < n_blocks; i++)
+    {
+      blocks[i].as_u64[0] = ((u64) (0x200 | (random_u32 (&seed) & 0xf)) << 52
+                             | (u64) (random_u32 (&seed) & 0xfffff) << 32);
+      blocks[i].as_u64[0] = clib_host_to_net_u64 (blocks[i].as_u64[0]);
+      blocks[i].as_u64[1] = 0;
+    }
+
+  vec_validate (routes, n_routes - 1);
+  vec_validate (lengths, n_routes - 1);
+  for (i = 0; i < n_routes; i++)
+    {
+      ip6_address_t * b = &blocks[random_u32 (&seed) % n_blocks];
+      u32 len = test_ip6_prefix_lengths
+        [random_u32 (&seed) % ARRAY_LEN (test_ip6_prefix_lengths)];
+
+      for (j = 0; j < ARRAY_LEN (routes[i].as_u32); j++)
+        routes[i].as_u32[j] = random_u32 (&seed);
+      for (j = 0; j < ARRAY_LEN (routes[i].as_u64); j++)
+        routes[i].as_u64[j] = ((routes[i].as_u64[j] & ~im->fib_masks[32].as_u64[j])
+                               | b->as_u64[j]);
+      ip6_address_mask (&routes[i], &im->fib_masks[len]);
+      lengths[i] = len;
+    }
+
+  memset (&a, 0, sizeof (a));
+  a.table_index_or_table_id = fib_index;
+  a.flags = (IP6_ROUTE_FLAG_ADD
+             | IP6_ROUTE_FLAG_FIB_INDEX
+             | IP6_ROUTE_FLAG_KEEP_OLD_ADJACENCY
+             | IP6_ROUTE_FLAG_NO_REDISTRIBUTE);
+
+  t0 = clib_cpu_time_now ();
+  for (i = 0; i < n_routes; i++)
+    {
+      a.dst_address = routes[i];
+      a.dst_address_length = lengths[i];
+      a.adj_index = adjs[i % n_adjs];
+      ip6_add_del_route (im, &a);
+    }
+  t1 = clib_cpu_time_now ();
+
+  vlib_cli_output (vm, "%d routes, %d prefix lengths, %.2e routes/sec",
+                   n_routes, vec_len (im->prefix_lengths_in_search_order),
+                   (f64) n_routes / ((f64)(t1 - t0) *
+                                     vm->clib_time.seconds_per_clock));
+  vlib_cli_output (vm, "%U", format_ip6_fib_mtrie, &fib->mtrie);
+
+  /* Mostly hits: random host bits under a random route */
+  vec_validate (addrs, n_lookups - 1);
+  vec_validate (results, n_lookups - 1);
+  for (i = 0; i < n_lookups; i++)
+    {
+      ip6_address_t * r = &routes[random_u32 (&seed) % n_routes];
+      for (j = 0; j < ARRAY_LEN (addrs[i].as_u32); j++)
+        addrs[i].as_u32[j] = random_u32 (&seed);
+      if (i % 8)
+        for (j = 0; j < ARRAY_LEN (addrs[i].as_u64); j++)
+          addrs[i].as_u64[j] = (r->as_u64[j]
+                                | (addrs[i].as_u64[j]
+                                   & ~im->fib_masks[lengths[r - routes]].as_u64[j]));
+    }
+
+  t0 = clib_cpu_time_now ();
+  for (i = 0; i < n_lookups; i++)
+    results[i] = ip6_fib_lookup_with_table_hash (im, fib_index, &addrs[i]);
+  t1 = clib_cpu_time_now ();
+  clocks_hash = (f64)(t1 - t0) / n_lookups;
+
+  t0 = clib_cpu_time_now ();
+  for (i = 0; i < n_lookups; i++)
+    errors += results[i] != ip6_fib_mtrie_lookup (&fib->mtrie, &addrs[i]);
+  t1 = clib_cpu_time_now ();
+  clocks_mtrie = (f64)(t1 - t0) / n_lookups;
+
+  t0 = clib_cpu_time_now ();
+  for (i = 0; i < n_lookups; i += 4)
+    {
+      u32 r[4];
+      ip6_mtrie_lookup_x4 (&fib->mtrie, &addrs[i], r);
+      errors += ((r[0] != results[i + 0]) + (r[1] != results[i + 1])
+                 + (r[2] != results[i + 2]) + (r[3] != results[i + 3]));
+    }
+  t1 = clib_cpu_time_now ();
+  clocks_mtrie_x4 = (f64)(t1 - t0) / n_lookups;
+
+  vlib_cli_output (vm, "%d lookups: bihash walk %.2f, mtrie %.2f, "
+                   "mtrie x4 %.2f clocks/lookup",
+                   n_lookups, clocks_hash, clocks_mtrie, clocks_mtrie_x4);
+
+  if (! keep)
+    {
+      a.flags = (IP6_ROUTE_FLAG_DEL
+                 | IP6_ROUTE_FLAG_FIB_INDEX
+                 | IP6_ROUTE_FLAG_KEEP_OLD_ADJACENCY
+                 | IP6_ROUTE_FLAG_NO_REDISTRIBUTE);
+      for (i = 0; i < n_routes; i++)
+        {
+          a.dst_address = routes[i];
+          a.dst_address_length = lengths[i];
+          a.adj_index = ~0;
+          ip6_add_del_route (im, &a);
+
+          /* Spot check the mtrie as routes are withdrawn */
+          if ((i % 64) == 0)
+            for (j = 0; j < 64; j++)
+              {
+                ip6_address_t * x = &addrs[random_u32 (&seed) % n_lookups];
+                errors += (ip6_fib_lookup_with_table_hash (im, fib_index, x)
+                           != ip6_fib_mtrie_lookup (&fib->mtrie, x));
+              }
+        }
+
+      for (i = 0; i < n_adjs; i++)
+        ip_del_adjacency (lm, adjs[i]);
+
+      vlib_cli_output (vm, "after delete: %U", format_ip6_fib_mtrie,
+                       &fib->mtrie);
+    }
+
+  if (errors)
+    vlib_cli_output (vm, "%d mtrie / bihash mismatches", errors);
+  else
+    vlib_cli_output (vm, "mtrie and bihash agree");
+
+  vec_free (blocks);
+  vec_free (routes);
+  vec_free (lengths);
+  vec_free (addrs);
+  vec_free (results);
+  vec_free (adjs);
+  return 0;
+}
+
+VLIB_CLI_COMMAND (test_ip6_lookup_command, static) = {
+  .path = "test ip6 lookup",
+  .short_help = "test ip6 lookup [table <id>] [routes <nn>] [lookups <nn>] "
+  "[seed <nn>] [keep]",
+  .function = test_ip6_lookup_command_fn,
+};
+
 static clib_error_t *
 ip6_config (vlib_main_t * vm, unformat_input_t * input)
 {
@@ -0,0 +1,485 @@
+/*
+ * Copyright (c) 2016 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * ip/ip6_mtrie.c: ip6 mtrie fib
+ *
+ * Longest prefix match structure sitting next to the ip6 bihash.
+ * The bihash remains the authoritative (prefix, length) -> adjacency
+ * store; the mtrie is derived from it and used by the forwarding path.
+ */
+
+#include <vnet/ip/ip.h>
+
+static void
+ply_init (ip6_fib_mtrie_ply_t * p, ip6_fib_mtrie_leaf_t init, uword prefix_len)
+{
+  p->n_non_empty_leafs = ip6_fib_mtrie_leaf_is_empty (init) ? 0 : ARRAY_LEN (p->leaves);
+  memset (p->dst_address_bits_of_leaves, prefix_len, sizeof (p->dst_address_bits_of_leaves));
+
+  /* Initialize leaves. */
+#if defined (CLIB_HAVE_VEC128) && ! defined (__ALTIVEC__)
+  {
+    u32x4 * l, init_x4;
+
+    init_x4 = u32x4_splat (init);
+
+    for (l = p->leaves_as_u32x4; l < p->leaves_as_u32x4 + ARRAY_LEN (p->leaves_as_u32x4); l += 4)
+      {
+	l[0] = init_x4;
+	l[1] = init_x4;
+	l[2] = init_x4;
+	l[3] = init_x4;
+      }
+  }
+#else
+  {
+    u32 * l;
+
+    for (l = p->leaves; l < p->leaves + ARRAY_LEN (p->leaves); l += 4)
+      {
+	l[0] = init;
+	l[1] = init;
+	l[2] = init;
+	l[3] = init;
+      }
+  }
+#endif
+}
+
+/* Retired plies held before the route code waits for the workers */
+#define IP6_FIB_MTRIE_MAX_RETIRED_PLIES 1024
+
+/* Would the next pool_get move the ply pool out from under the workers? */
+static uword
+ply_pool_will_expand (ip6_fib_mtrie_t * m)
+{
+  uword header_bytes, new_bytes;
+
+  if (! m->ply_pool)
+    return 1;
+
+  if (vec_len (pool_header (m->ply_pool)->free_indices) > 0)
+    return 0;
+
+  header_bytes = vec_header_bytes (pool_aligned_header_bytes);
+  new_bytes = (vec_len (m->ply_pool) + 1) * sizeof (m->ply_pool[0]) + header_bytes;
+
+  return new_bytes > clib_mem_size ((void *) m->ply_pool - header_bytes);
+}
+
+static ip6_fib_mtrie_leaf_t
+ply_create (ip6_fib_mtrie_t * m, ip6_fib_mtrie_leaf_t init_leaf, uword prefix_len)
+{
+  vlib_main_t * vm = vlib_get_main ();
+  ip6_fib_mtrie_ply_t * p;
+
+  /* Get cache aligned ply.  Only a pool resize needs the barrier; the
+     new ply is not reachable until the caller links it in. */
+  if (ply_pool_will_expand (m))
+    {
+      vlib_worker_thread_barrier_sync (vm);
+      pool_get_aligned (m->ply_pool, p, sizeof (p[0]));
+      vlib_worker_thread_barrier_release (vm);
+    }
+  else
+    pool_get_aligned (m->ply_pool, p, sizeof (p[0]));
+
+  ply_init (p, init_leaf, prefix_len);
+  return ip6_fib_mtrie_leaf_set_next_ply_index (p - m->ply_pool);
+}
+
+always_inline ip6_fib_mtrie_ply_t *
+get_next_ply_for_leaf (ip6_fib_mtrie_t * m, ip6_fib_mtrie_leaf_t l)
+{
+  uword n = ip6_fib_mtrie_leaf_get_next_ply_index (l);
+  /* It better not be the root ply. */
+  ASSERT (n != 0);
+  return pool_elt_at_index (m->ply_pool, n);
+}
+
+/* Caller is unlinking p; it is freed by ply_reclaim after a grace period */
+static void
+ply_retire (ip6_fib_mtrie_t * m, ip6_fib_mtrie_ply_t * p)
+{
+  ip6_fib_mtrie_retired_ply_t * r;
+
+  vec_add2 (m->retired_plies, r, 1);
+  r->ply_index = p - m->ply_pool;
+  r->epoch = ~0ULL;
+}
+
+/* Stamp plies retired by this route change, now that they are unlinked */
+static void
+ply_retire_commit (ip6_fib_mtrie_t * m)
+{
+  word i;
+  u64 epoch;
+
+  i = vec_len (m->retired_plies) - 1;
+  if (i < 0 || m->retired_plies[i].epoch != ~0ULL)
+    return;
+
+  epoch = vlib_rcu_advance ();
+  for (; i >= 0 && m->retired_plies[i].epoch == ~0ULL; i--)
+    m->retired_plies[i].epoch = epoch;
+}
+
+static void
+ply_reclaim (ip6_fib_mtrie_t * m)
+{
+  ip6_fib_mtrie_retired_ply_t * r;
+  uword n = 0;
+
+  /* Oldest first, epochs only go up */
+  vec_foreach (r, m->retired_plies)
+    {
+      if (r->epoch == ~0ULL || ! vlib_rcu_is_done (r->epoch))
+	break;
+      pool_put_index (m->ply_pool, r->ply_index);
+      n++;
+    }
+
+  if (n > 0)
+    vec_delete (m->retired_plies, n, 0);
+}
+
+void ip6_mtrie_init (ip6_fib_mtrie_t * m)
+{
+  ip6_fib_mtrie_leaf_t root;
+  memset (m, 0, sizeof (m[0]));
+  m->default_leaf = IP6_FIB_MTRIE_LEAF_EMPTY;
+  root = ply_create (m, IP6_FIB_MTRIE_LEAF_EMPTY, /* dst_address_bits_of_leaves */ 0);
+  ASSERT (ip6_fib_mtrie_leaf_get_next_ply_index (root) == 0);
+}
+
+void ip6_mtrie_free (ip6_fib_mtrie_t * m)
+{
+  pool_free (m->ply_pool);
+  vec_free (m->retired_plies);
+  m->default_leaf = IP6_FIB_MTRIE_LEAF_EMPTY;
+}
+
+typedef struct {
+  ip6_address_t dst_address;
+  u32 dst_address_length;
+  u32 adj_index;
+} ip6_fib_mtrie_set_unset_leaf_args_t;
+
+static void
+set_ply_with_more_specific_leaf (ip6_fib_mtrie_t * m,
+				 ip6_fib_mtrie_ply_t * ply,
+				 ip6_fib_mtrie_leaf_t new_leaf,
+				 uword new_leaf_dst_address_bits)
+{
+  ip6_fib_mtrie_leaf_t old_leaf;
+  uword i;
+
+  ASSERT (ip6_fib_mtrie_leaf_is_terminal (new_leaf));
+  ASSERT (! ip6_fib_mtrie_leaf_is_empty (new_leaf));
+
+  for (i = 0; i < ARRAY_LEN (ply->leaves); i++)
+    {
+      old_leaf = ply->leaves[i];
+
+      /* Recurse into sub plies. */
+      if (! ip6_fib_mtrie_leaf_is_terminal (old_leaf))
+	{
+	  ip6_fib_mtrie_ply_t * sub_ply = get_next_ply_for_leaf (m, old_leaf);
+	  set_ply_with_more_specific_leaf (m, sub_ply, new_leaf, new_leaf_dst_address_bits);
+	}
+
+      /* Replace less specific terminal leaves with new leaf. */
+      else if (new_leaf_dst_address_bits >= ply->dst_address_bits_of_leaves[i])
+	{
+	  __sync_val_compare_and_swap (&ply->leaves[i], old_leaf, new_leaf);
+	  ASSERT (ply->leaves[i] == new_leaf);
+	  ply->dst_address_bits_of_leaves[i] = new_leaf_dst_address_bits;
+	  ply->n_non_empty_leafs += ip6_fib_mtrie_leaf_is_empty (old_leaf);
+	}
+    }
+}
+
+static void
+set_leaf (ip6_fib_mtrie_t * m,
+	  ip6_fib_mtrie_set_unset_leaf_args_t * a,
+	  u32 old_ply_index,
+	  u32 dst_address_byte_index)
+{
+  ip6_fib_mtrie_leaf_t old_leaf, new_leaf;
+  i32 n_dst_bits_next_plies;
+  u8 dst_byte;
+
+  ASSERT (a->dst_address_length > 0 && a->dst_address_length <= 128);
+  ASSERT (dst_address_byte_index < ARRAY_LEN (a->dst_address.as_u8));
+
+  n_dst_bits_next_plies = a->dst_address_length - BITS (u8) * (dst_address_byte_index + 1);
+
+  dst_byte = a->dst_address.as_u8[dst_address_byte_index];
+
+  /* Number of bits next plies <= 0 => insert leaves this ply. */
+  if (n_dst_bits_next_plies <= 0)
+    {
+      uword i, n_dst_bits_this_ply, old_leaf_is_terminal;
+
+      n_dst_bits_this_ply = -n_dst_bits_next_plies;
+      ASSERT ((a->dst_address.as_u8[dst_address_byte_index] & pow2_mask (n_dst_bits_this_ply)) == 0);
+
+      for (i = dst_byte; i < dst_byte + (1 << n_dst_bits_this_ply); i++)
+	{
+	  ip6_fib_mtrie_ply_t * old_ply, * new_ply;
+
+	  old_ply = pool_elt_at_index (m->ply_pool, old_ply_index);
+
+	  old_leaf = old_ply->leaves[i];
+	  old_leaf_is_terminal = ip6_fib_mtrie_leaf_is_terminal (old_leaf);
+
+	  /* Is leaf to be inserted more specific? */
+	  if (a->dst_address_length >= old_ply->dst_address_bits_of_leaves[i])
+	    {
+	      new_leaf = ip6_fib_mtrie_leaf_set_adj_index (a->adj_index);
+
+	      if (old_leaf_is_terminal)
+		{
+		  old_ply->dst_address_bits_of_leaves[i] = a->dst_address_length;
+		  __sync_val_compare_and_swap (&old_ply->leaves[i], old_leaf,
+					       new_leaf);
+		  ASSERT (old_ply->leaves[i] == new_leaf);
+		  old_ply->n_non_empty_leafs += ip6_fib_mtrie_leaf_is_empty (old_leaf);
+		  ASSERT (old_ply->n_non_empty_leafs <= ARRAY_LEN (old_ply->leaves));
+		}
+	      else
+		{
+		  /* Existing leaf points to another ply.  We need to place new_leaf into all
+		     more specific slots. */
+		  new_ply = get_next_ply_for_leaf (m, old_leaf);
+		  set_ply_with_more_specific_leaf (m, new_ply, new_leaf, a->dst_address_length);
+		}
+	    }
+
+	  else if (! old_leaf_is_terminal)
+	    {
+	      new_ply = get_next_ply_for_leaf (m, old_leaf);
+	      set_leaf (m, a, new_ply - m->ply_pool, dst_address_byte_index + 1);
+	    }
+	}
+    }
+  else
+    {
+      ip6_fib_mtrie_ply_t * old_ply, * new_ply;
+
+      old_ply = pool_elt_at_index (m->ply_pool, old_ply_index);
+      old_leaf = old_ply->leaves[dst_byte];
+      if (ip6_fib_mtrie_leaf_is_terminal (old_leaf))
+	{
+	  new_leaf = ply_create (m, old_leaf, old_ply->dst_address_bits_of_leaves[dst_byte]);
+	  new_ply = get_next_ply_for_leaf (m, new_leaf);
+
+	  /* Refetch since ply_create may move pool. */
+	  old_ply = pool_elt_at_index (m->ply_pool, old_ply_index);
+
+	  __sync_val_compare_and_swap (&old_ply->leaves[dst_byte], old_leaf,
+				       new_leaf);
+	  ASSERT (old_ply->leaves[dst_byte] == new_leaf);
+	  old_ply->dst_address_bits_of_leaves[dst_byte] = 0;
+
+	  old_ply->n_non_empty_leafs -= ip6_fib_mtrie_leaf_is_non_empty (old_leaf);
+	  ASSERT (old_ply->n_non_empty_leafs >= 0);
+
+	  /* Account for the ply we just created. */
+	  old_ply->n_non_empty_leafs += 1;
+	}
+      else
+	new_ply = get_next_ply_for_leaf (m, old_leaf);
+
+      set_leaf (m, a, new_ply - m->ply_pool, dst_address_byte_index + 1);
+    }
+}
+
+static uword
+unset_leaf (ip6_fib_mtrie_t * m,
+	    ip6_fib_mtrie_set_unset_leaf_args_t * a,
+	    ip6_fib_mtrie_ply_t * old_ply,
+	    u32 dst_address_byte_index)
+{
+  ip6_fib_mtrie_leaf_t old_leaf, del_leaf;
+  i32 n_dst_bits_next_plies;
+  uword i, n_dst_bits_this_ply, old_leaf_is_terminal;
+  u8 dst_byte;
+
+  ASSERT (a->dst_address_length > 0 && a->dst_address_length <= 128);
+  ASSERT (dst_address_byte_index < ARRAY_LEN (a->dst_address.as_u8));
+
+  n_dst_bits_next_plies = a->dst_address_length - BITS (u8) * (dst_address_byte_index + 1);
+
+  dst_byte = a->dst_address.as_u8[dst_address_byte_index];
+  if (n_dst_bits_next_plies < 0)
+    dst_byte &= ~pow2_mask (-n_dst_bits_next_plies);
+
+  n_dst_bits_this_ply = n_dst_bits_next_plies <= 0 ? -n_dst_bits_next_plies : 0;
+  n_dst_bits_this_ply = clib_min (8, n_dst_bits_this_ply);
+
+  del_leaf = ip6_fib_mtrie_leaf_set_adj_index (a->adj_index);
+
+  for (i = dst_byte; i < dst_byte + (1 << n_dst_bits_this_ply); i++)
+    {
+      old_leaf = old_ply->leaves[i];
+      old_leaf_is_terminal = ip6_fib_mtrie_leaf_is_terminal (old_leaf);
+
+      /* Only remove leaves owned by this prefix: a more specific route
+	 may legitimately share the same adjacency. */
+      if ((old_leaf == del_leaf
+	   && old_ply->dst_address_bits_of_leaves[i] == a->dst_address_length)
+	  || (! old_leaf_is_terminal
+	      && unset_leaf (m, a, get_next_ply_for_leaf (m, old_leaf), dst_address_byte_index + 1)))
+	{
+	  old_ply->leaves[i] = IP6_FIB_MTRIE_LEAF_EMPTY;
+	  old_ply->dst_address_bits_of_leaves[i] = 0;
+
+	  /* No matter what we just deleted a non-empty leaf. */
+	  ASSERT (! ip6_fib_mtrie_leaf_is_empty (old_leaf));
+	  old_ply->n_non_empty_leafs -= 1;
+
+	  ASSERT (old_ply->n_non_empty_leafs >= 0);
+	  if (old_ply->n_non_empty_leafs == 0 && dst_address_byte_index > 0)
+	    {
+	      ply_retire (m, old_ply);
+	      /* Old ply was deleted. */
+	      return 1;
+	    }
+	}
+    }
+
+  /* Old ply was not deleted. */
+  return 0;
+}
+
+void
+ip6_fib_mtrie_add_del_route (ip6_fib_t * fib,
+			     ip6_address_t * dst_address,
+			     u32 dst_address_length,
+			     u32 adj_index,
+			     u32 is_del)
+{
+  ip6_fib_mtrie_t * m = &fib->mtrie;
+  ip6_fib_mtrie_ply_t * root_ply;
+  ip6_fib_mtrie_set_unset_leaf_args_t a;
+  ip6_main_t * im = &ip6_main;
+
+  ASSERT (m->ply_pool != 0);
+
+  ply_reclaim (m);
+
+  root_ply = pool_elt_at_index (m->ply_pool, 0);
+
+  /* Honor dst_address_length. */
+  a.dst_address = dst_address[0];
+  ip6_address_mask (&a.dst_address, &im->fib_masks[dst_address_length]);
+  a.dst_address_length = dst_address_length;
+  a.adj_index = adj_index;
+
+  if (! is_del)
+    {
+      if (dst_address_length == 0)
+	m->default_leaf = ip6_fib_mtrie_leaf_set_adj_index (adj_index);
+      else
+	set_leaf (m, &a, /* ply_index */ 0, /* dst_address_byte_index */ 0);
+    }
+  else
+    {
+      if (dst_address_length == 0)
+	m->default_leaf = IP6_FIB_MTRIE_LEAF_EMPTY;
+
+      else
+	{
+	  BVT(clib_bihash_kv) kv, value;
+	  ip6_address_t key;
+	  int i;
+
+	  unset_leaf (m, &a, root_ply, 0);
+
+	  /* Find next less specific route and insert into mtrie. */
+	  for (i = dst_address_length - 1; i >= 1; i--)
+	    {
+	      if (! clib_bitmap_get (im->non_empty_dst_address_length_bitmap,
+				     128 - i))
+		continue;
+
+	      key = a.dst_address;
+	      ip6_address_mask (&key, &im->fib_masks[i]);
+
+	      kv.key[0] = key.as_u64[0];
+	      kv.key[1] = key.as_u64[1];
+	      kv.key[2] = ((u64)(fib->index)<<32) | i;
+
+	      if (BV(clib_bihash_search)(&im->ip6_lookup_table, &kv, &value) == 0)
+		{
+		  a.dst_address = key;
+		  a.dst_address_length = i;
+		  a.adj_index = value.value;
+		  set_leaf (m, &a, /* ply_index */ 0, /* dst_address_byte_index */ 0);
+		  break;
+		}
+	    }
+	}
+    }
+
+  ply_retire_commit (m);
+
+  /* Don't let a worker that stops reporting pin an unbounded number of
+     plies; wait the grace period out instead. */
+  if (vec_len (m->retired_plies) > IP6_FIB_MTRIE_MAX_RETIRED_PLIES)
+    {
+      vlib_rcu_synchronize (vlib_get_main ());
+      ply_reclaim (m);
+    }
+}
+
+/* Returns number of bytes of memory used by mtrie. */
+static uword mtrie_memory_usage (ip6_fib_mtrie_t * m)
+{
+  return pool_elts (m->ply_pool) * sizeof (m->ply_pool[0]);
+}
+
+static uword mtrie_max_depth (ip6_fib_mtrie_t * m, ip6_fib_mtrie_ply_t * p)
+{
+  uword i, d, max_depth = 0;
+
+  for (i = 0 ; i < ARRAY_LEN (p->leaves); i++)
+    {
+      ip6_fib_mtrie_leaf_t l = p->leaves[i];
+      if (ip6_fib_mtrie_leaf_is_next_ply (l))
+	{
+	  d = mtrie_max_depth (m, get_next_ply_for_leaf (m, l));
+	  max_depth = clib_max (max_depth, d);
+	}
+    }
+
+  return 1 + max_depth;
+}
+
+u8 * format_ip6_fib_mtrie (u8 * s, va_list * va)
+{
+  ip6_fib_mtrie_t * m = va_arg (*va, ip6_fib_mtrie_t *);
+
+  s = format (s, "mtrie: %d plies, memory usage %U",
+	      pool_elts (m->ply_pool),
+	      format_memory_size, mtrie_memory_usage (m));
+
+  if (pool_elts (m->ply_pool) > 0)
+    s = format (s, ", max lookup depth %d",
+		mtrie_max_depth (m, pool_elt_at_index (m->ply_pool, 0)));
+
+  return s;
+}
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2016 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * ip/ip6_mtrie.h: ip6 mtrie fib
+ *
+ * Same scheme as the ip4 mtrie: 8 bit plies, leaves are either terminal
+ * (adjacency index) or point at the next ply.  Lookups stop at the first
+ * terminal leaf, so a /48 costs at most 6 dependent loads regardless of
+ * how many distinct prefix lengths are present in the table.
+ */
+
+#ifndef included_ip_ip6_mtrie_h
+#define included_ip_ip6_mtrie_h
+
+#include <vppinfra/cache.h>
+#include <vppinfra/vector.h>
+#include <vnet/ip/lookup.h>
+#include <vnet/ip/ip6_packet.h>	/* for ip6_address_t */
+
+/* ip6 fib leafs: up to 16 ply 8-8-...-8 mtrie.
+   1 + 2*adj_index for terminal leaves.
+   0 + 2*next_ply_index for non-terminals.
+   1 => empty (adjacency index of zero is special miss adjacency). */
+typedef u32 ip6_fib_mtrie_leaf_t;
+
+#define IP6_FIB_MTRIE_LEAF_EMPTY (1 + 2*IP_LOOKUP_MISS_ADJ_INDEX)
+#define IP6_FIB_MTRIE_LEAF_ROOT  (0 + 2*0)
+
+always_inline u32 ip6_fib_mtrie_leaf_is_empty (ip6_fib_mtrie_leaf_t n)
+{ return n == IP6_FIB_MTRIE_LEAF_EMPTY; }
+
+always_inline u32 ip6_fib_mtrie_leaf_is_non_empty (ip6_fib_mtrie_leaf_t n)
+{ return n != IP6_FIB_MTRIE_LEAF_EMPTY; }
+
+always_inline u32 ip6_fib_mtrie_leaf_is_terminal (ip6_fib_mtrie_leaf_t n)
+{ return n & 1; }
+
+always_inline u32 ip6_fib_mtrie_leaf_get_adj_index (ip6_fib_mtrie_leaf_t n)
+{
+  ASSERT (ip6_fib_mtrie_leaf_is_terminal (n));
+  return n >> 1;
+}
+
+always_inline ip6_fib_mtrie_leaf_t ip6_fib_mtrie_leaf_set_adj_index (u32 adj_index)
+{
+  ip6_fib_mtrie_leaf_t l;
+  l = 1 + 2*adj_index;
+  ASSERT (ip6_fib_mtrie_leaf_get_adj_index (l) == adj_index);
+  return l;
+}
+
+always_inline u32 ip6_fib_mtrie_leaf_is_next_ply (ip6_fib_mtrie_leaf_t n)
+{ return (n & 1) == 0; }
+
+always_inline u32 ip6_fib_mtrie_leaf_get_next_ply_index (ip6_fib_mtrie_leaf_t n)
+{
+  ASSERT (ip6_fib_mtrie_leaf_is_next_ply (n));
+  return n >> 1;
+}
+
+always_inline ip6_fib_mtrie_leaf_t ip6_fib_mtrie_leaf_set_next_ply_index (u32 i)
+{
+  ip6_fib_mtrie_leaf_t l;
+  l = 0 + 2*i;
+  ASSERT (ip6_fib_mtrie_leaf_get_next_ply_index (l) == i);
+  return l;
+}
+
+/* One ply of the ip6 mtrie fib. */
+typedef struct {
+  union {
+    ip6_fib_mtrie_leaf_t leaves[256];
+
+#ifdef CLIB_HAVE_VEC128
+    u32x4 leaves_as_u32x4[256 / 4];
+#endif
+  };
+
+  /* Prefix length for terminal leaves. */
+  u8 dst_address_bits_of_leaves[256];
+
+  /* Number of non-empty leafs (whether terminal or not). */
+  i32 n_non_empty_leafs;
+
+  /* Pad to cache line boundary. */
+  u8 pad[CLIB_CACHE_LINE_BYTES
+	 - 1 * sizeof (i32)];
+} ip6_fib_mtrie_ply_t;
+
+typedef struct {
+  u32 ply_index;
+
+  /* rcu epoch, ~0 until the unlinking route change is complete */
+  u64 epoch;
+} ip6_fib_mtrie_retired_ply_t;
+
+typedef struct {
+  /* Pool of plies.  Index zero is root ply. */
+  ip6_fib_mtrie_ply_t * ply_pool;
+
+  /* Plies unlinked from the trie.  Workers may still be walking them,
+     they go back to the pool once vlib_rcu_is_done says so. */
+  ip6_fib_mtrie_retired_ply_t * retired_plies;
+
+  /* Special case leaf for default route ::/0. */
+  ip6_fib_mtrie_leaf_t default_leaf;
+} ip6_fib_mtrie_t;
+
+void ip6_mtrie_init (ip6_fib_mtrie_t * m);
+
+void ip6_mtrie_free (ip6_fib_mtrie_t * m);
+
+struct ip6_fib_t;
+
+void ip6_fib_mtrie_add_del_route (struct ip6_fib_t * f,
+				  ip6_address_t * dst_address,
+				  u32 dst_address_length,
+				  u32 adj_index,
+				  u32 is_del);
+
+format_function_t format_ip6_fib_mtrie;
+
+/* Lookup step.  Processes 1 byte of 16 byte ip6 address. */
+always_inline ip6_fib_mtrie_leaf_t
+ip6_fib_mtrie_lookup_step (ip6_fib_mtrie_t * m,
+			   ip6_fib_mtrie_leaf_t current_leaf,
+			   ip6_address_t * dst_address,
+			   u32 dst_address_byte_index)
+{
+  ip6_fib_mtrie_leaf_t next_leaf;
+  ip6_fib_mtrie_ply_t * ply;
+  uword current_is_terminal = ip6_fib_mtrie_leaf_is_terminal (current_leaf);
+
+  ply = m->ply_pool + (current_is_terminal ? 0 : (current_leaf >> 1));
+  next_leaf = ply->leaves[dst_address->as_u8[dst_address_byte_index]];
+  next_leaf = current_is_terminal ? current_leaf : next_leaf;
+
+  return next_leaf;
+}
+
+/* Prefetch the leaf the next lookup step will read. */
+always_inline void
+ip6_fib_mtrie_prefetch_step (ip6_fib_mtrie_t * m,
+			     ip6_fib_mtrie_leaf_t current_leaf,
+			     ip6_address_t * dst_address,
+			     u32 dst_address_byte_index)
+{
+  ip6_fib_mtrie_ply_t * ply;
+
+  if (ip6_fib_mtrie_leaf_is_terminal (current_leaf)
+      || dst_address_byte_index >= ARRAY_LEN (dst_address->as_u8))
+    return;
+
+  ply = m->ply_pool + (current_leaf >> 1);
+  CLIB_PREFETCH (&ply->leaves[dst_address->as_u8[dst_address_byte_index]],
+		 sizeof (ply->leaves[0]), LOAD);
+}
+
+/* Returns adjacency index; default route / miss if nothing matches. */
+always_inline u32
+ip6_fib_mtrie_lookup (ip6_fib_mtrie_t * m, ip6_address_t * dst_address)
+{
+  ip6_fib_mtrie_leaf_t leaf;
+  u32 i;
+
+  leaf = IP6_FIB_MTRIE_LEAF_ROOT;
+  for (i = 0; i < ARRAY_LEN (dst_address->as_u8); i++)
+    {
+      leaf = ip6_fib_mtrie_lookup_step (m, leaf, dst_address, i);
+      if (ip6_fib_mtrie_leaf_is_terminal (leaf))
+	break;
+    }
+
+  /* Handle default route. */
+  leaf = (leaf == IP6_FIB_MTRIE_LEAF_EMPTY ? m->default_leaf : leaf);
+
+  return ip6_fib_mtrie_leaf_get_adj_index (leaf);
+}
+
+#endif /* included_ip_ip6_mtrie_h */
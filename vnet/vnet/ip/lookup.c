@@ -198,8 +198,19 @@ ip_add_adjacency (ip_lookup_main_t * lm,
 
   ip_poison_adjacencies (adj, n_adj);
 
-  /* Validate adjacency counters. */
-  vlib_validate_combined_counter (&lm->adjacency_counters, ai + n_adj - 1);
+  /* Validate adjacency counters.  Workers bump them, so moving the
+     per-thread vectors needs the barrier. */
+  if (vlib_validate_combined_counter_will_expand (&lm->adjacency_counters,
+                                                  ai + n_adj - 1))
+    {
+      vlib_main_t * vm = vlib_get_main ();
+
+      vlib_worker_thread_barrier_sync (vm);
+      vlib_validate_combined_counter (&lm->adjacency_counters, ai + n_adj - 1);
+      vlib_worker_thread_barrier_release (vm);
+    }
+  else
+    vlib_validate_combined_counter (&lm->adjacency_counters, ai + n_adj - 1);
 
   for (i = 0; i < n_adj; i++)
     {
@@ -277,8 +288,7 @@ static void ip_del_adjacency2 (ip_lookup_main_t * lm, u32 adj_index, u32 delete_
   if (delete_multipath_adjacency)
     ip_multipath_del_adjacency (lm, adj_index);
 
-  ip_poison_adjacencies (adj, adj->n_adj);
-
+  /* aa_free poisons the block once the workers are done with it */
   aa_free (lm->adjacency_heap, adj);
 }
 
@@ -1878,6 +1888,12 @@ ip4_show_fib (vlib_main_t * vm, unformat_input_t * input, vlib_cli_command_t * c
             vlib_cli_output (vm, "Table %d, fib_index %d, flow hash: %U", 
                              fib->table_id, fib - im4->fibs,
                              format_ip_flow_hash_config, fib->flow_hash_config);
+	  vlib_cli_output (vm, "mtrie layout %U, %d plies, memory usage %U",
+			   format_ip4_fib_mtrie_layout,
+			   ip4_fib_mtrie_get_layout (&fib->mtrie),
+			   pool_elts (fib->mtrie.ply_pool),
+			   format_memory_size,
+			   ip4_fib_mtrie_memory_usage (&fib->mtrie));
 	  vlib_cli_output (vm, "%=20s%=16s", "Prefix length", "Count");
 	  for (i = 0; i < ARRAY_LEN (fib->adj_index_by_dst_address); i++)
 	    {
@@ -2138,6 +2154,7 @@ ip6_show_fib (vlib_main_t * vm, unformat_input_t * input, vlib_cli_command_t * c
       vlib_cli_output (vm, "VRF %d, fib_index %d, flow hash: %U", 
                        fib->table_id, fib - im6->fibs,
                        format_ip_flow_hash_config, fib->flow_hash_config);
+      vlib_cli_output (vm, "%U", format_ip6_fib_mtrie, &fib->mtrie);
       
       /* Show summary? */
       if (! verbose)
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __AESNI_MB_H__
+#define __AESNI_MB_H__
+
+/*
+ * Multi-buffer AES-CBC encryption.  CBC encryption of one packet is
+ * serial, each block needs the previous ciphertext, so a single stream
+ * leaves most of the AES-NI pipeline idle.  Here up to
+ * AESNI_MB_N_LANES packets are encrypted in lock step, one block of
+ * each per round trip through the pipeline.
+ */
+
+#ifdef __AES__
+#include <x86intrin.h>
+
+#define AESNI_MB_N_LANES 8
+
+typedef struct {
+  __m128i rk[15];
+  u32 n_rounds;
+} aesni_key_t;
+
+always_inline __m128i
+aesni_key_assist (__m128i k, __m128i t)
+{
+  __m128i s;
+
+  s = _mm_slli_si128 (k, 4);
+  k = _mm_xor_si128 (k, s);
+  s = _mm_slli_si128 (s, 4);
+  k = _mm_xor_si128 (k, s);
+  s = _mm_slli_si128 (s, 4);
+  k = _mm_xor_si128 (k, s);
+  return _mm_xor_si128 (k, t);
+}
+
+always_inline void
+aesni_key_expand_128 (aesni_key_t * k, u8 * key)
+{
+  __m128i * rk = k->rk;
+
+  rk[0] = _mm_loadu_si128 ((__m128i *) key);
+#define _(i,rcon)                                                       \
+  rk[i] = aesni_key_assist (rk[i-1], _mm_shuffle_epi32                  \
+                            (_mm_aeskeygenassist_si128 (rk[i-1], rcon), \
+                             0xff));
+  _(1, 0x01) _(2, 0x02) _(3, 0x04) _(4, 0x08) _(5, 0x10)
+  _(6, 0x20) _(7, 0x40) _(8, 0x80) _(9, 0x1b) _(10, 0x36)
+#undef _
+  k->n_rounds = 10;
+}
+
+always_inline void
+aesni_key_expand_256 (aesni_key_t * k, u8 * key)
+{
+  __m128i * rk = k->rk;
+
+  rk[0] = _mm_loadu_si128 ((__m128i *) key);
+  rk[1] = _mm_loadu_si128 ((__m128i *) (key + 16));
+  /* Even round keys use RotWord+SubWord+rcon, odd ones SubWord only */
+#define _(i,rcon)                                                       \
+  rk[i] = aesni_key_assist (rk[i-2], _mm_shuffle_epi32                  \
+                            (_mm_aeskeygenassist_si128 (rk[i-1], rcon), \
+                             0xff));                                    \
+  if (i < 14)                                                           \
+    rk[i+1] = aesni_key_assist (rk[i-1], _mm_shuffle_epi32              \
+                                (_mm_aeskeygenassist_si128 (rk[i], 0),  \
+                                 0xaa));
+  _(2, 0x01) _(4, 0x02) _(6, 0x04) _(8, 0x08) _(10, 0x10)
+  _(12, 0x20) _(14, 0x40)
+#undef _
+  k->n_rounds = 14;
+}
+
+typedef struct {
+  u8 * src;
+  u8 * dst;
+  u8 * iv;
+  aesni_key_t * key;
+  u32 n_blocks;
+} aesni_mb_job_t;
+
+/* Run n_jobs CBC encryptions, all with keys of the same size */
+always_inline void
+aesni_cbc_encrypt_mb (aesni_mb_job_t * jobs, u32 n_jobs)
+{
+  __m128i x[AESNI_MB_N_LANES];
+  __m128i zero_block = _mm_setzero_si128 ();
+  __m128i dummy_dst;
+  aesni_key_t * k[AESNI_MB_N_LANES];
+  u8 * s[AESNI_MB_N_LANES], * d[AESNI_MB_N_LANES];
+  u32 left[AESNI_MB_N_LANES];
+  u32 next = 0, n_active = 0, n_rounds, l, r;
+
+  if (n_jobs == 0)
+    return;
+
+  n_rounds = jobs[0].key->n_rounds;
+
+  /* Idle lanes spin on a dummy block, so the round loop never branches */
+  for (l = 0; l < AESNI_MB_N_LANES; l++)
+    {
+      k[l] = jobs[0].key;
+      s[l] = (u8 *) &zero_block;
+      d[l] = (u8 *) &dummy_dst;
+      left[l] = 0;
+      x[l] = zero_block;
+    }
+
+  for (l = 0; l < AESNI_MB_N_LANES && next < n_jobs; l++, next++)
+    {
+      aesni_mb_job_t * j = jobs + next;
+
+      ASSERT (j->key->n_rounds == n_rounds && j->n_blocks > 0);
+      k[l] = j->key;
+      s[l] = j->src;
+      d[l] = j->dst;
+      left[l] = j->n_blocks;
+      x[l] = _mm_loadu_si128 ((__m128i *) j->iv);
+      n_active++;
+    }
+
+  while (n_active)
+    {
+      for (l = 0; l < AESNI_MB_N_LANES; l++)
+        x[l] = _mm_xor_si128 (_mm_xor_si128 (x[l], _mm_loadu_si128 
+                                             ((__m128i *) s[l])),
+                              k[l]->rk[0]);
+
+      for (r = 1; r < n_rounds; r++)
+        for (l = 0; l < AESNI_MB_N_LANES; l++)
+          x[l] = _mm_aesenc_si128 (x[l], k[l]->rk[r]);
+
+      for (l = 0; l < AESNI_MB_N_LANES; l++)
+        x[l] = _mm_aesenclast_si128 (x[l], k[l]->rk[n_rounds]);
+
+      for (l = 0; l < AESNI_MB_N_LANES; l++)
+        {
+          _mm_storeu_si128 ((__m128i *) d[l], x[l]);
+
+          if (left[l] == 0)
+            continue;
+
+          s[l] += 16;
+          d[l] += 16;
+          if (--left[l])
+            continue;
+
+          /* Lane done, feed it the next buffer */
+          if (next < n_jobs)
+            {
+              aesni_mb_job_t * j = jobs + next++;
+
+              ASSERT (j->key->n_rounds == n_rounds && j->n_blocks > 0);
+              k[l] = j->key;
+              s[l] = j->src;
+              d[l] = j->dst;
+              left[l] = j->n_blocks;
+              x[l] = _mm_loadu_si128 ((__m128i *) j->iv);
+            }
+          else
+            {
+              s[l] = (u8 *) &zero_block;
+              d[l] = (u8 *) &dummy_dst;
+              n_active--;
+            }
+        }
+    }
+}
+#endif /* __AES__ */
+
+#endif /* __AESNI_MB_H__ */
@@ -20,6 +20,8 @@
 #include <openssl/rand.h>
 #include <openssl/evp.h>
 
+#include <vnet/ipsec/aesni_mb.h>
+
 typedef struct {
   u32 spi;
   u32 seq;
@@ -43,13 +45,48 @@ typedef CLIB_PACKED (struct {
 
 typedef struct {
   const EVP_CIPHER * type;
+  u8 key_len;       /* cipher key, AEAD salt follows it in the SA key */
+  u8 iv_size;
+  u8 block_size;    /* payload + trailer alignment */
+  u8 icv_size;      /* AEAD only, 0 when integrity is a separate HMAC */
 } esp_crypto_alg_t;
 
+/* RFC4106/RFC7634: 4 byte salt from the key + 8 byte explicit IV */
+#define ESP_AEAD_SALT_SIZE 4
+#define ESP_AEAD_NONCE_SIZE 12
+
 typedef struct {
   const EVP_MD * md;
   u8 trunc_size;
 } esp_integ_alg_t;
 
+/* Cipher work for one packet, queued by the esp nodes and run per frame */
+typedef struct {
+  u8 * src;
+  u8 * dst;
+  u8 * iv;
+  u32 n_bytes;
+  u32 sa_index;
+  /* AEAD only: ICV location, nonce, SPI/seq AAD and the ICV check result */
+  u8 * tag;
+  u8 nonce[ESP_AEAD_NONCE_SIZE];
+  u8 aad[12];
+  u8 aad_len;
+  u8 tag_ok;
+} esp_crypto_op_t;
+
+/* Integrity work for one packet, the untruncated digest lands in sig */
+typedef struct {
+  u8 * data;
+  u8 * icv;
+  u32 n_bytes;
+  u32 sa_index;
+  u32 seq_hi;
+  u8 use_esn;
+  u8 icv_size;
+  u8 sig[64];
+} esp_integ_op_t;
+
 typedef struct {
   CLIB_CACHE_LINE_ALIGN_MARK(cacheline0);
   EVP_CIPHER_CTX encrypt_ctx;
@@ -57,9 +94,14 @@ typedef struct {
   EVP_CIPHER_CTX decrypt_ctx;
   CLIB_CACHE_LINE_ALIGN_MARK(cacheline2);
   HMAC_CTX hmac_ctx;
-  ipsec_crypto_alg_t last_encrypt_alg;
-  ipsec_crypto_alg_t last_decrypt_alg;
-  ipsec_integ_alg_t last_integ_alg;
+  CLIB_CACHE_LINE_ALIGN_MARK(cacheline3);
+  /* per frame op queues, reused from frame to frame */
+  esp_crypto_op_t * crypto_ops;
+  esp_integ_op_t * integ_ops;
+#ifdef __AES__
+  aesni_key_t * aesni_keys;
+  aesni_mb_job_t * aesni_jobs;
+#endif
 } esp_main_per_thread_data_t;
 
 typedef struct {
@@ -79,9 +121,46 @@ esp_init()
   memset (em, 0, sizeof (em[0]));
 
   vec_validate(em->esp_crypto_algs, IPSEC_CRYPTO_N_ALG - 1);
-  em->esp_crypto_algs[IPSEC_CRYPTO_ALG_AES_CBC_128].type = EVP_aes_128_cbc();
-  em->esp_crypto_algs[IPSEC_CRYPTO_ALG_AES_CBC_192].type = EVP_aes_192_cbc();
-  em->esp_crypto_algs[IPSEC_CRYPTO_ALG_AES_CBC_256].type = EVP_aes_256_cbc();
+  esp_crypto_alg_t * c;
+
+  c = &em->esp_crypto_algs[IPSEC_CRYPTO_ALG_AES_CBC_128];
+  c->type = EVP_aes_128_cbc();
+  c->key_len = 16;
+  c->iv_size = c->block_size = 16;
+
+  c = &em->esp_crypto_algs[IPSEC_CRYPTO_ALG_AES_CBC_192];
+  c->type = EVP_aes_192_cbc();
+  c->key_len = 24;
+  c->iv_size = c->block_size = 16;
+
+  c = &em->esp_crypto_algs[IPSEC_CRYPTO_ALG_AES_CBC_256];
+  c->type = EVP_aes_256_cbc();
+  c->key_len = 32;
+  c->iv_size = c->block_size = 16;
+
+  c = &em->esp_crypto_algs[IPSEC_CRYPTO_ALG_AES_GCM_128];
+  c->type = EVP_aes_128_gcm();
+  c->key_len = 16;
+  c->iv_size = 8;
+  c->block_size = 4;
+  c->icv_size = 16;
+
+  c = &em->esp_crypto_algs[IPSEC_CRYPTO_ALG_AES_GCM_256];
+  c->type = EVP_aes_256_gcm();
+  c->key_len = 32;
+  c->iv_size = 8;
+  c->block_size = 4;
+  c->icv_size = 16;
+
+  /* only in OpenSSL builds that have it, SAs are refused otherwise */
+#ifdef NID_chacha20_poly1305
+  c = &em->esp_crypto_algs[IPSEC_CRYPTO_ALG_CHACHA20_POLY1305];
+  c->type = EVP_chacha20_poly1305();
+  c->key_len = 32;
+  c->iv_size = 8;
+  c->block_size = 4;
+  c->icv_size = 16;
+#endif
 
   vec_validate(em->esp_integ_algs, IPSEC_INTEG_N_ALG - 1);
   esp_integ_alg_t * i;
@@ -109,7 +188,7 @@ esp_init()
   vec_validate_aligned(em->per_thread_data, tm->n_vlib_mains-1, CLIB_CACHE_LINE_BYTES);
   int thread_id;
 
-  for (thread_id = 0; thread_id < tm->n_vlib_mains - 1; thread_id++)
+  for (thread_id = 0; thread_id < tm->n_vlib_mains; thread_id++)
     {
       EVP_CIPHER_CTX_init(&(em->per_thread_data[thread_id].encrypt_ctx));
       EVP_CIPHER_CTX_init(&(em->per_thread_data[thread_id].decrypt_ctx));
@@ -117,40 +196,298 @@ esp_init()
     }
 }
 
-always_inline unsigned int
-hmac_calc(ipsec_integ_alg_t alg,
-          u8 * key,
-          int key_len,
-          u8 * data,
-          int data_len,
-          u8 * signature,
-          u8 use_esn,
-          u32 seq_hi)
+always_inline esp_main_per_thread_data_t *
+esp_get_per_thread_data (u32 cpu_index)
+{
+  return vec_elt_at_index (esp_main.per_thread_data, cpu_index);
+}
+
+always_inline esp_crypto_op_t *
+esp_add_crypto_op (esp_main_per_thread_data_t * ptd, u32 sa_index,
+                   u8 * src, u8 * dst, u8 * iv, u32 n_bytes)
+{
+  esp_crypto_op_t * op;
+
+  vec_add2 (ptd->crypto_ops, op, 1);
+  op->src = src;
+  op->dst = dst;
+  op->iv = iv;
+  op->n_bytes = n_bytes;
+  op->sa_index = sa_index;
+  return op;
+}
+
+/*
+ * Fill in the AEAD part of a crypto op: the nonce is the salt kept after
+ * the cipher key followed by the explicit IV, the AAD is SPI and
+ * sequence number as on the wire, with the high half inserted for ESN.
+ */
+always_inline void
+esp_crypto_op_set_aead (esp_crypto_op_t * op, ipsec_sa_t * sa,
+                        esp_header_t * esp, u32 seq_hi, u8 * tag)
+{
+  esp_crypto_alg_t * ca = &esp_main.esp_crypto_algs[sa->crypto_alg];
+  u32 * aad = (u32 *) op->aad;
+
+  clib_memcpy (op->nonce, sa->crypto_key + ca->key_len, ESP_AEAD_SALT_SIZE);
+  clib_memcpy (op->nonce + ESP_AEAD_SALT_SIZE, op->iv, ca->iv_size);
+  op->tag = tag;
+
+  aad[0] = esp->spi;
+  if (PREDICT_TRUE(sa->use_esn))
+    {
+      aad[1] = clib_host_to_net_u32 (seq_hi);
+      aad[2] = esp->seq;
+      op->aad_len = 12;
+    }
+  else
+    {
+      aad[1] = esp->seq;
+      op->aad_len = 8;
+    }
+}
+
+/* Returns the op index, or ~0 if the SA carries no integrity */
+always_inline u32
+esp_add_integ_op (esp_main_per_thread_data_t * ptd, ipsec_sa_t * sa,
+                  u32 sa_index, u8 * data, u32 n_bytes, u8 * icv)
 {
   esp_main_t * em = &esp_main;
-  u32 cpu_index = os_get_cpu_number();
-  HMAC_CTX * ctx = &(em->per_thread_data[cpu_index].hmac_ctx);
-  const EVP_MD * md = NULL;
+  esp_integ_op_t * op;
+
+  ASSERT(sa->integ_alg < IPSEC_INTEG_N_ALG);
+
+  if (PREDICT_FALSE(em->esp_integ_algs[sa->integ_alg].md == 0))
+    return ~0;
+
+  vec_add2 (ptd->integ_ops, op, 1);
+  op->data = data;
+  op->icv = icv;
+  op->n_bytes = n_bytes;
+  op->sa_index = sa_index;
+  /* seq_hi moves as the frame is processed, snapshot it per packet */
+  op->seq_hi = sa->seq_hi;
+  op->use_esn = sa->use_esn;
+  op->icv_size = em->esp_integ_algs[sa->integ_alg].trunc_size;
+  return op - ptd->integ_ops;
+}
+
+/*
+ * Run the queued integrity ops.  Ops from one SA arrive back to back,
+ * so the HMAC key schedule is only computed when the SA changes and the
+ * inner/outer pad state is reused for the rest of the run.
+ */
+always_inline void
+esp_integ_run (esp_main_per_thread_data_t * ptd)
+{
+  esp_main_t * em = &esp_main;
+  ipsec_main_t * im = &ipsec_main;
+  HMAC_CTX * ctx = &ptd->hmac_ctx;
+  esp_integ_op_t * op;
+  ipsec_sa_t * sa;
+  u32 last_sa_index = ~0;
   unsigned int len;
 
-  ASSERT(alg < IPSEC_INTEG_N_ALG);
+  vec_foreach (op, ptd->integ_ops)
+    {
+      if (PREDICT_FALSE(op->sa_index != last_sa_index))
+        {
+          sa = pool_elt_at_index (im->sad, op->sa_index);
+          HMAC_Init_ex(ctx, sa->integ_key, sa->integ_key_len,
+                       em->esp_integ_algs[sa->integ_alg].md, NULL);
+          last_sa_index = op->sa_index;
+        }
+      else
+        HMAC_Init_ex(ctx, NULL, 0, NULL, NULL);
 
-  if (PREDICT_FALSE(em->esp_integ_algs[alg].md == 0))
+      HMAC_Update(ctx, op->data, op->n_bytes);
+      if (PREDICT_TRUE(op->use_esn))
+        HMAC_Update(ctx, (u8 *) &op->seq_hi, sizeof(op->seq_hi));
+      HMAC_Final(ctx, op->sig, &len);
+    }
+}
+
+always_inline void
+esp_cipher_init (EVP_CIPHER_CTX * ctx, ipsec_sa_t * sa, u8 * iv, int is_encrypt)
+{
+  esp_main_t * em = &esp_main;
+
+  EVP_CipherInit_ex(ctx, em->esp_crypto_algs[sa->crypto_alg].type, NULL,
+                    sa->crypto_key, iv, is_encrypt);
+  /* ESP does its own padding */
+  EVP_CIPHER_CTX_set_padding(ctx, 0);
+}
+
+always_inline int
+esp_crypto_alg_uses_aesni_mb (ipsec_crypto_alg_t alg)
+{
+#ifdef __AES__
+  return (alg == IPSEC_CRYPTO_ALG_AES_CBC_128 ||
+          alg == IPSEC_CRYPTO_ALG_AES_CBC_256);
+#else
+  return 0;
+#endif
+}
+
+/* One AEAD op on a context already keyed for its SA, returns 0 on a bad ICV */
+always_inline int
+esp_aead_op_run (EVP_CIPHER_CTX * ctx, esp_crypto_op_t * op, u8 icv_size,
+                 int is_encrypt)
+{
+  int out_len, final_len;
+
+  EVP_CipherInit_ex(ctx, NULL, NULL, NULL, op->nonce, is_encrypt);
+  if (!is_encrypt)
+    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, icv_size, op->tag);
+
+  EVP_CipherUpdate(ctx, NULL, &out_len, op->aad, op->aad_len);
+  EVP_CipherUpdate(ctx, op->dst, &out_len, op->src, op->n_bytes);
+  if (EVP_CipherFinal_ex(ctx, op->dst + out_len, &final_len) <= 0)
     return 0;
 
-  if (PREDICT_FALSE(alg != em->per_thread_data[cpu_index].last_integ_alg)) {
-    md = em->esp_integ_algs[alg].md;
-    em->per_thread_data[cpu_index].last_integ_alg = alg;
-  }
+  if (is_encrypt)
+    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, icv_size, op->tag);
+  return 1;
+}
 
-  HMAC_Init(ctx, key, key_len, md);
+/*
+ * Run the queued encrypt ops.  AES-CBC-128/256 go through the AES-NI
+ * multi-buffer engine, which interleaves the serial CBC chains of
+ * several packets; anything else, AEAD included, goes through EVP with
+ * the key set up once per run of ops from the same SA.
+ */
+always_inline void
+esp_encrypt_run (esp_main_per_thread_data_t * ptd)
+{
+  ipsec_main_t * im = &ipsec_main;
+  EVP_CIPHER_CTX * ctx = &ptd->encrypt_ctx;
+  esp_crypto_op_t * op;
+  ipsec_sa_t * sa = 0;
+  u32 last_sa_index;
+  int out_len, new_sa;
+
+#ifdef __AES__
+  static const ipsec_crypto_alg_t mb_algs[] = {
+    IPSEC_CRYPTO_ALG_AES_CBC_128, IPSEC_CRYPTO_ALG_AES_CBC_256,
+  };
+  aesni_mb_job_t * job;
+  aesni_key_t * key = 0;
+  u32 n_keys = 0;
+  int i;
+
+  vec_validate_aligned (ptd->aesni_keys, vec_len (ptd->crypto_ops),
+                        CLIB_CACHE_LINE_BYTES);
+
+  /* the engine wants one key size per call */
+  for (i = 0; i < ARRAY_LEN(mb_algs); i++)
+    {
+      vec_reset_length (ptd->aesni_jobs);
+      last_sa_index = ~0;
 
-  HMAC_Update(ctx, data, data_len);
+      vec_foreach (op, ptd->crypto_ops)
+        {
+          if (PREDICT_FALSE(op->sa_index != last_sa_index))
+            {
+              sa = pool_elt_at_index (im->sad, op->sa_index);
+              last_sa_index = op->sa_index;
+              key = 0;
+            }
 
-  if (PREDICT_TRUE(use_esn))
-    HMAC_Update(ctx, (u8 *) &seq_hi, sizeof(seq_hi));
-  HMAC_Final(ctx, signature, &len);
+          if (sa->crypto_alg != mb_algs[i])
+            continue;
 
-  return em->esp_integ_algs[alg].trunc_size;
+          if (PREDICT_FALSE(key == 0))
+            {
+              key = vec_elt_at_index (ptd->aesni_keys, n_keys++);
+              if (mb_algs[i] == IPSEC_CRYPTO_ALG_AES_CBC_128)
+                aesni_key_expand_128 (key, sa->crypto_key);
+              else
+                aesni_key_expand_256 (key, sa->crypto_key);
+            }
+
+          vec_add2 (ptd->aesni_jobs, job, 1);
+          job->src = op->src;
+          job->dst = op->dst;
+          job->iv = op->iv;
+          job->key = key;
+          job->n_blocks = op->n_bytes / 16;
+        }
+
+      aesni_cbc_encrypt_mb (ptd->aesni_jobs, vec_len (ptd->aesni_jobs));
+    }
+#endif
+
+  last_sa_index = ~0;
+  vec_foreach (op, ptd->crypto_ops)
+    {
+      new_sa = op->sa_index != last_sa_index;
+      if (PREDICT_FALSE(new_sa))
+        {
+          sa = pool_elt_at_index (im->sad, op->sa_index);
+          last_sa_index = op->sa_index;
+        }
+
+      if (esp_crypto_alg_uses_aesni_mb (sa->crypto_alg))
+        continue;
+
+      if (ipsec_crypto_alg_is_aead (sa->crypto_alg))
+        {
+          if (PREDICT_FALSE(new_sa))
+            esp_cipher_init (ctx, sa, NULL, 1);
+          op->tag_ok = esp_aead_op_run
+            (ctx, op, esp_main.esp_crypto_algs[sa->crypto_alg].icv_size, 1);
+          continue;
+        }
+
+      if (PREDICT_FALSE(new_sa))
+        esp_cipher_init (ctx, sa, op->iv, 1);
+      else
+        /* same key, only the IV changes */
+        EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, op->iv);
+
+      EVP_EncryptUpdate(ctx, op->dst, &out_len, op->src, op->n_bytes);
+    }
 }
 
+/*
+ * Run the queued decrypt ops.  CBC decryption is already parallel
+ * within a packet, so EVP keeps the pipeline busy on its own; the win
+ * here is setting the key up once per run of ops from the same SA.
+ * AEAD ops verify their ICV here and report it in tag_ok.
+ */
+always_inline void
+esp_decrypt_run (esp_main_per_thread_data_t * ptd)
+{
+  ipsec_main_t * im = &ipsec_main;
+  EVP_CIPHER_CTX * ctx = &ptd->decrypt_ctx;
+  esp_crypto_op_t * op;
+  ipsec_sa_t * sa = 0;
+  u32 last_sa_index = ~0;
+  int out_len, new_sa;
+
+  vec_foreach (op, ptd->crypto_ops)
+    {
+      new_sa = op->sa_index != last_sa_index;
+      if (PREDICT_FALSE(new_sa))
+        {
+          sa = pool_elt_at_index (im->sad, op->sa_index);
+          last_sa_index = op->sa_index;
+        }
+
+      if (ipsec_crypto_alg_is_aead (sa->crypto_alg))
+        {
+          if (PREDICT_FALSE(new_sa))
+            esp_cipher_init (ctx, sa, NULL, 0);
+          op->tag_ok = esp_aead_op_run
+            (ctx, op, esp_main.esp_crypto_algs[sa->crypto_alg].icv_size, 0);
+          continue;
+        }
+
+      if (PREDICT_FALSE(new_sa))
+        esp_cipher_init (ctx, sa, op->iv, 0);
+      else
+        EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, op->iv);
+
+      EVP_DecryptUpdate(ctx, op->dst, &out_len, op->src, op->n_bytes);
+    }
+}
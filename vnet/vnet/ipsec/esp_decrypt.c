@@ -76,36 +76,6 @@ static u8 * format_esp_decrypt_trace (u8 * s, va_list * args)
   return s;
 }
 
-always_inline void
-esp_decrypt_aes_cbc(ipsec_crypto_alg_t alg,
-                    u8 * in,
-                    u8 * out,
-                    size_t in_len,
-                    u8 * key,
-                    u8 * iv)
-{
-  esp_main_t * em = &esp_main;
-  u32 cpu_index = os_get_cpu_number();
-  EVP_CIPHER_CTX * ctx = &(em->per_thread_data[cpu_index].decrypt_ctx);
-  const EVP_CIPHER * cipher = NULL;
-  int out_len;
-
-  ASSERT(alg < IPSEC_CRYPTO_N_ALG);
-
-  if (PREDICT_FALSE(em->esp_crypto_algs[alg].type == 0))
-    return;
-
-  if (PREDICT_FALSE(alg != em->per_thread_data[cpu_index].last_decrypt_alg)) {
-    cipher = em->esp_crypto_algs[alg].type;
-    em->per_thread_data[cpu_index].last_decrypt_alg = alg;
-  }
-
-  EVP_DecryptInit_ex(ctx, cipher, NULL, key, iv);
-
-  EVP_DecryptUpdate(ctx, out, &out_len, in, in_len);
-  EVP_DecryptFinal_ex(ctx, out + out_len, &out_len);
-}
-
 always_inline int
 esp_replay_check (ipsec_sa_t * sa, u32 seq)
 {
@@ -225,6 +195,32 @@ esp_replay_advance_esn (ipsec_sa_t * sa, u32 seq)
     }
 }
 
+always_inline int
+esp_decrypt_replay_check (ipsec_sa_t * sa, u32 seq)
+{
+  if (PREDICT_TRUE(sa->use_esn))
+    return esp_replay_check_esn(sa, seq);
+  else
+    return esp_replay_check(sa, seq);
+}
+
+always_inline int
+esp_decrypt_has_cipher (ipsec_sa_t * sa)
+{
+  return esp_main.esp_crypto_algs[sa->crypto_alg].type != 0;
+}
+
+/* Bytes to decrypt, the ICV of a non-AEAD SA has already been stripped */
+always_inline int
+esp_decrypt_payload_len (ipsec_sa_t * sa, vlib_buffer_t * b)
+{
+  esp_crypto_alg_t * ca = &esp_main.esp_crypto_algs[sa->crypto_alg];
+  int len;
+
+  len = b->current_length - sizeof (esp_header_t) - ca->iv_size - ca->icv_size;
+  return len - len % ca->block_size;
+}
+
 static uword
 esp_decrypt_node_fn (vlib_main_t * vm,
 		     vlib_node_runtime_t * node,
@@ -232,12 +228,15 @@ esp_decrypt_node_fn (vlib_main_t * vm,
 {
   u32 n_left_from, *from, next_index, *to_next;
   ipsec_main_t *im = &ipsec_main;
-  esp_main_t *em = &esp_main;
   u32 * recycle = 0;
   from = vlib_frame_vector_args (from_frame);
   n_left_from = from_frame->n_vectors;
-  u32 cpu_index = os_get_cpu_number();
+  u32 cpu_index = vm->cpu_index;
   u32 * empty_buffers = im->empty_buffers[cpu_index];
+  esp_main_per_thread_data_t * ptd = esp_get_per_thread_data (cpu_index);
+  u32 o_bis[VLIB_FRAME_SIZE], nexts[VLIB_FRAME_SIZE];
+  u32 integ_op_indices[VLIB_FRAME_SIZE], crypto_op_indices[VLIB_FRAME_SIZE];
+  u32 i;
 
   ipsec_alloc_empty_buffers(vm, im);
 
@@ -247,149 +246,258 @@ esp_decrypt_node_fn (vlib_main_t * vm,
     goto free_buffers_and_exit;
   }
 
-  next_index = node->cached_next_index;
+  ASSERT (n_left_from <= VLIB_FRAME_SIZE);
+
+  vec_reset_length (ptd->crypto_ops);
+  vec_reset_length (ptd->integ_ops);
 
-  while (n_left_from > 0)
+  /*
+   * Pass 1: drop obvious replays and queue the ICV checks.  A packet
+   * keeps o_bis[i] == ~0 for as long as it is still in flight.
+   */
+  for (i = 0; i < n_left_from; i++)
     {
-      u32 n_left_to_next;
+      u32 i_bi0 = from[i];
+      vlib_buffer_t * i_b0;
+      esp_header_t * esp0;
+      ipsec_sa_t * sa0;
+      u32 sa_index0;
+      u32 seq;
 
-      vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
+      o_bis[i] = ~0;
+      nexts[i] = ESP_DECRYPT_NEXT_DROP;
+      integ_op_indices[i] = ~0;
+      crypto_op_indices[i] = ~0;
+
+      i_b0 = vlib_get_buffer (vm, i_bi0);
+      esp0 = vlib_buffer_get_current (i_b0);
+
+      sa_index0 = vnet_buffer(i_b0)->output_features.ipsec_sad_index;
+      sa0 = pool_elt_at_index (im->sad, sa_index0);
 
-      while (n_left_from > 0 && n_left_to_next > 0)
+      seq = clib_host_to_net_u32(esp0->seq);
+
+      /* anti-replay check */
+      if (sa0->use_anti_replay && PREDICT_FALSE(esp_decrypt_replay_check(sa0, seq)))
         {
-          u32 i_bi0, o_bi0 = (u32) ~0, next0;
-          vlib_buffer_t * i_b0;
-          vlib_buffer_t * o_b0 = 0;
-          esp_header_t * esp0;
-          ipsec_sa_t * sa0;
-          u32 sa_index0 = ~0;
-          u32 seq;
-
-          i_bi0 = from[0];
-          from += 1;
-          n_left_from -= 1;
-          n_left_to_next -= 1;
+          clib_warning("anti-replay SPI %u seq %u", sa0->spi, seq);
+          vlib_node_increment_counter (vm, esp_decrypt_node.index,
+                                       ESP_DECRYPT_ERROR_REPLAY, 1);
+          o_bis[i] = i_bi0;
+          continue;
+        }
 
-          next0 = ESP_DECRYPT_NEXT_DROP;
+      if (PREDICT_TRUE(sa0->integ_alg != IPSEC_INTEG_ALG_NONE))
+        {
+          int icv_size = esp_main.esp_integ_algs[sa0->integ_alg].trunc_size;
+          u8 * icv = vlib_buffer_get_current (i_b0) + i_b0->current_length - icv_size;
+          i_b0->current_length -= icv_size;
+
+          integ_op_indices[i] = esp_add_integ_op (ptd, sa0, sa_index0,
+                                                  (u8 *) esp0,
+                                                  i_b0->current_length, icv);
 
-          i_b0 = vlib_get_buffer (vm, i_bi0);
-          esp0 = vlib_buffer_get_current (i_b0);
+          /* no digest for this algorithm, nothing can match */
+          if (PREDICT_FALSE(integ_op_indices[i] == ~0))
+            {
+              vlib_node_increment_counter (vm, esp_decrypt_node.index,
+                                           ESP_DECRYPT_ERROR_INTEG_ERROR, 1);
+              o_bis[i] = i_bi0;
+            }
+        }
+    }
 
-          sa_index0 = vnet_buffer(i_b0)->output_features.ipsec_sad_index;
-          sa0 = pool_elt_at_index (im->sad, sa_index0);
+  esp_integ_run (ptd);
 
-          seq = clib_host_to_net_u32(esp0->seq);
+  /* Pass 2: verify ICVs, advance the replay windows, queue the decrypts */
+  for (i = 0; i < n_left_from; i++)
+    {
+      u32 i_bi0 = from[i], o_bi0;
+      vlib_buffer_t * i_b0, * o_b0;
+      esp_header_t * esp0;
+      ipsec_sa_t * sa0;
+      u32 sa_index0;
+      u32 seq;
+
+      if (o_bis[i] != ~0)
+        continue;
+
+      i_b0 = vlib_get_buffer (vm, i_bi0);
+      esp0 = vlib_buffer_get_current (i_b0);
+      sa_index0 = vnet_buffer(i_b0)->output_features.ipsec_sad_index;
+      sa0 = pool_elt_at_index (im->sad, sa_index0);
+      seq = clib_host_to_net_u32(esp0->seq);
+
+      if (integ_op_indices[i] != ~0)
+        {
+          esp_integ_op_t * op = vec_elt_at_index (ptd->integ_ops,
+                                                  integ_op_indices[i]);
 
-          /* anti-replay check */
-          if (sa0->use_anti_replay)
+          if (PREDICT_FALSE(memcmp(op->icv, op->sig, op->icv_size)))
             {
-              int rv = 0;
+              vlib_node_increment_counter (vm, esp_decrypt_node.index,
+                                           ESP_DECRYPT_ERROR_INTEG_ERROR, 1);
+              o_bis[i] = i_bi0;
+              continue;
+            }
+        }
 
-              if (PREDICT_TRUE(sa0->use_esn))
-                rv = esp_replay_check_esn(sa0, seq);
-              else
-                rv = esp_replay_check(sa0, seq);
+      if (esp_decrypt_has_cipher (sa0) &&
+          PREDICT_FALSE(esp_decrypt_payload_len (sa0, i_b0) < (int) sizeof (esp_footer_t)))
+        {
+          vlib_node_increment_counter (vm, esp_decrypt_node.index,
+                                       ESP_DECRYPT_ERROR_DECRYPTION_FAILED, 1);
+          o_bis[i] = i_bi0;
+          continue;
+        }
 
-              if (PREDICT_FALSE(rv))
-                {
-                  clib_warning("anti-replay SPI %u seq %u", sa0->spi, seq);
-                  vlib_node_increment_counter (vm, esp_decrypt_node.index,
-                                               ESP_DECRYPT_ERROR_REPLAY, 1);
-                  o_bi0 = i_bi0;
-                  goto trace;
-                }
+      if (PREDICT_TRUE(sa0->use_anti_replay))
+        {
+          /*
+           * An earlier packet in this frame may have carried the same
+           * seq.  This also settles seq_hi for the AEAD AAD below.
+           */
+          if (PREDICT_FALSE(esp_decrypt_replay_check(sa0, seq)))
+            {
+              vlib_node_increment_counter (vm, esp_decrypt_node.index,
+                                           ESP_DECRYPT_ERROR_REPLAY, 1);
+              o_bis[i] = i_bi0;
+              continue;
             }
 
-          if (PREDICT_TRUE(sa0->integ_alg != IPSEC_INTEG_ALG_NONE))
+          /* AEAD packets are authenticated by the decrypt, advance after */
+          if (!ipsec_crypto_alg_is_aead (sa0->crypto_alg))
             {
-              u8 sig[64];
-              int icv_size = em->esp_integ_algs[sa0->integ_alg].trunc_size;
-              memset(sig, 0, sizeof(sig));
-              u8 * icv = vlib_buffer_get_current (i_b0) + i_b0->current_length - icv_size;
-              i_b0->current_length -= icv_size;
+              if (PREDICT_TRUE(sa0->use_esn))
+                esp_replay_advance_esn(sa0, seq);
+              else
+                esp_replay_advance(sa0, seq);
+            }
+        }
+
+      /* grab free buffer */
+      uword last_empty_buffer = vec_len (empty_buffers) - 1;
+      o_bi0 = empty_buffers[last_empty_buffer];
+      o_b0 = vlib_get_buffer (vm, o_bi0);
+      vlib_prefetch_buffer_with_index (vm, empty_buffers[last_empty_buffer-1], STORE);
+      _vec_len (empty_buffers) = last_empty_buffer;
+      o_bis[i] = o_bi0;
 
-              hmac_calc(sa0->integ_alg, sa0->integ_key, sa0->integ_key_len,
-                        (u8 *) esp0, i_b0->current_length, sig, sa0->use_esn,
-                        sa0->seq_hi);
+      /* add old buffer to the recycle list */
+      vec_add1(recycle, i_bi0);
+
+      if (esp_decrypt_has_cipher (sa0))
+        {
+          esp_crypto_alg_t * ca = &esp_main.esp_crypto_algs[sa0->crypto_alg];
+          int len = esp_decrypt_payload_len (sa0, i_b0);
+          esp_crypto_op_t * cop;
+
+          o_b0->current_data = sizeof(ethernet_header_t);
+          cop = esp_add_crypto_op (ptd, sa_index0, esp0->data + ca->iv_size,
+                                   (u8 *) vlib_buffer_get_current (o_b0),
+                                   esp0->data, len);
+          if (ipsec_crypto_alg_is_aead (sa0->crypto_alg))
+            esp_crypto_op_set_aead (cop, sa0, esp0, sa0->seq_hi,
+                                    esp0->data + ca->iv_size + len);
+          crypto_op_indices[i] = cop - ptd->crypto_ops;
+        }
+    }
+
+  esp_decrypt_run (ptd);
+
+  /* Pass 3: check AEAD ICVs, strip the ESP trailer, pick the next node */
+  for (i = 0; i < n_left_from; i++)
+    {
+      u32 i_bi0 = from[i], o_bi0 = o_bis[i], next0 = ESP_DECRYPT_NEXT_DROP;
+      vlib_buffer_t * i_b0, * o_b0;
+      ipsec_sa_t * sa0;
+
+      i_b0 = vlib_get_buffer (vm, i_bi0);
+      o_b0 = vlib_get_buffer (vm, o_bi0);
+      sa0 = pool_elt_at_index (im->sad,
+                               vnet_buffer(i_b0)->output_features.ipsec_sad_index);
+
+      if (crypto_op_indices[i] != ~0)
+        {
+          esp_crypto_op_t * cop = vec_elt_at_index (ptd->crypto_ops,
+                                                    crypto_op_indices[i]);
+          esp_footer_t * f0;
+
+          if (ipsec_crypto_alg_is_aead (sa0->crypto_alg))
+            {
+              esp_header_t * esp0 = vlib_buffer_get_current (i_b0);
+              u32 seq = clib_host_to_net_u32(esp0->seq);
 
-              if (PREDICT_FALSE(memcmp(icv, sig, icv_size)))
+              if (PREDICT_FALSE(!cop->tag_ok))
                 {
                   vlib_node_increment_counter (vm, esp_decrypt_node.index,
                                                ESP_DECRYPT_ERROR_INTEG_ERROR, 1);
-                  o_bi0 = i_bi0;
                   goto trace;
                 }
+
+              if (PREDICT_TRUE(sa0->use_anti_replay))
+                {
+                  if (PREDICT_FALSE(esp_decrypt_replay_check(sa0, seq)))
+                    {
+                      vlib_node_increment_counter (vm, esp_decrypt_node.index,
+                                                   ESP_DECRYPT_ERROR_REPLAY, 1);
+                      goto trace;
+                    }
+                  if (PREDICT_TRUE(sa0->use_esn))
+                    esp_replay_advance_esn(sa0, seq);
+                  else
+                    esp_replay_advance(sa0, seq);
+                }
             }
 
-          if (PREDICT_TRUE(sa0->use_anti_replay))
+          o_b0->current_length = cop->n_bytes - 2;
+          o_b0->flags = VLIB_BUFFER_TOTAL_LENGTH_VALID;
+          f0 = (esp_footer_t *) ((u8 *) vlib_buffer_get_current (o_b0) + o_b0->current_length);
+          o_b0->current_length -= f0->pad_length;
+          if (PREDICT_TRUE(f0->next_header == IP_PROTOCOL_IP_IN_IP))
+            next0 = ESP_DECRYPT_NEXT_IP4_INPUT;
+          else if (f0->next_header == IP_PROTOCOL_IPV6)
+            next0 = ESP_DECRYPT_NEXT_IP6_INPUT;
+          else
             {
-              if (PREDICT_TRUE(sa0->use_esn))
-                esp_replay_advance_esn(sa0, seq);
-              else
-                esp_replay_advance(sa0, seq);
-             }
-
-          /* grab free buffer */
-          uword last_empty_buffer = vec_len (empty_buffers) - 1;
-          o_bi0 = empty_buffers[last_empty_buffer];
-          o_b0 = vlib_get_buffer (vm, o_bi0);
-          vlib_prefetch_buffer_with_index (vm, empty_buffers[last_empty_buffer-1], STORE);
-          _vec_len (empty_buffers) = last_empty_buffer;
-
-          /* add old buffer to the recycle list */
-          vec_add1(recycle, i_bi0);
-
-          if (sa0->crypto_alg >= IPSEC_CRYPTO_ALG_AES_CBC_128 &&
-              sa0->crypto_alg <= IPSEC_CRYPTO_ALG_AES_CBC_256) {
-            const int BLOCK_SIZE = 16;
-            const int IV_SIZE = 16;
-            esp_footer_t * f0;
-
-            int blocks = (i_b0->current_length - sizeof (esp_header_t) - IV_SIZE) / BLOCK_SIZE;
-
-            o_b0->current_data = sizeof(ethernet_header_t);
-
-            esp_decrypt_aes_cbc(sa0->crypto_alg,
-                                esp0->data + IV_SIZE,
-                                (u8 *) vlib_buffer_get_current (o_b0),
-                                BLOCK_SIZE * blocks,
-                                sa0->crypto_key,
-                                esp0->data);
-
-            o_b0->current_length = (blocks * 16) - 2;
-            o_b0->flags = VLIB_BUFFER_TOTAL_LENGTH_VALID;
-            f0 = (esp_footer_t *) ((u8 *) vlib_buffer_get_current (o_b0) + o_b0->current_length);
-            o_b0->current_length -= f0->pad_length;
-            if (PREDICT_TRUE(f0->next_header == IP_PROTOCOL_IP_IN_IP))
-              next0 = ESP_DECRYPT_NEXT_IP4_INPUT;
-            else if (f0->next_header == IP_PROTOCOL_IPV6)
-              next0 = ESP_DECRYPT_NEXT_IP6_INPUT;
-            else
-              {
-                clib_warning("next header: 0x%x", f0->next_header);
-                vlib_node_increment_counter (vm, esp_decrypt_node.index,
-                                             ESP_DECRYPT_ERROR_DECRYPTION_FAILED,
-                                             1);
-                o_b0 = 0;
-                goto trace;
-              }
-
-            to_next[0] = o_bi0;
-            to_next += 1;
-
-            vnet_buffer (o_b0)->sw_if_index[VLIB_TX] = (u32)~0;
-          }
+              clib_warning("next header: 0x%x", f0->next_header);
+              vlib_node_increment_counter (vm, esp_decrypt_node.index,
+                                           ESP_DECRYPT_ERROR_DECRYPTION_FAILED,
+                                           1);
+            }
+
+          vnet_buffer (o_b0)->sw_if_index[VLIB_TX] = (u32)~0;
+        }
 
 trace:
-          if (PREDICT_FALSE(i_b0->flags & VLIB_BUFFER_IS_TRACED)) {
-            if (o_b0) {
-              o_b0->flags |= VLIB_BUFFER_IS_TRACED;
-              o_b0->trace_index = i_b0->trace_index;
-            }
-            esp_decrypt_trace_t *tr = vlib_add_trace (vm, node, o_b0, sizeof (*tr));
-            tr->crypto_alg = sa0->crypto_alg;
-            tr->integ_alg = sa0->integ_alg;
-          }
+      if (PREDICT_FALSE(i_b0->flags & VLIB_BUFFER_IS_TRACED)) {
+        o_b0->flags |= VLIB_BUFFER_IS_TRACED;
+        o_b0->trace_index = i_b0->trace_index;
+        esp_decrypt_trace_t *tr = vlib_add_trace (vm, node, o_b0, sizeof (*tr));
+        tr->crypto_alg = sa0->crypto_alg;
+        tr->integ_alg = sa0->integ_alg;
+      }
+
+      nexts[i] = next0;
+    }
+
+  next_index = node->cached_next_index;
+
+  for (i = 0; i < n_left_from; )
+    {
+      u32 n_left_to_next;
+
+      vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
+
+      while (i < n_left_from && n_left_to_next > 0)
+        {
+          u32 o_bi0 = o_bis[i];
+          u32 next0 = nexts[i];
+
+          i++;
+          to_next[0] = o_bi0;
+          to_next += 1;
+          n_left_to_next -= 1;
 
 	  vlib_validate_buffer_enqueue_x1 (vm, node, next_index, to_next,
                                            n_left_to_next, o_bi0, next0);
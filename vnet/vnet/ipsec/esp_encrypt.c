@@ -80,36 +80,6 @@ static u8 * format_esp_encrypt_trace (u8 * s, va_list * args)
   return s;
 }
 
-always_inline void
-esp_encrypt_aes_cbc(ipsec_crypto_alg_t alg,
-                    u8 * in,
-                    u8 * out,
-                    size_t in_len,
-                    u8 * key,
-                    u8 * iv)
-{
-  esp_main_t * em = &esp_main;
-  u32 cpu_index = os_get_cpu_number();
-  EVP_CIPHER_CTX * ctx = &(em->per_thread_data[cpu_index].encrypt_ctx);
-  const EVP_CIPHER * cipher = NULL;
-  int out_len;
-
-  ASSERT(alg < IPSEC_CRYPTO_N_ALG);
-
-  if (PREDICT_FALSE(em->esp_crypto_algs[alg].type == IPSEC_CRYPTO_ALG_NONE))
-    return;
-
-  if (PREDICT_FALSE(alg != em->per_thread_data[cpu_index].last_encrypt_alg)) {
-    cipher = em->esp_crypto_algs[alg].type;
-    em->per_thread_data[cpu_index].last_encrypt_alg = alg;
-  }
-
-  EVP_EncryptInit_ex(ctx, cipher, NULL, key, iv);
-
-  EVP_EncryptUpdate(ctx, out, &out_len, in, in_len);
-  EVP_EncryptFinal_ex(ctx, out + out_len, &out_len);
-}
-
 always_inline int
 esp_seq_advance (ipsec_sa_t * sa)
 {
@@ -143,8 +113,12 @@ esp_encrypt_node_fn (vlib_main_t * vm,
   n_left_from = from_frame->n_vectors;
   ipsec_main_t *im = &ipsec_main;
   u32 * recycle = 0;
-  u32 cpu_index = os_get_cpu_number();
+  u32 cpu_index = vm->cpu_index;
   u32 * empty_buffers = im->empty_buffers[cpu_index];
+  esp_main_per_thread_data_t * ptd = esp_get_per_thread_data (cpu_index);
+  u32 o_bis[VLIB_FRAME_SIZE], nexts[VLIB_FRAME_SIZE];
+  esp_integ_op_t * iop;
+  u32 i, n_pkts;
 
   ipsec_alloc_empty_buffers(vm, im);
 
@@ -155,203 +129,242 @@ esp_encrypt_node_fn (vlib_main_t * vm,
     goto free_buffers_and_exit;
   }
 
-  next_index = node->cached_next_index;
+  ASSERT (n_left_from <= VLIB_FRAME_SIZE);
+
+  /*
+   * Build headers and queue the crypto work for the whole frame first,
+   * then run the ciphers and HMACs back to back, so that consecutive
+   * packets of one SA share a key schedule and the AES-NI engine gets
+   * several packets at once.
+   */
+  vec_reset_length (ptd->crypto_ops);
+  vec_reset_length (ptd->integ_ops);
 
-  while (n_left_from > 0)
+  for (i = 0; i < n_left_from; i++)
     {
-      u32 n_left_to_next;
+      u32 i_bi0, o_bi0, next0;
+      vlib_buffer_t * i_b0, *o_b0 = 0;
+      u32 sa_index0;
+      ipsec_sa_t * sa0;
+      ip4_and_esp_header_t * ih0, * oh0 = 0;
+      ip6_and_esp_header_t * ih6_0, * oh6_0 = 0;
+      uword last_empty_buffer;
+      esp_header_t * o_esp0;
+      esp_footer_t *f0;
+      u8 is_ipv6;
+      u8 ip_hdr_size;
+      u8 next_hdr_type;
+
+      i_bi0 = from[i];
+      next0 = ESP_ENCRYPT_NEXT_DROP;
+
+      i_b0 = vlib_get_buffer (vm, i_bi0);
+      sa_index0 = vnet_buffer(i_b0)->output_features.ipsec_sad_index;
+      sa0 = pool_elt_at_index(im->sad, sa_index0);
+
+      if (PREDICT_FALSE(esp_seq_advance(sa0)))
+        {
+          clib_warning("sequence number counter has cycled SPI %u", sa0->spi);
+          vlib_node_increment_counter (vm, esp_encrypt_node.index,
+                                       ESP_ENCRYPT_ERROR_SEQ_CYCLED, 1);
+          //TODO: rekey SA
+          o_bi0 = i_bi0;
+          o_b0 = i_b0;
+          goto trace;
+        }
 
-      vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
+      /* grab free buffer */
+      last_empty_buffer = vec_len (empty_buffers) - 1;
+      o_bi0 = empty_buffers[last_empty_buffer];
+      o_b0 = vlib_get_buffer (vm, o_bi0);
+      o_b0->current_data = sizeof(ethernet_header_t);
+      ih0 = vlib_buffer_get_current (i_b0);
+      vlib_prefetch_buffer_with_index (vm, empty_buffers[last_empty_buffer-1], STORE);
+      _vec_len (empty_buffers) = last_empty_buffer;
+
+      /* add old buffer to the recycle list */
+      vec_add1(recycle, i_bi0);
 
-      while (n_left_from > 0 && n_left_to_next > 0)
+      /* is ipv6 */
+      if (PREDICT_FALSE((ih0->ip4.ip_version_and_header_length & 0xF0 ) == 0x60))
         {
-          u32 i_bi0, o_bi0, next0;
-          vlib_buffer_t * i_b0, *o_b0 = 0;
-          u32 sa_index0;
-          ipsec_sa_t * sa0;
-          ip4_and_esp_header_t * ih0, * oh0 = 0;
-          ip6_and_esp_header_t * ih6_0, * oh6_0 = 0;
-          uword last_empty_buffer;
-          esp_header_t * o_esp0;
-          esp_footer_t *f0;
-          u8 is_ipv6;
-          u8 ip_hdr_size;
-          u8 next_hdr_type;
-
-          i_bi0 = from[0];
-          from += 1;
-          n_left_from -= 1;
-          n_left_to_next -= 1;
+          is_ipv6 = 1;
+          ih6_0 = vlib_buffer_get_current (i_b0);
+          ip_hdr_size = sizeof(ip6_header_t);
+          next_hdr_type = IP_PROTOCOL_IPV6;
+          oh6_0 = vlib_buffer_get_current (o_b0);
+          o_esp0 = vlib_buffer_get_current (o_b0) + sizeof(ip6_header_t);
+
+          oh6_0->ip6.ip_version_traffic_class_and_flow_label =
+              ih6_0->ip6.ip_version_traffic_class_and_flow_label;
+          oh6_0->ip6.protocol = IP_PROTOCOL_IPSEC_ESP;
+          oh6_0->ip6.hop_limit = 254;
+          oh6_0->esp.spi = clib_net_to_host_u32(sa0->spi);
+          oh6_0->esp.seq = clib_net_to_host_u32(sa0->seq);
+        }
+      else
+        {
+          is_ipv6 = 0;
+          ip_hdr_size = sizeof(ip4_header_t);
+          next_hdr_type = IP_PROTOCOL_IP_IN_IP;
+          oh0 = vlib_buffer_get_current (o_b0);
+          o_esp0 = vlib_buffer_get_current (o_b0) + sizeof(ip4_header_t);
+
+          oh0->ip4.ip_version_and_header_length = 0x45;
+          oh0->ip4.tos = ih0->ip4.tos;
+          oh0->ip4.fragment_id = 0;
+          oh0->ip4.flags_and_fragment_offset = 0;
+          oh0->ip4.ttl = 254;
+          oh0->ip4.protocol = IP_PROTOCOL_IPSEC_ESP;
+          oh0->esp.spi = clib_net_to_host_u32(sa0->spi);
+          oh0->esp.seq = clib_net_to_host_u32(sa0->seq);
+        }
 
-          next0 = ESP_ENCRYPT_NEXT_DROP;
-
-          i_b0 = vlib_get_buffer (vm, i_bi0);
-          sa_index0 = vnet_buffer(i_b0)->output_features.ipsec_sad_index;
-          sa0 = pool_elt_at_index(im->sad, sa_index0);
-
-          if (PREDICT_FALSE(esp_seq_advance(sa0)))
-            {
-              clib_warning("sequence number counter has cycled SPI %u", sa0->spi);
-              vlib_node_increment_counter (vm, esp_encrypt_node.index,
-                                           ESP_ENCRYPT_ERROR_SEQ_CYCLED, 1);
-              //TODO: rekey SA
-              o_bi0 = i_bi0;
-              goto trace;
-            }
-
-          /* grab free buffer */
-          last_empty_buffer = vec_len (empty_buffers) - 1;
-          o_bi0 = empty_buffers[last_empty_buffer];
-          o_b0 = vlib_get_buffer (vm, o_bi0);
-          o_b0->current_data = sizeof(ethernet_header_t);
-          ih0 = vlib_buffer_get_current (i_b0);
-          vlib_prefetch_buffer_with_index (vm, empty_buffers[last_empty_buffer-1], STORE);
-          _vec_len (empty_buffers) = last_empty_buffer;
-          to_next[0] = o_bi0;
-          to_next += 1;
+      if (PREDICT_TRUE(sa0->is_tunnel && !sa0->is_tunnel_ip6))
+        {
+          oh0->ip4.src_address.as_u32 = sa0->tunnel_src_addr.ip4.as_u32;
+          oh0->ip4.dst_address.as_u32 = sa0->tunnel_dst_addr.ip4.as_u32;
 
-          /* add old buffer to the recycle list */
-          vec_add1(recycle, i_bi0);
-
-          /* is ipv6 */
-          if (PREDICT_FALSE((ih0->ip4.ip_version_and_header_length & 0xF0 ) == 0x60))
-            {
-              is_ipv6 = 1;
-              ih6_0 = vlib_buffer_get_current (i_b0);
-              ip_hdr_size = sizeof(ip6_header_t);
-              next_hdr_type = IP_PROTOCOL_IPV6;
-              oh6_0 = vlib_buffer_get_current (o_b0);
-              o_esp0 = vlib_buffer_get_current (o_b0) + sizeof(ip6_header_t);
-
-              oh6_0->ip6.ip_version_traffic_class_and_flow_label =
-                  ih6_0->ip6.ip_version_traffic_class_and_flow_label;
-              oh6_0->ip6.protocol = IP_PROTOCOL_IPSEC_ESP;
-              oh6_0->ip6.hop_limit = 254;
-              oh6_0->esp.spi = clib_net_to_host_u32(sa0->spi);
-              oh6_0->esp.seq = clib_net_to_host_u32(sa0->seq);
-            }
-          else
-            {
-              is_ipv6 = 0;
-              ip_hdr_size = sizeof(ip4_header_t);
-              next_hdr_type = IP_PROTOCOL_IP_IN_IP;
-              oh0 = vlib_buffer_get_current (o_b0);
-              o_esp0 = vlib_buffer_get_current (o_b0) + sizeof(ip4_header_t);
-
-              oh0->ip4.ip_version_and_header_length = 0x45;
-              oh0->ip4.tos = ih0->ip4.tos;
-              oh0->ip4.fragment_id = 0;
-              oh0->ip4.flags_and_fragment_offset = 0;
-              oh0->ip4.ttl = 254;
-              oh0->ip4.protocol = IP_PROTOCOL_IPSEC_ESP;
-              oh0->esp.spi = clib_net_to_host_u32(sa0->spi);
-              oh0->esp.seq = clib_net_to_host_u32(sa0->seq);
-            }
-
-          if (PREDICT_TRUE(sa0->is_tunnel && !sa0->is_tunnel_ip6))
-            {
-              oh0->ip4.src_address.as_u32 = sa0->tunnel_src_addr.ip4.as_u32;
-              oh0->ip4.dst_address.as_u32 = sa0->tunnel_dst_addr.ip4.as_u32;
-
-              /* in tunnel mode send it back to FIB */
-              next0 = ESP_ENCRYPT_NEXT_IP4_INPUT;
-              vnet_buffer (o_b0)->sw_if_index[VLIB_TX] = (u32)~0;
-            }
-          else if(sa0->is_tunnel && sa0->is_tunnel_ip6)
-            {
-              oh6_0->ip6.src_address.as_u64[0] = sa0->tunnel_src_addr.ip6.as_u64[0];
-              oh6_0->ip6.src_address.as_u64[1] = sa0->tunnel_src_addr.ip6.as_u64[1];
-              oh6_0->ip6.dst_address.as_u64[0] = sa0->tunnel_dst_addr.ip6.as_u64[0];
-              oh6_0->ip6.dst_address.as_u64[1] = sa0->tunnel_dst_addr.ip6.as_u64[1];
-
-              /* in tunnel mode send it back to FIB */
-              next0 = ESP_ENCRYPT_NEXT_IP6_INPUT;
-              vnet_buffer (o_b0)->sw_if_index[VLIB_TX] = (u32)~0;
-            }
-          else
-            {
-              next0 = ESP_ENCRYPT_NEXT_INTERFACE_OUTPUT;
-              vnet_buffer (o_b0)->sw_if_index[VLIB_TX] =
-                vnet_buffer (i_b0)->sw_if_index[VLIB_TX];
-            }
-
-          ASSERT(sa0->crypto_alg < IPSEC_CRYPTO_N_ALG);
-
-          if (PREDICT_TRUE(sa0->crypto_alg != IPSEC_CRYPTO_ALG_NONE)) {
-
-            const int BLOCK_SIZE = 16;
-            const int IV_SIZE = 16;
-            int blocks = 1 + (i_b0->current_length + 1) / BLOCK_SIZE;
-
-            /* pad packet in input buffer */
-            u8 pad_bytes = BLOCK_SIZE * blocks - 2 - i_b0->current_length;
-            u8 i;
-            u8 * padding = vlib_buffer_get_current (i_b0) + i_b0->current_length;
-            i_b0->current_length = BLOCK_SIZE * blocks;
-            for (i = 0; i < pad_bytes; ++i)
-              {
-                padding[i] = i + 1;
-              }
-            f0 = vlib_buffer_get_current (i_b0) + i_b0->current_length - 2;
-            f0->pad_length = pad_bytes;
-            f0->next_header = next_hdr_type;
-
-            o_b0->current_length = ip_hdr_size + sizeof(esp_header_t) +
-                  BLOCK_SIZE * blocks + IV_SIZE;
-
-            vnet_buffer (o_b0)->sw_if_index[VLIB_RX] =
-              vnet_buffer (i_b0)->sw_if_index[VLIB_RX];
-            o_b0->flags = VLIB_BUFFER_TOTAL_LENGTH_VALID;
-
-            u8 iv[16];
-            RAND_bytes(iv, sizeof(iv));
-
-            clib_memcpy((u8 *) vlib_buffer_get_current (o_b0) + ip_hdr_size +
-                   sizeof(esp_header_t), iv, 16 );
-
-            esp_encrypt_aes_cbc(sa0->crypto_alg,
-                                (u8 *) vlib_buffer_get_current (i_b0),
-                                (u8 *) vlib_buffer_get_current (o_b0) +
-                                  ip_hdr_size + sizeof(esp_header_t) + IV_SIZE,
-                                BLOCK_SIZE * blocks,
-                                sa0->crypto_key,
-                                iv);
+          /* in tunnel mode send it back to FIB */
+          next0 = ESP_ENCRYPT_NEXT_IP4_INPUT;
+          vnet_buffer (o_b0)->sw_if_index[VLIB_TX] = (u32)~0;
+        }
+      else if(sa0->is_tunnel && sa0->is_tunnel_ip6)
+        {
+          oh6_0->ip6.src_address.as_u64[0] = sa0->tunnel_src_addr.ip6.as_u64[0];
+          oh6_0->ip6.src_address.as_u64[1] = sa0->tunnel_src_addr.ip6.as_u64[1];
+          oh6_0->ip6.dst_address.as_u64[0] = sa0->tunnel_dst_addr.ip6.as_u64[0];
+          oh6_0->ip6.dst_address.as_u64[1] = sa0->tunnel_dst_addr.ip6.as_u64[1];
+
+          /* in tunnel mode send it back to FIB */
+          next0 = ESP_ENCRYPT_NEXT_IP6_INPUT;
+          vnet_buffer (o_b0)->sw_if_index[VLIB_TX] = (u32)~0;
+        }
+      else
+        {
+          next0 = ESP_ENCRYPT_NEXT_INTERFACE_OUTPUT;
+          vnet_buffer (o_b0)->sw_if_index[VLIB_TX] =
+            vnet_buffer (i_b0)->sw_if_index[VLIB_TX];
+        }
+
+      ASSERT(sa0->crypto_alg < IPSEC_CRYPTO_N_ALG);
+
+      if (PREDICT_TRUE(sa0->crypto_alg != IPSEC_CRYPTO_ALG_NONE)) {
+
+        esp_crypto_alg_t * ca = &esp_main.esp_crypto_algs[sa0->crypto_alg];
+        const int BLOCK_SIZE = ca->block_size;
+        const int IV_SIZE = ca->iv_size;
+        int blocks = 1 + (i_b0->current_length + 1) / BLOCK_SIZE;
+
+        /* pad packet in input buffer */
+        u8 pad_bytes = BLOCK_SIZE * blocks - 2 - i_b0->current_length;
+        u8 j;
+        u8 * padding = vlib_buffer_get_current (i_b0) + i_b0->current_length;
+        u8 * iv = (u8 *) o_esp0 + sizeof(esp_header_t);
+        esp_crypto_op_t * cop;
+        i_b0->current_length = BLOCK_SIZE * blocks;
+        for (j = 0; j < pad_bytes; ++j)
+          {
+            padding[j] = j + 1;
+          }
+        f0 = vlib_buffer_get_current (i_b0) + i_b0->current_length - 2;
+        f0->pad_length = pad_bytes;
+        f0->next_header = next_hdr_type;
+
+        o_b0->current_length = ip_hdr_size + sizeof(esp_header_t) +
+              BLOCK_SIZE * blocks + IV_SIZE;
+
+        vnet_buffer (o_b0)->sw_if_index[VLIB_RX] =
+          vnet_buffer (i_b0)->sw_if_index[VLIB_RX];
+        o_b0->flags = VLIB_BUFFER_TOTAL_LENGTH_VALID;
+
+        /*
+         * The IV goes straight into the packet.  CBC needs it
+         * unpredictable, AEAD only needs it unique per key, for which
+         * the 64 bit sequence number does nicely.
+         */
+        if (ipsec_crypto_alg_is_aead (sa0->crypto_alg))
+          {
+            u64 seq64 = ((u64) sa0->seq_hi << 32) | sa0->seq;
+            seq64 = clib_host_to_net_u64 (seq64);
+            clib_memcpy (iv, &seq64, sizeof (seq64));
+          }
+        else
+          RAND_bytes(iv, IV_SIZE);
+
+        cop = esp_add_crypto_op (ptd, sa_index0,
+                                 (u8 *) vlib_buffer_get_current (i_b0),
+                                 iv + IV_SIZE, iv, BLOCK_SIZE * blocks);
+
+        if (ipsec_crypto_alg_is_aead (sa0->crypto_alg))
+          {
+            esp_crypto_op_set_aead (cop, sa0, o_esp0, sa0->seq_hi,
+                                    vlib_buffer_get_current (o_b0) +
+                                    o_b0->current_length);
+            o_b0->current_length += ca->icv_size;
           }
+      }
 
-          o_b0->current_length += hmac_calc(sa0->integ_alg, sa0->integ_key,
-                                            sa0->integ_key_len,
-                                            (u8 *) o_esp0,
-                                            o_b0->current_length - ip_hdr_size,
-                                            vlib_buffer_get_current (o_b0) +
-                                            o_b0->current_length,
-                                            sa0->use_esn,
-                                            sa0->seq_hi);
-
-
-          if (PREDICT_FALSE(is_ipv6))
-            {
-              oh6_0->ip6.payload_length = clib_host_to_net_u16 (
-                  vlib_buffer_length_in_chain (vm, o_b0) - sizeof(ip6_header_t));
-            }
-          else
-            {
-              oh0->ip4.length = clib_host_to_net_u16 (
-                  vlib_buffer_length_in_chain (vm, o_b0));
-              oh0->ip4.checksum = ip4_header_checksum (&oh0->ip4);
-            }
+      /* the ICV is filled in once the frame's HMACs have been run */
+      if (esp_add_integ_op (ptd, sa0, sa_index0, (u8 *) o_esp0,
+                            o_b0->current_length - ip_hdr_size,
+                            vlib_buffer_get_current (o_b0) +
+                            o_b0->current_length) != ~0)
+        o_b0->current_length +=
+          esp_main.esp_integ_algs[sa0->integ_alg].trunc_size;
+
+      if (PREDICT_FALSE(is_ipv6))
+        {
+          oh6_0->ip6.payload_length = clib_host_to_net_u16 (
+              vlib_buffer_length_in_chain (vm, o_b0) - sizeof(ip6_header_t));
+        }
+      else
+        {
+          oh0->ip4.length = clib_host_to_net_u16 (
+              vlib_buffer_length_in_chain (vm, o_b0));
+          oh0->ip4.checksum = ip4_header_checksum (&oh0->ip4);
+        }
 
 trace:
-          if (PREDICT_FALSE(i_b0->flags & VLIB_BUFFER_IS_TRACED)) {
-            if (o_b0) {
-              o_b0->flags |= VLIB_BUFFER_IS_TRACED;
-              o_b0->trace_index = i_b0->trace_index;
-            }
-            esp_encrypt_trace_t *tr = vlib_add_trace (vm, node, o_b0, sizeof (*tr));
-            tr->spi = sa0->spi;
-            tr->seq = sa0->seq - 1;
-            tr->crypto_alg = sa0->crypto_alg;
-            tr->integ_alg = sa0->integ_alg;
-          }
+      if (PREDICT_FALSE(i_b0->flags & VLIB_BUFFER_IS_TRACED)) {
+        o_b0->flags |= VLIB_BUFFER_IS_TRACED;
+        o_b0->trace_index = i_b0->trace_index;
+        esp_encrypt_trace_t *tr = vlib_add_trace (vm, node, o_b0, sizeof (*tr));
+        tr->spi = sa0->spi;
+        tr->seq = sa0->seq - 1;
+        tr->crypto_alg = sa0->crypto_alg;
+        tr->integ_alg = sa0->integ_alg;
+      }
+
+      o_bis[i] = o_bi0;
+      nexts[i] = next0;
+    }
+
+  esp_encrypt_run (ptd);
+  esp_integ_run (ptd);
+
+  vec_foreach (iop, ptd->integ_ops)
+    clib_memcpy (iop->icv, iop->sig, iop->icv_size);
+
+  n_pkts = n_left_from;
+  from = o_bis;
+  next_index = node->cached_next_index;
+
+  for (i = 0; i < n_pkts; )
+    {
+      u32 n_left_to_next;
+
+      vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
+
+      while (i < n_pkts && n_left_to_next > 0)
+        {
+          u32 o_bi0 = from[i];
+          u32 next0 = nexts[i];
+
+          i++;
+          to_next[0] = o_bi0;
+          to_next += 1;
+          n_left_to_next -= 1;
 
           vlib_validate_buffer_enqueue_x1 (vm, node, next_index,
               to_next, n_left_to_next, o_bi0, next0);
@@ -76,6 +76,14 @@ typedef enum {
   IKEV2_N_NEXT,
 } ikev2_next_t;
 
+static int
+ikev2_transform_is_aead(ikev2_sa_transform_t * t)
+{
+  return t->type == IKEV2_TRANSFORM_TYPE_ENCR &&
+    (t->encr_type == IKEV2_TRANSFORM_ENCR_TYPE_AES_GCM_16 ||
+     t->encr_type == IKEV2_TRANSFORM_ENCR_TYPE_CHACHA20_POLY1305);
+}
+
 static ikev2_sa_transform_t *
 ikev2_find_transform_data(ikev2_sa_transform_t * t)
 {
@@ -90,7 +98,14 @@ ikev2_find_transform_data(ikev2_sa_transform_t * t)
       if (td->transform_id != t->transform_id)
         continue;
 
-      if (td->type == IKEV2_TRANSFORM_TYPE_ENCR)
+      /* chacha20-poly1305 has a fixed key size and no key length attr */
+      if (td->type == IKEV2_TRANSFORM_TYPE_ENCR &&
+          td->encr_type == IKEV2_TRANSFORM_ENCR_TYPE_CHACHA20_POLY1305)
+        {
+          if (vec_len(t->attrs))
+            continue;
+        }
+      else if (td->type == IKEV2_TRANSFORM_TYPE_ENCR)
         {
           if (vec_len(t->attrs) != 4 || t->attrs[0] != 0x80 || t->attrs[1] != 14)
             continue;
@@ -142,6 +157,7 @@ ikev2_select_proposal(ikev2_sa_proposal_t *proposals, ikev2_protocol_id_t prot_i
   vec_foreach(proposal, proposals)
     {
       u8 bitmap = 0;
+      u8 is_aead = 0;
       if (proposal->protocol_id != prot_id)
         continue;
 
@@ -150,8 +166,13 @@ ikev2_select_proposal(ikev2_sa_proposal_t *proposals, ikev2_protocol_id_t prot_i
           if ((1 << transform->type) & bitmap)
             continue;
 
+          /* IKE SA protection here is CBC + HMAC only */
+          if (prot_id == IKEV2_PROTOCOL_IKE && ikev2_transform_is_aead(transform))
+            continue;
+
           if (ikev2_find_transform_data(transform))
             {
+              is_aead |= ikev2_transform_is_aead(transform);
               bitmap |= 1 << transform->type;
               vec_add2(rv->transforms, new_t, 1);
               clib_memcpy(new_t, transform, sizeof(*new_t));
@@ -162,8 +183,10 @@ ikev2_select_proposal(ikev2_sa_proposal_t *proposals, ikev2_protocol_id_t prot_i
       clib_warning("bitmap is %x mandatory is %x optional is %x",
                    bitmap, mandatory_bitmap, optional_bitmap);
 
+      /* combined mode ciphers must not come with an integrity transform */
       if ((bitmap & mandatory_bitmap) == mandatory_bitmap &&
-          (bitmap & ~optional_bitmap) == 0)
+          (bitmap & ~optional_bitmap) == 0 &&
+          !(is_aead && (bitmap & (1 << IKEV2_TRANSFORM_TYPE_INTEG))))
         {
           rv->proposal_num = proposal->proposal_num;
           rv->protocol_id = proposal->protocol_id;
@@ -428,35 +451,42 @@ ikev2_calc_child_keys(ikev2_sa_t *sa, ikev2_child_sa_t * child)
   ctr_encr = ikev2_sa_get_td_for_type(child->r_proposals, IKEV2_TRANSFORM_TYPE_ENCR);
   ctr_integ = ikev2_sa_get_td_for_type(child->r_proposals, IKEV2_TRANSFORM_TYPE_INTEG);
 
+  /* AEAD: no integ keys, the encr keys carry a 4 byte salt (RFC4106 8.1) */
+  int encr_key_len = ctr_encr->key_len;
+  int integ_key_len = ctr_integ ? ctr_integ->key_len : 0;
+
+  if (ikev2_transform_is_aead(ctr_encr))
+    encr_key_len += 4;
+
   vec_append(s, sa->i_nonce);
   vec_append(s, sa->r_nonce);
   /* calculate PRFplus */
   u8 * keymat;
-  int len = ctr_encr->key_len * 2 + ctr_integ->key_len * 2;
+  int len = encr_key_len * 2 + integ_key_len * 2;
 
   keymat = ikev2_calc_prfplus(tr_prf, sa->sk_d, s, len);
 
   int pos = 0;
 
   /* SK_ei */
-  child->sk_ei = vec_new(u8, ctr_encr->key_len);
-  clib_memcpy(child->sk_ei, keymat + pos, ctr_encr->key_len);
-  pos += ctr_encr->key_len;
+  child->sk_ei = vec_new(u8, encr_key_len);
+  clib_memcpy(child->sk_ei, keymat + pos, encr_key_len);
+  pos += encr_key_len;
 
   /* SK_ai */
-  child->sk_ai = vec_new(u8, ctr_integ->key_len);
-  clib_memcpy(child->sk_ai, keymat + pos, ctr_integ->key_len);
-  pos += ctr_integ->key_len;
+  child->sk_ai = vec_new(u8, integ_key_len);
+  clib_memcpy(child->sk_ai, keymat + pos, integ_key_len);
+  pos += integ_key_len;
 
   /* SK_er */
-  child->sk_er = vec_new(u8, ctr_encr->key_len);
-  clib_memcpy(child->sk_er, keymat + pos, ctr_encr->key_len);
-  pos += ctr_encr->key_len;
+  child->sk_er = vec_new(u8, encr_key_len);
+  clib_memcpy(child->sk_er, keymat + pos, encr_key_len);
+  pos += encr_key_len;
 
   /* SK_ar */
-  child->sk_ar = vec_new(u8, ctr_integ->key_len);
-  clib_memcpy(child->sk_ar, keymat + pos, ctr_integ->key_len);
-  pos += ctr_integ->key_len;
+  child->sk_ar = vec_new(u8, integ_key_len);
+  clib_memcpy(child->sk_ar, keymat + pos, integ_key_len);
+  pos += integ_key_len;
 
   ASSERT(pos == len);
 
@@ -1155,6 +1185,7 @@ ikev2_create_tunnel_interface(vnet_main_t * vnm, ikev2_sa_t *sa, ikev2_child_sa_
   ikev2_sa_transform_t * tr;
   u32 hw_if_index;
   u8  encr_type = 0;
+  u8  integ_type = IPSEC_INTEG_ALG_SHA1_96;
 
   if (!child->r_proposals)
     {
@@ -1178,7 +1209,27 @@ ikev2_create_tunnel_interface(vnet_main_t * vnm, ikev2_sa_t *sa, ikev2_child_sa_
   tr = ikev2_sa_get_td_for_type(child->r_proposals, IKEV2_TRANSFORM_TYPE_ENCR);
   if (tr)
     {
-      if (tr->encr_type == IKEV2_TRANSFORM_ENCR_TYPE_AES_CBC && tr->key_len)
+      if (tr->encr_type == IKEV2_TRANSFORM_ENCR_TYPE_AES_GCM_16 && tr->key_len)
+        {
+          switch (tr->key_len)
+            {
+              case 16:
+                encr_type = IPSEC_CRYPTO_ALG_AES_GCM_128;
+                break;
+              case 32:
+                encr_type = IPSEC_CRYPTO_ALG_AES_GCM_256;
+                break;
+              default:
+                ikev2_set_state(sa, IKEV2_STATE_NO_PROPOSAL_CHOSEN);
+                return 1;
+                break;
+            }
+        }
+      else if (tr->encr_type == IKEV2_TRANSFORM_ENCR_TYPE_CHACHA20_POLY1305)
+        {
+          encr_type = IPSEC_CRYPTO_ALG_CHACHA20_POLY1305;
+        }
+      else if (tr->encr_type == IKEV2_TRANSFORM_ENCR_TYPE_AES_CBC && tr->key_len)
         {
           switch (tr->key_len)
             {
@@ -1210,7 +1261,11 @@ ikev2_create_tunnel_interface(vnet_main_t * vnm, ikev2_sa_t *sa, ikev2_child_sa_
     }
 
   tr = ikev2_sa_get_td_for_type(child->r_proposals, IKEV2_TRANSFORM_TYPE_INTEG);
-  if (tr)
+  if (ipsec_crypto_alg_is_aead(encr_type))
+    {
+      integ_type = IPSEC_INTEG_ALG_NONE;
+    }
+  else if (tr)
     {
       if (tr->integ_type != IKEV2_TRANSFORM_INTEG_TYPE_AUTH_HMAC_SHA1_96)
         {
@@ -1247,12 +1302,12 @@ ikev2_create_tunnel_interface(vnet_main_t * vnm, ikev2_sa_t *sa, ikev2_child_sa_
 
   ipsec_set_interface_key(vnm, hw_if_index,
                           IPSEC_IF_SET_KEY_TYPE_LOCAL_INTEG,
-                          IPSEC_INTEG_ALG_SHA1_96,
+                          integ_type,
                           child->sk_ar);
 
   ipsec_set_interface_key(vnm, hw_if_index,
                           IPSEC_IF_SET_KEY_TYPE_REMOTE_INTEG,
-                          IPSEC_INTEG_ALG_SHA1_96,
+                          integ_type,
                           child->sk_ai);
 
   return 0;
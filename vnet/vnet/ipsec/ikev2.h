@@ -213,7 +213,9 @@ typedef enum {
   _(9 , DES_IV32,  "des-iv32") \
   _(11, NULL,      "null")     \
   _(12, AES_CBC,   "aes-cbc")  \
-  _(13, AES_CTR,   "aes-ctr")
+  _(13, AES_CTR,   "aes-ctr")  \
+  _(20, AES_GCM_16, "aes-gcm-16") /* RFC4106 */ \
+  _(28, CHACHA20_POLY1305, "chacha20-poly1305") /* RFC7634 */
 
 typedef enum {
 #define _(v,f,str) IKEV2_TRANSFORM_ENCR_TYPE_##f = v,
@@ -574,6 +574,30 @@ ikev2_crypto_init (ikev2_main_t * km)
   tr->block_size  = 128/8;
   tr->cipher      = EVP_aes_128_cbc();
 
+  /* combined mode, ESP child SAs only */
+  vec_add2(km->supported_transforms, tr, 1);
+  tr->type        = IKEV2_TRANSFORM_TYPE_ENCR;
+  tr->encr_type   = IKEV2_TRANSFORM_ENCR_TYPE_AES_GCM_16;
+  tr->key_len     = 256/8;
+  tr->block_size  = 128/8;
+  tr->cipher      = EVP_aes_256_gcm();
+
+  vec_add2(km->supported_transforms, tr, 1);
+  tr->type        = IKEV2_TRANSFORM_TYPE_ENCR;
+  tr->encr_type   = IKEV2_TRANSFORM_ENCR_TYPE_AES_GCM_16;
+  tr->key_len     = 128/8;
+  tr->block_size  = 128/8;
+  tr->cipher      = EVP_aes_128_gcm();
+
+#ifdef NID_chacha20_poly1305
+  vec_add2(km->supported_transforms, tr, 1);
+  tr->type        = IKEV2_TRANSFORM_TYPE_ENCR;
+  tr->encr_type   = IKEV2_TRANSFORM_ENCR_TYPE_CHACHA20_POLY1305;
+  tr->key_len     = 256/8;
+  tr->block_size  = 1;
+  tr->cipher      = EVP_chacha20_poly1305();
+#endif
+
   vec_add2(km->supported_transforms, tr, 1);
   tr->type        = IKEV2_TRANSFORM_TYPE_PRF;
   tr->prf_type    = IKEV2_TRANSFORM_PRF_TYPE_PRF_HMAC_SHA1;
@@ -95,13 +95,199 @@ ipsec_set_interface_spd(vlib_main_t * vm, u32 sw_if_index, u32 spd_id, int is_ad
   return 0;
 }
 
+static void
+ipsec_spd_free_lookup (ipsec_spd_t * spd)
+{
+  ipsec_spd_range_t * r;
+  u32 ** v;
+
+  vec_foreach (r, spd->ipv4_outbound_ranges)
+    vec_free (r->policy_indices);
+  vec_free (spd->ipv4_outbound_ranges);
+  vec_foreach (r, spd->ipv6_outbound_ranges)
+    vec_free (r->policy_indices);
+  vec_free (spd->ipv6_outbound_ranges);
+
+  vec_foreach (v, spd->inbound_protect_policies)
+    vec_free (v[0]);
+  vec_free (spd->inbound_protect_policies);
+  hash_free (spd->inbound_protect_policies_by_spi);
+}
+
+/* Selector address of a policy, as a host byte order 128 bit number */
+static void
+ipsec_policy_range_key (ipsec_policy_t * p, int use_laddr, int is_stop,
+                        u64 * key)
+{
+  ip46_address_range_t * r = use_laddr ? &p->laddr : &p->raddr;
+  ip46_address_t * a = is_stop ? &r->stop : &r->start;
+
+  if (p->is_ipv6)
+    {
+      key[0] = clib_net_to_host_u64 (a->ip6.as_u64[0]);
+      key[1] = clib_net_to_host_u64 (a->ip6.as_u64[1]);
+    }
+  else
+    {
+      key[0] = 0;
+      key[1] = clib_net_to_host_u32 (a->ip4.as_u32);
+    }
+}
+
+static int
+ipsec_range_key_cmp (u64 * a, u64 * b)
+{
+  if (a[0] != b[0])
+    return a[0] < b[0] ? -1 : 1;
+  if (a[1] != b[1])
+    return a[1] < b[1] ? -1 : 1;
+  return 0;
+}
+
+static int
+ipsec_spd_range_sort (void * a1, void * a2)
+{
+  ipsec_spd_range_t * r1 = a1;
+  ipsec_spd_range_t * r2 = a2;
+
+  return ipsec_range_key_cmp (r1->start, r2->start);
+}
+
+/*
+ * Cut the address space into intervals at each policy's start and
+ * stop + 1, then give every interval the (priority ordered) policies
+ * which contain it.
+ */
+static ipsec_spd_range_t *
+ipsec_spd_build_ranges (ipsec_spd_t * spd, u32 * policy_indices,
+                        int use_laddr)
+{
+  ipsec_spd_range_t * ranges = 0, * r;
+  ipsec_policy_t * p;
+  u64 start[2], stop[2];
+  u32 * i, j;
+
+  if (vec_len (policy_indices) == 0)
+    return 0;
+
+  vec_add2 (ranges, r, 1);
+  memset (r, 0, sizeof (*r));
+
+  vec_foreach (i, policy_indices)
+    {
+      p = pool_elt_at_index (spd->policies, *i);
+
+      vec_add2 (ranges, r, 1);
+      memset (r, 0, sizeof (*r));
+      ipsec_policy_range_key (p, use_laddr, 0 /* is_stop */, r->start);
+
+      ipsec_policy_range_key (p, use_laddr, 1 /* is_stop */, stop);
+      if (++stop[1] == 0 && ++stop[0] == 0)
+        continue;  /* stops at the top of the address space */
+      vec_add2 (ranges, r, 1);
+      memset (r, 0, sizeof (*r));
+      r->start[0] = stop[0];
+      r->start[1] = stop[1];
+    }
+
+  vec_sort_with_function (ranges, ipsec_spd_range_sort);
+
+  /* Drop duplicate boundaries */
+  for (j = 1, r = ranges + 1; r < vec_end (ranges); r++)
+    if (ipsec_range_key_cmp (r->start, ranges[j-1].start))
+      ranges[j++] = r[0];
+  _vec_len (ranges) = j;
+
+  vec_foreach (r, ranges)
+    {
+      vec_foreach (i, policy_indices)
+        {
+          p = pool_elt_at_index (spd->policies, *i);
+          ipsec_policy_range_key (p, use_laddr, 0 /* is_stop */, start);
+          ipsec_policy_range_key (p, use_laddr, 1 /* is_stop */, stop);
+          if (ipsec_range_key_cmp (start, r->start) <= 0
+              && ipsec_range_key_cmp (r->start, stop) <= 0)
+            vec_add1 (r->policy_indices, *i);
+        }
+    }
+
+  return ranges;
+}
+
+static void
+ipsec_spd_add_protect_policies (ipsec_spd_t * spd, u32 * policy_indices,
+                                int is_ipv6)
+{
+  ipsec_main_t *im = &ipsec_main;
+  ipsec_policy_t * p;
+  ipsec_sa_t * sa;
+  uword key, * q;
+  u32 * i, index;
+
+  vec_foreach (i, policy_indices)
+    {
+      p = pool_elt_at_index (spd->policies, *i);
+      sa = pool_elt_at_index (im->sad, p->sa_index);
+      key = ((uword) is_ipv6 << 32) | sa->spi;
+
+      q = hash_get (spd->inbound_protect_policies_by_spi, key);
+      if (q)
+        index = q[0];
+      else
+        {
+          index = vec_len (spd->inbound_protect_policies);
+          vec_add1 (spd->inbound_protect_policies, 0);
+          hash_set (spd->inbound_protect_policies_by_spi, key, index);
+        }
+      vec_add1 (spd->inbound_protect_policies[index], *i);
+    }
+}
+
+/*
+ * Recompile the spd's lookup structures from its policy vectors and
+ * flush the flow caches.  Called whenever a policy is added or deleted.
+ */
+void
+ipsec_spd_rebuild (vlib_main_t * vm, ipsec_spd_t * spd)
+{
+  ipsec_spd_range_t * ipv4_ranges, * ipv6_ranges;
+
+  /* outbound ip4 matches dst against raddr, ip6 against laddr */
+  ipv4_ranges = ipsec_spd_build_ranges (spd, spd->ipv4_outbound_policies,
+                                        0 /* use_laddr */);
+  ipv6_ranges = ipsec_spd_build_ranges (spd, spd->ipv6_outbound_policies,
+                                        1 /* use_laddr */);
+
+  vlib_worker_thread_barrier_sync (vm);
+
+  ipsec_spd_free_lookup (spd);
+
+  spd->ipv4_outbound_ranges = ipv4_ranges;
+  spd->ipv6_outbound_ranges = ipv6_ranges;
+
+  spd->inbound_protect_policies_by_spi = hash_create (0, sizeof (uword));
+  ipsec_spd_add_protect_policies (spd, 
+                                  spd->ipv4_inbound_protect_policy_indices,
+                                  0 /* is_ipv6 */);
+  ipsec_spd_add_protect_policies (spd, 
+                                  spd->ipv6_inbound_protect_policy_indices,
+                                  1 /* is_ipv6 */);
+
+  /* Zero means "never filled" in the flow cache */
+  if (++spd->flow_cache_epoch == 0)
+    spd->flow_cache_epoch = 1;
+
+  vlib_worker_thread_barrier_release (vm);
+}
+
 int
 ipsec_add_del_spd(vlib_main_t * vm, u32 spd_id, int is_add)
 {
   ipsec_main_t *im = &ipsec_main;
+  vlib_thread_main_t * tm = vlib_get_thread_main();
   ipsec_spd_t * spd = 0;
   uword *p;
-  u32 spd_index, k, v;
+  u32 spd_index, k, v, i;
 
   p = hash_get (im->spd_index_by_spd_id, spd_id);
   if (p && is_add)
@@ -125,6 +311,12 @@ ipsec_add_del_spd(vlib_main_t * vm, u32 spd_id, int is_add)
       vec_free (spd->ipv6_outbound_policies);
       vec_free (spd->ipv4_inbound_protect_policy_indices);
       vec_free (spd->ipv4_inbound_policy_discard_and_bypass_indices);
+      vec_free (spd->ipv6_inbound_protect_policy_indices);
+      vec_free (spd->ipv6_inbound_policy_discard_and_bypass_indices);
+      ipsec_spd_free_lookup (spd);
+      for (i = 0; i < vec_len (spd->ipv4_outbound_flow_cache); i++)
+        vec_free (spd->ipv4_outbound_flow_cache[i]);
+      vec_free (spd->ipv4_outbound_flow_cache);
       pool_put (im->spds, spd);
     }
   else /* create new SPD */
@@ -133,6 +325,12 @@ ipsec_add_del_spd(vlib_main_t * vm, u32 spd_id, int is_add)
       memset (spd, 0, sizeof (*spd));
       spd_index = spd - im->spds;
       spd->id = spd_id;
+      spd->flow_cache_epoch = 1;
+      vec_validate (spd->ipv4_outbound_flow_cache, tm->n_vlib_mains - 1);
+      for (i = 0; i < tm->n_vlib_mains; i++)
+        vec_validate_aligned (spd->ipv4_outbound_flow_cache[i],
+                              IPSEC_SPD_FLOW_CACHE_SIZE - 1,
+                              CLIB_CACHE_LINE_BYTES);
       hash_set (im->spd_index_by_spd_id, spd_id, spd_index);
     }
   return 0;
@@ -378,6 +576,8 @@ ipsec_add_del_policy(vlib_main_t * vm, ipsec_policy_t * policy, int is_add)
       }));
     }
 
+  ipsec_spd_rebuild (vm, spd);
+
   return 0;
 }
 
@@ -431,6 +631,18 @@ ipsec_add_del_sa(vlib_main_t * vm, ipsec_sa_t * new_sa, int is_add)
     }
   else /* create new SA */
     {
+      if (new_sa->crypto_alg != IPSEC_CRYPTO_ALG_NONE &&
+          esp_main.esp_crypto_algs[new_sa->crypto_alg].type == 0)
+        return VNET_API_ERROR_UNIMPLEMENTED; /* not in this OpenSSL */
+
+      /* AEAD keys carry the nonce salt, and there is no separate integ */
+      if (ipsec_crypto_alg_is_aead (new_sa->crypto_alg) &&
+          (new_sa->integ_alg != IPSEC_INTEG_ALG_NONE ||
+           new_sa->crypto_key_len !=
+           esp_main.esp_crypto_algs[new_sa->crypto_alg].key_len +
+           ESP_AEAD_SALT_SIZE))
+        return VNET_API_ERROR_INVALID_VALUE;
+
       pool_get (im->sad, sa);
       clib_memcpy (sa, new_sa, sizeof (*sa));
       sa_index = sa - im->sad;
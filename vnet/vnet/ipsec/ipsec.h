@@ -29,11 +29,14 @@ typedef enum {
   IPSEC_POLICY_N_ACTION,
 } ipsec_policy_action_t;
 
-#define foreach_ipsec_crypto_alg \
-  _(0, NONE,  "none")               \
-  _(1, AES_CBC_128, "aes-cbc-128")  \
-  _(2, AES_CBC_192, "aes-cbc-192")  \
-  _(3, AES_CBC_256, "aes-cbc-256")
+#define foreach_ipsec_crypto_alg                                  \
+  _(0, NONE,  "none")                                             \
+  _(1, AES_CBC_128, "aes-cbc-128")                                \
+  _(2, AES_CBC_192, "aes-cbc-192")                                \
+  _(3, AES_CBC_256, "aes-cbc-256")                                \
+  _(4, AES_GCM_128, "aes-gcm-128")             /* RFC4106 */      \
+  _(5, AES_GCM_256, "aes-gcm-256")             /* RFC4106 */      \
+  _(6, CHACHA20_POLY1305, "chacha20-poly1305") /* RFC7634 */
 
 typedef enum {
 #define _(v,f,s) IPSEC_CRYPTO_ALG_##f = v,
@@ -139,6 +142,33 @@ typedef  struct {
     vlib_counter_t counter;
 } ipsec_policy_t;
 
+/*
+ * Compiled form of a priority ordered policy vector.  The address space
+ * of one selector field is cut into elementary intervals at every policy
+ * boundary, and each interval keeps the policies covering it, still in
+ * priority order.  A lookup is a binary search plus a short scan.
+ */
+typedef struct {
+  /* First address of the interval, host byte order, ip4 in start[1] */
+  u64 start[2];
+  u32 * policy_indices;
+} ipsec_spd_range_t;
+
+/* Per-thread, direct mapped cache of ip4 outbound classifications */
+#define IPSEC_SPD_FLOW_CACHE_SIZE 4096
+
+typedef struct {
+  /* 5-tuple, host byte order, ports zero unless tcp / udp */
+  u32 laddr, raddr;
+  u16 lport, rport;
+  u8 protocol;
+  u8 pad[3];
+  /* valid iff equal to the spd's flow_cache_epoch */
+  u32 epoch;
+  /* ~0: no policy matched */
+  u32 policy_index;
+} ipsec_spd_flow_cache_entry_t;
+
 typedef struct {
 	u32 id;
 	/* pool of policies */
@@ -150,6 +180,17 @@ typedef struct {
 	u32 * ipv4_inbound_policy_discard_and_bypass_indices;
         u32 * ipv6_inbound_protect_policy_indices;
         u32 * ipv6_inbound_policy_discard_and_bypass_indices;
+
+        /* lookup structures, rebuilt by ipsec_spd_rebuild */
+        ipsec_spd_range_t * ipv4_outbound_ranges;
+        ipsec_spd_range_t * ipv6_outbound_ranges;
+        /* (is_ipv6 << 32 | spi) -> index in inbound_protect_policies */
+        uword * inbound_protect_policies_by_spi;
+        u32 ** inbound_protect_policies;
+
+        /* per-thread flow caches, flushed by bumping the epoch */
+        ipsec_spd_flow_cache_entry_t ** ipv4_outbound_flow_cache;
+        u32 flow_cache_epoch;
 } ipsec_spd_t;
 
 typedef struct {
@@ -215,6 +256,7 @@ int ipsec_add_del_spd(vlib_main_t * vm, u32 spd_id, int is_add);
 int ipsec_add_del_policy(vlib_main_t * vm, ipsec_policy_t * policy, int is_add);
 int ipsec_add_del_sa(vlib_main_t * vm, ipsec_sa_t * new_sa, int is_add);
 int ipsec_set_sa_key(vlib_main_t * vm, ipsec_sa_t * sa_update);
+void ipsec_spd_rebuild(vlib_main_t * vm, ipsec_spd_t * spd);
 
 u8 * format_ipsec_if_output_trace (u8 * s, va_list * args);
 u8 * format_ipsec_policy_action (u8 * s, va_list * args);
@@ -233,6 +275,15 @@ int ipsec_set_interface_key(vnet_main_t * vnm, u32 hw_if_index, ipsec_if_set_key
  *  inline functions
  */
 
+/* Combined mode ciphers carry their own ICV, such SAs have no integ alg */
+always_inline int
+ipsec_crypto_alg_is_aead (ipsec_crypto_alg_t alg)
+{
+  return (alg == IPSEC_CRYPTO_ALG_AES_GCM_128 ||
+          alg == IPSEC_CRYPTO_ALG_AES_GCM_256 ||
+          alg == IPSEC_CRYPTO_ALG_CHACHA20_POLY1305);
+}
+
 always_inline void
 ipsec_alloc_empty_buffers(vlib_main_t * vm, ipsec_main_t *im)
 {
@@ -261,6 +312,42 @@ ipsec_alloc_empty_buffers(vlib_main_t * vm, ipsec_main_t *im)
     }
 }
 
+/* Policies which may match addr, in priority order */
+always_inline u32 *
+ipsec_spd_ranges_lookup (ipsec_spd_range_t * ranges, u64 addr_hi, u64 addr_lo)
+{
+  ipsec_spd_range_t * r;
+  u32 lo = 0, hi = vec_len (ranges), mid;
+
+  if (PREDICT_FALSE (hi == 0))
+    return 0;
+
+  /* ranges[0] starts at 0: find the last range starting at or below addr */
+  while (hi - lo > 1)
+    {
+      mid = (lo + hi) / 2;
+      r = ranges + mid;
+      if (r->start[0] < addr_hi
+          || (r->start[0] == addr_hi && r->start[1] <= addr_lo))
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+  return ranges[lo].policy_indices;
+}
+
+always_inline u32 *
+ipsec_spd_inbound_protect_policies (ipsec_spd_t * spd, u32 spi, int is_ipv6)
+{
+  uword * p;
+
+  p = hash_get (spd->inbound_protect_policies_by_spi, 
+                ((uword) is_ipv6 << 32) | spi);
+
+  return p ? spd->inbound_protect_policies[p[0]] : 0;
+}
+
 static_always_inline u32 /* FIXME move to interface???.h */
 get_next_output_feature_node_index( vnet_main_t * vnm,
                                     vlib_buffer_t * b)
@@ -68,6 +68,7 @@ ipsec_sa_add_del_command_fn (vlib_main_t * vm,
   ipsec_sa_t sa;
   int is_add = ~0;
   u8 * ck, * ik;
+  int rv;
 
   memset(&sa, 0, sizeof(sa));
 
@@ -92,7 +93,7 @@ ipsec_sa_add_del_command_fn (vlib_main_t * vm,
                        &sa.crypto_alg))
       {
         if (sa.crypto_alg < IPSEC_CRYPTO_ALG_AES_CBC_128 ||
-            sa.crypto_alg > IPSEC_CRYPTO_ALG_AES_CBC_256)
+            sa.crypto_alg > IPSEC_CRYPTO_ALG_CHACHA20_POLY1305)
           return clib_error_return(0, "unsupported crypto-alg: '%U'",
                                    format_ipsec_crypto_alg, sa.crypto_alg);
       }
@@ -131,13 +132,22 @@ ipsec_sa_add_del_command_fn (vlib_main_t * vm,
   if (sa.integ_key_len > sizeof(sa.integ_key))
     sa.integ_key_len = sizeof(sa.integ_key);
 
+  /* keys are binary, a zero byte does not end them */
   if (ck)
-    strncpy((char *) sa.crypto_key, (char *) ck, sa.crypto_key_len);
+    clib_memcpy(sa.crypto_key, ck, sa.crypto_key_len);
 
   if (ik)
-    strncpy((char *) sa.integ_key, (char *) ik, sa.integ_key_len);
+    clib_memcpy(sa.integ_key, ik, sa.integ_key_len);
+
+  rv = ipsec_add_del_sa(vm, &sa, is_add);
 
-  ipsec_add_del_sa(vm, &sa, is_add);
+  if (rv == VNET_API_ERROR_UNIMPLEMENTED)
+    return clib_error_return(0, "crypto-alg '%U' not available",
+                             format_ipsec_crypto_alg, sa.crypto_alg);
+  else if (rv == VNET_API_ERROR_INVALID_VALUE)
+    return clib_error_return(0, "crypto-alg '%U' takes the key followed by "
+                             "a 4 byte salt, and no integ-alg",
+                             format_ipsec_crypto_alg, sa.crypto_alg);
 
   return 0;
 }
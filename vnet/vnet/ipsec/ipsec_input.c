@@ -82,9 +82,12 @@ ipsec_input_protect_policy_match(ipsec_spd_t * spd, u32 sa, u32 da, u32 spi)
   ipsec_main_t *im = &ipsec_main;
   ipsec_policy_t * p;
   ipsec_sa_t * s;
-  u32 * i;
+  u32 * i, * policy_indices;
 
-  vec_foreach(i, spd->ipv4_inbound_protect_policy_indices)
+  policy_indices = ipsec_spd_inbound_protect_policies (spd, spi, 
+                                                       0 /* is_ipv6 */);
+
+  vec_foreach(i, policy_indices)
     {
       p = pool_elt_at_index(spd->policies, *i);
       s = pool_elt_at_index(im->sad, p->sa_index);
@@ -138,9 +141,12 @@ ipsec_input_ip6_protect_policy_match (ipsec_spd_t * spd,
   ipsec_main_t *im = &ipsec_main;
   ipsec_policy_t * p;
   ipsec_sa_t * s;
-  u32 * i;
+  u32 * i, * policy_indices;
+
+  policy_indices = ipsec_spd_inbound_protect_policies (spd, spi, 
+                                                       1 /* is_ipv6 */);
 
-  vec_foreach(i, spd->ipv6_inbound_protect_policy_indices)
+  vec_foreach(i, policy_indices)
     {
       p = pool_elt_at_index(spd->policies, *i);
       s = pool_elt_at_index(im->sad, p->sa_index);
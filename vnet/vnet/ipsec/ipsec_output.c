@@ -20,6 +20,7 @@
 #include <vnet/ip/ip.h>
 
 #include <vnet/ipsec/ipsec.h>
+#include <vppinfra/xxhash.h>
 
 #if IPSEC > 0
 
@@ -96,9 +97,11 @@ always_inline ipsec_policy_t *
 ipsec_output_policy_match(ipsec_spd_t * spd, u8 pr, u32 la, u32 ra, u16 lp, u16 rp)
 {
   ipsec_policy_t * p;
-  u32 * i;
+  u32 * i, * policy_indices;
 
-  vec_foreach(i, spd->ipv4_outbound_policies)
+  policy_indices = ipsec_spd_ranges_lookup (spd->ipv4_outbound_ranges, 0, ra);
+
+  vec_foreach(i, policy_indices)
     {
       p = pool_elt_at_index(spd->policies, *i);
       if (PREDICT_FALSE(p->protocol && (p->protocol != pr)))
@@ -136,6 +139,47 @@ ipsec_output_policy_match(ipsec_spd_t * spd, u8 pr, u32 la, u32 ra, u16 lp, u16
     return 0;
 }
 
+/* Established flows hit the cache and skip classification */
+always_inline ipsec_policy_t *
+ipsec_output_policy_match_cached (ipsec_spd_t * spd, u32 cpu_index, u8 pr,
+                                  u32 la, u32 ra, u16 lp, u16 rp)
+{
+  ipsec_spd_flow_cache_entry_t * e;
+  ipsec_policy_t * p;
+  u64 h;
+
+  /* Ports only select tcp and udp */
+  if (PREDICT_FALSE((pr != IP_PROTOCOL_TCP) && (pr != IP_PROTOCOL_UDP)))
+    lp = rp = 0;
+
+  h = clib_xxhash ((((u64) la << 32) | ra)
+                   ^ (((u64) lp << 32) | ((u64) rp << 16) | pr));
+  e = spd->ipv4_outbound_flow_cache[cpu_index]
+    + (h & (IPSEC_SPD_FLOW_CACHE_SIZE - 1));
+
+  if (PREDICT_TRUE(e->epoch == spd->flow_cache_epoch
+                   && e->laddr == la && e->raddr == ra
+                   && e->lport == lp && e->rport == rp
+                   && e->protocol == pr))
+    {
+      if (e->policy_index == ~0)
+        return 0;
+      return pool_elt_at_index(spd->policies, e->policy_index);
+    }
+
+  p = ipsec_output_policy_match (spd, pr, la, ra, lp, rp);
+
+  e->laddr = la;
+  e->raddr = ra;
+  e->lport = lp;
+  e->rport = rp;
+  e->protocol = pr;
+  e->policy_index = p ? p - spd->policies : ~0;
+  e->epoch = spd->flow_cache_epoch;
+
+  return p;
+}
+
 always_inline uword
 ip6_addr_match_range (ip6_address_t * a, ip6_address_t * la, ip6_address_t * ua)
 {
@@ -154,9 +198,14 @@ ipsec_output_ip6_policy_match (ipsec_spd_t * spd,
                                u8 pr)
 {
   ipsec_policy_t * p;
-  u32 * i;
+  u32 * i, * policy_indices;
+
+  policy_indices = 
+    ipsec_spd_ranges_lookup (spd->ipv6_outbound_ranges,
+                             clib_net_to_host_u64 (da->as_u64[0]),
+                             clib_net_to_host_u64 (da->as_u64[1]));
 
-  vec_foreach(i, spd->ipv6_outbound_policies)
+  vec_foreach(i, policy_indices)
     {
       p = pool_elt_at_index(spd->policies, *i);
       if (PREDICT_FALSE(p->protocol && (p->protocol != pr)))
@@ -284,7 +333,8 @@ ipsec_output_node_fn (vlib_main_t * vm,
                        sw_if_index0, spd_index0, spd0->id);
 #endif
 
-          p0 = ipsec_output_policy_match(spd0, ip0->protocol,
+          p0 = ipsec_output_policy_match_cached(spd0, vm->cpu_index,
+                     ip0->protocol,
                      clib_net_to_host_u32(ip0->src_address.as_u32),
                      clib_net_to_host_u32(ip0->dst_address.as_u32),
                      clib_net_to_host_u16(udp0->src_port),
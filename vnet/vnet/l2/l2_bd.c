@@ -43,6 +43,7 @@ bd_validate (l2_bridge_domain_t * bd_config)
     bd_config->feature_bitmap = ~L2INPUT_FEAT_ARP_TERM;
     bd_config->bvi_sw_if_index = ~0;
     bd_config->members = 0;
+    bd_config->mac_age = 0;
     bd_config->mac_by_ip4 = 0;
 //    bd_config->mac_by_ip6 = hash_create_mem (0, sizeof(ip6_address_t), 
 //					     sizeof(uword));
@@ -88,6 +89,7 @@ int bd_delete_bd_index (bd_main_t * bdm, u32 bd_id)
 
   l2input_main.bd_configs[bd_index].bd_id = ~0;
   l2input_main.bd_configs[bd_index].feature_bitmap = 0;
+  l2input_main.bd_configs[bd_index].mac_age = 0;
 
   return 0;
 }
@@ -193,6 +195,30 @@ bd_set_flags (vlib_main_t * vm,
   return 0;
 }
 
+// Set the mac aging time for the bridge domain, in minutes; 0 disables
+// aging. Return 0 if ok, non-zero if for an error.
+u32
+bd_set_mac_age (vlib_main_t * vm,
+                u32 bd_index,
+                u8 age)
+{
+  l2_bridge_domain_t * bd_config;
+
+  vec_validate (l2input_main.bd_configs, bd_index);
+  bd_config = vec_elt_at_index(l2input_main.bd_configs, bd_index);
+
+  bd_validate (bd_config);
+
+  bd_config->mac_age = age;
+
+  // Get the scanner going, it idles while no bridge domain ages macs
+  if (age)
+    vlib_process_signal_event (vm, l2fib_mac_age_scanner_process_node.index,
+                               L2FIB_MAC_AGE_SCANNER_EVENT_START, 0);
+
+  return 0;
+}
+
 // set bridge-domain learn enable/disable
 // The CLI format is:
 //    set bridge-domain learn <bd_id> [disable]
@@ -340,6 +366,63 @@ VLIB_CLI_COMMAND (bd_flood_cli, static) = {
   .function = bd_flood,
 };
 
+// set bridge-domain mac aging time
+// The CLI format is:
+//    set bridge-domain mac-age <bd_id> <minutes>
+static clib_error_t *
+bd_mac_age (vlib_main_t * vm,
+            unformat_input_t * input,
+            vlib_cli_command_t * cmd)
+{
+  bd_main_t * bdm = &bd_main;
+  clib_error_t * error = 0;
+  u32 bd_index, bd_id;
+  u32 age;
+  uword * p;
+
+  if (! unformat (input, "%d", &bd_id))
+    {
+      error = clib_error_return (0, "expecting bridge-domain id but got `%U'",
+                                 format_unformat_error, input);
+      goto done;
+    }
+
+  p = hash_get (bdm->bd_index_by_bd_id, bd_id);
+
+  if (p == 0)
+    return clib_error_return (0, "No such bridge domain %d", bd_id);
+  
+  bd_index = p[0];
+
+  if (! unformat (input, "%u", &age))
+    {
+      error = clib_error_return (0, "expecting mac aging time in minutes but got `%U'",
+                                 format_unformat_error, input);
+      goto done;
+    }
+
+  // The entry timestamp is a u8 count of minutes
+  if (age > 255)
+    {
+      error = clib_error_return (0, "mac aging time %d out of range (0-255)", age);
+      goto done;
+    }
+
+  if (bd_set_mac_age (vm, bd_index, age)) {
+    error = clib_error_return (0, "bridge-domain id %d out of range", bd_index);
+    goto done;
+  }
+
+ done:
+  return error;
+}
+
+VLIB_CLI_COMMAND (bd_mac_age_cli, static) = {
+  .path = "set bridge-domain mac-age",
+  .short_help = "set bridge-domain mac-age <bridge-domain-id> <minutes, 0 to disable>",
+  .function = bd_mac_age,
+};
+
 // set bridge-domain unkown-unicast flood enable/disable
 // The CLI format is:
 //    set bridge-domain uu-flood <bd_index> [disable]
@@ -569,6 +652,15 @@ u8* format_vtr(u8 * s, va_list *args)
     }
 }
 
+static u8 * format_bd_mac_age (u8 * s, va_list * args)
+{
+    u32 mac_age = va_arg (*args, u32);
+
+    if (mac_age == 0)
+	return format (s, "off");
+    return format (s, "%dm", mac_age);
+}
+
 // show bridge-domain state
 // The CLI format is:
 //    show bridge-domain [<bd_index>]
@@ -622,7 +714,7 @@ bd_show (vlib_main_t * vm,
     if (bd_is_valid(bd_config)) {
       if (!printed) {
         printed = 1;
-        vlib_cli_output (vm, "%=5s %=7s %=10s %=10s %=10s %=10s %=10s %=14s", 
+        vlib_cli_output (vm, "%=5s %=7s %=10s %=10s %=10s %=10s %=10s %=8s %=14s", 
                          "ID",
                          "Index",
                          "Learning",
@@ -630,17 +722,19 @@ bd_show (vlib_main_t * vm,
                          "UU-Flood",
                          "Flooding",
 			 "ARP-Term",
+			 "MAC-Age",
                          "BVI-Intf");
       }
 
       vlib_cli_output (
-	  vm, "%=5d %=7d %=10s %=10s %=10s %=10s %=10s %=14U", 
+	  vm, "%=5d %=7d %=10s %=10s %=10s %=10s %=10s %=8U %=14U", 
 	  bd_config->bd_id, bd_index,
 	  bd_config->feature_bitmap & L2INPUT_FEAT_LEARN ?    "on" : "off",
 	  bd_config->feature_bitmap & L2INPUT_FEAT_FWD ?      "on" : "off",
 	  bd_config->feature_bitmap & L2INPUT_FEAT_UU_FLOOD ? "on" : "off",
 	  bd_config->feature_bitmap & L2INPUT_FEAT_FLOOD ?    "on" : "off",
 	  bd_config->feature_bitmap & L2INPUT_FEAT_ARP_TERM ? "on" : "off",
+	  format_bd_mac_age, bd_config->mac_age,
 	  format_vnet_sw_if_index_name_with_NA, vnm, bd_config->bvi_sw_if_index);
 
       if (detail || intf) {
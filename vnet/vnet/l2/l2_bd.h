@@ -65,6 +65,9 @@ typedef struct {
   // Vector of members in the replication group
   l2_flood_member_t * members;
 
+  // learned mac aging time in minutes, 0 disables aging
+  u8 mac_age;
+
   // hash ip4/ip6 -> mac for arp termination
   uword *mac_by_ip4;
   uword *mac_by_ip6;
@@ -104,6 +107,11 @@ bd_set_flags (vlib_main_t * vm,
               u32 flags,
               u32 enable);
 
+u32
+bd_set_mac_age (vlib_main_t * vm,
+                u32 bd_index,
+                u8 age);
+
 u32 bd_find_or_add_bd_index (bd_main_t * bdm, u32 bd_id);
 int bd_delete_bd_index (bd_main_t * bdm, u32 bd_id);
 
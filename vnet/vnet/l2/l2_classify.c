@@ -295,32 +295,23 @@ l2_classify_node_fn (vlib_main_t * vm,
                 }
               else
                 {
-                  while (1)
+                  e0 = vnet_classify_find_entry_chain (vcm, t0, (u8 *) h0,
+                                                       now, &t0);
+                  if (e0)
                     {
-                      if (t0->next_table_index != ~0)
-                        t0 = pool_elt_at_index (vcm->tables,
-                                                t0->next_table_index);
-                      else
-                        {
-                          next0 = (t0->miss_next_index < L2_CLASSIFY_N_NEXT)?
-                                   t0->miss_next_index:next0;
-                          misses++;
-                          break;
-                        }
-
-                      hash0 = vnet_classify_hash_packet (t0, (u8 *) h0);
-                      e0 = vnet_classify_find_entry (t0, (u8 *) h0, hash0, now);
-                      if (e0)
-                        {
-                          vnet_buffer(b0)->l2_classify.opaque_index
-                            = e0->opaque_index;
-                          vlib_buffer_advance (b0, e0->advance);
-                          next0 = (e0->next_index < L2_CLASSIFY_N_NEXT)?
-                                   e0->next_index:next0;
-                          hits++;
-                          chain_hits++;
-                          break;
-                        }
+                      vnet_buffer(b0)->l2_classify.opaque_index
+                        = e0->opaque_index;
+                      vlib_buffer_advance (b0, e0->advance);
+                      next0 = (e0->next_index < L2_CLASSIFY_N_NEXT)?
+                               e0->next_index:next0;
+                      hits++;
+                      chain_hits++;
+                    }
+                  else
+                    {
+                      next0 = (t0->miss_next_index < L2_CLASSIFY_N_NEXT)?
+                               t0->miss_next_index:next0;
+                      misses++;
                     }
                 }
             }
@@ -399,6 +390,8 @@ VLIB_REGISTER_NODE (l2_classify_node) = {
   },
 };
 
+VLIB_NODE_FUNCTION_MULTIARCH (l2_classify_node, l2_classify_node_fn)
+
 clib_error_t *l2_classify_init (vlib_main_t *vm)
 {
   l2_classify_main_t * cm = &l2_classify_main;
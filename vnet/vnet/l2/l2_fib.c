@@ -24,17 +24,27 @@
 
 #include <vppinfra/error.h>
 #include <vppinfra/hash.h>
+#include <vnet/l2/l2_input.h>
 #include <vnet/l2/l2_fib.h>
 #include <vnet/l2/l2_learn.h>
 #include <vnet/l2/l2_bd.h>
 
 #include <vppinfra/bihash_template.c>
 
+/* Buckets the age scanner walks before yielding the main thread */
+#define L2FIB_AGE_SCAN_BUCKETS_PER_SLICE 256
+
 typedef struct {
 
   /* hash table */
   BVT(clib_bihash) mac_table;
 
+  /* age scanner state and counters */
+  BVT(clib_bihash_kv) * aged_kvs;
+  u64 n_aged;
+  u64 n_age_scans;
+  f64 last_age_scan_time;
+
   /* convenience variables */
   vlib_main_t * vlib_main;
   vnet_main_t * vnet_main;
@@ -189,6 +199,11 @@ show_l2fib  (vlib_main_t * vm,
   else
     vlib_cli_output (vm, "%lld l2fib entries", total_entries);
 
+  if (msm->n_age_scans)
+    vlib_cli_output (vm, "%lld entries aged in %lld scans, last scan %.2f sec ago",
+                     msm->n_aged, msm->n_age_scans,
+                     vlib_time_now (vm) - msm->last_age_scan_time);
+
   if (raw)
     vlib_cli_output (vm, "Raw Hash Table:\n%U\n",
                      BV(format_bihash), h, 1 /* verbose */);
@@ -261,6 +276,7 @@ void l2fib_add_entry (u64   mac,
   result.fields.static_mac = static_mac;
   result.fields.filter = filter_mac;
   result.fields.bvi = bvi_mac;
+  result.fields.timestamp = l2fib_timestamp (vlib_time_now (mp->vlib_main));
 
   kv.key = key.raw;
   kv.value = result.raw;
@@ -535,6 +551,160 @@ VLIB_CLI_COMMAND (l2fib_del_cli, static) = {
 };
 
 
+// Return 1 if the entry is a learned mac older than its bridge
+// domain's aging time
+static inline int
+l2fib_entry_is_aged (l2fib_entry_key_t * key,
+                     l2fib_entry_result_t * result,
+                     u8 now)
+{
+  l2input_main_t * l2im = &l2input_main;
+  l2_bridge_domain_t * bd_config;
+
+  if (result->fields.static_mac)
+    return 0;
+
+  if (key->fields.bd_index >= vec_len (l2im->bd_configs))
+    return 0;
+
+  bd_config = vec_elt_at_index (l2im->bd_configs, key->fields.bd_index);
+  if (!bd_is_valid (bd_config) || bd_config->mac_age == 0)
+    return 0;
+
+  return (u8) (now - result->fields.timestamp) >= bd_config->mac_age;
+}
+
+// Walk one bucket, remember the aged entries in aged_kvs
+static void
+l2fib_age_scan_bucket (l2fib_main_t * mp, u32 bucket_index, u8 now)
+{
+  BVT(clib_bihash) * h = &mp->mac_table;
+  clib_bihash_bucket_t * b, tmp_b;
+  BVT(clib_bihash_value) * v;
+  l2fib_entry_key_t key;
+  l2fib_entry_result_t result;
+  int j, k;
+
+  // Workers may split the bucket under us, so read offset and
+  // log2_pages from one snapshot, as clib_bihash_search does
+  b = &h->buckets[bucket_index];
+  tmp_b.as_u64 = b->as_u64;
+  if (tmp_b.offset == 0)
+    return;
+
+  v = BV(clib_bihash_get_value) (h, tmp_b.offset);
+  for (j = 0; j < (1<<tmp_b.log2_pages); j++)
+    {
+      for (k = 0; k < BIHASH_KVP_PER_PAGE; k++)
+        {
+          if (BV(clib_bihash_is_free) (&v->kvp[k]))
+            continue;
+
+          key.raw = v->kvp[k].key;
+          result.raw = v->kvp[k].value;
+
+          if (l2fib_entry_is_aged (&key, &result, now))
+            vec_add1 (mp->aged_kvs, v->kvp[k]);
+        }
+      v++;
+    }
+}
+
+// Delete the entries found by l2fib_age_scan_bucket. The table may
+// have changed since, so look each one up again first: the learn
+// node may just have refreshed it.
+static void
+l2fib_age_delete_aged (l2fib_main_t * mp, u8 now)
+{
+  BVT(clib_bihash_kv) * kv;
+  l2fib_entry_key_t key;
+  l2fib_entry_result_t result;
+
+  vec_foreach (kv, mp->aged_kvs)
+    {
+      if (BV(clib_bihash_search) (&mp->mac_table, kv, kv))
+        continue;
+
+      key.raw = kv->key;
+      result.raw = kv->value;
+      if (!l2fib_entry_is_aged (&key, &result, now))
+        continue;
+
+      BV(clib_bihash_add_del) (&mp->mac_table, kv, 0 /* is_add */);
+
+      mp->n_aged++;
+      if (l2learn_main.global_learn_count > 0)
+        l2learn_main.global_learn_count--;
+    }
+  vec_reset_length (mp->aged_kvs);
+}
+
+// Return 1 if any bridge domain has mac aging enabled
+static int
+l2fib_any_bd_aging (void)
+{
+  l2input_main_t * l2im = &l2input_main;
+  l2_bridge_domain_t * bd_config;
+
+  vec_foreach (bd_config, l2im->bd_configs)
+    if (bd_is_valid (bd_config) && bd_config->mac_age)
+      return 1;
+  return 0;
+}
+
+// Age out learned macs. Once a minute, while any bridge domain has
+// aging enabled, sweep the whole mac table a slice of buckets at a
+// time, so the main thread never stalls on a large table.
+static uword
+l2fib_mac_age_scanner_process (vlib_main_t * vm,
+                               vlib_node_runtime_t * rt,
+                               vlib_frame_t * f)
+{
+  l2fib_main_t * mp = &l2fib_main;
+  uword * event_data = 0;
+  u32 i;
+  u8 now;
+
+  while (1)
+    {
+      if (l2fib_any_bd_aging ())
+        vlib_process_wait_for_event_or_clock (vm, L2FIB_AGE_SCAN_INTERVAL);
+      else
+        vlib_process_wait_for_event (vm);
+
+      vlib_process_get_events (vm, &event_data);
+      vec_reset_length (event_data);
+
+      if (!l2fib_any_bd_aging ())
+        continue;
+
+      now = l2fib_timestamp (vlib_time_now (vm));
+
+      for (i = 0; i < mp->mac_table.nbuckets; i++)
+        {
+          l2fib_age_scan_bucket (mp, i, now);
+
+          if ((i + 1) % L2FIB_AGE_SCAN_BUCKETS_PER_SLICE == 0)
+            {
+              l2fib_age_delete_aged (mp, now);
+              vlib_process_suspend (vm, 1e-3);
+            }
+        }
+      l2fib_age_delete_aged (mp, now);
+
+      mp->n_age_scans++;
+      mp->last_age_scan_time = vlib_time_now (vm);
+    }
+  return 0;
+}
+
+VLIB_REGISTER_NODE (l2fib_mac_age_scanner_process_node) = {
+  .function = l2fib_mac_age_scanner_process,
+  .type = VLIB_NODE_TYPE_PROCESS,
+  .name = "l2fib-mac-age-scanner-process",
+};
+
+
 BVT(clib_bihash) *get_mac_table(void) {
   l2fib_main_t * mp = &l2fib_main;
   return &mp->mac_table;
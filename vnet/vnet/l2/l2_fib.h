@@ -57,13 +57,33 @@ typedef struct {
       u8  filter:1;      // drop packets to/from this mac
       u8  refresh:1;     // refresh flag for aging
       u8  unused1:4;
-      u8  timestamp;     // timestamp for aging
+      u8  timestamp;     // last seen, see l2fib_timestamp()
       u16 unused2;
     } fields;
     u64 raw;
   };
 } l2fib_entry_result_t;
 
+/*
+ * MAC aging. Entries carry a coarse timestamp in minutes which the
+ * learn node rewrites only when the minute changes, so a busy mac
+ * costs one table write per minute rather than one per packet. The
+ * scanner process ages entries out per bridge domain, see mac_age
+ * in l2_bridge_domain_t.
+ */
+#define L2FIB_AGE_SCAN_INTERVAL 60.0
+
+always_inline u8
+l2fib_timestamp (f64 now)
+{
+  return (u8) (u64) (now / L2FIB_AGE_SCAN_INTERVAL);
+}
+
+typedef enum {
+  L2FIB_MAC_AGE_SCANNER_EVENT_START = 1,
+} l2fib_mac_age_scanner_event_t;
+
+extern vlib_node_registration_t l2fib_mac_age_scanner_process_node;
 
 // Compute the hash for the given key and return the corresponding bucket index
 always_inline 
@@ -185,20 +205,19 @@ l2fib_lookup_2 (BVT(clib_bihash) * mac_table,
     *bucket1 = ~0;
 
   } else {
-    BVT(clib_bihash_kv) kv0, kv1;
+    BVT(clib_bihash_kv) kv[2];
     
     // Do a regular mac table lookup
-    // Interleave lookups for packet 0 and packet 1
-    kv0.key = key0->raw;
-    kv1.key = key1->raw;
-    kv0.value = ~0ULL;
-    kv1.value = ~0ULL;
+    // Hash both keys and prefetch buckets / values before comparing
+    kv[0].key = key0->raw;
+    kv[1].key = key1->raw;
+    kv[0].value = ~0ULL;
+    kv[1].value = ~0ULL;
 
-    BV(clib_bihash_search_inline) (mac_table, &kv0);
-    BV(clib_bihash_search_inline) (mac_table, &kv1);
+    BV(clib_bihash_search_inline_multi) (mac_table, kv, kv, 2);
 
-    result0->raw = kv0.value;
-    result1->raw = kv1.value;
+    result0->raw = kv[0].value;
+    result1->raw = kv[1].value;
 
     // Update one-entry cache
     cached_key->raw = key1->raw;
@@ -31,15 +31,11 @@
 
 
 /*
- * Flooding uses the packet replication infrastructure to send a copy of the
- * packet to each member interface. Logically the replication infrastructure
- * expects two graph nodes: a prep node that initiates replication and sends the
- * packet to the first destination, and a recycle node that is passed the packet
- * after it has been transmitted.
- *
- * To decrease the amount of code, l2 flooding implements both functions in
- * the same graph node. This node can tell if is it being called as the "prep"
- * or "recycle" using replication_is_recycled().
+ * Flooding sends a copy of the packet to each member interface of the
+ * bridge domain. All the copies are made at once by the replication
+ * engine (see replication.h): each copy has a private L2/L3 header
+ * and shares the payload with the others, and all of them leave this
+ * node in the same dispatch.
  */
 
 
@@ -51,6 +47,9 @@ typedef struct {
   // next node index for the L3 input node of each ethertype
   next_by_ethertype_t l3_next;
 
+  // per-thread scratch vector of the members a packet is flooded to
+  l2_flood_member_t ** members;
+
   /* convenience variables */
   vlib_main_t * vlib_main;
   vnet_main_t * vnet_main;
@@ -86,7 +85,7 @@ static vlib_node_registration_t l2flood_node;
 #define foreach_l2flood_error					\
 _(L2FLOOD,           "L2 flood packets")			\
 _(REPL_FAIL,         "L2 replication failures")			\
-_(NO_MEMBERS,        "L2 replication complete")			\
+_(NO_MEMBERS,        "L2 flood with no members")			\
 _(BVI_TAGGED,        "BVI packet with vlan tag")		\
 _(BVI_ETHERTYPE,     "BVI packet with unhandled ethertype")
 
@@ -110,153 +109,86 @@ typedef enum {
 } l2flood_next_t;
 
 /*
- * Perform flooding on one packet
- *
  * Due to the way BVI processing can modify the packet, the BVI interface
  * (if present) must be processed last in the replication. The member vector
  * is arranged so that the BVI interface is always the first element. 
  * Flooding walks the vector in reverse.
  *
- * BVI processing causes the packet to go to L3 processing. This strips the
- * L2 header, which is fine because the replication infrastructure restores
- * it. However L3 processing can trigger larger changes to the packet. For
- * example, an ARP request could be turned into an ARP reply, an ICMP request
- * could be turned into an ICMP reply. If BVI processing is not performed 
- * last, the modified packet would be replicated to the remaining members. 
+ * BVI processing causes the packet to go to L3 processing. L3 processing
+ * can change the packet in place; for example, an ARP request could be
+ * turned into an ARP reply, an ICMP request into an ICMP reply. Those
+ * headers are in the private part of the BVI copy, so the other copies
+ * are not affected, and the BVI copy is the last one made, so it is the
+ * first to go when buffers run out.
  */
 
-static_always_inline void
-l2flood_process (vlib_main_t * vm,
-                 vlib_node_runtime_t * node,
-                 l2flood_main_t * msm,
-                 u64 * counter_base,
+// Collect the members this packet is flooded to, skipping the input
+// interface and members of the input split-horizon group.
+static_always_inline l2_flood_member_t *
+l2flood_members (l2flood_main_t * msm,
+                 uword cpu_number,
                  vlib_buffer_t * b0,
-                 u32 * sw_if_index0,
-                 l2fib_entry_key_t * key0,
-		 u32 * bucket0,
-                 l2fib_entry_result_t * result0,
-                 u32 * next0)
+                 u32 sw_if_index0)
 {
-  u16 bd_index0;
-  l2_bridge_domain_t *bd_config;
-  l2_flood_member_t * members;
-  i32 current_member;  // signed
-  replication_context_t * ctx;
+  l2_bridge_domain_t * bd_config;
+  l2_flood_member_t * members, * flood;
   u8 in_shg = vnet_buffer(b0)->l2.shg;
+  i32 i;
 
-  if (!replication_is_recycled(b0)) {
-
-    // Do flood "prep node" processing
-
-    // Get config for the bridge domain interface
-    bd_index0 = vnet_buffer(b0)->l2.bd_index;
-    bd_config = vec_elt_at_index(l2input_main.bd_configs, bd_index0);
-    members = bd_config->members;
-
-    // Find first member that passes the reflection and SHG checks
-    current_member = vec_len(members) - 1;
-    while ((current_member >= 0) && 
-           ((members[current_member].sw_if_index == *sw_if_index0) ||
-	    (in_shg && members[current_member].shg == in_shg))) {
-      current_member--;
-    }
-
-    if (current_member < 0) {
-      // No members to flood to
-      *next0 = L2FLOOD_NEXT_DROP;
-      b0->error = node->errors[L2FLOOD_ERROR_NO_MEMBERS];
-      return;
-    }
-
-    if ((current_member > 0) &&
-        ((current_member > 1) || 
-	 ((members[0].sw_if_index != *sw_if_index0) &&
-	  (!in_shg || members[0].shg != in_shg)))) {
-      // If more than one member then initiate replication
-      ctx = replication_prep (vm, b0, l2flood_node.index, 1 /* l2_packet */);
-      ctx->feature_replicas = (uword) members;
-      ctx->feature_counter = current_member;
-    }
+  bd_config = vec_elt_at_index(l2input_main.bd_configs,
+                               vnet_buffer(b0)->l2.bd_index);
+  members = bd_config->members;
 
-  } else {
-    vnet_buffer_opaque_t *vnet_buff_op;
+  flood = msm->members[cpu_number];
+  vec_reset_length (flood);
 
-    // Do flood "recycle node" processing
-
-    if (PREDICT_FALSE(b0->flags & VLIB_BUFFER_REPL_FAIL))
-      {
-	(void)replication_recycle (vm, b0, 1 /* is_last */);
-	*next0 = L2FLOOD_NEXT_DROP;
-	b0->error = node->errors[L2FLOOD_ERROR_REPL_FAIL];
-	return;
-      }
-
-    ctx = replication_get_ctx (b0);
-    replication_clear_recycled (b0);
-
-    members = (l2_flood_member_t *)(intptr_t) ctx->feature_replicas;
-    current_member = (i32)ctx->feature_counter - 1;
-
-    // Need to update input index from saved packet context
-    vnet_buff_op = (vnet_buffer_opaque_t *)ctx->vnet_buffer;
-    *sw_if_index0 = vnet_buff_op->sw_if_index[VLIB_RX];
-
-    // Find next member that passes the reflection and SHG check
-    while ((current_member >= 0) &&
-           ((members[current_member].sw_if_index == *sw_if_index0) ||
-	    (in_shg && members[current_member].shg == in_shg))) {
-      current_member--;
-    }
-
-    if (current_member < 0) {
-      // No more members to flood to.
-      // Terminate replication and drop packet.
+  for (i = vec_len(members) - 1; i >= 0; i--) {
+    if ((members[i].sw_if_index == sw_if_index0) ||
+        (in_shg && members[i].shg == in_shg))
+      continue;
+    vec_add1 (flood, members[i]);
+  }
 
-      replication_recycle (vm, b0, 1 /* is_last */);
+  msm->members[cpu_number] = flood;
+  return flood;
+}
 
-      *next0 = L2FLOOD_NEXT_DROP;
-      // Ideally we woudn't bump a counter here, just silently complete
-      b0->error = node->errors[L2FLOOD_ERROR_NO_MEMBERS];
-      return;
-    }
+// Send one copy to one member
+static_always_inline u32
+l2flood_forward (vlib_main_t * vm,
+                 vlib_node_runtime_t * node,
+                 l2flood_main_t * msm,
+                 vlib_buffer_t * c0,
+                 l2_flood_member_t * member)
+{
+  u32 next0;
+  u32 rc;
 
-    // Restore packet and context and continue replication
-    ctx->feature_counter = current_member;
-    replication_recycle (vm, b0,
-       ((current_member == 0) || /*is_last */ 
-        ((current_member == 1) && 
-	 ((members[0].sw_if_index == *sw_if_index0) ||
-	  (in_shg && members[0].shg == in_shg)))));
+  if (PREDICT_TRUE(member->flags == L2_FLOOD_MEMBER_NORMAL)) {
+    // Do normal L2 forwarding
+    vnet_buffer(c0)->sw_if_index[VLIB_TX] = member->sw_if_index;
+    return L2FLOOD_NEXT_L2_OUTPUT;
   }
 
-  // Forward packet to the current member
-
-  if (PREDICT_TRUE(members[current_member].flags == L2_FLOOD_MEMBER_NORMAL)) {
-    // Do normal L2 forwarding
-    vnet_buffer(b0)->sw_if_index[VLIB_TX] = members[current_member].sw_if_index;
-    *next0 = L2FLOOD_NEXT_L2_OUTPUT;
-
-  } else {
-    // Do BVI processing
-    u32 rc;
-    rc = l2_to_bvi (vm,
-                    msm->vnet_main,
-                    b0, 
-                    members[current_member].sw_if_index,
-                    &msm->l3_next,
-                    next0);
-
-    if (PREDICT_FALSE(rc)) {
-      if (rc == TO_BVI_ERR_TAGGED) {
-        b0->error = node->errors[L2FLOOD_ERROR_BVI_TAGGED];
-        *next0 = L2FLOOD_NEXT_DROP;
-      } else if (rc == TO_BVI_ERR_ETHERTYPE) {
-        b0->error = node->errors[L2FLOOD_ERROR_BVI_ETHERTYPE];
-        *next0 = L2FLOOD_NEXT_DROP;
-      }
+  // Do BVI processing
+  rc = l2_to_bvi (vm,
+                  msm->vnet_main,
+                  c0, 
+                  member->sw_if_index,
+                  &msm->l3_next,
+                  &next0);
+
+  if (PREDICT_FALSE(rc)) {
+    if (rc == TO_BVI_ERR_TAGGED) {
+      c0->error = node->errors[L2FLOOD_ERROR_BVI_TAGGED];
+      next0 = L2FLOOD_NEXT_DROP;
+    } else if (rc == TO_BVI_ERR_ETHERTYPE) {
+      c0->error = node->errors[L2FLOOD_ERROR_BVI_ETHERTYPE];
+      next0 = L2FLOOD_NEXT_DROP;
     }
   }
 
+  return next0;
 }
 
 
@@ -266,159 +198,108 @@ l2flood_node_fn (vlib_main_t * vm,
 		  vlib_frame_t * frame)
 {
   u32 n_left_from, * from, * to_next;
-  l2flood_next_t next_index;
+  u32 next_index;
   l2flood_main_t * msm = &l2flood_main;
   vlib_node_t *n = vlib_get_node (vm, l2flood_node.index);
   u32 node_counter_base_index = n->error_heap_index;
   vlib_error_main_t * em = &vm->error_main;
+  uword cpu_number = vm->cpu_index;
+  u32 n_left_to_next;
 
   from = vlib_frame_vector_args (frame);
   n_left_from = frame->n_vectors; /* number of packets to process */
   next_index = node->cached_next_index;
  
+  /* One input packet turns into any number of output packets, so
+     buffers are enqueued one at a time rather than speculatively. */
+  vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
+
   while (n_left_from > 0)
     {
-      u32 n_left_to_next;
-
-      /* get space to enqueue frame to graph node "next_index" */
-      vlib_get_next_frame (vm, node, next_index,
-			   to_next, n_left_to_next);
-
-      while (n_left_from >= 6 && n_left_to_next >= 2)
-	{
-          u32 bi0, bi1;
-	  vlib_buffer_t * b0, * b1;
-          u32 next0, next1;
-          u32 sw_if_index0, sw_if_index1;
-          l2fib_entry_key_t key0, key1;
-          l2fib_entry_result_t result0, result1;
-          u32 bucket0, bucket1;
-          
-	  /* Prefetch next iteration. */
-	  {
-	    vlib_buffer_t * p2, * p3, * p4, * p5;
-            
-	    p2 = vlib_get_buffer (vm, from[2]);
-	    p3 = vlib_get_buffer (vm, from[3]);
-	    p4 = vlib_get_buffer (vm, from[4]);
-	    p5 = vlib_get_buffer (vm, from[5]);
-            
-	    // Prefetch the buffer header for the N+2 loop iteration
-	    vlib_prefetch_buffer_header (p4, LOAD);
-	    vlib_prefetch_buffer_header (p5, LOAD);
-
- 	    // Prefetch the replication context for the N+1 loop iteration
-            // This depends on the buffer header above
-            replication_prefetch_ctx (p2);
-            replication_prefetch_ctx (p3);
-
- 	    // Prefetch the packet for the N+1 loop iteration
-	    CLIB_PREFETCH (p2->data, CLIB_CACHE_LINE_BYTES, STORE);
-	    CLIB_PREFETCH (p3->data, CLIB_CACHE_LINE_BYTES, STORE);
-	  }
-
-          /* speculatively enqueue b0 and b1 to the current next frame */
-          /* bi is "buffer index", b is pointer to the buffer */
-	  to_next[0] = bi0 = from[0];
-	  to_next[1] = bi1 = from[1];
-	  from += 2;
-	  to_next += 2;
-	  n_left_from -= 2;
-	  n_left_to_next -= 2;
-
-	  b0 = vlib_get_buffer (vm, bi0);
-	  b1 = vlib_get_buffer (vm, bi1);
- 
-          /* RX interface handles */
-          sw_if_index0 = vnet_buffer(b0)->sw_if_index[VLIB_RX];
-          sw_if_index1 = vnet_buffer(b1)->sw_if_index[VLIB_RX];
-
-            /* process 2 pkts */
-            em->counters[node_counter_base_index + L2FLOOD_ERROR_L2FLOOD] += 2;
-
-            l2flood_process (vm, node, msm, &em->counters[node_counter_base_index],
-                             b0, &sw_if_index0, &key0, &bucket0, &result0, &next0);
-
-            l2flood_process (vm, node, msm, &em->counters[node_counter_base_index],
-                             b1, &sw_if_index1, &key1, &bucket1, &result1, &next1);
-
-          if (PREDICT_FALSE((node->flags & VLIB_NODE_FLAG_TRACE)))
-            {          
-              if (PREDICT_FALSE(b0->flags & VLIB_BUFFER_IS_TRACED)) 
-                {
-                  l2flood_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
-		  ethernet_header_t * h0 = vlib_buffer_get_current (b0); 
-                  t->sw_if_index = sw_if_index0;
-                  t->bd_index = vnet_buffer(b0)->l2.bd_index;
-                  clib_memcpy(t->src, h0->src_address, 6);
-                  clib_memcpy(t->dst, h0->dst_address, 6);
-                }
-              if (PREDICT_FALSE(b1->flags & VLIB_BUFFER_IS_TRACED))
-                {
-                  l2flood_trace_t *t = vlib_add_trace (vm, node, b1, sizeof (*t));
-		  ethernet_header_t * h1 = vlib_buffer_get_current (b1); 
-                  t->sw_if_index = sw_if_index1;
-                  t->bd_index = vnet_buffer(b1)->l2.bd_index;
-                  clib_memcpy(t->src, h1->src_address, 6);
-                  clib_memcpy(t->dst, h1->dst_address, 6);
-                }
-            }
+      u32 bi0, * replicas0, n_replicas0, i;
+      vlib_buffer_t * b0;
+      u32 sw_if_index0;
+      l2_flood_member_t * flood0;
+
+      if (n_left_from > 1)
+        {
+          vlib_buffer_t * p1 = vlib_get_buffer (vm, from[1]);
 
-            /* verify speculative enqueues, maybe switch current next frame */
-            /* if next0==next1==next_index then nothing special needs to be done */
-            vlib_validate_buffer_enqueue_x2 (vm, node, next_index,
-                                             to_next, n_left_to_next,
-                                             bi0, bi1, next0, next1);
+          vlib_prefetch_buffer_header (p1, LOAD);
+          CLIB_PREFETCH (p1->data, CLIB_CACHE_LINE_BYTES, LOAD);
         }
-      
-      while (n_left_from > 0 && n_left_to_next > 0)
-	{
-          u32 bi0;
-	  vlib_buffer_t * b0;
-          u32 next0;
-          u32 sw_if_index0;
-          l2fib_entry_key_t key0;
-          l2fib_entry_result_t result0;
-          u32 bucket0;
-
-          /* speculatively enqueue b0 to the current next frame */
-	  bi0 = from[0];
-	  to_next[0] = bi0;
-	  from += 1;
-	  to_next += 1;
-	  n_left_from -= 1;
-	  n_left_to_next -= 1;
-
-	  b0 = vlib_get_buffer (vm, bi0);
-
-          sw_if_index0 = vnet_buffer(b0)->sw_if_index[VLIB_RX];
- 
-          /* process 1 pkt */
-          em->counters[node_counter_base_index + L2FLOOD_ERROR_L2FLOOD] += 1;
 
-          l2flood_process (vm, node, msm, &em->counters[node_counter_base_index],
-                           b0, &sw_if_index0, &key0, &bucket0, &result0, &next0);
+      bi0 = from[0];
+      from += 1;
+      n_left_from -= 1;
+
+      b0 = vlib_get_buffer (vm, bi0);
+
+      /* RX interface handle */
+      sw_if_index0 = vnet_buffer(b0)->sw_if_index[VLIB_RX];
+
+      em->counters[node_counter_base_index + L2FLOOD_ERROR_L2FLOOD] += 1;
 
-          if (PREDICT_FALSE((node->flags & VLIB_NODE_FLAG_TRACE) &&
-                            (b0->flags & VLIB_BUFFER_IS_TRACED)))
+      if (PREDICT_FALSE((node->flags & VLIB_NODE_FLAG_TRACE) &&
+                        (b0->flags & VLIB_BUFFER_IS_TRACED)))
+        {
+          l2flood_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
+          ethernet_header_t * h0 = vlib_buffer_get_current (b0); 
+          t->sw_if_index = sw_if_index0;
+          t->bd_index = vnet_buffer(b0)->l2.bd_index;
+          clib_memcpy(t->src, h0->src_address, 6);
+          clib_memcpy(t->dst, h0->dst_address, 6);
+        }
+
+      flood0 = l2flood_members (msm, cpu_number, b0, sw_if_index0);
+
+      if (PREDICT_FALSE(vec_len (flood0) == 0))
+        {
+          // No members to flood to
+          b0->error = node->errors[L2FLOOD_ERROR_NO_MEMBERS];
+          replication_enqueue (vm, node, &next_index, &to_next,
+                               &n_left_to_next, bi0, L2FLOOD_NEXT_DROP);
+          continue;
+        }
+
+      if (vec_len (flood0) == 1)
+        {
+          // Nothing to replicate
+          replicas0 = &bi0;
+          n_replicas0 = 1;
+        }
+      else
+        {
+          replicas0 = replication_replicate (vm, bi0, vec_len (flood0));
+          n_replicas0 = vec_len (replicas0);
+
+          if (PREDICT_FALSE(n_replicas0 < vec_len (flood0)))
+            em->counters[node_counter_base_index + L2FLOOD_ERROR_REPL_FAIL]
+              += vec_len (flood0) - n_replicas0;
+
+          if (PREDICT_FALSE(n_replicas0 == 0))
             {
-              l2flood_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
-	      ethernet_header_t * h0 = vlib_buffer_get_current (b0); 
-              t->sw_if_index = sw_if_index0;
-              t->bd_index = vnet_buffer(b0)->l2.bd_index;
-              clib_memcpy(t->src, h0->src_address, 6);
-              clib_memcpy(t->dst, h0->dst_address, 6);
+              b0->error = node->errors[L2FLOOD_ERROR_REPL_FAIL];
+              replication_enqueue (vm, node, &next_index, &to_next,
+                                   &n_left_to_next, bi0, L2FLOOD_NEXT_DROP);
+              continue;
             }
+        }
 
-          /* verify speculative enqueue, maybe switch current next frame */
-	  vlib_validate_buffer_enqueue_x1 (vm, node, next_index,
-					   to_next, n_left_to_next,
-					   bi0, next0);
-	}
+      // Forward a copy to each member
+      for (i = 0; i < n_replicas0; i++)
+        {
+          u32 ci0 = replicas0[i];
+          vlib_buffer_t * c0 = vlib_get_buffer (vm, ci0);
+          u32 next0 = l2flood_forward (vm, node, msm, c0, flood0 + i);
 
-      vlib_put_next_frame (vm, node, next_index, n_left_to_next);
+          replication_enqueue (vm, node, &next_index, &to_next,
+                               &n_left_to_next, ci0, next0);
+        }
     }
 
+  vlib_put_next_frame (vm, node, next_index, n_left_to_next);
+
   return frame->n_vectors;
 }
 
@@ -449,6 +330,8 @@ clib_error_t *l2flood_init (vlib_main_t *vm)
   mp->vlib_main = vm;
   mp->vnet_main = vnet_get_main();
 
+  vec_validate (mp->members, vlib_get_thread_main()->n_vlib_mains - 1);
+
   // Initialize the feature next-node indexes
   feat_bitmap_init_next_nodes(vm,
                               l2flood_node.index,
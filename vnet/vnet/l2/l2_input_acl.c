@@ -283,40 +283,30 @@ l2_inacl_node_fn (vlib_main_t * vm,
                 }
               else
                 {
-                  while (1)
+                  e0 = vnet_classify_find_entry_chain (vcm, t0, (u8 *) h0,
+                                                       now, &t0);
+                  if (e0)
                     {
-                      if (PREDICT_TRUE(t0->next_table_index != ~0))
-                        t0 = pool_elt_at_index (vcm->tables,
-                                                t0->next_table_index);
-                      else
-                        {
-                          next0 = (t0->miss_next_index < ACL_NEXT_INDEX_N_NEXT)?
-                                   t0->miss_next_index:next0;
-
-                          misses++;
-
-                          error0 = (next0 == ACL_NEXT_INDEX_DENY)?
-                            L2_INACL_ERROR_TABLE_MISS:L2_INACL_ERROR_NONE;
-                          b0->error = node->errors[error0];
-                          break;
-                        }
-
-                      hash0 = vnet_classify_hash_packet (t0, (u8 *) h0);
-                      e0 = vnet_classify_find_entry
-                        (t0, (u8 *) h0, hash0, now);
-                      if (e0)
-                        {
-                          vlib_buffer_advance (b0, e0->advance);
-                          next0 = (e0->next_index < ACL_NEXT_INDEX_N_NEXT)?
-                                   e0->next_index:next0;
-                          hits++;
-                          chain_hits++;
-
-                          error0 = (next0 == ACL_NEXT_INDEX_DENY)?
-                            L2_INACL_ERROR_SESSION_DENY:L2_INACL_ERROR_NONE;
-                          b0->error = node->errors[error0];
-                          break;
-                        }
+                      vlib_buffer_advance (b0, e0->advance);
+                      next0 = (e0->next_index < ACL_NEXT_INDEX_N_NEXT)?
+                               e0->next_index:next0;
+                      hits++;
+                      chain_hits++;
+
+                      error0 = (next0 == ACL_NEXT_INDEX_DENY)?
+                        L2_INACL_ERROR_SESSION_DENY:L2_INACL_ERROR_NONE;
+                      b0->error = node->errors[error0];
+                    }
+                  else
+                    {
+                      next0 = (t0->miss_next_index < ACL_NEXT_INDEX_N_NEXT)?
+                               t0->miss_next_index:next0;
+
+                      misses++;
+
+                      error0 = (next0 == ACL_NEXT_INDEX_DENY)?
+                        L2_INACL_ERROR_TABLE_MISS:L2_INACL_ERROR_NONE;
+                      b0->error = node->errors[error0];
                     }
                 }
             }
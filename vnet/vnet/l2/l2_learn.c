@@ -77,6 +77,8 @@ _(MAC_MOVE,          "L2 mac moves")			\
 _(MAC_MOVE_VIOLATE,  "L2 mac move violations")		\
 _(LIMIT,             "L2 not learned due to limit")	\
 _(HIT,               "L2 learn hits")			\
+_(LEARNED,           "L2 macs learned")			\
+_(REFRESH,           "L2 mac age refreshes")		\
 _(FILTER_DROP,       "L2 filter mac drops")     
 
 typedef enum {
@@ -111,7 +113,8 @@ l2learn_process (vlib_node_runtime_t * node,
                  l2fib_entry_key_t * cached_key,
 		 u32 * bucket0,
                  l2fib_entry_result_t * result0,
-                 u32 * next0)
+                 u32 * next0,
+                 u8 timestamp)
 {
   u32 feature_bitmap;
 
@@ -131,11 +134,23 @@ l2learn_process (vlib_node_runtime_t * node,
 
   if (PREDICT_TRUE (result0->fields.sw_if_index == sw_if_index0)) {
     // The entry was in the table, and the sw_if_index matched, the normal case 
-
-    // TODO: for dataplane learning and aging, do this:
-    //       if refresh=0 and not a static mac, set refresh=1
     counter_base[L2LEARN_ERROR_HIT] += 1;
 
+    // Refresh the age timestamp, at most once a minute per mac
+    if (PREDICT_FALSE (result0->fields.timestamp != timestamp
+                       && !result0->fields.static_mac)) {
+      BVT(clib_bihash_kv) kv;
+
+      result0->fields.timestamp = timestamp;
+      kv.key = key0->raw;
+      kv.value = result0->raw;
+
+      BV(clib_bihash_add_del) (msm->mac_table, &kv, 1 /* is_add */);
+
+      cached_key->raw = ~0;  // invalidate the cache
+      counter_base[L2LEARN_ERROR_REFRESH] += 1;
+    }
+
   } else if (result0->raw == ~0) {  
 
     // The entry was not in table, so add it 
@@ -154,7 +169,7 @@ l2learn_process (vlib_node_runtime_t * node,
 
       result0->raw = 0; // clear all fields
       result0->fields.sw_if_index = sw_if_index0;
-      // TODO: set timestamp in entry to clock for dataplane aging
+      result0->fields.timestamp = timestamp;
       kv.key = key0->raw;
       kv.value = result0->raw;
 
@@ -162,6 +177,7 @@ l2learn_process (vlib_node_runtime_t * node,
 
       cached_key->raw = ~0;  // invalidate the cache
       msm->global_learn_count++;
+      counter_base[L2LEARN_ERROR_LEARNED] += 1;
     }
 
   } else {
@@ -182,6 +198,7 @@ l2learn_process (vlib_node_runtime_t * node,
 
       result0->raw = 0; // clear all fields
       result0->fields.sw_if_index = sw_if_index0;
+      result0->fields.timestamp = timestamp;
  
       kv.key = key0->raw;
       kv.value = result0->raw;
@@ -220,6 +237,7 @@ l2learn_node_fn (vlib_main_t * vm,
   vlib_error_main_t * em = &vm->error_main;
   l2fib_entry_key_t cached_key;
   l2fib_entry_result_t cached_result;
+  u8 timestamp = l2fib_timestamp (vlib_time_now (vm));
 
   from = vlib_frame_vector_args (frame);
   n_left_from = frame->n_vectors; /* number of packets to process */
@@ -322,11 +340,11 @@ l2learn_node_fn (vlib_main_t * vm,
 
             l2learn_process (node, msm, &em->counters[node_counter_base_index],
                              b0, sw_if_index0, &key0, &cached_key,
-                             &bucket0, &result0, &next0);
+                             &bucket0, &result0, &next0, timestamp);
 
             l2learn_process (node, msm, &em->counters[node_counter_base_index],
                              b1, sw_if_index1, &key1, &cached_key,
-                             &bucket1, &result1, &next1);
+                             &bucket1, &result1, &next1, timestamp);
 
             /* verify speculative enqueues, maybe switch current next frame */
             /* if next0==next1==next_index then nothing special needs to be done */
@@ -381,7 +399,7 @@ l2learn_node_fn (vlib_main_t * vm,
 
           l2learn_process (node, msm, &em->counters[node_counter_base_index],
                            b0, sw_if_index0, &key0, &cached_key,
-                           &bucket0, &result0, &next0);
+                           &bucket0, &result0, &next0, timestamp);
 
           /* verify speculative enqueue, maybe switch current next frame */
 	  vlib_validate_buffer_enqueue_x1 (vm, node, next_index,
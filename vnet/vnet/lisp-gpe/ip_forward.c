@@ -325,29 +325,37 @@ static u32
 ip6_sd_get_src_route (lisp_gpe_main_t * lgm, u32 src_fib_index,
                       ip6_address_t * src, u32 address_length)
 {
-  int i, len;
-  int rv;
-  BVT(clib_bihash_kv) kv, value;
+  int i, j, n, len;
+  u32 found;
+  BVT(clib_bihash_kv) kv[4];
   ip6_src_fib_t * fib = pool_elt_at_index (lgm->ip6_src_fibs, src_fib_index);
 
   len = vec_len (fib->prefix_lengths_in_search_order);
 
-  for (i = 0; i < len; i++)
+  /* Probe 4 prefix lengths at a time so the bucket misses overlap */
+  for (i = 0; i < len; i += n)
     {
-      int dst_address_length = fib->prefix_lengths_in_search_order[i];
-      ip6_address_t * mask;
+      n = clib_min (len - i, ARRAY_LEN (kv));
+
+      for (j = 0; j < n; j++)
+        {
+          int dst_address_length = fib->prefix_lengths_in_search_order[i + j];
+          ip6_address_t * mask;
 
-      ASSERT(dst_address_length >= 0 && dst_address_length <= 128);
+          ASSERT(dst_address_length >= 0 && dst_address_length <= 128);
 
-      mask = &fib->fib_masks[dst_address_length];
+          mask = &fib->fib_masks[dst_address_length];
 
-      kv.key[0] = src->as_u64[0] & mask->as_u64[0];
-      kv.key[1] = src->as_u64[1] & mask->as_u64[1];
-      kv.key[2] = dst_address_length;
+          kv[j].key[0] = src->as_u64[0] & mask->as_u64[0];
+          kv[j].key[1] = src->as_u64[1] & mask->as_u64[1];
+          kv[j].key[2] = dst_address_length;
+        }
 
-      rv = BV(clib_bihash_search_inline_2)(&fib->ip6_lookup_table, &kv, &value);
-      if (rv == 0)
-        return value.value;
+      found = BV(clib_bihash_search_inline_multi)(&fib->ip6_lookup_table,
+                                                  kv, kv, n);
+      /* Lowest set bit is the longest matching prefix */
+      if (found)
+        return kv[min_log2 (found & -found)].value;
     }
 
   return 0;
@@ -901,29 +909,37 @@ static u32
 ip6_src_fib_lookup (lisp_gpe_main_t * lgm, u32 src_fib_index,
                     ip6_address_t * src)
 {
-  int i, len;
-  int rv;
-  BVT(clib_bihash_kv) kv, value;
+  int i, j, n, len;
+  u32 found;
+  BVT(clib_bihash_kv) kv[4];
   ip6_src_fib_t * fib = pool_elt_at_index (lgm->ip6_src_fibs, src_fib_index);
 
   len = vec_len (fib->prefix_lengths_in_search_order);
 
-  for (i = 0; i < len; i++)
+  /* Probe 4 prefix lengths at a time so the bucket misses overlap */
+  for (i = 0; i < len; i += n)
     {
-      int dst_address_length = fib->prefix_lengths_in_search_order[i];
-      ip6_address_t * mask;
+      n = clib_min (len - i, ARRAY_LEN (kv));
+
+      for (j = 0; j < n; j++)
+        {
+          int dst_address_length = fib->prefix_lengths_in_search_order[i + j];
+          ip6_address_t * mask;
 
-      ASSERT(dst_address_length >= 0 && dst_address_length <= 128);
+          ASSERT(dst_address_length >= 0 && dst_address_length <= 128);
 
-      mask = &fib->fib_masks[dst_address_length];
+          mask = &fib->fib_masks[dst_address_length];
 
-      kv.key[0] = src->as_u64[0] & mask->as_u64[0];
-      kv.key[1] = src->as_u64[1] & mask->as_u64[1];
-      kv.key[2] = dst_address_length;
+          kv[j].key[0] = src->as_u64[0] & mask->as_u64[0];
+          kv[j].key[1] = src->as_u64[1] & mask->as_u64[1];
+          kv[j].key[2] = dst_address_length;
+        }
 
-      rv = BV(clib_bihash_search_inline_2)(&fib->ip6_lookup_table, &kv, &value);
-      if (rv == 0)
-        return value.value;
+      found = BV(clib_bihash_search_inline_multi)(&fib->ip6_lookup_table,
+                                                  kv, kv, n);
+      /* Lowest set bit is the longest matching prefix */
+      if (found)
+        return kv[min_log2 (found & -found)].value;
     }
 
   return 0;
@@ -951,7 +951,7 @@ show_map_stats_command_fn (vlib_main_t *vm, unformat_input_t *input, vlib_cli_co
   vec_foreach (cm, mm->domain_counters) {
     which = cm - mm->domain_counters;
 
-    for (i = 0; i < vec_len (cm->maxi); i++) {
+    for (i = 0; i < vlib_counter_len (cm); i++) {
       vlib_get_combined_counter (cm, i, &v);
       total_pkts[which] += v.packets;
       total_bytes[which] += v.bytes;
@@ -20,9 +20,8 @@
 #include <vlib/buffer_funcs.h>
 
 typedef struct {
-  /* Arrange for both prep and recycle nodes to have identical
-     next indices for a given output interface */
-  u32 prep_and_recycle_node_next_index;
+  /* Next index of the prep node for the output interface */
+  u32 prep_node_next_index;
 
   /* Show command, etc. */
   u32 tx_sw_if_index;
@@ -37,9 +36,6 @@ typedef struct {
   /* pool of multicast (interface) groups */
   mcast_group_t * groups;
 
-  /* multicast "free" list, aka recycle list */
-  u32 mcast_recycle_list_index;
-
   /* convenience */
   vlib_main_t * vlib_main;
   vnet_main_t * vnet_main;
@@ -33,7 +33,6 @@ typedef struct {
 
 mcast_test_main_t mcast_test_main;
 vlib_node_registration_t mcast_prep_node;
-vlib_node_registration_t mcast_recycle_node;
 
 static clib_error_t *
 mcast_test_command_fn (vlib_main_t * vm,
@@ -76,12 +75,7 @@ mcast_test_command_fn (vlib_main_t * vm,
           next = vlib_node_add_next (mtm->vlib_main, 
                                      mcast_prep_node.index,
                                      hw->output_node_index);
-          
-          /* Required to be the same next index... */
-          vlib_node_add_next_with_slot (mtm->vlib_main,
-                                        mcast_recycle_node.index,
-                                        hw->output_node_index, next);
-          member->prep_and_recycle_node_next_index = next;
+          member->prep_node_next_index = next;
         }
       else
         {
@@ -21,43 +21,34 @@
 
 #include <vlib/vlib.h>
 #include <vnet/vnet.h>
-#include <vnet/replication.h>
 
+/*
+ * Packet replication.
+ *
+ * A packet going to N destinations is turned into N buffers in one go
+ * with vlib_buffer_clone: each replica has a private header buffer
+ * holding the first REPLICATION_HEAD_BYTES of the packet, chained to
+ * the payload which all the replicas share.  The replicating node
+ * enqueues all of them in the same dispatch with replication_enqueue,
+ * instead of recycling one buffer through the graph once per
+ * destination.
+ *
+ * The private part covers the L2 header with tags plus the L3/L4
+ * headers that L2 rewrite, BVI and IP processing may change in place
+ * (ARP and ICMP echo replies).  Nothing may write to the payload.
+ */
 
-typedef struct {
-
-  // The entire vnet buffer header restored for each replica
-  u8   vnet_buffer[32];      // 16B aligned to allow vector unit copy
-  u8   reserved[32];         // space for future expansion of vnet buffer header
-
-  // feature state used during this replication
-  u64  feature_replicas;     // feature's id for its set of replicas
-  u32  feature_counter;      // feature's current index into set of replicas
-  u32  recycle_node_index;   // feature's recycle node index
-
-  // data saved from the start of replication and restored at the end of replication
-  u32  saved_clone_count;     // from vlib buffer
-  u32  saved_free_list_index; // from vlib buffer
-
-  // data saved from the original packet and restored for each replica
-  u64  l2_header[3];         // 24B (must be at least 22B for l2 packets)
-  u16  ip_tos;               // v4 and v6
-  u16  ip4_checksum;         // needed for v4 only
-
-  // data saved from the vlib buffer header and restored for each replica
-  i16  current_data;         // offset of first byte of packet in packet data
-  u8   pad[6];               // to 64B
-  u8   l2_packet;            // flag for l2 vs l3 packet data
-
-} replication_context_t;    // 128B
-
+#define REPLICATION_HEAD_BYTES 128
 
 typedef struct {
 
-  u32 recycle_list_index;
+  // per-thread vectors of replica buffer indices
+  u32 ** replicas;
 
-  // per-thread pools of replication contexts
-  replication_context_t ** contexts;
+  // per-thread counters
+  u64 * n_packets;
+  u64 * n_replicas;
+  u64 * n_failures;
 
   vlib_main_t * vlib_main;
   vnet_main_t * vnet_main;
@@ -68,56 +59,57 @@ typedef struct {
 extern replication_main_t replication_main;
 
 
-// Return 1 if this buffer just came from the replication recycle handler.
-always_inline u32
-replication_is_recycled (vlib_buffer_t * b0)
+// Replicate buffer bi0 n_replicas times. Returns a per-thread vector
+// of the replicas, valid until the next call on this thread; it may be
+// shorter than asked for if buffers ran out, and is empty (with bi0
+// untouched) if nothing could be done. bi0 itself must not be used
+// again unless the result is empty.
+always_inline u32 *
+replication_replicate (vlib_main_t * vm, u32 bi0, u32 n_replicas)
 {
-  return b0->flags & VLIB_BUFFER_IS_RECYCLED;
-}
+  replication_main_t * rm = &replication_main;
+  uword cpu_number = vm->cpu_index;
+  u32 * r = rm->replicas[cpu_number];
+  u16 n;
 
-// Clear the recycle flag. If buffer came from the replication recycle
-// handler, this flag must be cleared before the packet is transmitted again.
-always_inline void
-replication_clear_recycled (vlib_buffer_t * b0)
-{
-  b0->flags &= ~VLIB_BUFFER_IS_RECYCLED;
-}
+  ASSERT (n_replicas > 0 && n_replicas <= (u16) ~0);
+  vec_validate (r, n_replicas - 1);
+  rm->replicas[cpu_number] = r;
 
-// Return the active replication context if this buffer has 
-// been recycled, otherwise return 0. (Note that this essentially
-// restricts access to the replication context to the replication
-// feature's prep and recycle nodes.)
-always_inline replication_context_t *
-replication_get_ctx (vlib_buffer_t * b0)
-{
-  replication_main_t * rm = &replication_main;
+  n = vlib_buffer_clone (vm, bi0, r, n_replicas, REPLICATION_HEAD_BYTES);
+  _vec_len (r) = n;
+
+  rm->n_packets[cpu_number] += 1;
+  rm->n_replicas[cpu_number] += n;
+  rm->n_failures[cpu_number] += n_replicas - n;
 
-  return replication_is_recycled (b0) ? 
-   pool_elt_at_index (rm->contexts[os_get_cpu_number()], b0->clone_count) :
-   0;
+  return r;
 }
 
-// Prefetch the replication context for this buffer, if it exists
+// Enqueue one buffer to next0, switching the node's current next frame
+// when needed. Lets a node emit a variable number of buffers per input
+// packet: *next_index, *to_next and *n_left_to_next are the usual
+// vlib_get_next_frame state.
 always_inline void
-replication_prefetch_ctx (vlib_buffer_t * b0)
+replication_enqueue (vlib_main_t * vm,
+                     vlib_node_runtime_t * node,
+                     u32 * next_index,
+                     u32 ** to_next,
+                     u32 * n_left_to_next,
+                     u32 bi0,
+                     u32 next0)
 {
-  replication_context_t *ctx = replication_get_ctx (b0);
-
-  if (ctx) {
-    CLIB_PREFETCH (ctx, (2*CLIB_CACHE_LINE_BYTES), STORE);
-  }
+  if (PREDICT_FALSE (next0 != *next_index || *n_left_to_next == 0))
+    {
+      vlib_put_next_frame (vm, node, *next_index, *n_left_to_next);
+      *next_index = next0;
+      vlib_get_next_frame (vm, node, *next_index, *to_next, *n_left_to_next);
+    }
+
+  (*to_next)[0] = bi0;
+  *to_next += 1;
+  *n_left_to_next -= 1;
 }
 
-replication_context_t *
-replication_prep (vlib_main_t * vm,
-                  vlib_buffer_t * b0,
-                  u32 recycle_node_index,
-                  u32 l2_packet);
-
-replication_context_t *
-replication_recycle (vlib_main_t * vm,
-                     vlib_buffer_t * b0,
-                     u32 is_last);
-
 
 #endif
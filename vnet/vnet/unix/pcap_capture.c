@@ -0,0 +1,605 @@
+/*
+ * Copyright (c) 2016 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * pcap_capture.c: asynchronous rx / tx pcap capture, see pcap_capture.h
+ */
+
+#include <sys/fcntl.h>
+#include <limits.h>
+#include <vnet/unix/pcap_capture.h>
+#include <vnet/classify/vnet_classify.h>
+#include <vlib/threads.h>
+
+pcap_capture_main_t pcap_capture_main;
+
+int
+pcap_capture_classify (vlib_main_t * vm, pcap_capture_main_t * pcm,
+                       vlib_buffer_t * b)
+{
+  vnet_classify_main_t * vcm = &vnet_classify_main;
+  vnet_classify_table_t * t;
+  u8 * h = vlib_buffer_get_current (b);
+  u64 hash;
+
+  /* The table may have been deleted since capture started */
+  if (pool_is_free_index (vcm->tables, pcm->classify_table_index))
+    return 0;
+
+  t = pool_elt_at_index (vcm->tables, pcm->classify_table_index);
+  hash = vnet_classify_hash_packet (t, h);
+  return vnet_classify_find_entry (t, h, hash, vlib_time_now (vm)) != 0;
+}
+
+/*
+ * Writer thread. Everything from here to pcap_capture_writer runs on
+ * the writer pthread, so: no clib heap, no vectors, no format.
+ */
+
+always_inline int
+pcap_capture_rotates (pcap_capture_main_t * pcm)
+{
+  return pcm->max_file_bytes != 0 || pcm->rotate_interval != 0;
+}
+
+static int
+pcap_capture_write_all (int fd, u8 * data, uword n_bytes)
+{
+  ssize_t n;
+
+  while (n_bytes > 0)
+    {
+      n = write (fd, data, n_bytes);
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return -1;
+        }
+      data += n;
+      n_bytes -= n;
+    }
+  return 0;
+}
+
+static void
+pcap_capture_file_path (pcap_capture_main_t * pcm, u32 file_index,
+                        char * path, uword n_path)
+{
+  if (pcap_capture_rotates (pcm))
+    snprintf (path, n_path, "%s.%u", pcm->file_name, file_index);
+  else
+    snprintf (path, n_path, "%s", pcm->file_name);
+}
+
+static int
+pcap_capture_open_file (pcap_capture_main_t * pcm, f64 now)
+{
+  char path[PATH_MAX];
+  pcap_file_header_t fh;
+  int fd;
+
+  pcap_capture_file_path (pcm, pcm->file_index, path, sizeof (path));
+
+  fd = open (path, O_CREAT | O_TRUNC | O_WRONLY, 0664);
+  if (fd < 0)
+    {
+      pcm->write_errno = errno;
+      return -1;
+    }
+
+  memset (&fh, 0, sizeof (fh));
+  fh.magic = 0xa1b2c3d4;
+  fh.major_version = 2;
+  fh.minor_version = 4;
+  fh.time_zone = 0;
+  fh.max_packet_size_in_bytes = pcm->snaplen;
+  fh.packet_type = PCAP_PACKET_TYPE_ethernet;
+
+  if (pcap_capture_write_all (fd, (u8 *) &fh, sizeof (fh)))
+    {
+      pcm->write_errno = errno;
+      close (fd);
+      return -1;
+    }
+
+  /* Keep at most max_files around */
+  if (pcm->max_files && pcm->file_index >= pcm->max_files)
+    {
+      pcap_capture_file_path (pcm, pcm->file_index - pcm->max_files,
+                              path, sizeof (path));
+      unlink (path);
+    }
+
+  pcm->fd = fd;
+  pcm->file_index++;
+  pcm->file_bytes = sizeof (fh);
+  pcm->file_open_time = now;
+  pcm->n_files++;
+  return 0;
+}
+
+static void
+pcap_capture_close_file (pcap_capture_main_t * pcm)
+{
+  if (pcm->fd >= 0)
+    close (pcm->fd);
+  pcm->fd = -1;
+}
+
+/* Start the next file, unless the current one holds no packets */
+static void
+pcap_capture_maybe_rotate (pcap_capture_main_t * pcm, f64 now,
+                           uword n_bytes_to_write)
+{
+  int rotate = 0;
+
+  if (pcm->fd < 0 || pcm->file_bytes <= sizeof (pcap_file_header_t))
+    return;
+
+  if (pcm->max_file_bytes
+      && pcm->file_bytes + n_bytes_to_write > pcm->max_file_bytes)
+    rotate = 1;
+
+  if (pcm->rotate_interval
+      && now - pcm->file_open_time >= pcm->rotate_interval)
+    rotate = 1;
+
+  if (rotate)
+    {
+      pcap_capture_close_file (pcm);
+      pcap_capture_open_file (pcm, now);
+    }
+}
+
+static void
+pcap_capture_flush (pcap_capture_main_t * pcm, f64 now)
+{
+  uword n = pcm->n_write_buffer_bytes;
+
+  if (n == 0)
+    return;
+
+  pcm->n_write_buffer_bytes = 0;
+
+  pcap_capture_maybe_rotate (pcm, now, n);
+
+  /* After a write error the data is dropped, capture keeps draining */
+  if (pcm->fd < 0)
+    return;
+
+  if (pcap_capture_write_all (pcm->fd, pcm->write_buffer, n))
+    {
+      pcm->write_errno = errno;
+      pcap_capture_close_file (pcm);
+      return;
+    }
+
+  pcm->file_bytes += n;
+  pcm->n_bytes_written += n;
+}
+
+/* Move everything queued in the rings to the write buffer */
+static uword
+pcap_capture_drain (pcap_capture_main_t * pcm, f64 now)
+{
+  pcap_capture_ring_t * r;
+  pcap_packet_header_t * h;
+  u32 head, tail, n_bytes;
+  uword n_packets = 0;
+
+  vec_foreach (r, pcm->rings)
+    {
+      head = r->head;
+      CLIB_MEMORY_BARRIER ();
+
+      for (tail = r->tail; tail != head; tail++)
+        {
+          h = (pcap_packet_header_t *)
+            (r->slots + (tail & (r->n_slots - 1)) * r->slot_bytes);
+          n_bytes = sizeof (h[0]) + h->n_packet_bytes_stored_in_file;
+
+          if (pcm->n_write_buffer_bytes + n_bytes > PCAP_CAPTURE_WRITE_BYTES)
+            pcap_capture_flush (pcm, now);
+
+          clib_memcpy (pcm->write_buffer + pcm->n_write_buffer_bytes,
+                       h, n_bytes);
+          pcm->n_write_buffer_bytes += n_bytes;
+          n_packets++;
+        }
+
+      /* Hand the slots back to the producer */
+      CLIB_MEMORY_BARRIER ();
+      r->tail = tail;
+    }
+
+  pcm->n_packets_written += n_packets;
+  return n_packets;
+}
+
+static void *
+pcap_capture_writer (void * arg)
+{
+  pcap_capture_main_t * pcm = arg;
+  u32 stop;
+  f64 now;
+
+  while (1)
+    {
+      /* Sample stop first so the last drain sees every packet */
+      stop = pcm->writer_stop;
+      CLIB_MEMORY_BARRIER ();
+
+      now = unix_time_now ();
+      if (pcap_capture_drain (pcm, now))
+        continue;
+
+      /* Idle: push out what we have, then check the clock */
+      pcap_capture_flush (pcm, now);
+      if (stop)
+        break;
+
+      pcap_capture_maybe_rotate (pcm, now, 0);
+      usleep (1000);
+    }
+
+  return 0;
+}
+
+/* Main thread control */
+
+static void
+pcap_capture_free_rings (pcap_capture_main_t * pcm)
+{
+  pcap_capture_ring_t * r;
+
+  vec_foreach (r, pcm->rings)
+    if (r->slots)
+      clib_mem_free (r->slots);
+  vec_free (pcm->rings);
+
+  if (pcm->write_buffer)
+    clib_mem_free (pcm->write_buffer);
+  pcm->write_buffer = 0;
+}
+
+static clib_error_t *
+pcap_capture_enable (vlib_main_t * vm, pcap_capture_main_t * pcm)
+{
+  vlib_thread_main_t * tm = vlib_get_thread_main ();
+  vnet_classify_main_t * vcm = &vnet_classify_main;
+  pcap_capture_ring_t * r;
+  u32 i, slot_bytes;
+  int rv;
+
+  if (pcm->config_classify_table_index != ~0
+      && pool_is_free_index (vcm->tables, pcm->config_classify_table_index))
+    return clib_error_return (0, "classify table %d does not exist",
+                              pcm->config_classify_table_index);
+
+  pcm->snaplen = pcm->config_snaplen;
+  pcm->sw_if_index = pcm->config_sw_if_index;
+  pcm->classify_table_index = pcm->config_classify_table_index;
+
+  slot_bytes = round_pow2 (sizeof (pcap_packet_header_t) + pcm->snaplen,
+                           CLIB_CACHE_LINE_BYTES);
+
+  vec_validate_aligned (pcm->rings, tm->n_vlib_mains - 1,
+                        CLIB_CACHE_LINE_BYTES);
+  for (i = 0; i < vec_len (pcm->rings); i++)
+    {
+      r = vec_elt_at_index (pcm->rings, i);
+      memset (r, 0, sizeof (r[0]));
+      r->n_slots = pcm->config_ring_slots;
+      r->slot_bytes = slot_bytes;
+      r->slots = clib_mem_alloc_aligned (r->n_slots * r->slot_bytes,
+                                         CLIB_CACHE_LINE_BYTES);
+    }
+
+  pcm->write_buffer = clib_mem_alloc_aligned (PCAP_CAPTURE_WRITE_BYTES,
+                                              clib_mem_get_page_size ());
+  pcm->n_write_buffer_bytes = 0;
+  pcm->n_packets_written = 0;
+  pcm->n_bytes_written = 0;
+  pcm->n_files = 0;
+  pcm->file_index = 0;
+  pcm->write_errno = 0;
+  pcm->writer_stop = 0;
+
+  /* Open the first file here, so a bad path is reported to the user */
+  if (pcap_capture_open_file (pcm, unix_time_now ()))
+    {
+      rv = pcm->write_errno;
+      pcap_capture_free_rings (pcm);
+      return clib_error_return (0, "failed to open `%s': %s",
+                                pcm->file_name, strerror (rv));
+    }
+
+  rv = pthread_create (&pcm->writer, NULL, pcap_capture_writer, pcm);
+  if (rv)
+    {
+      pcap_capture_close_file (pcm);
+      pcap_capture_free_rings (pcm);
+      return clib_error_return (0, "failed to start writer thread: %s",
+                                strerror (rv));
+    }
+
+  pcm->time_offset = unix_time_now () - vlib_time_now (vm);
+
+  vlib_worker_thread_barrier_sync (vm);
+  pcm->flags = pcm->config_flags;
+  vlib_worker_thread_barrier_release (vm);
+
+  return 0;
+}
+
+static void
+pcap_capture_disable (vlib_main_t * vm, pcap_capture_main_t * pcm)
+{
+  /* After the barrier no thread is inside pcap_capture_frame */
+  vlib_worker_thread_barrier_sync (vm);
+  pcm->flags = 0;
+  vlib_worker_thread_barrier_release (vm);
+
+  pcm->writer_stop = 1;
+  pthread_join (pcm->writer, 0);
+
+  pcap_capture_close_file (pcm);
+}
+
+static u8 *
+format_pcap_capture_flags (u8 * s, va_list * args)
+{
+  u32 flags = va_arg (*args, u32);
+
+  if ((flags & (PCAP_CAPTURE_F_RX | PCAP_CAPTURE_F_TX))
+      == (PCAP_CAPTURE_F_RX | PCAP_CAPTURE_F_TX))
+    return format (s, "rx tx");
+  if (flags & PCAP_CAPTURE_F_RX)
+    return format (s, "rx");
+  if (flags & PCAP_CAPTURE_F_TX)
+    return format (s, "tx");
+  return format (s, "none");
+}
+
+static u8 *
+format_pcap_capture_intfc (u8 * s, va_list * args)
+{
+  vnet_main_t * vnm = va_arg (*args, vnet_main_t *);
+  u32 sw_if_index = va_arg (*args, u32);
+
+  if (sw_if_index == ~0)
+    return format (s, "any interface");
+  return format (s, "%U", format_vnet_sw_interface_name, vnm,
+                 vnet_get_sw_interface (vnm, sw_if_index));
+}
+
+static void
+pcap_capture_show (vlib_main_t * vm, pcap_capture_main_t * pcm)
+{
+  vnet_main_t * vnm = vnet_get_main ();
+  pcap_capture_ring_t * r;
+  u64 n_captured = 0, n_dropped = 0;
+
+  vlib_cli_output (vm, "pcap capture is %s, %U on %U",
+                   pcm->flags ? "on" : "off",
+                   format_pcap_capture_flags, pcm->config_flags,
+                   format_pcap_capture_intfc, vnm,
+                   pcm->config_sw_if_index);
+  vlib_cli_output (vm, "  file %s snaplen %d ring %d slots",
+                   pcm->file_name, pcm->config_snaplen,
+                   pcm->config_ring_slots);
+  if (pcm->config_classify_table_index != ~0)
+    vlib_cli_output (vm, "  classify table %d%s",
+                     pcm->config_classify_table_index,
+                     pool_is_free_index (vnet_classify_main.tables,
+                                         pcm->config_classify_table_index)
+                     ? " (deleted, nothing matches)" : "");
+  if (pcap_capture_rotates (pcm))
+    vlib_cli_output (vm, "  rotate at %lld bytes / %.0f sec, keep %d files",
+                     pcm->max_file_bytes, pcm->rotate_interval,
+                     pcm->max_files);
+
+  if (vec_len (pcm->rings) == 0)
+    return;
+
+  vec_foreach (r, pcm->rings)
+    {
+      vlib_cli_output (vm, "  thread %d: captured %lld dropped %lld",
+                       r - pcm->rings, r->n_captured, r->n_dropped);
+      n_captured += r->n_captured;
+      n_dropped += r->n_dropped;
+    }
+  vlib_cli_output (vm, "  total: captured %lld dropped %lld, "
+                   "written %lld pkts %lld bytes in %d files",
+                   n_captured, n_dropped, pcm->n_packets_written,
+                   pcm->n_bytes_written, pcm->n_files);
+  if (pcm->write_errno)
+    vlib_cli_output (vm, "  last write error: %s",
+                     strerror (pcm->write_errno));
+}
+
+static clib_error_t *
+pcap_capture_command_fn (vlib_main_t * vm,
+                         unformat_input_t * input,
+                         vlib_cli_command_t * cmd)
+{
+  pcap_capture_main_t * pcm = &pcap_capture_main;
+  vnet_main_t * vnm = vnet_get_main ();
+  u32 flags = 0, on = 0, off = 0, status = 0;
+  u32 snaplen = pcm->config_snaplen;
+  u32 ring_slots = pcm->config_ring_slots;
+  u32 sw_if_index = pcm->config_sw_if_index;
+  u32 table_index = pcm->config_classify_table_index;
+  u32 max_files = pcm->max_files;
+  u64 max_file_mb = pcm->max_file_bytes >> 20;
+  f64 rotate_interval = pcm->rotate_interval;
+  u8 * filename = 0, * chroot_filename = 0;
+  int config_changed = 0;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "on"))
+        on = 1;
+      else if (unformat (input, "off"))
+        off = 1;
+      else if (unformat (input, "status"))
+        status = 1;
+      else if (unformat (input, "rx"))
+        flags |= PCAP_CAPTURE_F_RX;
+      else if (unformat (input, "tx"))
+        flags |= PCAP_CAPTURE_F_TX;
+      else if (unformat (input, "intfc any"))
+        sw_if_index = ~0;
+      else if (unformat (input, "intfc %U",
+                         unformat_vnet_sw_interface, vnm, &sw_if_index))
+        ;
+      else if (unformat (input, "snaplen %d", &snaplen))
+        ;
+      else if (unformat (input, "classify-table none"))
+        table_index = ~0;
+      else if (unformat (input, "classify-table %d", &table_index))
+        ;
+      else if (unformat (input, "ring-size %d", &ring_slots))
+        ;
+      else if (unformat (input, "max-file-size %lld", &max_file_mb))
+        ;
+      else if (unformat (input, "rotate-interval %f", &rotate_interval))
+        ;
+      else if (unformat (input, "max-files %d", &max_files))
+        ;
+      else if (unformat (input, "file %s", &filename))
+        {
+          /* Brain-police user path input */
+          if (strstr ((char *) filename, "..")
+              || index ((char *) filename, '/'))
+            {
+              vec_free (filename);
+              return clib_error_return (0, "illegal characters in filename");
+            }
+          vec_free (chroot_filename);
+          chroot_filename = format (0, "/tmp/%s%c", filename, 0);
+          vec_free (filename);
+        }
+      else
+        return clib_error_return (0, "unknown input `%U'",
+                                  format_unformat_error, input);
+    }
+
+  config_changed = flags || chroot_filename
+    || snaplen != pcm->config_snaplen
+    || ring_slots != pcm->config_ring_slots
+    || sw_if_index != pcm->config_sw_if_index
+    || table_index != pcm->config_classify_table_index
+    || max_files != pcm->max_files
+    || (max_file_mb << 20) != pcm->max_file_bytes
+    || rotate_interval != pcm->rotate_interval;
+
+  if (config_changed && pcm->flags)
+    {
+      vec_free (chroot_filename);
+      return clib_error_return (0, "pcap capture is on, turn it off first");
+    }
+
+  /* Device input nodes only know the hardware interface */
+  if (((flags ? flags : pcm->config_flags) & PCAP_CAPTURE_F_RX)
+      && sw_if_index != ~0
+      && vnet_get_sw_interface (vnm, sw_if_index)->sup_sw_if_index
+         != sw_if_index)
+    {
+      vec_free (chroot_filename);
+      return clib_error_return (0, "rx capture only sees hardware "
+                                "interfaces, use tx alone for "
+                                "sub-interface %U",
+                                format_vnet_sw_if_index_name, vnm,
+                                sw_if_index);
+    }
+
+  if (snaplen == 0 || snaplen > PCAP_CAPTURE_MAX_SNAPLEN)
+    return clib_error_return (0, "snaplen %d out of range (1-%d)",
+                              snaplen, PCAP_CAPTURE_MAX_SNAPLEN);
+
+  if (ring_slots < 2 || !is_pow2 (ring_slots))
+    return clib_error_return (0, "ring-size %d must be a power of 2",
+                              ring_slots);
+
+  if (flags)
+    pcm->config_flags = flags;
+  if (chroot_filename)
+    {
+      vec_free (pcm->file_name);
+      pcm->file_name = chroot_filename;
+    }
+  pcm->config_snaplen = snaplen;
+  pcm->config_ring_slots = ring_slots;
+  pcm->config_sw_if_index = sw_if_index;
+  pcm->config_classify_table_index = table_index;
+  pcm->max_files = max_files;
+  pcm->max_file_bytes = max_file_mb << 20;
+  pcm->rotate_interval = rotate_interval;
+
+  if (on)
+    {
+      clib_error_t * error;
+
+      if (pcm->flags)
+        return clib_error_return (0, "pcap capture already on");
+
+      error = pcap_capture_enable (vm, pcm);
+      if (error)
+        return error;
+      vlib_cli_output (vm, "pcap capture on...");
+    }
+  else if (off)
+    {
+      if (pcm->flags == 0)
+        return clib_error_return (0, "pcap capture already off");
+
+      pcap_capture_disable (vm, pcm);
+      pcap_capture_show (vm, pcm);
+      pcap_capture_free_rings (pcm);
+    }
+  else if (status || !config_changed)
+    pcap_capture_show (vm, pcm);
+
+  return 0;
+}
+
+VLIB_CLI_COMMAND (pcap_capture_command, static) = {
+  .path = "pcap capture",
+  .short_help =
+  "pcap capture on | off | status [rx] [tx] [intfc <interface> | any]\n"
+  "    [snaplen <bytes>] [classify-table <index> | none] [file <name>]\n"
+  "    [ring-size <slots>] [max-file-size <MB>] [rotate-interval <sec>]\n"
+  "    [max-files <n>]",
+  .function = pcap_capture_command_fn,
+};
+
+static clib_error_t *
+pcap_capture_init (vlib_main_t * vm)
+{
+  pcap_capture_main_t * pcm = &pcap_capture_main;
+
+  pcm->config_flags = PCAP_CAPTURE_F_RX | PCAP_CAPTURE_F_TX;
+  pcm->config_sw_if_index = ~0;
+  pcm->config_classify_table_index = ~0;
+  pcm->config_snaplen = PCAP_CAPTURE_DEFAULT_SNAPLEN;
+  pcm->config_ring_slots = PCAP_CAPTURE_DEFAULT_RING_SLOTS;
+  pcm->file_name = format (0, "/tmp/capture.pcap%c", 0);
+  pcm->fd = -1;
+
+  return 0;
+}
+
+VLIB_INIT_FUNCTION (pcap_capture_init);
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2016 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef included_vnet_pcap_capture_h
+#define included_vnet_pcap_capture_h
+
+#include <pthread.h>
+#include <vnet/vnet.h>
+#include <vnet/unix/pcap.h>
+
+/*
+ * Asynchronous pcap capture.
+ *
+ * Each vlib thread copies matching rx / tx packets, up to snaplen
+ * bytes, into its own single-producer single-consumer ring of fixed
+ * size slots. A slot is a pcap packet header followed by the data,
+ * i.e. exactly the record that goes into the file. When the ring is
+ * full the packet is counted as dropped; forwarding never waits.
+ *
+ * A dedicated writer pthread drains the rings into a large staging
+ * buffer and writes it out in one go, rotating files by size and / or
+ * age. The writer is not a vlib thread: it must not touch the clib
+ * heap, vectors or format, only the memory set up for it.
+ */
+
+#define PCAP_CAPTURE_DEFAULT_SNAPLEN	256
+#define PCAP_CAPTURE_MAX_SNAPLEN	9216
+#define PCAP_CAPTURE_DEFAULT_RING_SLOTS	4096
+#define PCAP_CAPTURE_WRITE_BYTES	(1 << 20)
+
+typedef struct {
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+
+  /* Producer: the vlib thread owning the ring */
+  volatile u32 head;
+  u32 n_slots;
+  u32 slot_bytes;
+  u8 * slots;
+  u64 n_captured;
+  u64 n_dropped;
+
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline1);
+
+  /* Consumer: the writer thread */
+  volatile u32 tail;
+} pcap_capture_ring_t;
+
+typedef struct {
+  /* Set while capture is running, checked by the graph nodes */
+  volatile u32 flags;
+#define PCAP_CAPTURE_F_RX (1 << 0)
+#define PCAP_CAPTURE_F_TX (1 << 1)
+
+  /* Capture filters, ~0 for none */
+  u32 sw_if_index;
+  u32 classify_table_index;
+
+  u32 snaplen;
+
+  /* Per thread rings, indexed by cpu_index */
+  pcap_capture_ring_t * rings;
+
+  /* Adds to vlib_time_now to get unix time */
+  f64 time_offset;
+
+  /* Configuration, kept across on / off */
+  u32 config_flags;
+  u32 config_sw_if_index;
+  u32 config_classify_table_index;
+  u32 config_snaplen;
+  u32 config_ring_slots;
+  u8 * file_name;
+  u64 max_file_bytes;
+  f64 rotate_interval;
+  u32 max_files;
+
+  /* Writer thread state */
+  pthread_t writer;
+  volatile u32 writer_stop;
+  int fd;
+  u32 file_index;
+  u64 file_bytes;
+  f64 file_open_time;
+  u8 * write_buffer;
+  u32 n_write_buffer_bytes;
+
+  /* Writer statistics */
+  u64 n_packets_written;
+  u64 n_bytes_written;
+  u32 n_files;
+  int write_errno;
+} pcap_capture_main_t;
+
+extern pcap_capture_main_t pcap_capture_main;
+
+int pcap_capture_classify (vlib_main_t * vm, pcap_capture_main_t * pcm,
+                           vlib_buffer_t * b);
+
+static_always_inline void
+pcap_capture_buffer (vlib_main_t * vm, pcap_capture_main_t * pcm,
+                     pcap_capture_ring_t * r, vlib_buffer_t * b, f64 now)
+{
+  pcap_packet_header_t * h;
+  u32 head = r->head;
+  u32 n_bytes, n_left, n_copy;
+  u8 * d;
+
+  if (PREDICT_FALSE (head - r->tail >= r->n_slots))
+    {
+      r->n_dropped++;
+      return;
+    }
+
+  h = (pcap_packet_header_t *)
+    (r->slots + (head & (r->n_slots - 1)) * r->slot_bytes);
+
+  n_bytes = vlib_buffer_length_in_chain (vm, b);
+  n_left = clib_min (n_bytes, pcm->snaplen);
+
+  h->time_in_sec = now;
+  h->time_in_usec = 1e6 * (now - h->time_in_sec);
+  h->n_packet_bytes_stored_in_file = n_left;
+  h->n_bytes_in_packet = n_bytes;
+
+  d = h->data;
+  while (1)
+    {
+      n_copy = clib_min (n_left, b->current_length);
+      clib_memcpy (d, vlib_buffer_get_current (b), n_copy);
+      d += n_copy;
+      n_left -= n_copy;
+      if (n_left == 0 || !(b->flags & VLIB_BUFFER_NEXT_PRESENT))
+        break;
+      b = vlib_get_buffer (vm, b->next_buffer);
+    }
+
+  /* Publish the slot only once its contents are in place */
+  CLIB_MEMORY_BARRIER ();
+  r->head = head + 1;
+  r->n_captured++;
+}
+
+/*
+ * Capture a frame of packets. sw_if_index is the interface for tx;
+ * if it is ~0 each buffer's rx interface is used instead.
+ * Callers check pcap_capture_main.flags first.
+ */
+always_inline void
+pcap_capture_frame (vlib_main_t * vm, u32 * buffers, u32 n_buffers,
+                    u32 sw_if_index)
+{
+  pcap_capture_main_t * pcm = &pcap_capture_main;
+  pcap_capture_ring_t * r;
+  vlib_buffer_t * b;
+  u32 sw_if_index0;
+  f64 now;
+
+  r = vec_elt_at_index (pcm->rings, vm->cpu_index);
+  now = vlib_time_now (vm) + pcm->time_offset;
+
+  while (n_buffers > 0)
+    {
+      b = vlib_get_buffer (vm, buffers[0]);
+      buffers++;
+      n_buffers--;
+
+      sw_if_index0 = sw_if_index != ~0
+        ? sw_if_index : vnet_buffer (b)->sw_if_index[VLIB_RX];
+
+      if (pcm->sw_if_index != ~0 && sw_if_index0 != pcm->sw_if_index)
+        continue;
+
+      if (pcm->classify_table_index != ~0
+          && !pcap_capture_classify (vm, pcm, b))
+        continue;
+
+      pcap_capture_buffer (vm, pcm, r, b, now);
+    }
+}
+
+/*
+ * Capture a packet as a device input node hands it to the graph.
+ * l2_hdr_bytes is how far the buffer has already been advanced past
+ * the ethernet header, e.g. when dpdk-input sends ip4 straight to
+ * ip4-input. The rx interface is always the hardware interface, so
+ * the CLI refuses an rx filter on a sub-interface. Callers check
+ * pcap_capture_main.flags first.
+ */
+always_inline void
+pcap_capture_rx_buffer (vlib_main_t * vm, vlib_buffer_t * b, u32 l2_hdr_bytes)
+{
+  pcap_capture_main_t * pcm = &pcap_capture_main;
+  pcap_capture_ring_t * r;
+
+  if (pcm->sw_if_index != ~0
+      && vnet_buffer (b)->sw_if_index[VLIB_RX] != pcm->sw_if_index)
+    return;
+
+  vlib_buffer_advance (b, -(word) l2_hdr_bytes);
+
+  if (pcm->classify_table_index == ~0 || pcap_capture_classify (vm, pcm, b))
+    {
+      r = vec_elt_at_index (pcm->rings, vm->cpu_index);
+      pcap_capture_buffer (vm, pcm, r, b,
+                           vlib_time_now (vm) + pcm->time_offset);
+    }
+
+  vlib_buffer_advance (b, l2_hdr_bytes);
+}
+
+#endif /* included_vnet_pcap_capture_h */
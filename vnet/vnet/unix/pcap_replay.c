@@ -0,0 +1,749 @@
+/*
+ * Copyright (c) 2016 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * pcap_replay.c: replay a pcap file into the graph
+ *
+ * The file is mmap'ed and every packet copied once into a template
+ * area on the heap; templates are kept out of vlib buffers, which with
+ * dpdk would eat into the NIC rx mbuf pool. The packets are then
+ * spread over the worker threads by flow hash, so a flow always lands
+ * on the same worker and keeps its order, and each worker's
+ * pcap-replay-input node injects them into ethernet-input as if
+ * received on the chosen interface. Replay runs at full speed, at a
+ * given aggregate rate, or with the inter-packet gaps recorded in the
+ * file, for a number of loops or forever.
+ *
+ * Transmit consumes the buffers, so each replayed packet is a copy of
+ * its template; nothing is parsed or rebuilt on the fast path.
+ */
+
+#include <sys/fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <vlib/vlib.h>
+#include <vlib/threads.h>
+#include <vnet/vnet.h>
+#include <vnet/ethernet/ethernet.h>
+#include <vnet/ip/ip.h>
+#include <vnet/unix/pcap.h>
+
+/* Heap space for packet templates, at most */
+#define PCAP_REPLAY_MAX_DATA_BYTES (256 << 20)
+
+typedef struct {
+  /* Packet data, in pcap_replay_main.data */
+  u32 data_offset;
+  u32 n_bytes;
+
+  /* Seconds since the first packet in the file */
+  f64 time_offset;
+} pcap_replay_packet_t;
+
+typedef struct {
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+
+  /* This thread's share of the packets, in file order */
+  u32 * packets;
+  u32 next_packet;
+
+  u32 started;
+  u32 done;
+  u32 n_loops_done;
+
+  /* Timed replay: when the current loop started */
+  f64 loop_start_time;
+
+  /* Rate limited replay: packet credit and when it was last topped up */
+  f64 credit;
+  f64 last_time;
+
+  u64 n_packets;
+  u64 n_bytes;
+} pcap_replay_thread_t;
+
+typedef struct {
+  pcap_replay_packet_t * packets;
+
+  /* Packet templates, each starting on a cache line */
+  u8 * data;
+
+  /* Per thread state, indexed by cpu_index */
+  pcap_replay_thread_t * threads;
+
+  /* cpu_index of the threads doing the replay */
+  u32 * replay_threads;
+
+  u8 * file_name;
+  u32 sw_if_index;
+
+  /* Aggregate packets per second, 0 for as fast as possible */
+  f64 rate;
+  u32 timed;
+
+  /* Times to replay the file, 0 for forever */
+  u32 n_loops;
+
+  u32 is_running;
+  f64 start_time;
+
+  /* Replay threads done with all their loops, the last one to finish
+     clears is_running */
+  volatile u32 n_threads_done;
+
+  u32 n_skipped;
+} pcap_replay_main_t;
+
+pcap_replay_main_t pcap_replay_main;
+
+static vlib_node_registration_t pcap_replay_input_node;
+
+#define foreach_pcap_replay_input_error				\
+_(NO_BUFFERS, "pcap replay buffer allocation failures")
+
+typedef enum {
+#define _(f,s) PCAP_REPLAY_INPUT_ERROR_##f,
+  foreach_pcap_replay_input_error
+#undef _
+  PCAP_REPLAY_INPUT_N_ERROR,
+} pcap_replay_input_error_t;
+
+static char * pcap_replay_input_error_strings[] = {
+#define _(n,s) s,
+  foreach_pcap_replay_input_error
+#undef _
+};
+
+typedef enum {
+  PCAP_REPLAY_INPUT_NEXT_ETHERNET_INPUT,
+  PCAP_REPLAY_INPUT_N_NEXT,
+} pcap_replay_input_next_t;
+
+typedef struct {
+  u32 packet_index;
+  u32 n_bytes;
+  u32 sw_if_index;
+} pcap_replay_input_trace_t;
+
+static u8 * format_pcap_replay_input_trace (u8 * s, va_list * args)
+{
+  CLIB_UNUSED (vlib_main_t * vm) = va_arg (*args, vlib_main_t *);
+  CLIB_UNUSED (vlib_node_t * node) = va_arg (*args, vlib_node_t *);
+  pcap_replay_input_trace_t * t = va_arg (*args, pcap_replay_input_trace_t *);
+
+  s = format (s, "pcap-replay: packet %d, %d bytes, sw_if_index %d",
+              t->packet_index, t->n_bytes, t->sw_if_index);
+  return s;
+}
+
+/* Number of packets this thread may send now */
+always_inline u32
+pcap_replay_n_due (pcap_replay_main_t * prm, pcap_replay_thread_t * t,
+                   f64 now)
+{
+  u32 n = clib_min (VLIB_FRAME_SIZE, vec_len (t->packets) - t->next_packet);
+  u32 i;
+
+  if (prm->rate != 0)
+    {
+      t->credit += (now - t->last_time)
+        * prm->rate / vec_len (prm->replay_threads);
+      t->last_time = now;
+      /* Don't bank credit across idle periods */
+      if (t->credit > VLIB_FRAME_SIZE)
+        t->credit = VLIB_FRAME_SIZE;
+      n = clib_min (n, (u32) t->credit);
+    }
+
+  if (prm->timed)
+    {
+      for (i = 0; i < n; i++)
+        {
+          pcap_replay_packet_t * p =
+            vec_elt_at_index (prm->packets, t->packets[t->next_packet + i]);
+          if (t->loop_start_time + p->time_offset > now)
+            break;
+        }
+      n = i;
+    }
+
+  return n;
+}
+
+static uword
+pcap_replay_input_fn (vlib_main_t * vm,
+                      vlib_node_runtime_t * node,
+                      vlib_frame_t * frame)
+{
+  pcap_replay_main_t * prm = &pcap_replay_main;
+  u32 cpu_index = os_get_cpu_number ();
+  pcap_replay_thread_t * t;
+  u32 next_index = PCAP_REPLAY_INPUT_NEXT_ETHERNET_INPUT;
+  u32 buffers[VLIB_FRAME_SIZE];
+  u32 n_this, n_alloc, n_left_to_next, * to_next;
+  u32 n_trace = vlib_get_trace_count (vm, node);
+  u32 i, n_bytes = 0;
+  f64 now;
+
+  if (cpu_index >= vec_len (prm->threads))
+    return 0;
+
+  t = vec_elt_at_index (prm->threads, cpu_index);
+  if (t->done || vec_len (t->packets) == 0)
+    return 0;
+
+  now = vlib_time_now (vm);
+  if (PREDICT_FALSE (! t->started))
+    {
+      t->started = 1;
+      t->loop_start_time = now;
+      t->last_time = now;
+    }
+
+  n_this = pcap_replay_n_due (prm, t, now);
+  if (n_this == 0)
+    return 0;
+
+  n_alloc = vlib_buffer_alloc (vm, buffers, n_this);
+  if (PREDICT_FALSE (n_alloc < n_this))
+    {
+      vlib_error_count (vm, node->node_index,
+                        PCAP_REPLAY_INPUT_ERROR_NO_BUFFERS, n_this - n_alloc);
+      n_this = n_alloc;
+      if (n_this == 0)
+        return 0;
+    }
+
+  vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
+  ASSERT (n_left_to_next >= n_this);
+
+  for (i = 0; i < n_this; i++)
+    {
+      u32 packet_index = t->packets[t->next_packet + i];
+      pcap_replay_packet_t * p = vec_elt_at_index (prm->packets, packet_index);
+      vlib_buffer_t * b0 = vlib_get_buffer (vm, buffers[i]);
+
+      if (i + 1 < n_this)
+        {
+          pcap_replay_packet_t * p1 =
+            vec_elt_at_index (prm->packets, t->packets[t->next_packet + i + 1]);
+          CLIB_PREFETCH (prm->data + p1->data_offset, CLIB_CACHE_LINE_BYTES,
+                         LOAD);
+        }
+
+      b0->current_data = 0;
+      b0->current_length = p->n_bytes;
+      clib_memcpy (vlib_buffer_get_current (b0), prm->data + p->data_offset,
+                   p->n_bytes);
+
+      b0->clone_count = 0;
+      b0->total_length_not_including_first_buffer = 0;
+      b0->flags = VLIB_BUFFER_TOTAL_LENGTH_VALID;
+      vnet_buffer(b0)->sw_if_index[VLIB_RX] = prm->sw_if_index;
+      vnet_buffer(b0)->sw_if_index[VLIB_TX] = (u32)~0;
+#if DPDK > 0
+      {
+        struct rte_mbuf * mb = rte_mbuf_from_vlib_buffer(b0);
+        rte_pktmbuf_data_len (mb) = b0->current_length;
+        rte_pktmbuf_pkt_len (mb) = b0->current_length;
+      }
+#endif
+      VLIB_BUFFER_TRACE_TRAJECTORY_INIT(b0);
+
+      if (PREDICT_FALSE (n_trace > 0))
+        {
+          pcap_replay_input_trace_t * tr;
+          vlib_trace_buffer (vm, node, next_index, b0, /* follow_chain */ 0);
+          vlib_set_trace_count (vm, node, --n_trace);
+          tr = vlib_add_trace (vm, node, b0, sizeof (*tr));
+          tr->packet_index = packet_index;
+          tr->n_bytes = b0->current_length;
+          tr->sw_if_index = prm->sw_if_index;
+        }
+
+      n_bytes += b0->current_length;
+      to_next[i] = buffers[i];
+    }
+
+  vlib_put_next_frame (vm, node, next_index, n_left_to_next - n_this);
+
+  vlib_increment_combined_counter
+    (vnet_get_main()->interface_main.combined_sw_if_counters
+     + VNET_INTERFACE_COUNTER_RX,
+     cpu_index, prm->sw_if_index, n_this, n_bytes);
+
+  t->n_packets += n_this;
+  t->n_bytes += n_bytes;
+  t->next_packet += n_this;
+  if (prm->rate != 0)
+    t->credit -= n_this;
+
+  if (t->next_packet == vec_len (t->packets))
+    {
+      t->next_packet = 0;
+      t->n_loops_done++;
+      t->loop_start_time = now;
+      if (prm->n_loops && t->n_loops_done >= prm->n_loops)
+        {
+          t->done = 1;
+          vlib_node_set_state (vm, node->node_index,
+                               VLIB_NODE_STATE_DISABLED);
+          if (__sync_add_and_fetch (&prm->n_threads_done, 1)
+              == vec_len (prm->replay_threads))
+            prm->is_running = 0;
+        }
+    }
+
+  return n_this;
+}
+
+VLIB_REGISTER_NODE (pcap_replay_input_node, static) = {
+  .function = pcap_replay_input_fn,
+  .name = "pcap-replay-input",
+  .format_trace = format_pcap_replay_input_trace,
+  .type = VLIB_NODE_TYPE_INPUT,
+  .state = VLIB_NODE_STATE_DISABLED,
+  .n_errors = PCAP_REPLAY_INPUT_N_ERROR,
+  .error_strings = pcap_replay_input_error_strings,
+
+  .n_next_nodes = PCAP_REPLAY_INPUT_N_NEXT,
+  .next_nodes = {
+    [PCAP_REPLAY_INPUT_NEXT_ETHERNET_INPUT] = "ethernet-input",
+  },
+};
+
+/* Hash the addresses and ports, so each flow stays on one worker */
+static u32
+pcap_replay_flow_hash (u8 * data, u32 n_bytes)
+{
+  ethernet_header_t * e = (ethernet_header_t *) data;
+  u8 * l3 = data + sizeof (e[0]);
+  u8 * end = data + n_bytes;
+  u64 a, b, c;
+  u16 type;
+
+  if (n_bytes < sizeof (e[0]))
+    return 0;
+
+  type = clib_net_to_host_u16 (e->type);
+  if (type == ETHERNET_TYPE_VLAN && l3 + 4 <= end)
+    {
+      type = clib_net_to_host_u16 (*(u16 *) (l3 + 2));
+      l3 += 4;
+    }
+
+  a = b = c = 0;
+  if (type == ETHERNET_TYPE_IP4 && l3 + sizeof (ip4_header_t) <= end)
+    {
+      ip4_header_t * ip = (ip4_header_t *) l3;
+      u8 * l4 = l3 + ip4_header_bytes (ip);
+
+      a = ip->src_address.as_u32;
+      b = ip->dst_address.as_u32;
+      c = ip->protocol;
+      if ((ip->protocol == IP_PROTOCOL_TCP || ip->protocol == IP_PROTOCOL_UDP)
+          && l4 + 4 <= end)
+        c |= (u64) *(u32 *) l4 << 8;
+    }
+  else if (type == ETHERNET_TYPE_IP6 && l3 + sizeof (ip6_header_t) <= end)
+    {
+      ip6_header_t * ip = (ip6_header_t *) l3;
+      u8 * l4 = l3 + sizeof (ip[0]);
+
+      a = ip->src_address.as_u64[0] ^ ip->src_address.as_u64[1];
+      b = ip->dst_address.as_u64[0] ^ ip->dst_address.as_u64[1];
+      c = ip->protocol;
+      if ((ip->protocol == IP_PROTOCOL_TCP || ip->protocol == IP_PROTOCOL_UDP)
+          && l4 + 4 <= end)
+        c |= (u64) *(u32 *) l4 << 8;
+    }
+  else
+    {
+      clib_memcpy (&a, e->src_address, sizeof (e->src_address));
+      clib_memcpy (&b, e->dst_address, sizeof (e->dst_address));
+      c = type;
+    }
+
+  hash_mix64 (a, b, c);
+  return c;
+}
+
+static void
+pcap_replay_unload (vlib_main_t * vm, pcap_replay_main_t * prm)
+{
+  pcap_replay_thread_t * t;
+
+  vec_free (prm->packets);
+  vec_free (prm->data);
+
+  vec_foreach (t, prm->threads)
+    vec_free (t->packets);
+  vec_free (prm->threads);
+  vec_free (prm->replay_threads);
+  vec_free (prm->file_name);
+  prm->n_skipped = 0;
+}
+
+static clib_error_t *
+pcap_replay_load (vlib_main_t * vm, pcap_replay_main_t * prm, char * file_name)
+{
+  vlib_thread_main_t * tm = vlib_get_thread_main ();
+  clib_error_t * error = 0;
+  pcap_file_header_t * fh;
+  pcap_replay_packet_t * p;
+  u8 * base = MAP_FAILED;
+  u32 swap, nsec, sec, frac, n_stored, i, n_threads;
+  f64 first_time = 0, time;
+  uword offset, data_offset;
+  struct stat st;
+  int fd;
+
+  fd = open (file_name, O_RDONLY);
+  if (fd < 0)
+    return clib_error_return_unix (0, "open `%s'", file_name);
+
+  if (fstat (fd, &st) < 0)
+    {
+      error = clib_error_return_unix (0, "stat `%s'", file_name);
+      goto done;
+    }
+
+  if (st.st_size < sizeof (fh[0]))
+    {
+      error = clib_error_return (0, "`%s' is not a pcap file", file_name);
+      goto done;
+    }
+
+  base = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (base == MAP_FAILED)
+    {
+      error = clib_error_return_unix (0, "mmap `%s'", file_name);
+      goto done;
+    }
+
+  fh = (pcap_file_header_t *) base;
+  switch (fh->magic)
+    {
+    case 0xa1b2c3d4: swap = 0; nsec = 0; break;
+    case 0xa1b23c4d: swap = 0; nsec = 1; break;
+    case 0xd4c3b2a1: swap = 1; nsec = 0; break;
+    case 0x4d3cb2a1: swap = 1; nsec = 1; break;
+    default:
+      error = clib_error_return (0, "`%s' is not a pcap file", file_name);
+      goto done;
+    }
+
+#define _(x) (swap ? clib_byte_swap_u32 (x) : (x))
+
+  if (_(fh->packet_type) != PCAP_PACKET_TYPE_ethernet)
+    {
+      error = clib_error_return (0, "`%s': packet type %d, only ethernet "
+                                 "captures can be replayed",
+                                 file_name, _(fh->packet_type));
+      goto done;
+    }
+
+  for (offset = sizeof (fh[0]);
+       offset + sizeof (pcap_packet_header_t) <= st.st_size;
+       offset += sizeof (pcap_packet_header_t) + n_stored)
+    {
+      pcap_packet_header_t * ph = (pcap_packet_header_t *) (base + offset);
+
+      n_stored = _(ph->n_packet_bytes_stored_in_file);
+      if (offset + sizeof (ph[0]) + n_stored > st.st_size)
+        break;
+
+      sec = _(ph->time_in_sec);
+      frac = _(ph->time_in_usec);
+      time = sec + frac * (nsec ? 1e-9 : 1e-6);
+
+      /* Replayed packets are single buffers */
+      if (n_stored == 0 || n_stored > VLIB_BUFFER_DEFAULT_FREE_LIST_BYTES)
+        {
+          prm->n_skipped++;
+          continue;
+        }
+
+      data_offset = round_pow2 (vec_len (prm->data), CLIB_CACHE_LINE_BYTES);
+      if (data_offset + n_stored > PCAP_REPLAY_MAX_DATA_BYTES)
+        {
+          error = clib_error_return (0, "`%s': too large, more than %d MB "
+                                     "of packets", file_name,
+                                     PCAP_REPLAY_MAX_DATA_BYTES >> 20);
+          goto done;
+        }
+
+      vec_validate_aligned (prm->data, data_offset + n_stored - 1,
+                            CLIB_CACHE_LINE_BYTES);
+      clib_memcpy (prm->data + data_offset, ph->data, n_stored);
+
+      if (vec_len (prm->packets) == 0)
+        first_time = time;
+
+      vec_add2 (prm->packets, p, 1);
+      p->data_offset = data_offset;
+      p->n_bytes = n_stored;
+      p->time_offset = clib_max (time - first_time, 0);
+    }
+
+#undef _
+
+  if (vec_len (prm->packets) == 0)
+    {
+      error = clib_error_return (0, "`%s': no packets to replay", file_name);
+      goto done;
+    }
+
+  /* Replay on the workers, or on the main thread if there are none */
+  if (tm->n_vlib_mains == 1)
+    vec_add1 (prm->replay_threads, 0);
+  else
+    for (i = 1; i < tm->n_vlib_mains; i++)
+      vec_add1 (prm->replay_threads, i);
+
+  vec_validate_aligned (prm->threads, tm->n_vlib_mains - 1,
+                        CLIB_CACHE_LINE_BYTES);
+
+  n_threads = vec_len (prm->replay_threads);
+  vec_foreach (p, prm->packets)
+    {
+      u32 h = pcap_replay_flow_hash (prm->data + p->data_offset, p->n_bytes);
+      u32 cpu_index = prm->replay_threads[h % n_threads];
+
+      vec_add1 (prm->threads[cpu_index].packets, p - prm->packets);
+    }
+
+  prm->file_name = format (0, "%s%c", file_name, 0);
+
+ done:
+  if (base != MAP_FAILED)
+    munmap (base, st.st_size);
+  close (fd);
+  if (error)
+    pcap_replay_unload (vm, prm);
+  return error;
+}
+
+static void
+pcap_replay_set_running (vlib_main_t * vm, pcap_replay_main_t * prm,
+                         u32 is_running)
+{
+  pcap_replay_thread_t * t;
+  u32 * cpu_index;
+
+  vlib_worker_thread_barrier_sync (vm);
+
+  vec_foreach (t, prm->threads)
+    {
+      t->next_packet = 0;
+      t->started = 0;
+      t->done = 0;
+      t->n_loops_done = 0;
+      t->credit = 0;
+      t->n_packets = 0;
+      t->n_bytes = 0;
+    }
+  prm->n_threads_done = 0;
+
+  vec_foreach (cpu_index, prm->replay_threads)
+    vlib_node_set_state (vlib_mains ? vlib_mains[cpu_index[0]] : vm,
+                         pcap_replay_input_node.index,
+                         is_running ? VLIB_NODE_STATE_POLLING
+                         : VLIB_NODE_STATE_DISABLED);
+
+  prm->is_running = is_running;
+  prm->start_time = vlib_time_now (vm);
+
+  vlib_worker_thread_barrier_release (vm);
+}
+
+static void
+pcap_replay_show (vlib_main_t * vm, pcap_replay_main_t * prm)
+{
+  pcap_replay_thread_t * t;
+  u64 n_packets = 0, n_bytes = 0;
+  u32 * cpu_index;
+  f64 dt;
+
+  if (prm->file_name == 0)
+    {
+      vlib_cli_output (vm, "pcap replay: no file loaded");
+      return;
+    }
+
+  vlib_cli_output (vm, "pcap replay %s: %d packets (%d skipped) into %U",
+                   prm->file_name, vec_len (prm->packets), prm->n_skipped,
+                   format_vnet_sw_interface_name, vnet_get_main (),
+                   vnet_get_sw_interface (vnet_get_main (), prm->sw_if_index));
+  vlib_cli_output (vm, "  %s, rate %s%.0f pps, loops %d",
+                   prm->is_running ? "running" : "stopped",
+                   prm->timed ? "timed, " : "", prm->rate, prm->n_loops);
+
+  vec_foreach (cpu_index, prm->replay_threads)
+    {
+      t = vec_elt_at_index (prm->threads, cpu_index[0]);
+      vlib_cli_output (vm, "  thread %d: %d packets, sent %lld pkts %lld "
+                       "bytes, %d loops%s",
+                       cpu_index[0], vec_len (t->packets), t->n_packets,
+                       t->n_bytes, t->n_loops_done, t->done ? ", done" : "");
+      n_packets += t->n_packets;
+      n_bytes += t->n_bytes;
+    }
+
+  dt = vlib_time_now (vm) - prm->start_time;
+  if (prm->is_running && dt > 0)
+    vlib_cli_output (vm, "  average %.2e pps %.2e bps",
+                     n_packets / dt, n_bytes * 8 / dt);
+}
+
+static clib_error_t *
+pcap_replay_command_fn (vlib_main_t * vm,
+                        unformat_input_t * input,
+                        vlib_cli_command_t * cmd)
+{
+  pcap_replay_main_t * prm = &pcap_replay_main;
+  vnet_main_t * vnm = vnet_get_main ();
+  clib_error_t * error = 0;
+  u8 * file_name = 0;
+  u32 sw_if_index = ~0;
+  u32 start = 0, stop = 0, delete = 0, status = 0;
+  u32 timed = 0, n_loops = 1;
+  u32 rate_set = 0, timed_set = 0, loops_set = 0;
+  f64 rate = 0;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "file %s", &file_name))
+        ;
+      else if (unformat (input, "intfc %U",
+                         unformat_vnet_sw_interface, vnm, &sw_if_index))
+        ;
+      else if (unformat (input, "rate %f", &rate))
+        rate_set = 1;
+      else if (unformat (input, "timed off"))
+        {
+          timed = 0;
+          timed_set = 1;
+        }
+      else if (unformat (input, "timed"))
+        {
+          timed = 1;
+          timed_set = 1;
+        }
+      else if (unformat (input, "loop forever"))
+        {
+          n_loops = 0;
+          loops_set = 1;
+        }
+      else if (unformat (input, "loop %d", &n_loops))
+        loops_set = 1;
+      else if (unformat (input, "start"))
+        start = 1;
+      else if (unformat (input, "stop"))
+        stop = 1;
+      else if (unformat (input, "delete"))
+        delete = 1;
+      else if (unformat (input, "status"))
+        status = 1;
+      else
+        {
+          error = clib_error_return (0, "unknown input `%U'",
+                                     format_unformat_error, input);
+          goto done;
+        }
+    }
+
+  if (rate < 0)
+    {
+      error = clib_error_return (0, "rate %.0f must not be negative", rate);
+      goto done;
+    }
+
+  if ((stop || delete) && prm->is_running)
+    pcap_replay_set_running (vm, prm, 0);
+
+  if (delete)
+    pcap_replay_unload (vm, prm);
+
+  if (file_name)
+    {
+      if (sw_if_index == ~0)
+        {
+          error = clib_error_return (0, "specify the rx interface: "
+                                     "intfc <interface>");
+          goto done;
+        }
+
+      if (prm->is_running)
+        pcap_replay_set_running (vm, prm, 0);
+      pcap_replay_unload (vm, prm);
+
+      vec_add1 (file_name, 0);
+      error = pcap_replay_load (vm, prm, (char *) file_name);
+      if (error)
+        goto done;
+
+      prm->sw_if_index = sw_if_index;
+      prm->rate = rate;
+      prm->timed = timed;
+      prm->n_loops = n_loops;
+    }
+  else if (sw_if_index != ~0 || rate_set || timed_set || loops_set)
+    {
+      /* Change the settings of the loaded file, running or not */
+      if (prm->file_name == 0)
+        {
+          error = clib_error_return (0, "no pcap file loaded");
+          goto done;
+        }
+
+      vlib_worker_thread_barrier_sync (vm);
+      if (sw_if_index != ~0)
+        prm->sw_if_index = sw_if_index;
+      if (rate_set)
+        prm->rate = rate;
+      if (timed_set)
+        prm->timed = timed;
+      if (loops_set)
+        prm->n_loops = n_loops;
+      vlib_worker_thread_barrier_release (vm);
+    }
+
+  if (start)
+    {
+      if (prm->file_name == 0)
+        {
+          error = clib_error_return (0, "no pcap file loaded");
+          goto done;
+        }
+      pcap_replay_set_running (vm, prm, 1);
+    }
+
+  if (status || stop || (!file_name && !start && !delete))
+    pcap_replay_show (vm, prm);
+
+ done:
+  vec_free (file_name);
+  return error;
+}
+
+VLIB_CLI_COMMAND (pcap_replay_command, static) = {
+  .path = "pcap replay",
+  .short_help =
+  "pcap replay [file <name> intfc <interface>] [rate <pps>]\n"
+  "    [timed | timed off] [loop <n> | loop forever]\n"
+  "    | start | stop | delete | status",
+  .function = pcap_replay_command_fn,
+};
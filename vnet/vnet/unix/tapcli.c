@@ -40,6 +40,7 @@
 #endif
 
 #include <vnet/unix/tapcli.h>
+#include <vnet/unix/pcap_capture.h>
 
 static vnet_device_class_t tapcli_dev_class;
 static vnet_hw_interface_class_t tapcli_interface_class;
@@ -313,6 +314,9 @@ static uword tapcli_rx_iface(vlib_main_t * vm,
     vnet_buffer (b_first)->sw_if_index[VLIB_RX] = ti->sw_if_index;
     vnet_buffer (b_first)->sw_if_index[VLIB_TX] = (u32)~0;
 
+    if (PREDICT_FALSE (pcap_capture_main.flags & PCAP_CAPTURE_F_RX))
+      pcap_capture_rx_buffer (vm, b_first, 0);
+
     b_first->error = node->errors[TAPCLI_ERROR_NONE];
     next_index = TAPCLI_RX_NEXT_ETHERNET_INPUT;
     next_index = (ti->per_interface_next_index != ~0) ?
@@ -516,6 +516,38 @@ static void vl_api_create_vlan_subif_reply_t_handler_json
     vam->result_ready = 1;
 }
 
+static void vl_api_ip_add_del_route_batch_reply_t_handler 
+(vl_api_ip_add_del_route_batch_reply_t * mp)
+{
+    vat_main_t * vam = &vat_main;
+    i32 retval = ntohl(mp->retval);
+
+    vam->route_batch_n_done += ntohl(mp->n_done);
+    vam->route_batch_fib_usec += ntohl(mp->fib_usec);
+    vam->retval = retval;
+    vam->result_ready = 1;
+}
+
+static void vl_api_ip_add_del_route_batch_reply_t_handler_json
+(vl_api_ip_add_del_route_batch_reply_t * mp)
+{
+    vat_main_t * vam = &vat_main;
+    vat_json_node_t node;
+
+    vat_json_init_object(&node);
+    vat_json_object_add_int(&node, "retval", ntohl(mp->retval));
+    vat_json_object_add_uint(&node, "n_done", ntohl(mp->n_done));
+    vat_json_object_add_uint(&node, "fib_usec", ntohl(mp->fib_usec));
+
+    vat_json_print(vam->ofp, &node);
+    vat_json_free(&node);
+
+    vam->route_batch_n_done += ntohl(mp->n_done);
+    vam->route_batch_fib_usec += ntohl(mp->fib_usec);
+    vam->retval = ntohl(mp->retval);
+    vam->result_ready = 1;
+}
+
 static void vl_api_create_subif_reply_t_handler 
 (vl_api_create_subif_reply_t * mp)
 {
@@ -2202,6 +2234,7 @@ _(l2_interface_efp_filter_reply)                        \
 _(l2_interface_vlan_tag_rewrite_reply)                  \
 _(modify_vhost_user_if_reply)                           \
 _(delete_vhost_user_if_reply)                           \
+_(sw_interface_set_dpdk_rx_placement_reply)             \
 _(want_ip4_arp_events_reply)                            \
 _(input_acl_set_interface_reply)                        \
 _(ipsec_spd_add_del_reply)                              \
@@ -2311,6 +2344,7 @@ _(SW_INTERFACE_SET_UNNUMBERED_REPLY,                                    \
 _(IP_NEIGHBOR_ADD_DEL_REPLY, ip_neighbor_add_del_reply)                 \
 _(RESET_VRF_REPLY, reset_vrf_reply)                                     \
 _(CREATE_VLAN_SUBIF_REPLY, create_vlan_subif_reply)                     \
+_(IP_ADD_DEL_ROUTE_BATCH_REPLY, ip_add_del_route_batch_reply)           \
 _(CREATE_SUBIF_REPLY, create_subif_reply)                     		\
 _(OAM_ADD_DEL_REPLY, oam_add_del_reply)                                 \
 _(RESET_FIB_REPLY, reset_fib_reply)                                     \
@@ -2357,6 +2391,8 @@ _(SW_INTERFACE_VHOST_USER_DETAILS, sw_interface_vhost_user_details)     \
 _(CREATE_VHOST_USER_IF_REPLY, create_vhost_user_if_reply)               \
 _(MODIFY_VHOST_USER_IF_REPLY, modify_vhost_user_if_reply)               \
 _(DELETE_VHOST_USER_IF_REPLY, delete_vhost_user_if_reply)               \
+_(SW_INTERFACE_SET_DPDK_RX_PLACEMENT_REPLY,                             \
+  sw_interface_set_dpdk_rx_placement_reply)                             \
 _(SHOW_VERSION_REPLY, show_version_reply)                               \
 _(NSH_GRE_ADD_DEL_TUNNEL_REPLY, nsh_gre_add_del_tunnel_reply)		\
 _(L2_FIB_TABLE_ENTRY, l2_fib_table_entry)				\
@@ -4021,6 +4057,171 @@ static int api_ip_add_del_route (vat_main_t * vam)
     return (vam->retval);
 }
 
+/*
+ * Load count routes, batch routes per ip_add_del_route_batch message,
+ * and report the rate seen by the client and the time vpp spent in
+ * the fib.  Run traffic meanwhile to see what the workers drop.
+ */
+static int api_ip_add_del_route_batch (vat_main_t * vam)
+{
+    unformat_input_t * i = vam->input;
+    vl_api_ip_add_del_route_batch_t *mp;
+    vl_api_ip_route_batch_entry_t * e;
+    f64 timeout, before, after;
+    u32 sw_if_index = 0, vrf_id = 0;
+    u8 is_ipv6 = 0;
+    u8 is_local = 0, is_drop = 0;
+    u8 create_vrf_if_needed = 0;
+    u8 is_add = 1;
+    u8 address_set = 0;
+    u8 address_length_set = 0;
+    u8 next_hop_set = 0;
+    u32 dst_address_length = 0;
+    ip4_address_t v4_dst_address, v4_next_hop_address;
+    ip6_address_t v6_dst_address, v6_next_hop_address;
+    u32 count = 1, batch_size = 1000;
+    u32 n_sent = 0, n_batches = 0, n_this_batch, j;
+
+    /* Parse args required to build the message */
+    while (unformat_check_input (i) != UNFORMAT_END_OF_INPUT) {
+        if (unformat (i, "%U", unformat_sw_if_index, vam, &sw_if_index))
+            ;
+        else if (unformat (i, "sw_if_index %d", &sw_if_index))
+            ;
+        else if (unformat (i, "%U", unformat_ip4_address,
+                           &v4_dst_address)) {
+            address_set = 1;
+            is_ipv6 = 0;
+        }
+        else if (unformat (i, "%U", unformat_ip6_address, &v6_dst_address)) {
+            address_set = 1;
+            is_ipv6 = 1;
+        }
+        else if (unformat (i, "/%d", &dst_address_length)) {
+            address_length_set = 1;
+        }
+        else if (is_ipv6 == 0 && unformat (i, "via %U", unformat_ip4_address, 
+                                           &v4_next_hop_address)) {
+            next_hop_set = 1;
+        }
+        else if (is_ipv6 == 1 && unformat (i, "via %U", unformat_ip6_address, 
+                                           &v6_next_hop_address)) {
+            next_hop_set = 1;
+        }
+        else if (unformat (i, "drop"))
+            is_drop = 1;
+        else if (unformat (i, "local"))
+            is_local = 1;
+        else if (unformat (i, "del"))
+            is_add = 0;
+        else if (unformat (i, "add"))
+            is_add = 1;
+        else if (unformat (i, "vrf %d", &vrf_id))
+            ;
+        else if (unformat (i, "create-vrf"))
+            create_vrf_if_needed = 1;
+        else if (unformat (i, "count %d", &count))
+            ;
+        else if (unformat (i, "batch %d", &batch_size))
+            ;
+        else {
+            clib_warning ("parse error '%U'", format_unformat_error, i);
+            return -99;
+        }
+    }
+
+    if (!next_hop_set && !is_drop && !is_local) {
+        errmsg ("next hop / local / drop not set\n");
+        return -99;
+    }
+
+    if (address_set == 0) {
+        errmsg ("missing addresses\n");
+        return -99;
+    }
+
+    if (address_length_set == 0) {
+        errmsg ("missing address length\n");
+        return -99;
+    }
+
+    if (count == 0 || batch_size == 0) {
+        errmsg ("count and batch must be non-zero\n");
+        return -99;
+    }
+
+    vam->route_batch_n_done = 0;
+    vam->route_batch_fib_usec = 0;
+    vam->retval = 0;
+    before = vat_time_now (vam);
+
+    while (n_sent < count) {
+        n_this_batch = clib_min (batch_size, count - n_sent);
+
+        M2(IP_ADD_DEL_ROUTE_BATCH, ip_add_del_route_batch, 
+           n_this_batch * sizeof (*e));
+
+        mp->vrf_id = ntohl (vrf_id);
+        mp->create_vrf_if_needed = create_vrf_if_needed;
+        mp->is_ipv6 = is_ipv6;
+        mp->count = ntohl (n_this_batch);
+
+        for (j = 0; j < n_this_batch; j++) {
+            e = mp->routes + j;
+            memset (e, 0, sizeof (*e));
+            e->next_hop_sw_if_index = ntohl (sw_if_index);
+            e->is_add = is_add;
+            e->is_drop = is_drop;
+            e->is_local = is_local;
+            e->dst_address_length = dst_address_length;
+            if (is_ipv6) {
+                clib_memcpy (e->dst_address, &v6_dst_address, 
+                             sizeof (v6_dst_address));
+                if (next_hop_set)
+                    clib_memcpy (e->next_hop_address, &v6_next_hop_address, 
+                                 sizeof (v6_next_hop_address));
+                increment_v6_address (&v6_dst_address);
+            } else {
+                clib_memcpy (e->dst_address, &v4_dst_address, 
+                             sizeof (v4_dst_address));
+                if (next_hop_set)
+                    clib_memcpy (e->next_hop_address, &v4_next_hop_address, 
+                                 sizeof (v4_next_hop_address));
+                increment_v4_address (&v4_dst_address);
+            }
+        }
+        S;
+
+        /* A batch can take a while, allow for it */
+        timeout = vat_time_now (vam) + 10.0;
+        while (vat_time_now (vam) < timeout)
+            if (vam->result_ready == 1)
+                break;
+        if (vam->result_ready == 0) {
+            errmsg ("timeout\n");
+            return -99;
+        }
+
+        n_sent += n_this_batch;
+        n_batches++;
+        if (vam->retval)
+            break;
+    }
+
+    after = vat_time_now (vam);
+
+    fformat (vam->ofp, "%d routes in %d batches in %.6f secs, %.2f routes/sec\n",
+             vam->route_batch_n_done, n_batches, after - before, 
+             vam->route_batch_n_done / (after - before));
+    fformat (vam->ofp, "fib time %.6f secs, %.2f routes/sec\n",
+             vam->route_batch_fib_usec * 1e-6,
+             vam->route_batch_fib_usec ? 
+             vam->route_batch_n_done / (vam->route_batch_fib_usec * 1e-6) : 0);
+
+    /* Return the good/bad news */
+    return (vam->retval);
+}
+
 static int api_proxy_arp_add_del (vat_main_t * vam)
 {
     unformat_input_t * i = vam->input;
@@ -7858,6 +8059,50 @@ static int api_delete_vhost_user_if (vat_main_t * vam)
     return 0;
 }
 
+static int api_sw_interface_set_dpdk_rx_placement (vat_main_t * vam)
+{
+    unformat_input_t * i = vam->input;
+    vl_api_sw_interface_set_dpdk_rx_placement_t *mp;
+    f64 timeout;
+    u32 sw_if_index = ~0;
+    u8 sw_if_index_set = 0;
+    u32 queue_id = 0;
+    u32 thread_index = ~0;
+
+    while (unformat_check_input (i) != UNFORMAT_END_OF_INPUT) {
+      if (unformat (i, "%U", unformat_sw_if_index, vam, &sw_if_index))
+          sw_if_index_set = 1;
+      else if (unformat (i, "sw_if_index %d", &sw_if_index))
+          sw_if_index_set = 1;
+      else if (unformat (i, "queue %d", &queue_id))
+          ;
+      else if (unformat (i, "thread %d", &thread_index))
+          ;
+      else
+          break;
+    }
+
+    if (sw_if_index_set == 0) {
+       errmsg ("missing sw_if_index or interface name\n");
+       return -99;
+    }
+
+    if (thread_index == ~0) {
+       errmsg ("missing thread\n");
+       return -99;
+    }
+
+    M(SW_INTERFACE_SET_DPDK_RX_PLACEMENT, sw_interface_set_dpdk_rx_placement);
+
+    mp->sw_if_index = ntohl(sw_if_index);
+    mp->queue_id = ntohs(queue_id);
+    mp->thread_index = ntohl(thread_index);
+
+    S; W;
+    /* NOTREACHED */
+    return 0;
+}
+
 static void vl_api_sw_interface_vhost_user_details_t_handler
 (vl_api_sw_interface_vhost_user_details_t * mp)
 {
@@ -8954,7 +9199,7 @@ api_ipsec_sad_add_del_entry (vat_main_t * vam)
         }
         else if (unformat (i, "crypto_alg %U", unformat_ipsec_crypto_alg, &crypto_alg)) {
             if (crypto_alg < IPSEC_CRYPTO_ALG_AES_CBC_128 ||
-                crypto_alg > IPSEC_INTEG_ALG_SHA_512_256) {
+                crypto_alg > IPSEC_CRYPTO_ALG_CHACHA20_POLY1305) {
                 clib_warning ("unsupported crypto-alg: '%U'",
                               format_ipsec_crypto_alg, crypto_alg);
                 return -99;
@@ -10660,6 +10905,10 @@ _(ip_add_del_route,                                                     \
   "[<intfc> | sw_if_index <id>] [resolve-attempts <n>]\n"               \
   "[weight <n>] [drop] [local] [classify <n>] [del]\n"                  \
   "[multipath] [count <n>]")                                            \
+_(ip_add_del_route_batch,                                               \
+  "<addr>/<mask> via <addr> [vrf <n>] [create-vrf]\n"                   \
+  "[<intfc> | sw_if_index <id>] [drop] [local] [del]\n"                 \
+  "[count <n>] [batch <n>]")                                            \
 _(proxy_arp_add_del,                                                    \
   "<lo-ip4-addr> - <hi-ip4-addr> [vrf <n>] [del]")                      \
 _(proxy_arp_intfc_enable_disable,                                       \
@@ -10771,6 +11020,8 @@ _(modify_vhost_user_if,                                                 \
         "<intfc> | sw_if_index <nn> socket <filename>\n"                \
         "[server] [renumber <dev_instance>]")                           \
 _(delete_vhost_user_if, "<intfc> | sw_if_index <nn>")                   \
+_(sw_interface_set_dpdk_rx_placement,                                   \
+  "<intfc> | sw_if_index <nn> [queue <nn>] thread <nn>")                \
 _(sw_interface_vhost_user_dump, "")                                     \
 _(show_version, "")                                                     \
 _(nsh_gre_add_del_tunnel,                                               \
@@ -127,6 +127,10 @@ typedef struct {
     volatile i32 retval;
     volatile u8 *shmem_result;
 
+    /* ip_add_del_route_batch results, summed over the batches sent */
+    u32 route_batch_n_done;
+    u64 route_batch_fib_usec;
+
     /* our client index */
     u32 my_client_index;
 
@@ -49,7 +49,8 @@ cfg = importlib.import_module(inputfile, package=None)
 
 # FIXME: functions unsupported due to problems with vpe.api
 def is_supported(f_name):
-    return f_name not in {'vnet_ip4_fib_counters', 'vnet_ip6_fib_counters'}
+    return f_name not in {'vnet_ip4_fib_counters', 'vnet_ip6_fib_counters',
+                          'ip_add_del_route_batch', 'ip_add_del_route_batch_reply'}
 
 
 def is_request_field(field_name):
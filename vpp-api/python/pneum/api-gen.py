@@ -35,6 +35,7 @@ format_struct = {'u8': 'B',
                  'f64' : 'd',
                  'vl_api_ip4_fib_counter_t' : 'IBQQ',
                  'vl_api_ip6_fib_counter_t' : 'QQBQQ',
+                 'vl_api_ip_route_batch_entry_t' : 'IBBBB16s16s',
                  };
 #
 # NB: If new types are introduced in vpe.api, these must be updated.
@@ -47,6 +48,7 @@ type_size = {'u8':   1,
              'f64' : 8,
              'vl_api_ip4_fib_counter_t' : 21,
              'vl_api_ip6_fib_counter_t' : 33,
+             'vl_api_ip_route_batch_entry_t' : 40,
 };
 
 def get_args(t):
@@ -282,6 +282,7 @@ _(L2_INTERFACE_VLAN_TAG_REWRITE, l2_interface_vlan_tag_rewrite)         \
 _(CREATE_VHOST_USER_IF, create_vhost_user_if)                           \
 _(MODIFY_VHOST_USER_IF, modify_vhost_user_if)                           \
 _(DELETE_VHOST_USER_IF, delete_vhost_user_if)                           \
+_(SW_INTERFACE_SET_DPDK_RX_PLACEMENT, sw_interface_set_dpdk_rx_placement) \
 _(SW_INTERFACE_VHOST_USER_DUMP, sw_interface_vhost_user_dump)           \
 _(IP_ADDRESS_DUMP, ip_address_dump)                                     \
 _(IP_DUMP, ip_dump)                                                     \
@@ -606,7 +607,7 @@ void handle_ip4_arp_event (u32 pool_index)
         return;
     }
     
-    if (q->cursize < q->maxsize) {
+    if (!unix_shared_memory_queue_is_full (q)) {
         mp =  vl_msg_api_alloc (sizeof (*mp));
         clib_memcpy (mp, event, sizeof (*mp));
         vl_msg_api_send_shmem (q, (u8 *)&mp);
@@ -1199,6 +1200,104 @@ void vl_api_ip_add_del_route_t_handler (
     REPLY_MACRO(VL_API_IP_ADD_DEL_ROUTE_REPLY);
 }
 
+/*
+ * Most routes accepted in one ip_add_del_route_batch message.  The
+ * message may arrive over shared memory, the socket or trace replay,
+ * so its length is not known here; count is bounded instead.
+ */
+#define IP_ROUTE_BATCH_MAX_ROUTES 1024
+
+/* Variable length, so the generated endian function is not used */
+static void
+vl_api_ip_add_del_route_batch_t_endian (vl_api_ip_add_del_route_batch_t *mp)
+{
+    u32 i, n_routes;
+
+    n_routes = clib_min (ntohl (mp->count), IP_ROUTE_BATCH_MAX_ROUTES);
+
+    mp->_vl_msg_id = clib_net_to_host_u16 (mp->_vl_msg_id);
+    mp->client_index = clib_net_to_host_u32 (mp->client_index);
+    mp->context = clib_net_to_host_u32 (mp->context);
+    mp->vrf_id = clib_net_to_host_u32 (mp->vrf_id);
+    mp->count = clib_net_to_host_u32 (mp->count);
+    for (i = 0; i < n_routes; i++)
+        mp->routes[i].next_hop_sw_if_index =
+            clib_net_to_host_u32 (mp->routes[i].next_hop_sw_if_index);
+}
+
+/*
+ * Program a batch of routes.  The message is not mp-safe, so the
+ * dispatcher holds the workers at the barrier once for the whole batch;
+ * the stats data structure lock is likewise taken once, and the
+ * per-route handlers nest inside both.
+ */
+void vl_api_ip_add_del_route_batch_t_handler (
+    vl_api_ip_add_del_route_batch_t *mp)
+{
+    vl_api_ip_add_del_route_batch_reply_t * rmp;
+    vl_api_ip_route_batch_entry_t * e;
+    vl_api_ip_add_del_route_t r;
+    vnet_main_t * vnm = vnet_get_main();
+    vlib_main_t * vm = vlib_get_main();
+    stats_main_t * sm = &stats_main;
+    u32 i, n_routes, n_done = 0;
+    f64 t0, t1;
+    int rv = 0;
+
+    n_routes = ntohl (mp->count);
+    if (n_routes > IP_ROUTE_BATCH_MAX_ROUTES) {
+        rv = VNET_API_ERROR_INVALID_VALUE;
+        t0 = t1 = 0;
+        goto out;
+    }
+
+    memset (&r, 0, sizeof (r));
+    r.vrf_id = mp->vrf_id;
+    r.create_vrf_if_needed = mp->create_vrf_if_needed;
+    r.is_ipv6 = mp->is_ipv6;
+    r.next_hop_weight = 1;
+
+    t0 = vlib_time_now (vm);
+    dslock (sm, 1 /* release hint */, 12 /* tag */);
+
+    for (i = 0; i < n_routes; i++) {
+        e = mp->routes + i;
+
+        r.next_hop_sw_if_index = e->next_hop_sw_if_index;
+        r.is_add = e->is_add;
+        r.is_drop = e->is_drop;
+        r.is_local = e->is_local;
+        r.dst_address_length = e->dst_address_length;
+        clib_memcpy (r.dst_address, e->dst_address, sizeof (r.dst_address));
+        clib_memcpy (r.next_hop_address, e->next_hop_address,
+                     sizeof (r.next_hop_address));
+        /* Route callbacks can defer their work to the end of the batch */
+        r.not_last = (i + 1 < n_routes);
+
+        vnm->api_errno = 0;
+
+        if (r.is_ipv6)
+            rv = ip6_add_del_route_t_handler (&r);
+        else
+            rv = ip4_add_del_route_t_handler (&r);
+
+        rv = (rv == 0) ? vnm->api_errno : rv;
+        if (rv)
+            break;
+        n_done++;
+    }
+
+    dsunlock (sm);
+    t1 = vlib_time_now (vm);
+
+ out:
+    REPLY_MACRO2(VL_API_IP_ADD_DEL_ROUTE_BATCH_REPLY,
+    ({
+        rmp->n_done = htonl (n_done);
+        rmp->fib_usec = htonl ((u32) ((t1 - t0) * 1e6));
+    }));
+}
+
 void api_config_default_ip_route (u8 is_ipv6, u8 is_add, u32 vrf_id,
                                   u32 sw_if_index, u8 *next_hop_addr)
 {
@@ -2657,7 +2756,7 @@ vl_api_vnet_get_summary_stats_t_handler (
     vec_foreach (cm, im->combined_sw_if_counters) {
         which = cm - im->combined_sw_if_counters;
 
-        for (i = 0; i < vec_len (cm->maxi); i++) {
+        for (i = 0; i < vlib_counter_len (cm); i++) {
             vlib_get_combined_counter (cm, i, &v);
             total_pkts[which] += v.packets;
             total_bytes[which] += v.bytes;
@@ -3797,6 +3896,34 @@ vl_api_delete_vhost_user_if_t_handler (vl_api_delete_vhost_user_if_t *mp)
 #endif
 }
 
+static void
+vl_api_sw_interface_set_dpdk_rx_placement_t_handler
+(vl_api_sw_interface_set_dpdk_rx_placement_t *mp)
+{
+    int rv = 0;
+    vl_api_sw_interface_set_dpdk_rx_placement_reply_t * rmp;
+
+    VALIDATE_SW_IF_INDEX(mp);
+
+#if DPDK > 0
+    {
+        vnet_main_t * vnm = vnet_get_main();
+        vnet_hw_interface_t * hw;
+
+        hw = vnet_get_sup_hw_interface (vnm, ntohl(mp->sw_if_index));
+        rv = dpdk_set_rx_queue_placement (hw->hw_if_index,
+                                          ntohs(mp->queue_id),
+                                          ntohl(mp->thread_index));
+    }
+#else
+    rv = VNET_API_ERROR_UNIMPLEMENTED;
+#endif
+
+    BAD_SW_IF_INDEX_LABEL;
+
+    REPLY_MACRO(VL_API_SW_INTERFACE_SET_DPDK_RX_PLACEMENT_REPLY);
+}
+
 static void vl_api_sw_interface_vhost_user_details_t_handler (
     vl_api_sw_interface_vhost_user_details_t * mp)
 {
@@ -5444,7 +5571,7 @@ static void vl_api_ipsec_sad_add_del_entry_t_handler
     sa.protocol = mp->protocol;
     /* check for unsupported crypto-alg */
     if (mp->crypto_algorithm < IPSEC_CRYPTO_ALG_AES_CBC_128 ||
-        mp->crypto_algorithm > IPSEC_CRYPTO_ALG_AES_CBC_256) {
+        mp->crypto_algorithm > IPSEC_CRYPTO_ALG_CHACHA20_POLY1305) {
         clib_warning("unsupported crypto-alg: '%U'", format_ipsec_crypto_alg,
                      mp->crypto_algorithm);
         rv = VNET_API_ERROR_UNIMPLEMENTED;
@@ -5453,9 +5580,11 @@ static void vl_api_ipsec_sad_add_del_entry_t_handler
     sa.crypto_alg = mp->crypto_algorithm;
     sa.crypto_key_len = mp->crypto_key_length;
     clib_memcpy(&sa.crypto_key, mp->crypto_key, sizeof(sa.crypto_key));
-    /* check for unsupported integ-alg */
-    if (mp->integrity_algorithm < IPSEC_INTEG_ALG_SHA1_96 ||
-        mp->integrity_algorithm > IPSEC_INTEG_ALG_SHA_512_256) {
+    /* check for unsupported integ-alg, AEAD crypto-algs need none */
+    if (!(ipsec_crypto_alg_is_aead (sa.crypto_alg) &&
+          mp->integrity_algorithm == IPSEC_INTEG_ALG_NONE) &&
+        (mp->integrity_algorithm < IPSEC_INTEG_ALG_SHA1_96 ||
+         mp->integrity_algorithm > IPSEC_INTEG_ALG_SHA_512_256)) {
         clib_warning("unsupported integ-alg: '%U'", format_ipsec_integ_alg,
                      mp->integrity_algorithm);
         rv = VNET_API_ERROR_UNIMPLEMENTED;
@@ -5748,7 +5877,7 @@ vl_api_map_summary_stats_t_handler (
     vec_foreach(cm, mm->domain_counters) {
       which = cm - mm->domain_counters;
 
-      for (i = 0; i < vec_len(cm->maxi); i++) {
+      for (i = 0; i < vlib_counter_len (cm); i++) {
 	vlib_get_combined_counter (cm, i, &v);
 	total_pkts[which] += v.packets;
 	total_bytes[which] += v.bytes;
@@ -5939,7 +6068,7 @@ static void vl_api_##nn##_t_handler (                                   \
              * It's unlikely that the intended recipient is             \
              * alive; avoid deadlock at all costs.                      \
              */                                                         \
-            if (q->cursize == q->maxsize) {                             \
+            if (unix_shared_memory_queue_is_full (q)) {                 \
                 clib_warning ("ERROR: receiver queue full, drop msg");  \
                 vl_msg_api_free (mp);                                   \
                 return;                                                 \
@@ -5999,6 +6128,18 @@ vpe_api_hookup (vlib_main_t *vm)
                              vl_api_sr_policy_add_del_t_print,
                              256, 1);
 
+    /* 
+     * Route batches are variable length; trace the first few routes
+     */
+    vl_msg_api_set_handlers (VL_API_IP_ADD_DEL_ROUTE_BATCH, 
+                             "ip_add_del_route_batch",
+                             vl_api_ip_add_del_route_batch_t_handler,
+                             vl_noop_handler,
+                             vl_api_ip_add_del_route_batch_t_endian,
+                             vl_noop_handler,
+                             sizeof (vl_api_ip_add_del_route_batch_t) 
+                             + 8 * sizeof (vl_api_ip_route_batch_entry_t), 1);
+
     /* 
      * Trace space for 8 MPLS encap labels, classifier mask+match
      */
@@ -428,6 +428,48 @@ static void *vl_api_ip_add_del_route_t_print
     FINISH;
 }
 
+static void *vl_api_ip_add_del_route_batch_t_print
+(vl_api_ip_add_del_route_batch_t * mp, void *handle)
+{
+    vl_api_ip_route_batch_entry_t * e;
+    u32 i, n_routes;
+    u8 * s;
+
+    n_routes = ntohl(mp->count);
+
+    s = format (0, "SCRIPT: ip_add_del_route_batch count %d ", n_routes);
+
+    if (mp->vrf_id != 0)
+        s = format (s, "vrf %d ", ntohl(mp->vrf_id));
+
+    if (mp->create_vrf_if_needed)
+        s = format (s, "create-vrf ");
+
+    /* Only the first few routes are traced */
+    for (i = 0; i < clib_min (n_routes, 8); i++) {
+        e = mp->routes + i;
+        s = format (s, "\n    %s", e->is_add ? "" : "del ");
+        if (mp->is_ipv6)
+            s = format (s, "%U/%d ", format_ip6_address, e->dst_address,
+                        e->dst_address_length);
+        else
+            s = format (s, "%U/%d ", format_ip4_address, e->dst_address,
+                        e->dst_address_length);
+        if (e->is_local)
+            s = format (s, "local ");
+        else if (e->is_drop)
+            s = format (s, "drop ");
+        else if (mp->is_ipv6)
+            s = format (s, "via %U ", format_ip6_address, e->next_hop_address);
+        else
+            s = format (s, "via %U ", format_ip4_address, e->next_hop_address);
+        if (e->next_hop_sw_if_index)
+            s = format (s, "sw_if_index %d ", ntohl(e->next_hop_sw_if_index));
+    }
+
+    FINISH;
+}
+
 static void *vl_api_proxy_arp_add_del_t_print
 (vl_api_proxy_arp_add_del_t * mp, void * handle)
 {
@@ -1486,6 +1528,20 @@ static void *vl_api_delete_vhost_user_if_t_print
     FINISH;
 }
 
+static void *vl_api_sw_interface_set_dpdk_rx_placement_t_print
+(vl_api_sw_interface_set_dpdk_rx_placement_t * mp, void *handle)
+{
+    u8 * s;
+
+    s = format (0, "SCRIPT: sw_interface_set_dpdk_rx_placement ");
+
+    s = format (s, "sw_if_index %d ", ntohl(mp->sw_if_index));
+    s = format (s, "queue %d ", ntohs(mp->queue_id));
+    s = format (s, "thread %d ", ntohl(mp->thread_index));
+
+    FINISH;
+}
+
 static void *vl_api_sw_interface_vhost_user_dump_t_print
 (vl_api_sw_interface_vhost_user_dump_t * mp, void *handle)
 {
@@ -1853,6 +1909,7 @@ _(TAP_MODIFY, tap_modify)                                               \
 _(TAP_DELETE, tap_delete)                                               \
 _(SW_INTERFACE_TAP_DUMP, sw_interface_tap_dump)                         \
 _(IP_ADD_DEL_ROUTE, ip_add_del_route)                                   \
+_(IP_ADD_DEL_ROUTE_BATCH, ip_add_del_route_batch)                       \
 _(PROXY_ARP_ADD_DEL, proxy_arp_add_del)                                 \
 _(PROXY_ARP_INTFC_ENABLE_DISABLE, proxy_arp_intfc_enable_disable)       \
 _(MPLS_ADD_DEL_DECAP, mpls_add_del_decap)                               \
@@ -1908,6 +1965,7 @@ _(L2_INTERFACE_VLAN_TAG_REWRITE, l2_interface_vlan_tag_rewrite)         \
 _(CREATE_VHOST_USER_IF, create_vhost_user_if)				\
 _(MODIFY_VHOST_USER_IF, modify_vhost_user_if)				\
 _(DELETE_VHOST_USER_IF, delete_vhost_user_if)				\
+_(SW_INTERFACE_SET_DPDK_RX_PLACEMENT, sw_interface_set_dpdk_rx_placement) \
 _(SW_INTERFACE_DUMP, sw_interface_dump)					\
 _(CONTROL_PING, control_ping)						\
 _(WANT_INTERFACE_EVENTS, want_interface_events)				\
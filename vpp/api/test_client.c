@@ -76,6 +76,9 @@ typedef struct {
     int stats_on;
     int oam_events_on;
 
+    /* control ping replies seen, for the queue benchmark */
+    volatile u32 ping_replies;
+
     /* convenience */
     unix_shared_memory_queue_t * vl_input_queue;
     u32 my_client_index;
@@ -543,6 +546,14 @@ static void vl_api_sw_interface_set_l2_bridge_reply_t_handler
     fformat (stdout, "l2_bridge reply %d\n", ntohl(mp->retval));
 }
 
+static void vl_api_control_ping_reply_t_handler
+(vl_api_control_ping_reply_t * mp)
+{
+    test_main_t * tm = &test_main;
+
+    tm->ping_replies++;
+}
+
 static void noop_handler (void *notused) { }
 
 #define vl_api_vnet_ip4_fib_counters_t_endian noop_handler
@@ -585,7 +596,8 @@ _(SW_INTERFACE_IP6_SET_LINK_LOCAL_ADDRESS_REPLY, sw_interface_ip6_set_link_local
 _(L2_PATCH_ADD_DEL_REPLY, l2_patch_add_del_reply)			\
 _(SR_TUNNEL_ADD_DEL_REPLY,sr_tunnel_add_del_reply)          \
 _(SW_INTERFACE_SET_L2_XCONNECT_REPLY, sw_interface_set_l2_xconnect_reply) \
-_(SW_INTERFACE_SET_L2_BRIDGE_REPLY, sw_interface_set_l2_bridge_reply)
+_(SW_INTERFACE_SET_L2_BRIDGE_REPLY, sw_interface_set_l2_bridge_reply) \
+_(CONTROL_PING_REPLY, control_ping_reply)
 
 int connect_to_vpe(char *name)
 {
@@ -1282,6 +1294,38 @@ void l2_bridge (test_main_t *tm)
     vl_msg_api_send_shmem (tm->vl_input_queue, (u8 *)&mp);
 }
 
+/* 
+ * Blast control pings at vpp and count the replies: measures the
+ * shared-memory queues and message rings, not any real handler.
+ */
+void api_queue_benchmark (test_main_t *tm, u32 n_msgs)
+{
+    vl_api_control_ping_t * mp;
+    f64 before, elapsed, timeout;
+    u32 i;
+
+    tm->ping_replies = 0;
+    before = unix_time_now ();
+
+    for (i = 0; i < n_msgs; i++) {
+        mp = vl_msg_api_alloc (sizeof (*mp));
+        memset(mp, 0, sizeof (*mp));
+        mp->_vl_msg_id = ntohs (VL_API_CONTROL_PING);
+        mp->client_index = tm->my_client_index;
+        mp->context = i;
+        vl_msg_api_send_shmem (tm->vl_input_queue, (u8 *)&mp);
+    }
+
+    timeout = unix_time_now () + 10.0;
+    while (tm->ping_replies < n_msgs && unix_time_now () < timeout)
+        usleep (10);
+
+    elapsed = unix_time_now () - before;
+    fformat (stdout, "%d requests, %d replies in %.3f sec: %.0f msgs/sec\n",
+             n_msgs, tm->ping_replies, elapsed, 
+             (n_msgs + tm->ping_replies) / elapsed);
+}
+
 int main (int argc, char ** argv)
 {
     api_main_t * am = &api_main;
@@ -1478,6 +1522,10 @@ int main (int argc, char ** argv)
 			l2_bridge(tm);
             break;
                 
+        case 'P':
+            api_queue_benchmark (tm, 100000);
+            break;
+
         case 'h':
             fformat (stdout, "q=quit,d=dump,L=link evts on,l=link evts off\n");
             fformat (stdout, "S=stats on,s=stats off\n");
@@ -1501,6 +1549,7 @@ int main (int argc, char ** argv)
 	    fformat (stdout, "Y=no ip6 nd prefix\n");
 	    fformat (stdout, "@=l2 xconnect\n");
 	    fformat (stdout, "#=l2 bridge\n");
+            fformat (stdout, "P=api queue benchmark, 100k control pings\n");
             
         default:
             break;
@@ -58,6 +58,13 @@ _(VNET_IP6_FIB_COUNTERS, vnet_ip6_fib_counters)
 #define STATS_RELEASE_DELAY_NS (1000 * 1000 * 5)
 /*                              ns/us  us/ms        */
 
+/* Stats thread wakeup */
+#define STATS_TICK_SECONDS 1
+
+/* FIB counter walk: routes per dslock hold, and per tick */
+#define STATS_FIB_CHUNK_ROUTES (1<<10)
+#define STATS_FIB_ROUTES_PER_TICK (128<<10)
+
 void dslock (stats_main_t *sm, int release_hint, int tag)
 {
     u32 thread_id;
@@ -121,10 +128,10 @@ static void do_simple_interface_counters (stats_main_t * sm)
 
     vec_foreach (cm, im->sw_if_counters) {
 
-        for (i = 0; i < vec_len (cm->maxi); i++) {
+        for (i = 0; i < vlib_counter_len (cm); i++) {
             if (mp == 0) {
                 items_this_message = clib_min (SIMPLE_COUNTER_BATCH_SIZE,
-                                               vec_len (cm->maxi) - i);
+                                               vlib_counter_len (cm) - i);
 
                 mp = vl_msg_api_alloc_as_if_client 
                     (sizeof (*mp) + items_this_message * sizeof (v));
@@ -167,10 +174,10 @@ static void do_combined_interface_counters (stats_main_t * sm)
 
     vec_foreach (cm, im->combined_sw_if_counters) {
 
-        for (i = 0; i < vec_len (cm->maxi); i++) {
+        for (i = 0; i < vlib_counter_len (cm); i++) {
             if (mp == 0) {
                 items_this_message = clib_min (COMBINED_COUNTER_BATCH_SIZE,
-                                               vec_len (cm->maxi) - i);
+                                               vlib_counter_len (cm) - i);
                 
                 mp = vl_msg_api_alloc_as_if_client 
                     (sizeof (*mp) + items_this_message * sizeof (v));
@@ -209,6 +216,13 @@ typedef CLIB_PACKED (struct {
   u32 index : 26;
 }) ip4_route_t;
 
+typedef struct {
+  ip6_address_t address;
+  u32 address_length;
+  u32 index;
+  u32 fib_index;
+} ip6_route_t;
+
 static void ip46_fib_stats_delay (stats_main_t * sm, u32 sec, u32 nsec)
 {
     struct timespec _req, *req = &_req;
@@ -227,387 +241,421 @@ static void ip46_fib_stats_delay (stats_main_t * sm, u32 sec, u32 nsec)
     }
 }
 
-static void do_ip4_fibs (stats_main_t * sm)
+/* 
+ * Start a new pass over the FIB if the last one is done and the poll
+ * interval has passed. Returns 0 if there is nothing to do this tick.
+ */
+static int stats_fib_cursor_start (stats_main_t * sm, stats_fib_cursor_t * c)
+{
+    f64 now = unix_time_now ();
+
+    if (c->in_cycle)
+        return 1;
+
+    if (now < c->next_cycle_time)
+        return 0;
+
+    c->fib_index = 0;
+    c->address_length = 0;
+    c->slot = 0;
+    c->hash_capacity = 0;
+    c->full_cycle = c->full_cycle_requested;
+    c->full_cycle_requested = 0;
+    c->next_cycle_time = now + sm->stats_poll_interval_in_seconds;
+    c->in_cycle = 1;
+    return 1;
+}
+
+static void stats_fib_cursor_done (stats_fib_cursor_t * c)
+{
+    u64 * tmp;
+
+    /* This pass's counts are what the next pass compares against */
+    tmp = c->last_packets_by_adj;
+    c->last_packets_by_adj = c->this_packets_by_adj;
+    c->this_packets_by_adj = tmp;
+
+    c->in_cycle = 0;
+    c->n_cycles++;
+}
+
+/*
+ * Counters of one route: a sum per next hop of its adjacency block,
+ * as the fib counter messages have always carried them. Returns 0 if
+ * none of the adjacencies moved since the last pass, in which case
+ * the route is not exported again.
+ */
+static int 
+stats_fib_route_sums (stats_fib_cursor_t * c, ip_lookup_main_t * lm,
+                      uword adj_index, vlib_counter_t ** sums)
+{
+    vlib_counter_t cnt, sum;
+    uword i, j, n_left, n_nhs;
+    ip_adjacency_t * adj;
+    ip_multipath_next_hop_t * nhs, tmp_nhs[1];
+    int changed = c->full_cycle;
+
+    vec_reset_length (*sums);
+
+    adj = ip_get_adjacency (lm, adj_index);
+    if (adj->n_adj == 1) {
+        nhs = &tmp_nhs[0];
+        nhs[0].next_hop_adj_index = ~0; /* not used */
+        nhs[0].weight = 1;
+        n_nhs = 1;
+    } else {
+        ip_multipath_adjacency_t * madj;
+        madj = vec_elt_at_index (lm->multipath_adjacencies, 
+                                 adj->heap_handle);
+        nhs = heap_elt_at_index 
+            (lm->next_hop_heap, 
+             madj->normalized_next_hops.heap_offset);
+        n_nhs = madj->normalized_next_hops.count;
+    }
+
+    vec_validate_init_empty (c->last_packets_by_adj, 
+                             adj_index + adj->n_adj - 1, ~0ULL);
+    vec_validate_init_empty (c->this_packets_by_adj, 
+                             adj_index + adj->n_adj - 1, ~0ULL);
+
+    n_left = nhs[0].weight;
+    vlib_counter_zero (&sum);
+    for (i = j = 0; i < adj->n_adj; i++) {
+        vlib_get_combined_counter (&lm->adjacency_counters, 
+                                   adj_index + i, &cnt);
+        vlib_counter_add (&sum, &cnt);
+
+        changed |= (cnt.packets != c->last_packets_by_adj[adj_index + i]);
+        c->this_packets_by_adj[adj_index + i] = cnt.packets;
+
+        /* 
+         * If we're done with this next hop and it has actually
+         * seen at least one packet, send it.
+         */
+        if (--n_left == 0) {
+            if (sum.packets > 0)
+                vec_add1 (*sums, sum);
+            if (++j >= n_nhs)
+                break;
+            n_left = nhs[j].weight;
+            vlib_counter_zero (&sum);
+        }
+    }
+
+    if (changed)
+        c->n_routes_exported++;
+    else
+        c->n_routes_unchanged++;
+    return changed;
+}
+
+/* Routes in ip4 fib hash slots [slot, ...), whole buckets at a time */
+static uword 
+ip4_fib_hash_collect (uword * hash, uword slot, u32 address_length,
+                      ip_lookup_main_t * lm, ip4_route_t ** routes,
+                      uword ** results, uword max_routes)
+{
+    hash_t * h = hash_header (hash);
+    hash_pair_t * p, * pairs[1];
+    hash_pair_indirect_t * pi;
+    uword j, n_pairs;
+    ip4_route_t x;
+
+    x.address_length = address_length;
+
+    for (; slot < hash_capacity (hash) && vec_len (*routes) < max_routes; 
+         slot++) {
+        if (hash_is_user (hash, slot)) {
+            pairs[0] = hash_forward (h, hash, slot);
+            pi = 0;
+            n_pairs = 1;
+        } else {
+            pi = hash_forward (h, hash, slot);
+            n_pairs = h->log2_pair_size > 0 ? 
+                indirect_pair_get_len (pi) : vec_len (pi->pairs);
+        }
+
+        for (j = 0; j < n_pairs; j++) {
+            p = pi ? hash_forward (h, pi->pairs, j) : pairs[0];
+            x.address.data_u32 = p->key;
+            if (lm->fib_result_n_words > 1) {
+                x.index = vec_len (*results);
+                vec_add (*results, p->value, lm->fib_result_n_words);
+            }
+            else
+                x.index = p->value[0];
+            vec_add1 (*routes, x);
+        }
+    }
+
+    return slot;
+}
+
+/* Queue up a message built under dslock, sent once the lock is dropped */
+#define stats_fib_msg_done(mps,mp)                      \
+do {                                                    \
+    if ((mp) && (mp)->count) {                          \
+        (mp)->count = htonl ((mp)->count);              \
+        vec_add1 ((mps), (mp));                         \
+    } else if (mp)                                      \
+        vl_msg_api_free (mp);                           \
+    (mp) = 0;                                           \
+} while (0)
+
+static void stats_fib_send (stats_main_t * sm, void ** mps)
 {
-    ip4_main_t * im4 = &ip4_main;
     api_main_t * am = sm->api_main;
     vl_shmem_hdr_t *shmem_hdr = am->shmem_hdr;
     unix_shared_memory_queue_t * q = shmem_hdr->vl_input_queue;
-    static ip4_route_t * routes;
-    ip4_route_t * r;
-    ip4_fib_t * fib;
+    void ** mpp;
+
+    /* No lock held: fine to wait for the main thread to drain its queue */
+    vec_foreach (mpp, mps)
+        vl_msg_api_send_shmem (q, (u8 *)mpp);
+}
+
+/*
+ * ip4 FIB counters, a bounded chunk at a time. The cursor (fib,
+ * prefix length, hash slot) survives dropping dslock, so control-plane
+ * activity only delays the pass instead of restarting it. A hash
+ * resized behind our back is walked again from its first slot.
+ */
+static void do_ip4_fibs (stats_main_t * sm)
+{
+    stats_fib_cursor_t * c = &sm->ip4_fib_cursor;
+    ip4_main_t * im4 = &ip4_main;
     ip_lookup_main_t * lm = &im4->lookup_main;
+    static ip4_route_t * routes;
     static uword * results;
-    vl_api_vnet_ip4_fib_counters_t * mp = 0;
-    u32 items_this_message;
+    static vlib_counter_t * sums;
+    static void ** mps;
+    vl_api_vnet_ip4_fib_counters_t * mp;
     vl_api_ip4_fib_counter_t *ctrp = 0;
-    u32 start_at_fib_index = 0;
-    int i;
-
-again:
-    vec_foreach (fib, im4->fibs) {
-        /* We may have bailed out due to control-plane activity */
-        while ((fib - im4->fibs) < start_at_fib_index)
-            continue;
+    ip4_route_t * r;
+    ip4_fib_t * fib;
+    vlib_counter_t * sum;
+    uword * hash, adj_index, n_routes_this_tick = 0;
 
-        if (mp == 0) {
-            items_this_message = IP4_FIB_COUNTER_BATCH_SIZE;
-            mp = vl_msg_api_alloc_as_if_client 
-                (sizeof(*mp) + 
-                 items_this_message*sizeof(vl_api_ip4_fib_counter_t));
-            mp->_vl_msg_id = ntohs (VL_API_VNET_IP4_FIB_COUNTERS);
-            mp->count = 0;
-            mp->vrf_id = ntohl(fib->table_id);
-            ctrp = (vl_api_ip4_fib_counter_t *)mp->c;
-        } else {
-            /* happens if the last FIB was empty... */
-            ASSERT(mp->count == 0);
-            mp->vrf_id = ntohl(fib->table_id);
-        }
+    if (! stats_fib_cursor_start (sm, c))
+        return;
 
-        dslock (sm, 0 /* release hint */, 1 /* tag */);
-      
+    while (n_routes_this_tick < STATS_FIB_ROUTES_PER_TICK) {
         vec_reset_length (routes);
         vec_reset_length (results);
+        vec_reset_length (mps);
+        mp = 0;
 
-        for (i = 0; i < ARRAY_LEN (fib->adj_index_by_dst_address); i++) {
-            uword * hash = fib->adj_index_by_dst_address[i];
-            hash_pair_t * p;
-            ip4_route_t x;
+        dslock (sm, 0 /* release hint */, 1 /* tag */);
 
-            x.address_length = i;
+        if (c->fib_index >= vec_len (im4->fibs)) {
+            dsunlock (sm);
+            stats_fib_cursor_done (c);
+            break;
+        }
 
-            hash_foreach_pair (p, hash, 
-            ({
-                x.address.data_u32 = p->key;
-                if (lm->fib_result_n_words > 1) {
-                    x.index = vec_len (results);
-                    vec_add (results, p->value, lm->fib_result_n_words);
-                }
-                else
-                    x.index = p->value[0];
-                
-                vec_add1 (routes, x);
-                if (sm->data_structure_lock->release_hint) {
-                    start_at_fib_index = fib - im4->fibs;
-                    dsunlock (sm);
-                    ip46_fib_stats_delay (sm, 0 /* sec */, 
-                                         STATS_RELEASE_DELAY_NS);
+        fib = vec_elt_at_index (im4->fibs, c->fib_index);
+        hash = fib->adj_index_by_dst_address[c->address_length];
+
+        if (hash_capacity (hash) != c->hash_capacity) {
+            c->slot = 0;
+            c->hash_capacity = hash_capacity (hash);
+        }
+
+        if (hash)
+            c->slot = ip4_fib_hash_collect (hash, c->slot, c->address_length,
+                                            lm, &routes, &results,
+                                            STATS_FIB_CHUNK_ROUTES);
+
+        if (c->slot >= c->hash_capacity) {
+            c->slot = c->hash_capacity = 0;
+            if (++c->address_length >= 
+                ARRAY_LEN (fib->adj_index_by_dst_address)) {
+                c->address_length = 0;
+                c->fib_index++;
+            }
+        }
+
+        vec_foreach (r, routes) {
+            adj_index = r->index;
+            if (lm->fib_result_n_words > 1)
+                adj_index = results[adj_index];
+
+            if (! stats_fib_route_sums (c, lm, adj_index, &sums))
+                continue;
+
+            vec_foreach (sum, sums) {
+                if (mp == 0) {
+                    mp = vl_msg_api_alloc_as_if_client 
+                        (sizeof(*mp) + 
+                         IP4_FIB_COUNTER_BATCH_SIZE * 
+                         sizeof(vl_api_ip4_fib_counter_t));
+                    mp->_vl_msg_id = ntohs (VL_API_VNET_IP4_FIB_COUNTERS);
                     mp->count = 0;
+                    mp->vrf_id = ntohl(fib->table_id);
                     ctrp = (vl_api_ip4_fib_counter_t *)mp->c;
-                    goto again;
                 }
-            }));
-        }
-      
-        vec_foreach (r, routes) {
-            vlib_counter_t c, sum;
-            uword i, j, n_left, n_nhs, adj_index, * result = 0;
-            ip_adjacency_t * adj;
-            ip_multipath_next_hop_t * nhs, tmp_nhs[1];
 
-            adj_index = r->index;
-            if (lm->fib_result_n_words > 1) {
-                result = vec_elt_at_index (results, adj_index);
-                adj_index = result[0];
-	    }
-
-            adj = ip_get_adjacency (lm, adj_index);
-            if (adj->n_adj == 1) {
-                nhs = &tmp_nhs[0];
-                nhs[0].next_hop_adj_index = ~0; /* not used */
-                nhs[0].weight = 1;
-                n_nhs = 1;
-	    } else {
-                ip_multipath_adjacency_t * madj;
-                madj = vec_elt_at_index (lm->multipath_adjacencies, 
-                                         adj->heap_handle);
-                nhs = heap_elt_at_index 
-                    (lm->next_hop_heap, 
-                     madj->normalized_next_hops.heap_offset);
-                n_nhs = madj->normalized_next_hops.count;
-	    }
-            
-            n_left = nhs[0].weight;
-            vlib_counter_zero (&sum);
-            for (i = j = 0; i < adj->n_adj; i++) {
-                n_left -= 1;
-                vlib_get_combined_counter (&lm->adjacency_counters, 
-                                           adj_index + i, &c);
-                vlib_counter_add (&sum, &c);
-                /* 
-                 * If we're done with this adj and it has actually
-                 * seen at least one packet, send it.
-                 */
-                if (n_left == 0 && sum.packets > 0) {
-                    
-                    /* already in net byte order */
-                    ctrp->address = r->address.as_u32;
-                    ctrp->address_length = r->address_length;
-                    ctrp->packets = clib_host_to_net_u64 (sum.packets);
-                    ctrp->bytes = clib_host_to_net_u64(sum.bytes);
-                    mp->count++;
-                    ctrp++;
-                    
-                    if (mp->count == items_this_message) {
-                        mp->count = htonl (items_this_message);
-                        /*
-                         * If the main thread's input queue is stuffed,
-                         * drop the data structure lock (which the main thread
-                         * may want), and take a pause.
-                         */
-                        unix_shared_memory_queue_lock (q);
-                        if (unix_shared_memory_queue_is_full (q)) {
-                            dsunlock (sm);
-                            vl_msg_api_send_shmem_nolock (q, (u8 *)&mp);
-                            unix_shared_memory_queue_unlock (q);
-                            mp = 0;
-                            ip46_fib_stats_delay (sm, 0 /* sec */, 
-                                                  STATS_RELEASE_DELAY_NS);
-                            goto again;
-                        } 
-                        vl_msg_api_send_shmem_nolock (q, (u8 *)&mp);
-                        unix_shared_memory_queue_unlock (q);
-                        
-                        items_this_message = IP4_FIB_COUNTER_BATCH_SIZE;
-                        mp = vl_msg_api_alloc_as_if_client 
-                            (sizeof(*mp) + 
-                             items_this_message*
-                             sizeof(vl_api_ip4_fib_counter_t));
-                        mp->_vl_msg_id = ntohs (VL_API_VNET_IP4_FIB_COUNTERS);
-                        mp->count = 0;
-                        mp->vrf_id = ntohl(fib->table_id);
-                        ctrp = (vl_api_ip4_fib_counter_t *)mp->c;
-                    }
-                    
-                    j++;
-                    if (j < n_nhs) {
-                        n_left = nhs[j].weight;
-                        vlib_counter_zero (&sum);
-		    }
-		}
-            } /* for each (mp or single) adj */
-            if (sm->data_structure_lock->release_hint) {
-                start_at_fib_index = fib - im4->fibs;
-                dsunlock (sm);
-                ip46_fib_stats_delay (sm, 0 /* sec */, STATS_RELEASE_DELAY_NS);
-                mp->count = 0;
-                ctrp = (vl_api_ip4_fib_counter_t *)mp->c;
-                goto again;
+                /* already in net byte order */
+                ctrp->address = r->address.as_u32;
+                ctrp->address_length = r->address_length;
+                ctrp->packets = clib_host_to_net_u64 (sum->packets);
+                ctrp->bytes = clib_host_to_net_u64(sum->bytes);
+                mp->count++;
+                ctrp++;
+
+                if (mp->count == IP4_FIB_COUNTER_BATCH_SIZE)
+                    stats_fib_msg_done (mps, mp);
             }
-        } /* vec_foreach (routes) */      
-        
-        dsunlock(sm);
-
-        /* Flush any data from this fib */
-        if (mp->count) {
-            mp->count = htonl (mp->count);
-            vl_msg_api_send_shmem (q, (u8 *)&mp);
-            mp = 0;
-        } 
-    } /* vec_foreach (fib) */
-    /* If e.g. the last FIB had no reportable routes, free the buffer */
-    if (mp)
-        vl_msg_api_free (mp);
+        }
+        stats_fib_msg_done (mps, mp);
+
+        n_routes_this_tick += vec_len (routes);
+
+        /* The main thread wants the lock, give it a moment */
+        if (sm->data_structure_lock->release_hint) {
+            dsunlock (sm);
+            stats_fib_send (sm, mps);
+            ip46_fib_stats_delay (sm, 0 /* sec */, STATS_RELEASE_DELAY_NS);
+            continue;
+        }
+
+        dsunlock (sm);
+        stats_fib_send (sm, mps);
+    }
 }
 
-typedef struct {
-  ip6_address_t address;
-  u32 address_length;
-  u32 index;
-} ip6_route_t;
+static int ip6_route_sort_by_fib_index (void * a1, void * a2)
+{
+    ip6_route_t * r1 = a1, * r2 = a2;
 
-typedef struct {
-  u32 fib_index;
-  ip6_route_t ** routep;
-  stats_main_t * sm;
-} add_routes_in_fib_arg_t;
+    return (int) r1->fib_index - (int) r2->fib_index;
+}
 
-static void add_routes_in_fib (BVT(clib_bihash_kv) * kvp, void *arg)
+/* Routes in ip6 lookup bihash buckets [bucket, ...), all fibs at once */
+static uword 
+ip6_fib_bihash_collect (BVT(clib_bihash) * h, uword bucket,
+                        ip6_route_t ** routes, uword max_routes)
 {
-  add_routes_in_fib_arg_t * ap = arg;
-  stats_main_t * sm = ap->sm;
+    clib_bihash_bucket_t * b;
+    BVT(clib_bihash_value) * v;
+    ip6_route_t * r;
+    int j, k;
 
-  if (sm->data_structure_lock->release_hint)
-    clib_longjmp (&sm->jmp_buf, 1);
+    for (; bucket < h->nbuckets && vec_len (*routes) < max_routes; bucket++) {
+        b = &h->buckets[bucket];
+        if (b->offset == 0)
+            continue;
 
-  if (kvp->key[2]>>32 == ap->fib_index)
-    {
-      ip6_address_t *addr;
-      ip6_route_t * r;
-      addr = (ip6_address_t *) kvp;
-      vec_add2 (*ap->routep, r, 1);
-      r->address = addr[0];
-      r->address_length = kvp->key[2] & 0xFF;
-      r->index = kvp->value;
+        v = BV(clib_bihash_get_value) (h, b->offset);
+        for (j = 0; j < (1<<b->log2_pages); j++, v++) {
+            for (k = 0; k < BIHASH_KVP_PER_PAGE; k++) {
+                if (BV(clib_bihash_is_free)(&v->kvp[k]))
+                    continue;
+
+                vec_add2 (*routes, r, 1);
+                r->address.as_u64[0] = v->kvp[k].key[0];
+                r->address.as_u64[1] = v->kvp[k].key[1];
+                r->address_length = v->kvp[k].key[2] & 0xFF;
+                r->fib_index = v->kvp[k].key[2] >> 32;
+                r->index = v->kvp[k].value;
+            }
+        }
     }
+
+    return bucket;
 }
 
+/*
+ * ip6 FIB counters. All fibs share one bihash, so the cursor is a
+ * bucket index and a chunk may span fibs; routes are grouped per fib
+ * before they go into messages.
+ */
 static void do_ip6_fibs (stats_main_t * sm)
 {
+    stats_fib_cursor_t * c = &sm->ip6_fib_cursor;
     ip6_main_t * im6 = &ip6_main;
-    api_main_t * am = sm->api_main;
-    vl_shmem_hdr_t *shmem_hdr = am->shmem_hdr;
-    unix_shared_memory_queue_t * q = shmem_hdr->vl_input_queue;
+    ip_lookup_main_t * lm = &im6->lookup_main;
+    BVT(clib_bihash) * h = &im6->ip6_lookup_table;
     static ip6_route_t * routes;
+    static vlib_counter_t * sums;
+    static void ** mps;
+    vl_api_vnet_ip6_fib_counters_t * mp;
+    vl_api_ip6_fib_counter_t *ctrp = 0;
     ip6_route_t * r;
     ip6_fib_t * fib;
-    ip_lookup_main_t * lm = &im6->lookup_main;
-    static uword * results;
-    vl_api_vnet_ip6_fib_counters_t * mp = 0;
-    u32 items_this_message;
-    vl_api_ip6_fib_counter_t *ctrp = 0;
-    u32 start_at_fib_index = 0;
-    BVT(clib_bihash) * h = &im6->ip6_lookup_table;
-    add_routes_in_fib_arg_t _a, *a=&_a;
-
-again:
-    vec_foreach (fib, im6->fibs) {
-        /* We may have bailed out due to control-plane activity */
-        while ((fib - im6->fibs) < start_at_fib_index)
-            continue;
+    vlib_counter_t * sum;
+    uword n_routes_this_tick = 0;
 
-        if (mp == 0) {
-            items_this_message = IP6_FIB_COUNTER_BATCH_SIZE;
-            mp = vl_msg_api_alloc_as_if_client 
-                (sizeof(*mp) + 
-                 items_this_message*sizeof(vl_api_ip6_fib_counter_t));
-            mp->_vl_msg_id = ntohs (VL_API_VNET_IP6_FIB_COUNTERS);
-            mp->count = 0;
-            mp->vrf_id = ntohl(fib->table_id);
-            ctrp = (vl_api_ip6_fib_counter_t *)mp->c;
-        }
+    if (! stats_fib_cursor_start (sm, c))
+        return;
 
-        dslock (sm, 0 /* release hint */, 1 /* tag */);
-      
+    while (n_routes_this_tick < STATS_FIB_ROUTES_PER_TICK) {
         vec_reset_length (routes);
-        vec_reset_length (results);
+        vec_reset_length (mps);
+        mp = 0;
 
-        a->fib_index = fib - im6->fibs;
-        a->routep = &routes;
-        a->sm = sm;
+        dslock (sm, 0 /* release hint */, 1 /* tag */);
 
-        if (clib_setjmp(&sm->jmp_buf, 0) == 0)
-          {
-            start_at_fib_index = fib - im6->fibs;
-            BV(clib_bihash_foreach_key_value_pair)(h, add_routes_in_fib, a);
-          }
-        else
-          {
+        if (c->slot >= h->nbuckets) {
             dsunlock (sm);
-            ip46_fib_stats_delay (sm, 0 /* sec */, 
-                                  STATS_RELEASE_DELAY_NS);
-            mp->count = 0;
-            ctrp = (vl_api_ip6_fib_counter_t *)mp->c;
-            goto again;
-          }
+            stats_fib_cursor_done (c);
+            break;
+        }
+
+        c->slot = ip6_fib_bihash_collect (h, c->slot, &routes, 
+                                          STATS_FIB_CHUNK_ROUTES);
+        vec_sort_with_function (routes, ip6_route_sort_by_fib_index);
 
         vec_foreach (r, routes) {
-            vlib_counter_t c, sum;
-            uword i, j, n_left, n_nhs, adj_index, * result = 0;
-            ip_adjacency_t * adj;
-            ip_multipath_next_hop_t * nhs, tmp_nhs[1];
+            if (r->fib_index >= vec_len (im6->fibs))
+                continue;
+            fib = vec_elt_at_index (im6->fibs, r->fib_index);
+
+            if (! stats_fib_route_sums (c, lm, r->index, &sums))
+                continue;
+
+            vec_foreach (sum, sums) {
+                if (mp && mp->vrf_id != ntohl (fib->table_id))
+                    stats_fib_msg_done (mps, mp);
+
+                if (mp == 0) {
+                    mp = vl_msg_api_alloc_as_if_client 
+                        (sizeof(*mp) + 
+                         IP6_FIB_COUNTER_BATCH_SIZE *
+                         sizeof(vl_api_ip6_fib_counter_t));
+                    mp->_vl_msg_id = ntohs (VL_API_VNET_IP6_FIB_COUNTERS);
+                    mp->count = 0;
+                    mp->vrf_id = ntohl(fib->table_id);
+                    ctrp = (vl_api_ip6_fib_counter_t *)mp->c;
+                }
 
-            adj_index = r->index;
-            if (lm->fib_result_n_words > 1) {
-                result = vec_elt_at_index (results, adj_index);
-                adj_index = result[0];
-	    }
-
-            adj = ip_get_adjacency (lm, adj_index);
-            if (adj->n_adj == 1) {
-                nhs = &tmp_nhs[0];
-                nhs[0].next_hop_adj_index = ~0; /* not used */
-                nhs[0].weight = 1;
-                n_nhs = 1;
-	    } else {
-                ip_multipath_adjacency_t * madj;
-                madj = vec_elt_at_index (lm->multipath_adjacencies, 
-                                         adj->heap_handle);
-                nhs = heap_elt_at_index 
-                    (lm->next_hop_heap, 
-                     madj->normalized_next_hops.heap_offset);
-                n_nhs = madj->normalized_next_hops.count;
-	    }
-            
-            n_left = nhs[0].weight;
-            vlib_counter_zero (&sum);
-            for (i = j = 0; i < adj->n_adj; i++) {
-                n_left -= 1;
-                vlib_get_combined_counter (&lm->adjacency_counters, 
-                                           adj_index + i, &c);
-                vlib_counter_add (&sum, &c);
-                if (n_left == 0 && sum.packets > 0) {
-                    
-                    /* already in net byte order */
-                    ctrp->address[0] = r->address.as_u64[0];
-                    ctrp->address[1] = r->address.as_u64[1];
-                    ctrp->address_length = (u8) r->address_length;
-                    ctrp->packets = clib_host_to_net_u64 (sum.packets);
-                    ctrp->bytes = clib_host_to_net_u64(sum.bytes);
-                    mp->count++;
-                    ctrp++;
-                    
-                    if (mp->count == items_this_message) {
-                        mp->count = htonl (items_this_message);
-                        /*
-                         * If the main thread's input queue is stuffed,
-                         * drop the data structure lock (which the main thread
-                         * may want), and take a pause.
-                         */
-                        unix_shared_memory_queue_lock (q);
-                        if (unix_shared_memory_queue_is_full (q)) {
-                            dsunlock (sm);
-                            vl_msg_api_send_shmem_nolock (q, (u8 *)&mp);
-                            unix_shared_memory_queue_unlock (q);
-                            mp = 0;
-                            ip46_fib_stats_delay (sm, 0 /* sec */, 
-                                                  STATS_RELEASE_DELAY_NS);
-                            goto again;
-                        } 
-                        vl_msg_api_send_shmem_nolock (q, (u8 *)&mp);
-                        unix_shared_memory_queue_unlock (q);
-
-                        items_this_message = IP6_FIB_COUNTER_BATCH_SIZE;
-                        mp = vl_msg_api_alloc_as_if_client 
-                            (sizeof(*mp) + 
-                             items_this_message*
-                             sizeof(vl_api_ip6_fib_counter_t));
-                        mp->_vl_msg_id = ntohs (VL_API_VNET_IP6_FIB_COUNTERS);
-                        mp->count = 0;
-                        mp->vrf_id = ntohl(fib->table_id);
-                        ctrp = (vl_api_ip6_fib_counter_t *)mp->c;
-                    }
-                    
-                    j++;
-                    if (j < n_nhs) {
-                        n_left = nhs[j].weight;
-                        vlib_counter_zero (&sum);
-		    }
-		}
-            } /* for each (mp or single) adj */
-            if (sm->data_structure_lock->release_hint) {
-                start_at_fib_index = fib - im6->fibs;
-                dsunlock (sm);
-                ip46_fib_stats_delay (sm, 0 /* sec */, STATS_RELEASE_DELAY_NS);
-                mp->count = 0;
-                ctrp = (vl_api_ip6_fib_counter_t *)mp->c;
-                goto again;
+                /* already in net byte order */
+                ctrp->address[0] = r->address.as_u64[0];
+                ctrp->address[1] = r->address.as_u64[1];
+                ctrp->address_length = (u8) r->address_length;
+                ctrp->packets = clib_host_to_net_u64 (sum->packets);
+                ctrp->bytes = clib_host_to_net_u64(sum->bytes);
+                mp->count++;
+                ctrp++;
+
+                if (mp->count == IP6_FIB_COUNTER_BATCH_SIZE)
+                    stats_fib_msg_done (mps, mp);
             }
-        } /* vec_foreach (routes) */      
-        
-        dsunlock(sm);
+        }
+        stats_fib_msg_done (mps, mp);
+
+        n_routes_this_tick += vec_len (routes);
 
-        /* Flush any data from this fib */
-        if (mp->count) {
-            mp->count = htonl (mp->count);
-            vl_msg_api_send_shmem (q, (u8 *)&mp);
-            mp = 0;
+        if (sm->data_structure_lock->release_hint) {
+            dsunlock (sm);
+            stats_fib_send (sm, mps);
+            ip46_fib_stats_delay (sm, 0 /* sec */, STATS_RELEASE_DELAY_NS);
+            continue;
         }
-    } /* vec_foreach (fib) */
-    /* If e.g. the last FIB had no reportable routes, free the buffer */
-    if (mp) 
-        vl_msg_api_free (mp);
+
+        dsunlock (sm);
+        stats_fib_send (sm, mps);
+    }
 }
 
 static void stats_thread_fn (void *arg)
@@ -615,6 +663,7 @@ static void stats_thread_fn (void *arg)
     stats_main_t *sm = &stats_main;
     vlib_worker_thread_t *w = (vlib_worker_thread_t *)arg;
     vlib_thread_main_t *tm = vlib_get_thread_main();
+    f64 next_poll_time = 0;
     
     /* stats thread wants no signals. */
     {
@@ -630,13 +679,21 @@ static void stats_thread_fn (void *arg)
     clib_mem_set_heap (w->thread_mheap);
 
     while (1) {
-        /* 10 second poll interval */
-        ip46_fib_stats_delay (sm, 10 /* secs */, 0 /* nsec */);
+        /* 
+         * Interface counters every poll interval; FIB passes start at
+         * the same rate but may take several ticks to finish.
+         */
+        ip46_fib_stats_delay (sm, STATS_TICK_SECONDS, 0 /* nsec */);
 
         if (! (sm->enable_poller))
             continue;
-        do_simple_interface_counters (sm);
-        do_combined_interface_counters (sm);
+
+        if (unix_time_now () >= next_poll_time) {
+            next_poll_time = unix_time_now () + 
+                sm->stats_poll_interval_in_seconds;
+            do_simple_interface_counters (sm);
+            do_combined_interface_counters (sm);
+        }
         do_ip4_fibs (sm);
         do_ip6_fibs (sm);
     }
@@ -664,7 +721,7 @@ static void vl_api_vnet_interface_counters_t_handler (
     ({
         q = vl_api_client_index_to_input_queue (reg->client_index);
         if (q) {
-            if (q_prev && (q_prev->cursize < q_prev->maxsize)) {
+            if (q_prev && !unix_shared_memory_queue_is_full (q_prev)) {
                 mp_copy = vl_msg_api_alloc_as_if_client(mp_size);
                 clib_memcpy(mp_copy, mp, mp_size);
                 vl_msg_api_send_shmem (q_prev, (u8 *)&mp);
@@ -751,7 +808,7 @@ static void vl_api_vnet_interface_counters_t_handler (
     }
 #endif
     if (q_prev &&
-        (q_prev->cursize < q_prev->maxsize)) {
+        !unix_shared_memory_queue_is_full (q_prev)) {
             vl_msg_api_send_shmem (q_prev, (u8 *)&mp);
     } else {
         vl_msg_api_free (mp);
@@ -774,7 +831,7 @@ static void vl_api_vnet_ip4_fib_counters_t_handler (
     ({
         q = vl_api_client_index_to_input_queue (reg->client_index);
         if (q) {
-            if (q_prev && (q_prev->cursize < q_prev->maxsize)) {
+            if (q_prev && !unix_shared_memory_queue_is_full (q_prev)) {
                 mp_copy = vl_msg_api_alloc_as_if_client(mp_size);
                 clib_memcpy(mp_copy, mp, mp_size);
                 vl_msg_api_send_shmem (q_prev, (u8 *)&mp);
@@ -784,7 +841,7 @@ static void vl_api_vnet_ip4_fib_counters_t_handler (
         }
     }));
     if (q_prev &&
-        (q_prev->cursize < q_prev->maxsize)) {
+        !unix_shared_memory_queue_is_full (q_prev)) {
             vl_msg_api_send_shmem (q_prev, (u8 *)&mp);
     } else {
         vl_msg_api_free (mp);
@@ -807,7 +864,7 @@ static void vl_api_vnet_ip6_fib_counters_t_handler (
     ({
         q = vl_api_client_index_to_input_queue (reg->client_index);
         if (q) {
-            if (q_prev && (q_prev->cursize < q_prev->maxsize)) {
+            if (q_prev && !unix_shared_memory_queue_is_full (q_prev)) {
                 mp_copy = vl_msg_api_alloc_as_if_client(mp_size);
                 clib_memcpy(mp_copy, mp, mp_size);
                 vl_msg_api_send_shmem (q_prev, (u8 *)&mp);
@@ -817,7 +874,7 @@ static void vl_api_vnet_ip6_fib_counters_t_handler (
         }
     }));
     if (q_prev &&
-        (q_prev->cursize < q_prev->maxsize)) {
+        !unix_shared_memory_queue_is_full (q_prev)) {
             vl_msg_api_send_shmem (q_prev, (u8 *)&mp);
     } else {
         vl_msg_api_free (mp);
@@ -861,6 +918,10 @@ static void vl_api_want_stats_t_handler (
     hash_set (sm->stats_registration_hash, rp->client_index, 
               rp - sm->stats_registrations);
 
+    /* FIB counters go out as deltas, a new listener needs them all once */
+    sm->ip4_fib_cursor.full_cycle_requested = 1;
+    sm->ip6_fib_cursor.full_cycle_requested = 1;
+
 reply:
     if (pool_elts(sm->stats_registrations))
         sm->enable_poller = 1;
@@ -901,6 +962,271 @@ int stats_memclnt_delete_callback (u32 client_index)
 #define vl_api_vnet_ip6_fib_counters_t_endian vl_noop_handler
 #define vl_api_vnet_ip6_fib_counters_t_print vl_noop_handler
 
+/*
+ * Stats segment writer.  It runs as a process on the main thread, so
+ * the node, error and counter vectors cannot be resized while they are
+ * walked; the per-thread counters themselves are summed without
+ * stopping the workers.
+ */
+
+/* Grow a segment vector to n elements, segment vectors never shrink */
+#define stats_segment_vec_validate(sm,v,n)                      \
+do {                                                            \
+    if ((n) > vec_len (v)) {                                    \
+        void * _oldheap = ssvm_push_heap ((sm)->segment.sh);    \
+        vec_validate ((v), (n) - 1);                            \
+        ssvm_pop_heap (_oldheap);                               \
+    }                                                           \
+} while (0)
+
+static stats_segment_entry_t *
+stats_segment_entry (stats_main_t * sm, char * name, u32 type)
+{
+    stats_segment_shared_header_t * hdr = sm->segment_header;
+    stats_segment_entry_t * e;
+    void * oldheap;
+    uword * p;
+    u8 * key;
+
+    p = hash_get_mem (sm->segment_entry_by_name, name);
+    if (p)
+        return vec_elt_at_index (hdr->directory, p[0]);
+
+    oldheap = ssvm_push_heap (sm->segment.sh);
+    vec_add2 (hdr->directory, e, 1);
+    ssvm_pop_heap (oldheap);
+
+    memset (e, 0, sizeof (*e));
+    strncpy ((char *) e->name, name, ARRAY_LEN (e->name) - 1);
+    e->type = type;
+
+    key = format (0, "%s%c", name, 0);
+    hash_set_mem (sm->segment_entry_by_name, key, e - hdr->directory);
+    return e;
+}
+
+static void
+stats_segment_set_name (stats_segment_name_t * n, u8 * name)
+{
+    memset (n->name, 0, sizeof (n->name));
+    strncpy ((char *) n->name, (char *) name, ARRAY_LEN (n->name) - 1);
+}
+
+static void
+stats_segment_node_stats (vlib_main_t * vm, u32 node_index,
+                          vlib_node_stats_t * s)
+{
+    vlib_node_t * n = vlib_get_node (vm, node_index);
+    vlib_node_runtime_t * r;
+
+    s->calls = n->stats_total.calls - n->stats_last_clear.calls;
+    s->vectors = n->stats_total.vectors - n->stats_last_clear.vectors;
+    s->clocks = n->stats_total.clocks - n->stats_last_clear.clocks;
+    s->suspends = n->stats_total.suspends - n->stats_last_clear.suspends;
+
+    /* Add what the runtime has not folded into the totals yet */
+    if (n->type == VLIB_NODE_TYPE_PROCESS)
+        return;
+
+    r = vec_elt_at_index (vm->node_main.nodes_by_type[n->type],
+                          n->runtime_index);
+    s->calls += r->calls_since_last_overflow;
+    s->vectors += r->vectors_since_last_overflow;
+    s->clocks += r->clocks_since_last_overflow;
+}
+
+static void stats_segment_update (stats_main_t * sm)
+{
+    vlib_main_t * vm = sm->vlib_main;
+    vnet_interface_main_t * im = sm->interface_main;
+    vlib_error_main_t * em = &vm->error_main;
+    stats_segment_shared_header_t * hdr = sm->segment_header;
+    vlib_simple_counter_main_t * scm;
+    vlib_combined_counter_main_t * ccm;
+    stats_segment_entry_t * e, * calls, * vectors, * clocks, * suspends;
+    stats_segment_combined_t * cv;
+    stats_segment_name_t * nv;
+    vlib_node_stats_t ns;
+    vlib_counter_t v;
+    vlib_node_t * n;
+    u64 * sv;
+    u8 * name = 0;
+    u32 i, n_elts, n_old, code;
+
+    hdr->epoch++;
+    CLIB_MEMORY_BARRIER();
+
+    e = stats_segment_entry (sm, "/sys/heartbeat", STATS_SEGMENT_ENTRY_SCALAR);
+    e->value++;
+
+    /* FIB counter export progress, written by the stats thread */
+#define _(af,x)                                                 \
+    e = stats_segment_entry (sm, "/fib/" #af "/" #x,            \
+                             STATS_SEGMENT_ENTRY_SCALAR);       \
+    e->value = sm->af##_fib_cursor.n_##x;
+    _(ip4, cycles) _(ip4, routes_exported) _(ip4, routes_unchanged)
+    _(ip6, cycles) _(ip6, routes_exported) _(ip6, routes_unchanged)
+#undef _
+
+    /* Interface names, indexed by sw_if_index; slots can be reused */
+    n_elts = vec_len (im->sw_interfaces);
+    e = stats_segment_entry (sm, "/if/names", STATS_SEGMENT_ENTRY_NAMES);
+    nv = e->data;
+    stats_segment_vec_validate (sm, nv, n_elts);
+    for (i = 0; i < n_elts; i++) {
+        if (pool_is_free_index (im->sw_interfaces, i))
+            name = format (name, "%c", 0);
+        else
+            name = format (name, "%U%c", format_vnet_sw_if_index_name,
+                           sm->vnet_main, i, 0);
+        stats_segment_set_name (&nv[i], name);
+        vec_reset_length (name);
+    }
+    e->data = nv;
+
+    vec_foreach (scm, im->sw_if_counters) {
+        name = format (name, "/if/%s%c", scm->name, 0);
+        e = stats_segment_entry (sm, (char *) name,
+                                 STATS_SEGMENT_ENTRY_SIMPLE);
+        vec_reset_length (name);
+
+        n_elts = vlib_counter_len (scm);
+        sv = e->data;
+        stats_segment_vec_validate (sm, sv, n_elts);
+        for (i = 0; i < n_elts; i++)
+            sv[i] = vlib_get_simple_counter (scm, i);
+        e->data = sv;
+    }
+
+    vec_foreach (ccm, im->combined_sw_if_counters) {
+        name = format (name, "/if/%s%c", ccm->name, 0);
+        e = stats_segment_entry (sm, (char *) name,
+                                 STATS_SEGMENT_ENTRY_COMBINED);
+        vec_reset_length (name);
+
+        n_elts = vlib_counter_len (ccm);
+        cv = e->data;
+        stats_segment_vec_validate (sm, cv, n_elts);
+        for (i = 0; i < n_elts; i++) {
+            vlib_get_combined_counter (ccm, i, &v);
+            cv[i].packets = v.packets;
+            cv[i].bytes = v.bytes;
+        }
+        e->data = cv;
+    }
+
+    /* Node names never change, only name the new ones */
+    n_elts = vec_len (vm->node_main.nodes);
+    e = stats_segment_entry (sm, "/node/names", STATS_SEGMENT_ENTRY_NAMES);
+    nv = e->data;
+    n_old = vec_len (nv);
+    stats_segment_vec_validate (sm, nv, n_elts);
+    for (i = n_old; i < n_elts; i++) {
+        n = vlib_get_node (vm, i);
+        name = format (name, "%v%c", n->name, 0);
+        stats_segment_set_name (&nv[i], name);
+        vec_reset_length (name);
+    }
+    e->data = nv;
+
+    /*
+     * Creating an entry can reallocate the directory, so create all
+     * four before holding pointers to any of them.
+     */
+#define _(x) stats_segment_entry (sm, "/node/" #x, STATS_SEGMENT_ENTRY_SIMPLE);
+    _(calls) _(vectors) _(clocks) _(suspends)
+#undef _
+
+#define _(x)                                                    \
+    x = stats_segment_entry (sm, "/node/" #x,                   \
+                             STATS_SEGMENT_ENTRY_SIMPLE);       \
+    sv = x->data;                                               \
+    stats_segment_vec_validate (sm, sv, n_elts);                \
+    memset (sv, 0, n_elts * sizeof (sv[0]));                    \
+    x->data = sv;
+    _(calls) _(vectors) _(clocks) _(suspends)
+#undef _
+
+    foreach_vlib_main (({
+        u32 n_this = clib_min (n_elts,
+                               vec_len (this_vlib_main->node_main.nodes));
+        for (i = 0; i < n_this; i++) {
+            stats_segment_node_stats (this_vlib_main, i, &ns);
+            ((u64 *) calls->data)[i] += ns.calls;
+            ((u64 *) vectors->data)[i] += ns.vectors;
+            ((u64 *) clocks->data)[i] += ns.clocks;
+            ((u64 *) suspends->data)[i] += ns.suspends;
+        }
+    }));
+
+    /* Error counters, indexed by error heap index */
+    n_elts = vec_len (em->counters);
+    e = stats_segment_entry (sm, "/err/names", STATS_SEGMENT_ENTRY_NAMES);
+    nv = e->data;
+    n_old = vec_len (nv);
+    stats_segment_vec_validate (sm, nv, n_elts);
+    if (n_old < n_elts) {
+        for (i = 0; i < vec_len (vm->node_main.nodes); i++) {
+            n = vlib_get_node (vm, i);
+            for (code = 0; code < n->n_errors; code++) {
+                u32 ei = n->error_heap_index + code;
+                if (ei < n_old || ei >= n_elts)
+                    continue;
+                name = format (name, "%v/%s%c", n->name,
+                               em->error_strings_heap[ei], 0);
+                stats_segment_set_name (&nv[ei], name);
+                vec_reset_length (name);
+            }
+        }
+    }
+    e->data = nv;
+
+    e = stats_segment_entry (sm, "/err/counters", STATS_SEGMENT_ENTRY_SIMPLE);
+    sv = e->data;
+    stats_segment_vec_validate (sm, sv, n_elts);
+    memset (sv, 0, n_elts * sizeof (sv[0]));
+    foreach_vlib_main (({
+        vlib_error_main_t * tem = &this_vlib_main->error_main;
+        u32 n_this = clib_min (n_elts, vec_len (tem->counters));
+        for (i = 0; i < n_this; i++) {
+            sv[i] += tem->counters[i];
+            if (i < vec_len (tem->counters_last_clear))
+                sv[i] -= tem->counters_last_clear[i];
+        }
+    }));
+    e->data = sv;
+
+    vec_free (name);
+
+    hdr->update_time = vlib_time_now (vm);
+    CLIB_MEMORY_BARRIER();
+    hdr->epoch++;
+}
+
+static uword
+stats_segment_process (vlib_main_t * vm,
+                       vlib_node_runtime_t * rt,
+                       vlib_frame_t * f)
+{
+    stats_main_t * sm = &stats_main;
+
+    if (sm->segment_header == 0)
+        return 0;
+
+    while (1) {
+        vlib_process_suspend (vm, sm->segment_update_interval);
+        stats_segment_update (sm);
+    }
+
+    return 0; /* not so much */
+}
+
+VLIB_REGISTER_NODE (stats_segment_process_node,static) = {
+    .function = stats_segment_process,
+    .type = VLIB_NODE_TYPE_PROCESS,
+    .name = "stats-segment-process",
+};
+
 static clib_error_t * stats_init (vlib_main_t * vm)
 {
     stats_main_t * sm = &stats_main;
@@ -937,6 +1263,94 @@ static clib_error_t * stats_init (vlib_main_t * vm)
 
 VLIB_INIT_FUNCTION (stats_init);
 
+/*
+ * stats {
+ *   segment [name <name>] [size <bytes>] [base-va <addr>] [interval <sec>]
+ * }
+ */
+static clib_error_t *
+stats_config (vlib_main_t * vm, unformat_input_t * input)
+{
+    stats_main_t * sm = &stats_main;
+    ssvm_shared_header_t * sh;
+    stats_segment_shared_header_t * hdr;
+    u8 * name = 0;
+    uword size = 32<<20;
+    u64 base_va = 0x580000000ULL;
+    f64 interval = 1.0;
+    int enable = 0;
+    void * oldheap;
+    int rv;
+
+    while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT) {
+        if (unformat (input, "segment"))
+            enable = 1;
+        else if (unformat (input, "name %s", &name))
+            ;
+        else if (unformat (input, "size %U", unformat_memory_size, &size))
+            ;
+        else if (unformat (input, "base-va %llx", &base_va))
+            ;
+        else if (unformat (input, "interval %f", &interval))
+            ;
+        else
+            return clib_error_return (0, "unknown input `%U'",
+                                      format_unformat_error, input);
+    }
+
+    if (! enable) {
+        vec_free (name);
+        return 0;
+    }
+
+    if (name == 0)
+        name = format (0, "vpp-stats");
+    vec_add1 (name, 0);
+
+    sm->segment.name = name;
+    sm->segment.ssvm_size = size;
+    sm->segment.requested_va = base_va;
+    sm->segment.i_am_master = 1;
+    sm->segment.my_pid = getpid();
+
+    rv = ssvm_master_init (&sm->segment, 0 /* master index */);
+    if (rv < 0)
+        return clib_error_return (0, "stats segment '%s' create failed, "
+                                  "error %d", name, rv);
+
+    sh = sm->segment.sh;
+    oldheap = ssvm_push_heap (sh);
+    hdr = clib_mem_alloc_aligned (sizeof (*hdr), CLIB_CACHE_LINE_BYTES);
+    memset (hdr, 0, sizeof (*hdr));
+    ssvm_pop_heap (oldheap);
+
+    sh->opaque[STATS_SEGMENT_OPAQUE_INDEX] = hdr;
+    sm->segment_header = hdr;
+    sm->segment_entry_by_name = hash_create_string (0, sizeof (uword));
+    sm->segment_update_interval = interval;
+
+    /* Let readers in */
+    sh->ready = 1;
+
+    return 0;
+}
+
+VLIB_CONFIG_FUNCTION (stats_config, "stats");
+
+static clib_error_t * stats_exit (vlib_main_t * vm)
+{
+    stats_main_t * sm = &stats_main;
+
+    if (sm->segment_header) {
+        shm_unlink ((char *) sm->segment.name);
+        munmap ((void *) sm->segment.sh, sm->segment.ssvm_size);
+        sm->segment_header = 0;
+    }
+    return 0;
+}
+
+VLIB_MAIN_LOOP_EXIT_FUNCTION (stats_exit);
+
 VLIB_REGISTER_THREAD (stats_thread_reg, static) = {
     .name = "stats",
     .function = stats_thread_fn,
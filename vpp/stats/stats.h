@@ -24,6 +24,10 @@
 #include <vlib/unix/unix.h>
 #include <vlibmemory/api.h>
 #include <vlibmemory/unix_shared_memory_queue.h>
+/* svm.h and ssvm.h disagree on MMAP_PAGESIZE, nothing here uses it */
+#undef MMAP_PAGESIZE
+#include <ssvm.h>
+#include <stats/stats_segment.h>
 
 typedef struct {
     u32 client_index;           /* in memclnt registration pool */
@@ -38,6 +42,32 @@ typedef struct {
     int tag;
 } data_structure_lock_t;
 
+/* Resumable walk over the ip4 or ip6 FIB, see do_ip4_fibs / do_ip6_fibs */
+typedef struct {
+    /* ip4: fib, prefix length and slot of the next hash to look at */
+    u32 fib_index;
+    u32 address_length;
+    uword hash_capacity;
+
+    /* ip4: hash slot, ip6: bihash bucket */
+    uword slot;
+
+    int in_cycle;
+    f64 next_cycle_time;
+
+    /* Export every route this pass, not only the ones that moved */
+    int full_cycle;
+    int full_cycle_requested;
+
+    /* Adjacency packet counts seen by the last and by this pass */
+    u64 * last_packets_by_adj;
+    u64 * this_packets_by_adj;
+
+    u64 n_cycles;
+    u64 n_routes_exported;
+    u64 n_routes_unchanged;
+} stats_fib_cursor_t;
+
 typedef struct {
     void *mheap;
     pthread_t thread_self;
@@ -52,8 +82,15 @@ typedef struct {
     /* control-plane data structure lock */
     data_structure_lock_t * data_structure_lock;
 
-    /* bail out of FIB walk if set */
-    clib_longjmp_t jmp_buf;
+    /* FIB counter export cursors */
+    stats_fib_cursor_t ip4_fib_cursor;
+    stats_fib_cursor_t ip6_fib_cursor;
+
+    /* shared memory stats segment, see stats_segment.h */
+    ssvm_private_t segment;
+    stats_segment_shared_header_t * segment_header;
+    uword * segment_entry_by_name;
+    f64 segment_update_interval;
 
     /* convenience */
     vlib_main_t * vlib_main;
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2016 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __included_stats_segment_h__
+#define __included_stats_segment_h__
+
+#include <vppinfra/clib.h>
+#include <vppinfra/vec.h>
+
+/*
+ * Shared memory stats segment.
+ *
+ * vpp publishes interface, node and error counters, and the progress
+ * of the FIB counter export, into an ssvm segment.  Readers map it
+ * with ssvm_slave_init (same virtual address as vpp), find the header
+ * in sh->opaque[STATS_SEGMENT_OPAQUE_INDEX] and walk the directory; no
+ * API messages, no locks.
+ *
+ * The writer makes the epoch odd before it touches the segment and
+ * even again when it is done.  A reader takes the epoch with
+ * stats_segment_read_begin, copies what it needs, and starts over if
+ * stats_segment_read_retry says the epoch moved.  Vectors may be
+ * reallocated underneath a reader, so every vector pointer read from
+ * the segment goes through stats_segment_vec_valid before it is used.
+ */
+
+#define STATS_SEGMENT_OPAQUE_INDEX	0
+#define STATS_SEGMENT_NAME_LEN		64
+
+#define foreach_stats_segment_entry_type				\
+_(SCALAR, "scalar")		/* value */				\
+_(SIMPLE, "simple")		/* u64 vector */			\
+_(COMBINED, "combined")		/* vlib_counter_t style vector */	\
+_(NAMES, "names")		/* stats_segment_name_t vector */
+
+typedef enum {
+#define _(n,s) STATS_SEGMENT_ENTRY_##n,
+  foreach_stats_segment_entry_type
+#undef _
+} stats_segment_entry_type_t;
+
+typedef struct {
+  u8 name[STATS_SEGMENT_NAME_LEN];
+} stats_segment_name_t;
+
+typedef struct {
+  u64 packets, bytes;
+} stats_segment_combined_t;
+
+typedef struct {
+  u8 name[STATS_SEGMENT_NAME_LEN];
+  u32 type;
+  union {
+    u64 value;
+    void * data;
+  };
+} stats_segment_entry_t;
+
+typedef struct {
+  /* Odd while the writer is updating the segment */
+  volatile u64 epoch;
+
+  /* vpp clock at the last update */
+  f64 update_time;
+
+  /* Vector of entries, see the entry types above */
+  stats_segment_entry_t * directory;
+} stats_segment_shared_header_t;
+
+always_inline u64
+stats_segment_read_begin (stats_segment_shared_header_t * hdr)
+{
+  u64 epoch;
+
+  while ((epoch = hdr->epoch) & 1)
+    ;
+  CLIB_MEMORY_BARRIER();
+  return epoch;
+}
+
+always_inline int
+stats_segment_read_retry (stats_segment_shared_header_t * hdr, u64 epoch)
+{
+  CLIB_MEMORY_BARRIER();
+  return hdr->epoch != epoch;
+}
+
+/* base and size describe the mapping, i.e. the ssvm header and its size */
+always_inline int
+stats_segment_vec_valid (void * base, uword size, void * v, uword elt_bytes)
+{
+  uword lo = pointer_to_uword (base);
+  uword hi = lo + size;
+  uword p = pointer_to_uword (v);
+
+  if (v == 0)
+    return 1;
+
+  if (p < lo + sizeof (vec_header_t) || p >= hi)
+    return 0;
+
+  return p + (uword) vec_len (v) * elt_bytes <= hi;
+}
+
+#endif /* __included_stats_segment_h__ */
@@ -0,0 +1,233 @@
+/*
+ *------------------------------------------------------------------
+ * stats_segment_client - dump the vpp shared memory stats segment
+ *
+ * Copyright (c) 2016 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *------------------------------------------------------------------
+ */
+
+#include <vppinfra/clib.h>
+#include <vppinfra/vec.h>
+#include <vppinfra/format.h>
+#include <vppinfra/error.h>
+
+#include <ssvm.h>
+#include <stats/stats_segment.h>
+
+typedef struct {
+  u8 name[STATS_SEGMENT_NAME_LEN];
+  u32 type;
+  u64 value;
+  u8 * data;			/* private copy */
+} stats_client_entry_t;
+
+static void
+stats_client_entries_free (stats_client_entry_t * entries)
+{
+  stats_client_entry_t * e;
+
+  vec_foreach (e, entries)
+    vec_free (e->data);
+  vec_free (entries);
+}
+
+static uword
+stats_client_elt_bytes (u32 type)
+{
+  switch (type)
+    {
+    case STATS_SEGMENT_ENTRY_SIMPLE:
+      return sizeof (u64);
+    case STATS_SEGMENT_ENTRY_COMBINED:
+      return sizeof (stats_segment_combined_t);
+    case STATS_SEGMENT_ENTRY_NAMES:
+      return sizeof (stats_segment_name_t);
+    default:
+      return 0;
+    }
+}
+
+/* Copy the whole directory out of the segment, retrying on a torn read */
+static stats_client_entry_t *
+stats_client_snapshot (ssvm_shared_header_t * sh)
+{
+  stats_segment_shared_header_t * hdr = sh->opaque[STATS_SEGMENT_OPAQUE_INDEX];
+  stats_segment_entry_t * dir, * se;
+  stats_client_entry_t * entries = 0, * e;
+  uword elt_bytes;
+  u64 epoch;
+
+again:
+  stats_client_entries_free (entries);
+  entries = 0;
+
+  epoch = stats_segment_read_begin (hdr);
+
+  dir = hdr->directory;
+  if (! stats_segment_vec_valid (sh, sh->ssvm_size, dir, sizeof (dir[0])))
+    goto again;
+
+  vec_foreach (se, dir)
+    {
+      vec_add2 (entries, e, 1);
+      clib_memcpy (e->name, se->name, sizeof (e->name));
+      e->name[sizeof (e->name) - 1] = 0;
+      e->type = se->type;
+      e->value = se->value;
+      e->data = 0;
+
+      elt_bytes = stats_client_elt_bytes (e->type);
+      if (elt_bytes == 0)
+	continue;
+
+      if (! stats_segment_vec_valid (sh, sh->ssvm_size, se->data, elt_bytes))
+	goto again;
+
+      vec_add (e->data, se->data, vec_len (se->data) * elt_bytes);
+    }
+
+  if (stats_segment_read_retry (hdr, epoch))
+    goto again;
+
+  return entries;
+}
+
+static stats_segment_name_t *
+stats_client_names (stats_client_entry_t * entries, char * name)
+{
+  stats_client_entry_t * e;
+
+  vec_foreach (e, entries)
+    if (e->type == STATS_SEGMENT_ENTRY_NAMES && !strcmp ((char *) e->name, name))
+      return (stats_segment_name_t *) e->data;
+  return 0;
+}
+
+static void
+stats_client_dump (stats_client_entry_t * entries)
+{
+  stats_client_entry_t * e;
+  stats_segment_name_t * names;
+  u8 * label;
+  uword i, n;
+
+  vec_foreach (e, entries)
+    {
+      if (!strncmp ((char *) e->name, "/if/", 4))
+	names = stats_client_names (entries, "/if/names");
+      else if (!strncmp ((char *) e->name, "/node/", 6))
+	names = stats_client_names (entries, "/node/names");
+      else if (!strncmp ((char *) e->name, "/err/", 5))
+	names = stats_client_names (entries, "/err/names");
+      else
+	names = 0;
+
+      switch (e->type)
+	{
+	case STATS_SEGMENT_ENTRY_SCALAR:
+	  fformat (stdout, "%s %lld\n", e->name, e->value);
+	  break;
+
+	case STATS_SEGMENT_ENTRY_SIMPLE:
+	  n = vec_len (e->data) / sizeof (u64);
+	  for (i = 0; i < n; i++)
+	    {
+	      u64 v = ((u64 *) e->data)[i];
+	      if (v == 0)
+		continue;
+	      label = (names && i * sizeof (names[0]) < vec_len ((u8 *) names))
+		? names[i].name : (u8 *) "?";
+	      fformat (stdout, "%s[%s] %lld\n", e->name, label, v);
+	    }
+	  break;
+
+	case STATS_SEGMENT_ENTRY_COMBINED:
+	  n = vec_len (e->data) / sizeof (stats_segment_combined_t);
+	  for (i = 0; i < n; i++)
+	    {
+	      stats_segment_combined_t * c =
+		((stats_segment_combined_t *) e->data) + i;
+	      if (c->packets == 0)
+		continue;
+	      label = (names && i * sizeof (names[0]) < vec_len ((u8 *) names))
+		? names[i].name : (u8 *) "?";
+	      fformat (stdout, "%s[%s] packets %lld bytes %lld\n", e->name,
+		       label, c->packets, c->bytes);
+	    }
+	  break;
+
+	default:
+	  break;
+	}
+    }
+}
+
+int main (int argc, char ** argv)
+{
+  unformat_input_t _argv, * a = &_argv;
+  ssvm_private_t _ssvm, * ssvm = &_ssvm;
+  stats_client_entry_t * entries;
+  u8 * name = 0;
+  f64 interval = 0;
+  int rv;
+
+  clib_mem_init (0, 64<<20);
+
+  unformat_init_command_line (a, argv);
+
+  while (unformat_check_input (a) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (a, "name %s", &name))
+	;
+      else if (unformat (a, "interval %f", &interval))
+	;
+      else
+	{
+	  fformat (stderr, "%s: usage [name <segment>] [interval <sec>]\n",
+		   argv[0]);
+	  exit (1);
+	}
+    }
+
+  if (name == 0)
+    name = format (0, "vpp-stats");
+  vec_add1 (name, 0);
+
+  memset (ssvm, 0, sizeof (*ssvm));
+  ssvm->name = name;
+  ssvm->my_pid = getpid ();
+
+  rv = ssvm_slave_init (ssvm, 20 /* timeout in seconds */);
+  if (rv < 0)
+    {
+      fformat (stderr, "map stats segment '%s' failed, error %d\n", name, rv);
+      exit (1);
+    }
+
+  do
+    {
+      entries = stats_client_snapshot (ssvm->sh);
+      stats_client_dump (entries);
+      stats_client_entries_free (entries);
+
+      if (interval > 0)
+	{
+	  fformat (stdout, "\n");
+	  usleep ((u32) (interval * 1e6));
+	}
+    }
+  while (interval > 0);
+
+  exit (0);
+}
@@ -24,6 +24,7 @@
 #include <vppinfra/format.h>
 #include <vppinfra/pool.h>
 #include <vppinfra/xxhash.h>
+#include <vppinfra/crc32.h>
 
 typedef struct {
   u64 key[3];
@@ -38,16 +39,7 @@ static inline int clib_bihash_is_free_24_8 (clib_bihash_kv_24_8_t *v)
   return 0;
 }
 
-#if __SSE4_2__
-static inline u32
-crc_u32(u32 data, u32 value)
-{
-  __asm__ volatile( "crc32l %[data], %[value];"
-                    : [value] "+r" (value)
-                    : [data] "rm" (data));
-  return value;
-}
-
+#ifdef clib_crc32c_uses_intrinsics
 static inline u64 clib_bihash_hash_24_8  (clib_bihash_kv_24_8_t *v)
 {
   u32 * dp = (u32 *) &v->key[0];
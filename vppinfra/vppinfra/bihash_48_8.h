@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#undef BIHASH_TYPE
+
+#define BIHASH_TYPE _48_8
+#define BIHASH_KVP_PER_PAGE 4
+
+#ifndef __included_bihash_48_8_h__
+#define __included_bihash_48_8_h__
+
+#include <vppinfra/heap.h>
+#include <vppinfra/format.h>
+#include <vppinfra/pool.h>
+#include <vppinfra/xxhash.h>
+#include <vppinfra/crc32.h>
+
+#if __SSE4_2__
+#include <x86intrin.h>
+#endif
+
+/* e.g. ip6 5-tuple plus fib index and direction, or a dual-stack session */
+typedef struct {
+  u64 key[6];
+  u64 value;
+} clib_bihash_kv_48_8_t;
+
+static inline int clib_bihash_is_free_48_8 (clib_bihash_kv_48_8_t *v)
+{
+  /* Free values are memset to 0xff, check a bit... */
+  if (v->key[0] == ~0ULL && v->value == ~0ULL)
+    return 1;
+  return 0;
+}
+
+#ifdef clib_crc32c_uses_intrinsics
+static inline u64 clib_bihash_hash_48_8 (clib_bihash_kv_48_8_t *v)
+{
+  u32 value = 0;
+
+  value = crc_u64 (v->key[0], value);
+  value = crc_u64 (v->key[1], value);
+  value = crc_u64 (v->key[2], value);
+  value = crc_u64 (v->key[3], value);
+  value = crc_u64 (v->key[4], value);
+  value = crc_u64 (v->key[5], value);
+
+  return value;
+}
+#else
+static inline u64 clib_bihash_hash_48_8 (clib_bihash_kv_48_8_t *v)
+{
+  u64 tmp = v->key[0] ^ v->key[1] ^ v->key[2] ^ v->key[3] ^ v->key[4] 
+    ^ v->key[5];
+  return clib_xxhash (tmp);
+}
+#endif
+
+static inline u8 * format_bihash_kvp_48_8 (u8 * s, va_list * args)
+{
+  clib_bihash_kv_48_8_t * v = va_arg (*args, clib_bihash_kv_48_8_t *);
+
+  s = format (s, "key %llu %llu %llu %llu %llu %llu value %llu", 
+              v->key[0], v->key[1], v->key[2], v->key[3], v->key[4], 
+              v->key[5], v->value);
+  return s;
+}
+
+static inline int clib_bihash_key_compare_48_8 (u64 * a, u64 * b)
+{
+#if __AVX2__
+  __m256i v;
+  __m128i w;
+
+  v = _mm256_xor_si256 (_mm256_loadu_si256 ((__m256i *) a), 
+                        _mm256_loadu_si256 ((__m256i *) b));
+  w = _mm_xor_si128 (_mm_loadu_si128 ((__m128i *) (a+4)), 
+                     _mm_loadu_si128 ((__m128i *) (b+4)));
+  return _mm256_testz_si256 (v, v) && _mm_testz_si128 (w, w);
+#elif __SSE4_2__
+  __m128i v;
+
+  v = _mm_xor_si128 (_mm_loadu_si128 ((__m128i *) a), 
+                     _mm_loadu_si128 ((__m128i *) b));
+  v = _mm_or_si128 (v, _mm_xor_si128 (_mm_loadu_si128 ((__m128i *) (a+2)), 
+                                      _mm_loadu_si128 ((__m128i *) (b+2))));
+  v = _mm_or_si128 (v, _mm_xor_si128 (_mm_loadu_si128 ((__m128i *) (a+4)), 
+                                      _mm_loadu_si128 ((__m128i *) (b+4))));
+  return _mm_testz_si128 (v, v);
+#else
+  return ((a[0]^b[0]) | (a[1]^b[1]) | (a[2]^b[2]) | (a[3]^b[3]) 
+          | (a[4]^b[4]) | (a[5]^b[5])) == 0;
+#endif
+}
+
+#undef __included_bihash_template_h__
+#include <vppinfra/bihash_template.h>
+
+#endif /* __included_bihash_48_8_h__ */
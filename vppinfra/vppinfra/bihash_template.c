@@ -25,12 +25,13 @@ void BV(clib_bihash_init)
   h->nbuckets = nbuckets;
   h->log2_nbuckets = max_log2 (nbuckets);
 
-  h->mheap = mheap_alloc (0 /* use VM */, memory_size);
+  h->mheap = clib_mem_table_heap_alloc (memory_size);
 
   oldheap = clib_mem_set_heap (h->mheap);
   vec_validate_aligned (h->buckets, nbuckets - 1, CLIB_CACHE_LINE_BYTES);
-  h->writer_lock = clib_mem_alloc_aligned (CLIB_CACHE_LINE_BYTES, 
-                                           CLIB_CACHE_LINE_BYTES);
+  h->alloc_lock = clib_mem_alloc_aligned (CLIB_CACHE_LINE_BYTES, 
+                                          CLIB_CACHE_LINE_BYTES);
+  h->alloc_lock[0] = 0;
 
   clib_mem_set_heap (oldheap);
 }
@@ -41,13 +42,42 @@ void BV(clib_bihash_free) (BVT(clib_bihash) * h)
     memset (h, 0, sizeof (*h));
 }
 
+static inline void
+BV(clib_bihash_alloc_lock) (BVT(clib_bihash) * h)
+{
+  while (__sync_lock_test_and_set (h->alloc_lock, 1))
+    ;
+}
+
+static inline void
+BV(clib_bihash_alloc_unlock) (BVT(clib_bihash) * h)
+{
+  CLIB_MEMORY_BARRIER();
+  h->alloc_lock[0] = 0;
+}
+
+static inline void
+BV(clib_bihash_lock_bucket) (clib_bihash_bucket_t * b)
+{
+  while (__sync_lock_test_and_set (&b->lock, 1))
+    ;
+}
+
+static inline void
+BV(clib_bihash_unlock_bucket) (clib_bihash_bucket_t * b)
+{
+  CLIB_MEMORY_BARRIER();
+  b->lock = 0;
+}
+
 static BVT(clib_bihash_value) *
 BV(value_alloc) (BVT(clib_bihash) * h, u32 log2_pages)
 {
     BVT(clib_bihash_value) * rv = 0;
     void * oldheap;
 
-    ASSERT (h->writer_lock[0]);
+    BV(clib_bihash_alloc_lock) (h);
+
     if (log2_pages >= vec_len (h->freelists)
         || h->freelists [log2_pages] == 0)
     {
@@ -62,6 +92,8 @@ BV(value_alloc) (BVT(clib_bihash) * h, u32 log2_pages)
     h->freelists[log2_pages] = rv->next_free;
 
  initialize:
+    BV(clib_bihash_alloc_unlock) (h);
+
     ASSERT(rv);
     ASSERT (vec_len(rv) == (1<<log2_pages));
     /* 
@@ -80,61 +112,16 @@ BV(value_free)
 {
     u32 log2_pages;
 
-    ASSERT (h->writer_lock[0]);
-    
     log2_pages = min_log2(vec_len(v));
 
+    BV(clib_bihash_alloc_lock) (h);
+
     ASSERT(vec_len (h->freelists) > log2_pages);
 
     v->next_free = h->freelists[log2_pages];
     h->freelists[log2_pages] = v;
-}
-
-static inline void
-BV(make_working_copy) 
-    (BVT(clib_bihash) * h, clib_bihash_bucket_t * b)
-{
-  BVT(clib_bihash_value) * v;
-  clib_bihash_bucket_t working_bucket __attribute__((aligned (8)));
-  void * oldheap;
-  BVT(clib_bihash_value) * working_copy;
-  u32 cpu_number = os_get_cpu_number();
-
-  if (cpu_number >= vec_len (h->working_copies))
-    {
-      oldheap = clib_mem_set_heap (h->mheap);
-      vec_validate (h->working_copies, cpu_number);
-      clib_mem_set_heap (oldheap);
-    }
-
-  /* 
-   * working_copies are per-cpu so that near-simultaneous
-   * updates from multiple threads will not result in sporadic, spurious
-   * lookup failures. 
-   */
-  working_copy = h->working_copies[cpu_number];
-
-  h->saved_bucket.as_u64 = b->as_u64;
-  oldheap = clib_mem_set_heap (h->mheap);
-
-  if ((1<<b->log2_pages) > vec_len (working_copy))
-    {
-      vec_validate_aligned (working_copy, (1<<b->log2_pages)-1, 
-                            sizeof (u64));
-      h->working_copies[cpu_number] = working_copy;
-    }
 
-  _vec_len(working_copy) = 1<<b->log2_pages;
-  clib_mem_set_heap (oldheap);
-
-  v = BV(clib_bihash_get_value) (h, b->offset);
-
-  clib_memcpy (working_copy, v, sizeof (*v)*(1<<b->log2_pages));
-  working_bucket.as_u64 = b->as_u64;
-  working_bucket.offset = BV(clib_bihash_get_offset) (h, working_copy);
-  CLIB_MEMORY_BARRIER();
-  b->as_u64 = working_bucket.as_u64;
-  h->working_copies[cpu_number] = working_copy;
+    BV(clib_bihash_alloc_unlock) (h);
 }
 
 static BVT(clib_bihash_value) *
@@ -191,13 +178,12 @@ int BV(clib_bihash_add_del)
 {
   u32 bucket_index;
   clib_bihash_bucket_t * b, tmp_b;
-  BVT(clib_bihash_value) * v, * new_v, * save_new_v, * working_copy;
+  BVT(clib_bihash_value) * v, * new_v, * save_new_v, * old_values;
   u32 value_index;
   int rv = 0;
   int i;
   u64 hash, new_hash;
   u32 new_log2_pages;
-  u32 cpu_number = os_get_cpu_number();
   
   hash = BV(clib_bihash_hash) (add_v);
 
@@ -206,8 +192,7 @@ int BV(clib_bihash_add_del)
 
   hash >>= h->log2_nbuckets;
 
-  while (__sync_lock_test_and_set (h->writer_lock, 1))
-    ; 
+  BV(clib_bihash_lock_bucket) (b);
 
   /* First elt in the bucket? */
   if (b->offset == 0)
@@ -222,15 +207,15 @@ int BV(clib_bihash_add_del)
       *v->kvp = * add_v;
       tmp_b.as_u64 = 0;
       tmp_b.offset = BV(clib_bihash_get_offset) (h, v);
+      tmp_b.lock = 1;
 
+      CLIB_MEMORY_BARRIER();
       b->as_u64 = tmp_b.as_u64;
       goto unlock;
     }
 
-  BV(make_working_copy) (h, b);
-
-  v = BV(clib_bihash_get_value) (h, h->saved_bucket.offset);
-  value_index = hash & ((1<<h->saved_bucket.log2_pages)-1);
+  v = BV(clib_bihash_get_value) (h, b->offset);
+  value_index = hash & ((1<<b->log2_pages)-1);
   v += value_index;
   
   if (is_add)
@@ -243,10 +228,7 @@ int BV(clib_bihash_add_del)
         {
           if (!memcmp(&(v->kvp[i]), &add_v->key, sizeof (add_v->key)))
             {
-              clib_memcpy (&(v->kvp[i]), add_v, sizeof (*add_v));
-              CLIB_MEMORY_BARRIER();
-              /* Restore the previous (k,v) pairs */
-              b->as_u64 = h->saved_bucket.as_u64;
+              v->kvp[i].value = add_v->value;
               goto unlock;
             }
         }
@@ -254,9 +236,11 @@ int BV(clib_bihash_add_del)
         {
           if (BV(clib_bihash_is_free)(&(v->kvp[i])))
             {
-              clib_memcpy (&(v->kvp[i]), add_v, sizeof (*add_v));
+              /* Value first: a reader matching the key sees the value */
+              v->kvp[i].value = add_v->value;
               CLIB_MEMORY_BARRIER();
-              b->as_u64 = h->saved_bucket.as_u64;
+              clib_memcpy (&(v->kvp[i].key), &add_v->key, 
+                           sizeof (add_v->key));
               goto unlock;
             }
         }
@@ -268,22 +252,26 @@ int BV(clib_bihash_add_del)
         {
           if (!memcmp(&(v->kvp[i]), &add_v->key, sizeof (add_v->key)))
             {
-              memset (&(v->kvp[i]), 0xff, sizeof (*(add_v)));
+              /* Key first: readers stop matching before the value goes */
+              memset (&(v->kvp[i].key), 0xff, sizeof (add_v->key));
               CLIB_MEMORY_BARRIER();
-              b->as_u64 = h->saved_bucket.as_u64;
+              memset (&(v->kvp[i].value), 0xff, sizeof (add_v->value));
               goto unlock;
             }
         }
       rv = -3;
-      b->as_u64 = h->saved_bucket.as_u64;
       goto unlock;
     }
 
-  new_log2_pages = h->saved_bucket.log2_pages + 1;
+  /* 
+   * The page is full.  Rehash into a larger page set while readers keep
+   * using the old one; nobody else writes it since we hold the bucket.
+   */
+  old_values = BV(clib_bihash_get_value) (h, b->offset);
+  new_log2_pages = b->log2_pages + 1;
 
  expand_again:
-  working_copy = h->working_copies[cpu_number];
-  new_v = BV(split_and_rehash) (h, working_copy, new_log2_pages);
+  new_v = BV(split_and_rehash) (h, old_values, new_log2_pages);
   if (new_v == 0)
     {
       new_log2_pages++;
@@ -311,16 +299,16 @@ int BV(clib_bihash_add_del)
   goto expand_again;
 
  expand_ok:
+  tmp_b.as_u64 = 0;
   tmp_b.log2_pages = min_log2 (vec_len (save_new_v));
   tmp_b.offset = BV(clib_bihash_get_offset) (h, save_new_v);
+  tmp_b.lock = 1;
   CLIB_MEMORY_BARRIER();
   b->as_u64 = tmp_b.as_u64;
-  v = BV(clib_bihash_get_value) (h, h->saved_bucket.offset);
-  BV(value_free) (h, v);
+  BV(value_free) (h, old_values);
 
  unlock:
-  CLIB_MEMORY_BARRIER();
-  h->writer_lock[0] = 0;
+  BV(clib_bihash_unlock_bucket) (b);
   return rv;
 }
 
@@ -329,38 +317,9 @@ int BV(clib_bihash_search)
       BVT(clib_bihash_kv) *search_key,
       BVT(clib_bihash_kv) *valuep)
 {
-  u64 hash;
-  u32 bucket_index;
-  uword value_index;
-  BVT(clib_bihash_value) * v;
-  clib_bihash_bucket_t * b;
-  int i;
-
   ASSERT(valuep);
 
-  hash = BV(clib_bihash_hash) (search_key);
-
-  bucket_index = hash & (h->nbuckets-1);
-  b = &h->buckets[bucket_index];
-
-  if (b->offset == 0)
-    return -1;
-
-  hash >>= h->log2_nbuckets;
-
-  v = BV(clib_bihash_get_value) (h, b->offset);
-  value_index = hash & ((1<<b->log2_pages)-1);
-  v += value_index;
-  
-  for (i = 0; i < BIHASH_KVP_PER_PAGE; i++)
-    {
-      if (BV(clib_bihash_key_compare)(v->kvp[i].key, search_key->key))
-        {
-          *valuep = v->kvp[i];
-          return 0;
-        }
-    }
-  return -1;
+  return BV(clib_bihash_search_inline_2) (h, search_key, valuep);
 }
 
 u8 * BV(format_bihash) (u8 * s, va_list * args)
@@ -54,7 +54,9 @@ typedef struct {
   union {
     struct {
       u32 offset;
-      u8 pad[3];
+      /* Writer lock, readers ignore it */
+      u8 lock;
+      u8 pad[2];
       u8 log2_pages;
     };
     u64 as_u64;
@@ -62,13 +64,18 @@ typedef struct {
 } clib_bihash_bucket_t;
 #endif /* __defined_clib_bihash_bucket_t__ */
 
+/* 
+ * Writers lock the bucket they modify and update its page in place
+ * when there is room, so writers on different buckets run in parallel.
+ * Readers take no locks: they snapshot the bucket once, and a page set
+ * is only swapped (on split) with a single 64 bit bucket store.
+ */
 typedef struct {
   BVT(clib_bihash_value) * values;
   clib_bihash_bucket_t * buckets;
-  volatile u32 * writer_lock;
 
-  BVT(clib_bihash_value) ** working_copies;
-  clib_bihash_bucket_t saved_bucket;
+  /* Protects the freelists and mheap, i.e. value_alloc / value_free */
+  volatile u32 * alloc_lock;
 
   u32 nbuckets;
   u32 log2_nbuckets;
@@ -121,79 +128,168 @@ format_function_t BV(format_bihash);
 format_function_t BV(format_bihash_kvp);
 
 
-static inline int BV(clib_bihash_search_inline) 
-    (BVT(clib_bihash) * h, BVT(clib_bihash_kv) * kvp)
+static inline void BV(clib_bihash_prefetch_bucket)
+    (BVT(clib_bihash) * h, u64 hash)
 {
-  u64 hash;
   u32 bucket_index;
-  uword value_index;
-  BVT(clib_bihash_value) * v;
   clib_bihash_bucket_t * b;
-  int i;
-
-  hash = BV(clib_bihash_hash) (kvp);
 
   bucket_index = hash & (h->nbuckets-1);
   b = &h->buckets[bucket_index];
 
-  if (b->offset == 0)
-    return -1;
+  CLIB_PREFETCH (b, CLIB_CACHE_LINE_BYTES, LOAD);
+}
+
+/* Needs the bucket, so issue after clib_bihash_prefetch_bucket */
+static inline void BV(clib_bihash_prefetch_data)
+    (BVT(clib_bihash) * h, u64 hash)
+{
+  u32 bucket_index;
+  uword value_index;
+  BVT(clib_bihash_value) * v;
+  clib_bihash_bucket_t b;
+
+  bucket_index = hash & (h->nbuckets-1);
+  b.as_u64 = *(volatile u64 *) &h->buckets[bucket_index].as_u64;
+
+  if (b.offset == 0)
+    return;
 
   hash >>= h->log2_nbuckets;
 
-  v = BV(clib_bihash_get_value) (h, b->offset);
-  value_index = hash & ((1<<b->log2_pages)-1);
+  v = BV(clib_bihash_get_value) (h, b.offset);
+  value_index = hash & ((1<<b.log2_pages)-1);
   v += value_index;
-  
-  for (i = 0; i < BIHASH_KVP_PER_PAGE; i++)
-    {
-      if (BV(clib_bihash_key_compare)(v->kvp[i].key, kvp->key))
-        {
-          *kvp = v->kvp[i];
-          return 0;
-        }
-    }
-  return -1;
+
+  CLIB_PREFETCH (v, sizeof (v[0]), LOAD);
 }
 
-static inline int BV(clib_bihash_search_inline_2) 
+static inline int BV(clib_bihash_search_inline_2_with_hash) 
      (BVT(clib_bihash) * h, 
+      u64 hash,
       BVT(clib_bihash_kv) *search_key,
       BVT(clib_bihash_kv) *valuep)
 {
-  u64 hash;
   u32 bucket_index;
   uword value_index;
   BVT(clib_bihash_value) * v;
-  clib_bihash_bucket_t * b;
+  BVT(clib_bihash_kv) kv;
+  clib_bihash_bucket_t b, nb;
   int i;
 
   ASSERT(valuep);
 
-  hash = BV(clib_bihash_hash) (search_key);
-
   bucket_index = hash & (h->nbuckets-1);
-  b = &h->buckets[bucket_index];
+  hash >>= h->log2_nbuckets;
 
-  if (b->offset == 0)
-    return -1;
+ again:
+  /* One load, so offset and log2_pages agree across a split */
+  b.as_u64 = *(volatile u64 *) &h->buckets[bucket_index].as_u64;
 
-  hash >>= h->log2_nbuckets;
+  if (b.offset == 0)
+    return -1;
 
-  v = BV(clib_bihash_get_value) (h, b->offset);
-  value_index = hash & ((1<<b->log2_pages)-1);
+  v = BV(clib_bihash_get_value) (h, b.offset);
+  value_index = hash & ((1<<b.log2_pages)-1);
   v += value_index;
   
   for (i = 0; i < BIHASH_KVP_PER_PAGE; i++)
     {
       if (BV(clib_bihash_key_compare)(v->kvp[i].key, search_key->key))
         {
-          *valuep = v->kvp[i];
-          return 0;
+          kv = v->kvp[i];
+          /* 
+           * Delete clobbers the key before the value, so if the key 
+           * is still there the value we copied is good.
+           */
+          CLIB_LOAD_BARRIER();
+          if (PREDICT_TRUE (BV(clib_bihash_key_compare)
+                            (v->kvp[i].key, search_key->key)))
+            {
+              *valuep = kv;
+              return 0;
+            }
         }
     }
+
+  /* 
+   * A split may have moved the entry to new pages (and recycled the
+   * ones we looked at) after we read the bucket: look again.
+   */
+  CLIB_LOAD_BARRIER();
+  nb.as_u64 = *(volatile u64 *) &h->buckets[bucket_index].as_u64;
+  if (PREDICT_FALSE (nb.offset != b.offset 
+                     || nb.log2_pages != b.log2_pages))
+    goto again;
+
   return -1;
 }
 
+static inline int BV(clib_bihash_search_inline_with_hash) 
+    (BVT(clib_bihash) * h, u64 hash, BVT(clib_bihash_kv) * kvp)
+{
+  return BV(clib_bihash_search_inline_2_with_hash) (h, hash, kvp, kvp);
+}
+
+static inline int BV(clib_bihash_search_inline) 
+    (BVT(clib_bihash) * h, BVT(clib_bihash_kv) * kvp)
+{
+  u64 hash = BV(clib_bihash_hash) (kvp);
+
+  return BV(clib_bihash_search_inline_with_hash) (h, hash, kvp);
+}
+
+static inline int BV(clib_bihash_search_inline_2) 
+     (BVT(clib_bihash) * h, 
+      BVT(clib_bihash_kv) *search_key,
+      BVT(clib_bihash_kv) *valuep)
+{
+  u64 hash = BV(clib_bihash_hash) (search_key);
+
+  return BV(clib_bihash_search_inline_2_with_hash) (h, hash, 
+                                                     search_key, valuep);
+}
+
+#ifndef BIHASH_SEARCH_MULTI_MAX
+#define BIHASH_SEARCH_MULTI_MAX 16
+#endif
+
+/* 
+ * Search for up to BIHASH_SEARCH_MULTI_MAX keys at once: hash all keys
+ * and prefetch their buckets, then prefetch their value pages, then
+ * compare, so the cache misses overlap instead of being taken one
+ * after the other.  Matches are copied to valuep[i]; valuep[i] is left
+ * alone on a miss.  search_keys and valuep may be the same array.
+ * Returns a bitmap with bit i set if search_keys[i] was found.
+ */
+static inline u32 BV(clib_bihash_search_inline_multi) 
+     (BVT(clib_bihash) * h, 
+      BVT(clib_bihash_kv) *search_keys,
+      BVT(clib_bihash_kv) *valuep,
+      u32 n_keys)
+{
+  u64 hashes[BIHASH_SEARCH_MULTI_MAX];
+  u32 i, found = 0;
+
+  ASSERT (n_keys <= BIHASH_SEARCH_MULTI_MAX);
+
+  for (i = 0; i < n_keys; i++)
+    {
+      hashes[i] = BV(clib_bihash_hash) (&search_keys[i]);
+      BV(clib_bihash_prefetch_bucket) (h, hashes[i]);
+    }
+
+  for (i = 0; i < n_keys; i++)
+    BV(clib_bihash_prefetch_data) (h, hashes[i]);
+
+  for (i = 0; i < n_keys; i++)
+    if (BV(clib_bihash_search_inline_2_with_hash) (h, hashes[i], 
+                                                   &search_keys[i], 
+                                                   &valuep[i]) == 0)
+      found |= 1 << i;
+
+  return found;
+}
+
 
 #endif /* __included_bihash_template_h__ */
@@ -100,6 +100,9 @@
 /* Full memory barrier (read and write). */
 #define CLIB_MEMORY_BARRIER() __sync_synchronize ()
 
+/* Orders earlier loads before later ones; free on x86. */
+#define CLIB_LOAD_BARRIER() __atomic_thread_fence (__ATOMIC_ACQUIRE)
+
 /* Arranges for function to be called before main. */
 #define INIT_FUNCTION(decl)			\
   decl __attribute ((constructor));		\
@@ -108,4 +108,19 @@ format_cpu_model_name (u8 * s, va_list * args)
 #else /* ! __x86_64__ */
   return format (s, "unknown");
 #endif
-}
\ No newline at end of file
+}
+
+u8 *
+format_cpu_flags (u8 * s, va_list * args)
+{
+#if __x86_64__
+#define _(flag, leaf, reg, bit, state)		\
+  if (clib_cpu_supports_ ## flag ())		\
+    s = format (s, "%s ", #flag);
+  foreach_x86_64_flags
+#undef _
+  return s;
+#else /* ! __x86_64__ */
+  return format (s, "unknown");
+#endif
+}
@@ -16,7 +16,146 @@
 #ifndef included_clib_cpu_h
 #define included_clib_cpu_h
 
+#include <vppinfra/format.h>
+
+/*
+ * CPU feature detection and per-architecture function variants.
+ *
+ * Hot functions can be compiled a second time for a newer instruction
+ * set with the target attribute; the variant to use is picked at run
+ * time with the clib_cpu_supports_* predicates below, so a single
+ * binary built for the baseline -march still gets AVX2 / AVX-512 code
+ * where the CPU has it.
+ */
+
+#if __x86_64__
+/*
+ * Variants: name, gcc target string, selection priority.  The targets
+ * only add instruction sets; with a different "arch=" gcc refuses to
+ * inline the baseline code into the clone and the clone is useless.
+ */
+#define CLIB_MARCH_AVX2_TARGET "avx2,fma,bmi,bmi2,popcnt,lzcnt"
+#define CLIB_MARCH_AVX512_TARGET \
+  CLIB_MARCH_AVX2_TARGET ",avx512f,avx512bw,avx512dq,avx512vl,avx512cd"
+
+#if __GNUC__ >= 6 && !__clang__
+#define foreach_march_variant(macro, ...)			\
+  macro(avx2, __VA_ARGS__, CLIB_MARCH_AVX2_TARGET, 50)		\
+  macro(avx512, __VA_ARGS__, CLIB_MARCH_AVX512_TARGET, 100)
+#else
+#define foreach_march_variant(macro, ...)			\
+  macro(avx2, __VA_ARGS__, CLIB_MARCH_AVX2_TARGET, 50)
+#endif
+#else
+#define foreach_march_variant(macro, ...)
+#endif
+
+#if __GNUC__ > 4 && !__clang__
+#define CLIB_CPU_OPTIMIZED __attribute__ ((optimize ("tree-vectorize")))
+#else
+#define CLIB_CPU_OPTIMIZED
+#endif
+
+#if __x86_64__
+#include <cpuid.h>
+
+/* flag, cpuid leaf, register, bit, extended register state needed */
+#define foreach_x86_64_flags				\
+_ (sse3,     1, ecx, 0,  0)				\
+_ (ssse3,    1, ecx, 9,  0)				\
+_ (fma,      1, ecx, 12, 1)				\
+_ (sse41,    1, ecx, 19, 0)				\
+_ (sse42,    1, ecx, 20, 0)				\
+_ (popcnt,   1, ecx, 23, 0)				\
+_ (aes,      1, ecx, 25, 0)				\
+_ (avx,      1, ecx, 28, 1)				\
+_ (bmi,      7, ebx, 3,  0)				\
+_ (avx2,     7, ebx, 5,  1)				\
+_ (bmi2,     7, ebx, 8,  0)				\
+_ (avx512f,  7, ebx, 16, 2)				\
+_ (avx512dq, 7, ebx, 17, 2)				\
+_ (avx512cd, 7, ebx, 28, 2)				\
+_ (avx512bw, 7, ebx, 30, 2)				\
+_ (avx512vl, 7, ebx, 31, 2)				\
+_ (lzcnt,    0x80000001, ecx, 5, 0)
+
+typedef struct {
+  u32 eax, ebx, ecx, edx;
+} clib_cpuid_t;
+
+/* Leaf (sub-leaf 0); all zeros if the leaf is not implemented */
+static inline clib_cpuid_t
+clib_get_cpuid (u32 leaf)
+{
+  clib_cpuid_t r = { 0 };
+
+  if (__get_cpuid_max (leaf & 0x80000000, 0) < leaf)
+    return r;
+
+  __cpuid_count (leaf, 0, r.eax, r.ebx, r.ecx, r.edx);
+  return r;
+}
+
+/*
+ * Extended register state the OS saves across context switches:
+ * 1 = ymm (AVX), 2 = ymm + opmask + zmm (AVX-512).  A CPU that has
+ * the instructions is no use if the kernel does not save the state.
+ */
+static inline int
+clib_cpu_os_saves_state (int level)
+{
+  u32 eax, edx;
+  u64 xcr0, need;
+
+  if (level == 0)
+    return 1;
+
+  /* OSXSAVE */
+  if ((clib_get_cpuid (1).ecx & (1 << 27)) == 0)
+    return 0;
+
+  asm volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+  xcr0 = ((u64) edx << 32) | eax;
+
+  need = level == 1 ? 0x06 : 0xe6;
+  return (xcr0 & need) == need;
+}
+
+#define _(flag, leaf, reg, bit, state)				\
+static inline int						\
+clib_cpu_supports_ ## flag (void)				\
+{								\
+  return ((clib_get_cpuid (leaf).reg & (1U << bit)) != 0	\
+	  && clib_cpu_os_saves_state (state));			\
+}
+foreach_x86_64_flags
+#undef _
+
+/*
+ * Predicates for the variants in foreach_march_variant; each checks
+ * what its gcc target enables that the code generator actually uses.
+ */
+static inline int
+clib_cpu_march_avx2 (void)
+{
+  return (clib_cpu_supports_avx2 () && clib_cpu_supports_fma ()
+	  && clib_cpu_supports_bmi () && clib_cpu_supports_bmi2 ()
+	  && clib_cpu_supports_popcnt () && clib_cpu_supports_lzcnt ());
+}
+
+static inline int
+clib_cpu_march_avx512 (void)
+{
+  return (clib_cpu_march_avx2 ()
+	  && clib_cpu_supports_avx512f () && clib_cpu_supports_avx512bw ()
+	  && clib_cpu_supports_avx512dq () && clib_cpu_supports_avx512vl ()
+	  && clib_cpu_supports_avx512cd ());
+}
+
+#endif /* __x86_64__ */
+
 format_function_t format_cpu_uarch;
 format_function_t format_cpu_model_name;
+format_function_t format_cpu_flags;
 
 #endif
\ No newline at end of file
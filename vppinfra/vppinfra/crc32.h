@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __included_crc32_h__
+#define __included_crc32_h__
+
+#include <vppinfra/clib.h>
+
+/* CRC32C (Castagnoli) steps, used as fast hash functions */
+#if __SSE4_2__
+#define clib_crc32c_uses_intrinsics
+
+static inline u32
+crc_u32 (u32 data, u32 value)
+{
+  __asm__ volatile( "crc32l %[data], %[value];"
+                    : [value] "+r" (value)
+                    : [data] "rm" (data));
+  return value;
+}
+
+static inline u32
+crc_u64 (u64 data, u32 value)
+{
+  u64 v = value;
+
+  __asm__ volatile( "crc32q %[data], %[value];"
+                    : [value] "+r" (v)
+                    : [data] "rm" (data));
+  return v;
+}
+#endif /* __SSE4_2__ */
+
+#endif /* __included_crc32_h__ */
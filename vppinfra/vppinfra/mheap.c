@@ -49,6 +49,7 @@
 static void mheap_get_trace (void * v, uword offset, uword size);
 static void mheap_put_trace (void * v, uword offset, uword size);
 static int mheap_trace_sort (const void * t1, const void * t2);
+static void mheap_put_no_lock (void * v, uword uoffset);
 
 always_inline void mheap_maybe_lock (void * v)
 {
@@ -618,6 +619,192 @@ mheap_get_extend_vector (void * v,
   return v;
 }
 
+/* Allocate with the heap lock held; size and alignment already rounded. */
+static void *
+mheap_get_no_lock (void * v,
+		   uword * n_user_data_bytes,
+		   uword align,
+		   uword align_offset,
+		   uword * offset_return)
+{
+  mheap_t * h;
+  uword offset;
+
+  /* First search free lists for object. */
+  offset = mheap_get_search_free_list (v, n_user_data_bytes, align, align_offset);
+
+  h = mheap_header (v);
+
+  /* If that fails allocate object at end of heap by extending vector. */
+  if (offset == ~0 && _vec_len (v) < h->max_size)
+    {
+      v = mheap_get_extend_vector (v, *n_user_data_bytes, align, align_offset, &offset);
+      h = mheap_header (v);
+      h->stats.n_vector_expands += offset != ~0;
+    }
+
+  if (offset != ~0)
+    h->n_elts += 1;
+
+  *offset_return = offset;
+  return v;
+}
+
+always_inline uword
+mheap_cpu_cache_is_enabled (mheap_t * h)
+{
+  uword want = MHEAP_FLAG_THREAD_SAFE | MHEAP_FLAG_CPU_CACHE;
+
+  /* Tracing and validation need to see every get and put. */
+  return (h->flags & (want | MHEAP_FLAG_TRACE | MHEAP_FLAG_VALIDATE)) == want;
+}
+
+/* Cache for the calling cpu, created on first use; 0 if there is none. */
+static mheap_cpu_cache_t *
+mheap_cpu_cache (void * v)
+{
+  mheap_t * h = mheap_header (v);
+  uword cpu = os_get_cpu_number ();
+  mheap_cpu_cache_t * c;
+  uword n_bytes, offset;
+
+  /*
+   * cpu 0 is the main thread, but also any pthread not started by vlib
+   * (e.g. the stats thread): the number comes from the stack address.
+   * Those can race the main thread, so cpu 0 always takes the lock.
+   */
+  if (cpu == 0 || cpu >= MHEAP_CPU_CACHE_MAX_CPUS)
+    return 0;
+
+  if (PREDICT_TRUE (h->cpu_caches != 0 && h->cpu_caches[cpu] != 0))
+    return h->cpu_caches[cpu];
+
+  mheap_maybe_lock (v);
+
+  if (! h->cpu_caches)
+    {
+      n_bytes = MHEAP_CPU_CACHE_MAX_CPUS * sizeof (h->cpu_caches[0]);
+      mheap_get_no_lock (v, &n_bytes, MHEAP_USER_DATA_WORD_BYTES, 0, &offset);
+      if (offset != ~0)
+	{
+	  memset (v + offset, 0, n_bytes);
+	  CLIB_MEMORY_BARRIER ();
+	  h->cpu_caches = v + offset;
+	}
+    }
+
+  c = 0;
+  if (h->cpu_caches)
+    {
+      /* Own cache line(s), caches of different cpus must not share. */
+      n_bytes = round_pow2 (sizeof (c[0]), CLIB_CACHE_LINE_BYTES);
+      mheap_get_no_lock (v, &n_bytes, CLIB_CACHE_LINE_BYTES, 0, &offset);
+      if (offset != ~0)
+	{
+	  c = v + offset;
+	  memset (c, 0, sizeof (c[0]));
+	  CLIB_MEMORY_BARRIER ();
+	  h->cpu_caches[cpu] = c;
+	}
+    }
+
+  mheap_maybe_unlock (v);
+
+  return c;
+}
+
+always_inline uword
+mheap_cpu_cache_stash (mheap_cpu_cache_t * c, uword n_words, uword uoffset)
+{
+  if (n_words > MHEAP_CPU_CACHE_MAX_USER_WORDS
+      || c->n_cached[n_words] >= MHEAP_CPU_CACHE_MAGAZINE_SIZE)
+    return 0;
+
+  c->offsets[n_words][c->n_cached[n_words]++] = uoffset;
+  return 1;
+}
+
+static uword
+mheap_cpu_cache_get (void * v, uword n_user_data_bytes)
+{
+  mheap_cpu_cache_t * c = mheap_cpu_cache (v);
+  uword n_words = n_user_data_bytes / MHEAP_USER_DATA_WORD_BYTES;
+  uword i, n_bytes, offset;
+
+  if (! c)
+    return ~0;
+
+  if (PREDICT_TRUE (c->n_cached[n_words] > 0))
+    {
+      c->n_get_hits += 1;
+      return c->offsets[n_words][--c->n_cached[n_words]];
+    }
+
+  /* Empty: refill half a magazine under a single lock. */
+  c->n_get_misses += 1;
+
+  mheap_maybe_lock (v);
+
+  for (i = 0; i < MHEAP_CPU_CACHE_MAGAZINE_SIZE / 2; i++)
+    {
+      n_bytes = n_user_data_bytes;
+      mheap_get_no_lock (v, &n_bytes, MHEAP_USER_DATA_WORD_BYTES, 0, &offset);
+      if (offset == ~0)
+	break;
+
+      /* Free list may hand us a slightly larger object. */
+      if (! mheap_cpu_cache_stash (c, n_bytes / MHEAP_USER_DATA_WORD_BYTES,
+				   offset))
+	mheap_put_no_lock (v, offset);
+    }
+
+  mheap_maybe_unlock (v);
+
+  if (c->n_cached[n_words] == 0)
+    return ~0;
+
+  return c->offsets[n_words][--c->n_cached[n_words]];
+}
+
+static uword
+mheap_cpu_cache_put (void * v, uword uoffset)
+{
+  mheap_elt_t * e = mheap_elt_at_uoffset (v, uoffset);
+  uword n_words = e->n_user_data;
+  uword i, n_drain = MHEAP_CPU_CACHE_MAGAZINE_SIZE / 2;
+  mheap_cpu_cache_t * c;
+
+  if (n_words > MHEAP_CPU_CACHE_MAX_USER_WORDS)
+    return 0;
+
+  /* Object was already freed. */
+  if (e->is_free)
+    os_panic ();
+
+  c = mheap_cpu_cache (v);
+  if (! c)
+    return 0;
+
+  /* Full: give the oldest half back to the heap under a single lock. */
+  if (c->n_cached[n_words] == MHEAP_CPU_CACHE_MAGAZINE_SIZE)
+    {
+      c->n_flushes += 1;
+
+      mheap_maybe_lock (v);
+      for (i = 0; i < n_drain; i++)
+	mheap_put_no_lock (v, c->offsets[n_words][i]);
+      mheap_maybe_unlock (v);
+
+      memmove (c->offsets[n_words], c->offsets[n_words] + n_drain,
+	       (MHEAP_CPU_CACHE_MAGAZINE_SIZE - n_drain) * sizeof (c->offsets[0][0]));
+      c->n_cached[n_words] -= n_drain;
+    }
+
+  c->offsets[n_words][c->n_cached[n_words]++] = uoffset;
+  c->n_puts += 1;
+  return 1;
+}
+
 void * mheap_get_aligned (void * v,
 			  uword n_user_data_bytes,
 			  uword align,
@@ -650,6 +837,22 @@ void * mheap_get_aligned (void * v,
   if (! v)
     v = mheap_alloc (0, 64 << 20);
 
+  h = mheap_header (v);
+
+  if (mheap_cpu_cache_is_enabled (h)
+      && align == MHEAP_USER_DATA_WORD_BYTES
+      && align_offset == 0
+      && n_user_data_bytes <= (MHEAP_CPU_CACHE_MAX_USER_WORDS
+			       * MHEAP_USER_DATA_WORD_BYTES))
+    {
+      offset = mheap_cpu_cache_get (v, n_user_data_bytes);
+      if (offset != ~0)
+	{
+	  *offset_return = offset;
+	  return v;
+	}
+    }
+
   mheap_maybe_lock (v);
 
   h = mheap_header (v);
@@ -657,24 +860,12 @@ void * mheap_get_aligned (void * v,
   if (h->flags & MHEAP_FLAG_VALIDATE)
     mheap_validate (v);
 
-  /* First search free lists for object. */
-  offset = mheap_get_search_free_list (v, &n_user_data_bytes, align, align_offset);
-
+  v = mheap_get_no_lock (v, &n_user_data_bytes, align, align_offset, &offset);
   h = mheap_header (v);
 
-  /* If that fails allocate object at end of heap by extending vector. */
-  if (offset == ~0 && _vec_len (v) < h->max_size)
-    {
-      v = mheap_get_extend_vector (v, n_user_data_bytes, align, align_offset, &offset);
-      h = mheap_header (v);
-      h->stats.n_vector_expands += offset != ~0;
-    }
-
   *offset_return = offset;
   if (offset != ~0)
     {
-      h->n_elts += 1;
-
       if (h->flags & MHEAP_FLAG_TRACE)
 	{
 	  /* Recursion block for case when we are traceing main clib heap. */
@@ -728,8 +919,6 @@ static void free_last_elt (void * v, mheap_elt_t * e)
 void mheap_put (void * v, uword uoffset)
 {
   mheap_t * h;
-  uword n_user_data_bytes, bin;
-  mheap_elt_t * e, * n;
   uword trace_uoffset, trace_n_user_data_bytes;
   u64 cpu_times[2];
 
@@ -737,22 +926,57 @@ void mheap_put (void * v, uword uoffset)
 
   h = mheap_header (v);
 
+  if (mheap_cpu_cache_is_enabled (h)
+      && mheap_cpu_cache_put (v, uoffset))
+    return;
+
   mheap_maybe_lock (v);
 
   if (h->flags & MHEAP_FLAG_VALIDATE)
     mheap_validate (v);
 
+  h->stats.n_puts += 1;
+
+  trace_uoffset = uoffset;
+  trace_n_user_data_bytes = mheap_data_bytes (v, uoffset);
+
+  mheap_put_no_lock (v, uoffset);
+
+  h = mheap_header (v);
+
+  if (h->flags & MHEAP_FLAG_TRACE)
+    {
+      /* Recursion block for case when we are traceing main clib heap. */
+      h->flags &= ~MHEAP_FLAG_TRACE;
+
+      mheap_put_trace (v, trace_uoffset, trace_n_user_data_bytes);
+
+      h->flags |= MHEAP_FLAG_TRACE;
+    }
+
+  if (h->flags & MHEAP_FLAG_VALIDATE)
+    mheap_validate (v);
+
+  mheap_maybe_unlock (v);
+
+  cpu_times[1] = clib_cpu_time_now ();
+  h->stats.n_clocks_put += cpu_times[1] - cpu_times[0];
+}
+
+/* Free an object with the heap lock held. */
+static void mheap_put_no_lock (void * v, uword uoffset)
+{
+  mheap_t * h = mheap_header (v);
+  uword n_user_data_bytes, bin;
+  mheap_elt_t * e, * n;
+
   ASSERT (h->n_elts > 0);
   h->n_elts--;
-  h->stats.n_puts += 1;
 
   e = mheap_elt_at_uoffset (v, uoffset);
   n = mheap_next_elt (e);
   n_user_data_bytes = mheap_elt_data_bytes (e);
 
-  trace_uoffset = uoffset;
-  trace_n_user_data_bytes = n_user_data_bytes;
-
   bin = user_data_size_to_bin_index (n_user_data_bytes);
   if (MHEAP_HAVE_SMALL_OBJECT_CACHE
       && bin < 255
@@ -760,7 +984,7 @@ void mheap_put (void * v, uword uoffset)
     {
       uoffset = mheap_put_small_object (h, bin, uoffset);
       if (uoffset == 0)      
-	goto done;
+	return;
 
       e = mheap_elt_at_uoffset (v, uoffset);
       n = mheap_next_elt (e);
@@ -816,27 +1040,6 @@ void mheap_put (void * v, uword uoffset)
       if (! (h->flags & MHEAP_FLAG_DISABLE_VM))
 	mheap_vm_elt (v, MHEAP_VM_UNMAP, f0);
     }
-
- done:
-  h = mheap_header (v);
-
-  if (h->flags & MHEAP_FLAG_TRACE)
-    {
-      /* Recursion block for case when we are traceing main clib heap. */
-      h->flags &= ~MHEAP_FLAG_TRACE;
-
-      mheap_put_trace (v, trace_uoffset, trace_n_user_data_bytes);
-
-      h->flags |= MHEAP_FLAG_TRACE;
-    }
-
-  if (h->flags & MHEAP_FLAG_VALIDATE)
-    mheap_validate (v);
-
-  mheap_maybe_unlock (v);
-
-  cpu_times[1] = clib_cpu_time_now ();
-  h->stats.n_clocks_put += cpu_times[1] - cpu_times[0];
 }
 
 void * mheap_alloc_with_flags (void * memory, uword memory_size, uword flags)
@@ -1100,12 +1303,41 @@ static u8 * format_mheap_stats (u8 * s, va_list * va)
   s = format (s, "\n%Uallocs: %Ld %.2f clocks/call",
 	      format_white_space, indent,
 	      st->n_gets,
-	      (f64) st->n_clocks_get / (f64) st->n_gets);
+	      st->n_gets ? (f64) st->n_clocks_get / (f64) st->n_gets : 0.);
 
   s = format (s, "\n%Ufrees: %Ld %.2f clocks/call",
 	      format_white_space, indent,
 	      st->n_puts,
-	      (f64) st->n_clocks_put / (f64) st->n_puts);
+	      st->n_puts ? (f64) st->n_clocks_put / (f64) st->n_puts : 0.);
+
+  if (h->cpu_caches)
+    {
+      mheap_cpu_cache_t * c;
+      uword i, n, n_objects, n_bytes;
+
+      for (i = 0; i < MHEAP_CPU_CACHE_MAX_CPUS; i++)
+	{
+	  if (! (c = h->cpu_caches[i]))
+	    continue;
+
+	  n_objects = n_bytes = 0;
+	  for (n = 0; n < ARRAY_LEN (c->n_cached); n++)
+	    {
+	      n_objects += c->n_cached[n];
+	      n_bytes += c->n_cached[n] * n * MHEAP_USER_DATA_WORD_BYTES;
+	    }
+
+	  s = format (s, "\n%Ucpu %d cache: allocs %Ld hits %Ld misses (%.2f%%), "
+		      "frees %Ld, flushes %Ld, %d objects %U cached",
+		      format_white_space, indent, i,
+		      c->n_get_hits, c->n_get_misses,
+		      (c->n_get_hits + c->n_get_misses != 0
+		       ? 100. * (f64) c->n_get_hits / (f64) (c->n_get_hits + c->n_get_misses)
+		       : 0.),
+		      c->n_puts, c->n_flushes,
+		      n_objects, format_mheap_byte_count, n_bytes);
+	}
+    }
 	      
   return s;
 }
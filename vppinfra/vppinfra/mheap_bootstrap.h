@@ -165,6 +165,28 @@ typedef struct {
   u32 replacement_index;
 } mheap_small_object_cache_t;
 
+/*
+ * Per-cpu magazines of small free objects.  On a thread safe heap
+ * small frees are kept by the freeing cpu and handed back out to its
+ * next allocations of the same size without taking the heap lock.
+ * Empty magazines are refilled, and full ones drained, in batches
+ * under a single lock acquisition.  Cached objects still count as
+ * allocated as far as the heap is concerned.  cpu 0 has no magazine
+ * since threads not started by vlib also report cpu 0.
+ */
+#define MHEAP_CPU_CACHE_MAX_USER_WORDS 64
+#define MHEAP_CPU_CACHE_MAGAZINE_SIZE 16
+#define MHEAP_CPU_CACHE_MAX_CPUS 256
+
+typedef struct {
+  /* Free objects, indexed by size in user data words */
+  u32 n_cached[MHEAP_CPU_CACHE_MAX_USER_WORDS + 1];
+  u32 offsets[MHEAP_CPU_CACHE_MAX_USER_WORDS + 1][MHEAP_CPU_CACHE_MAGAZINE_SIZE];
+
+  u64 n_get_hits, n_get_misses;
+  u64 n_puts, n_flushes;
+} mheap_cpu_cache_t;
+
 /* Vec header for heaps. */
 typedef struct {
   /* User offsets for head of doubly-linked list of free objects of this size. */
@@ -181,12 +203,17 @@ typedef struct {
 #define MHEAP_FLAG_THREAD_SAFE			(1 << 2)
 #define MHEAP_FLAG_SMALL_OBJECT_CACHE		(1 << 3)
 #define MHEAP_FLAG_VALIDATE			(1 << 4)
+#define MHEAP_FLAG_CPU_CACHE			(1 << 5)
 
   /* Lock use when MHEAP_FLAG_THREAD_SAFE is set. */
   volatile u32 lock;
   volatile u32 owner_cpu;
   int recursion_count;
 
+  /* Per-cpu small object caches, allocated from the heap on first use.
+     Only used with MHEAP_FLAG_THREAD_SAFE | MHEAP_FLAG_CPU_CACHE. */
+  mheap_cpu_cache_t ** cpu_caches;
+
   /* Number of allocated objects. */
   u64 n_elts;
 
@@ -12,6 +12,7 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <pthread.h>
 #include <vppinfra/time.h>
 #include <vppinfra/cache.h>
 #include <vppinfra/error.h>
@@ -27,6 +28,10 @@ typedef struct {
   u32 nitems;
   u32 search_iter;
   int careful_delete_tests;
+  int batch_tests;
+  int shape_tests;
+  u32 nthreads;
+  volatile u32 stress_errors;
   int verbose;
   int non_random_keys;
   uword * key_hash;
@@ -45,6 +50,174 @@ uword vl (void * v)
     return vec_len (v);
 }
 
+/* 
+ * Cycles per lookup for 1, 4 and 8 way batched searches.  Keys are
+ * searched in random order so that, with nitems sized well past the
+ * LLC, nearly every bucket and value page access misses.
+ */
+static void test_bihash_batch (test_main_t * tm)
+{
+  BVT(clib_bihash) * h = &tm->hash;
+  BVT(clib_bihash_kv) kv[8];
+  u32 ways[] = { 1, 4, 8 };
+  u32 * order = 0;
+  uword total_searches;
+  u64 before, delta;
+  int i, j, k, w, errors;
+  u32 found;
+
+  for (i = 0; i < tm->nitems; i++)
+    vec_add1 (order, random_u32 (&tm->seed) % tm->nitems);
+
+  for (w = 0; w < ARRAY_LEN (ways); w++)
+    {
+      u32 n = ways[w];
+
+      errors = 0;
+      before = clib_cpu_time_now ();
+
+      for (j = 0; j < tm->search_iter; j++)
+        {
+          for (i = 0; i + n <= tm->nitems; i += n)
+            {
+              for (k = 0; k < n; k++)
+                kv[k].key = tm->keys[order[i + k]];
+
+              if (n == 1)
+                found = BV(clib_bihash_search_inline) (h, &kv[0]) == 0;
+              else
+                found = BV(clib_bihash_search_inline_multi) (h, kv, kv, n);
+
+              errors += found != pow2_mask (n);
+              for (k = 0; k < n; k++)
+                errors += kv[k].value != (u64)(order[i + k] + 1);
+            }
+        }
+
+      delta = clib_cpu_time_now () - before;
+      total_searches = (uword)tm->search_iter * (uword)(tm->nitems - tm->nitems % n);
+
+      fformat (stdout, "%d-way batch: %lld searches, %.2f clocks/search%s\n",
+               n, total_searches, (f64) delta / (f64) total_searches,
+               errors ? ", ERRORS" : "");
+    }
+
+  vec_free (order);
+}
+
+typedef struct {
+  test_main_t * tm;
+  u32 thread_index;
+  int is_delete;
+} test_stress_thread_t;
+
+/* 
+ * Each thread owns the keys congruent to its index.  While it adds (or
+ * deletes the odd half of) its keys, it keeps searching: its own keys
+ * added so far must always be found, other threads' keys must have the
+ * right value when they are found.  No clib allocation is done here,
+ * the threads share the cpu 0 heap pointer.
+ */
+static void * test_bihash_stress_thread (void * arg)
+{
+  test_stress_thread_t * t = arg;
+  test_main_t * tm = t->tm;
+  BVT(clib_bihash) * h = &tm->hash;
+  BVT(clib_bihash_kv) kv;
+  u32 seed = t->thread_index + 1;
+  u32 i, j, errors = 0;
+
+  for (i = t->thread_index; i < tm->nitems; i += tm->nthreads)
+    {
+      kv.key = (u64)(i + 1);
+      kv.value = (u64)(i + 1);
+
+      if (t->is_delete == 0)
+        errors += BV(clib_bihash_add_del) (h, &kv, 1 /* is_add */) != 0;
+      else if (i & 1)
+        errors += BV(clib_bihash_add_del) (h, &kv, 0 /* is_add */) != 0;
+
+      /* Own key, already added / never deleted */
+      j = random_u32 (&seed) % (i + 1);
+      j -= j % tm->nthreads;
+      j += t->thread_index;
+      if (j > i)
+        j -= tm->nthreads;
+      if (j <= i && (t->is_delete == 0 || (j & 1) == 0))
+        {
+          kv.key = (u64)(j + 1);
+          if (BV(clib_bihash_search) (h, &kv, &kv) < 0
+              || kv.value != (u64)(j + 1))
+            errors++;
+        }
+
+      /* Anybody's key */
+      kv.key = (u64)(random_u32 (&seed) % tm->nitems) + 1;
+      if (BV(clib_bihash_search) (h, &kv, &kv) == 0 && kv.value != kv.key)
+        errors++;
+    }
+
+  __sync_fetch_and_add (&tm->stress_errors, errors);
+  return 0;
+}
+
+static clib_error_t * test_bihash_stress (test_main_t * tm)
+{
+  BVT(clib_bihash) * h = &tm->hash;
+  BVT(clib_bihash_kv) kv;
+  test_stress_thread_t * threads = 0;
+  pthread_t * tids = 0;
+  int i, is_delete, rv;
+  f64 before, delta;
+
+  BV(clib_bihash_init) (h, "stress", tm->nbuckets, 3ULL<<30);
+
+  vec_validate (threads, tm->nthreads - 1);
+  vec_validate (tids, tm->nthreads - 1);
+
+  for (is_delete = 0; is_delete < 2; is_delete++)
+    {
+      fformat (stdout, "%d threads %s %d items...\n", tm->nthreads,
+               is_delete ? "delete half of" : "add", tm->nitems);
+
+      before = clib_time_now (&tm->clib_time);
+      for (i = 0; i < tm->nthreads; i++)
+        {
+          threads[i].tm = tm;
+          threads[i].thread_index = i;
+          threads[i].is_delete = is_delete;
+          rv = pthread_create (&tids[i], 0, test_bihash_stress_thread,
+                               &threads[i]);
+          if (rv)
+            return clib_error_return_code (0, rv, 0, "pthread_create");
+        }
+      for (i = 0; i < tm->nthreads; i++)
+        pthread_join (tids[i], 0);
+      delta = clib_time_now (&tm->clib_time) - before;
+
+      fformat (stdout, "%.6f seconds, %d errors so far\n", delta, 
+               tm->stress_errors);
+    }
+
+  /* Even keys must be left, odd ones gone */
+  for (i = 0; i < tm->nitems; i++)
+    {
+      kv.key = (u64)(i + 1);
+      rv = BV(clib_bihash_search) (h, &kv, &kv);
+      if ((i & 1) ? rv == 0 : (rv < 0 || kv.value != (u64)(i + 1)))
+        tm->stress_errors++;
+    }
+
+  fformat (stdout, "%U", BV(format_bihash), h, 0 /* very verbose */);
+
+  vec_free (threads);
+  vec_free (tids);
+
+  if (tm->stress_errors)
+    return clib_error_return (0, "%d errors", tm->stress_errors);
+  return 0;
+}
+
 static clib_error_t * test_bihash (test_main_t * tm)
 {
   int i, j;
@@ -150,6 +323,9 @@ static clib_error_t * test_bihash (test_main_t * tm)
 
   fformat (stdout, "%lld searches in %.6f seconds\n", total_searches, delta);
 
+  if (tm->batch_tests)
+    test_bihash_batch (tm);
+
   fformat (stdout, "Standard E-hash search for items %d times...\n", 
            tm->search_iter);
 
@@ -216,6 +392,94 @@ static clib_error_t * test_bihash (test_main_t * tm)
   return 0;
 }
 
+/* 
+ * The wider key shapes.  Add nitems random keys, every other one
+ * differing from its neighbour only in the last key word, time
+ * search_iter passes over all of them, then delete them all.  Each
+ * instance binds BV() to the shape included just before it.
+ */
+#define test_bihash_shape_fn(n_key_u64)                                 \
+static clib_error_t * BV(test_bihash_shape) (test_main_t * tm)          \
+{                                                                       \
+  BVT(clib_bihash) h;                                                   \
+  BVT(clib_bihash_kv) kv, * kvs = 0;                                    \
+  u64 before, delta;                                                    \
+  int i, j, k, errors = 0;                                              \
+                                                                        \
+  memset (&h, 0, sizeof (h));                                           \
+  BV(clib_bihash_init) (&h, "shape", tm->nbuckets, 3ULL<<30);           \
+  vec_validate (kvs, tm->nitems - 1);                                   \
+                                                                        \
+  for (i = 0; i < tm->nitems; i++)                                      \
+    {                                                                   \
+      if (i & 1)                                                        \
+        {                                                               \
+          kvs[i] = kvs[i-1];                                            \
+          kvs[i].key[(n_key_u64) - 1] ^= 1;                             \
+        }                                                               \
+      else                                                              \
+        for (k = 0; k < (n_key_u64); k++)                               \
+          kvs[i].key[k] = random_u64 (&tm->seed);                       \
+      kvs[i].value = i + 1;                                             \
+      errors += BV(clib_bihash_add_del) (&h, &kvs[i], 1 /* is_add */)   \
+        != 0;                                                           \
+    }                                                                   \
+                                                                        \
+  before = clib_cpu_time_now ();                                        \
+  for (j = 0; j < tm->search_iter; j++)                                 \
+    for (i = 0; i < tm->nitems; i++)                                    \
+      {                                                                 \
+        kv = kvs[i];                                                    \
+        if (BV(clib_bihash_search_inline) (&h, &kv) < 0                 \
+            || kv.value != (u64)(i + 1))                                \
+          errors++;                                                     \
+      }                                                                 \
+  delta = clib_cpu_time_now () - before;                                \
+                                                                        \
+  fformat (stdout, "%d byte keys: %lld searches, %.2f clocks/search\n", \
+           8 * (n_key_u64), (u64) tm->search_iter * tm->nitems,         \
+           (f64) delta / ((f64) tm->search_iter * (f64) tm->nitems));   \
+                                                                        \
+  for (i = 0; i < tm->nitems; i++)                                      \
+    {                                                                   \
+      errors += BV(clib_bihash_add_del) (&h, &kvs[i], 0 /* is_add */)   \
+        != 0;                                                           \
+      kv = kvs[i];                                                      \
+      errors += BV(clib_bihash_search_inline) (&h, &kv) == 0;           \
+    }                                                                   \
+                                                                        \
+  BV(clib_bihash_free) (&h);                                            \
+  vec_free (kvs);                                                       \
+                                                                        \
+  if (errors)                                                           \
+    return clib_error_return (0, "%d byte keys: %d errors",             \
+                              8 * (n_key_u64), errors);                 \
+  return 0;                                                             \
+}
+
+#include <vppinfra/bihash_16_8.h>
+#include <vppinfra/bihash_template.c>
+test_bihash_shape_fn (2)
+
+#include <vppinfra/bihash_40_8.h>
+#include <vppinfra/bihash_template.c>
+test_bihash_shape_fn (5)
+
+#include <vppinfra/bihash_48_8.h>
+#include <vppinfra/bihash_template.c>
+test_bihash_shape_fn (6)
+
+static clib_error_t * test_bihash_shapes (test_main_t * tm)
+{
+  clib_error_t * error;
+
+  if ((error = test_bihash_shape_16_8 (tm)))
+    return error;
+  if ((error = test_bihash_shape_40_8 (tm)))
+    return error;
+  return test_bihash_shape_48_8 (tm);
+}
+
 clib_error_t * 
 test_bihash_main (test_main_t * tm)
 {
@@ -235,6 +499,12 @@ test_bihash_main (test_main_t * tm)
         ;
       else if (unformat (i, "careful %d", &tm->careful_delete_tests))
         ;
+      else if (unformat (i, "batch"))
+        tm->batch_tests = 1;
+      else if (unformat (i, "threads %d", &tm->nthreads))
+        ;
+      else if (unformat (i, "shapes"))
+        tm->shape_tests = 1;
       else if (unformat (i, "verbose %d", &tm->verbose))
         ;
       else if (unformat (i, "search %d", &tm->search_iter))
@@ -246,7 +516,12 @@ test_bihash_main (test_main_t * tm)
                                   format_unformat_error, i);
     }
     
-  error = test_bihash (tm);
+  if (tm->nthreads)
+    error = test_bihash_stress (tm);
+  else if (tm->shape_tests)
+    error = test_bihash_shapes (tm);
+  else
+    error = test_bihash (tm);
 
   return error;
 }
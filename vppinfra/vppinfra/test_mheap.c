@@ -48,18 +48,150 @@
 #include <vppinfra/mheap.h>
 #include <vppinfra/format.h>
 #include <vppinfra/random.h>
+#include <vppinfra/time.h>
 
 static int verbose = 0;
 #define if_verbose(format,args...) \
   if (verbose) { clib_warning(format, ## args); }
 
+#ifdef CLIB_UNIX
+#include <pthread.h>
+
+/* Multi-threaded alloc/free benchmark for thread safe heaps. */
+typedef struct {
+  void * heap;
+  uword * objects;
+  u32 cpu;
+  u32 n_iterations;
+  u32 max_object_size;
+  u32 seed;
+  u64 n_clocks;
+} test_mheap_thread_t;
+
+static __thread uword test_mheap_cpu;
+
+/* Benchmark threads are plain pthreads, not on clib per-cpu stacks. */
+uword os_get_cpu_number (void)
+{ return test_mheap_cpu; }
+
+static void * test_mheap_thread (void * arg)
+{
+  test_mheap_thread_t * t = arg;
+  uword * objects = t->objects;
+  u32 i, j, size;
+  u64 t0;
+
+  test_mheap_cpu = t->cpu;
+
+  t0 = clib_cpu_time_now ();
+  for (i = 0; i < t->n_iterations; i++)
+    {
+      j = random_u32 (&t->seed) % vec_len (objects);
+      if (objects[j] != ~0)
+	{
+	  mheap_put (t->heap, objects[j]);
+	  objects[j] = ~0;
+	}
+      else
+	{
+	  size = 1 + random_u32 (&t->seed) % t->max_object_size;
+	  mheap_get_aligned (t->heap, size, 0, 0, &objects[j]);
+	  ASSERT (objects[j] != ~0);
+	}
+    }
+  t->n_clocks = clib_cpu_time_now () - t0;
+
+  return 0;
+}
+
+static int
+test_mheap_threads (u32 n_threads, u32 n_iterations, u32 n_objects,
+		    u32 max_object_size, u32 seed)
+{
+  test_mheap_thread_t * threads = 0, * t;
+  pthread_t * tids = 0;
+  void * heap;
+  uword size, flags;
+  int i, j, use_cache;
+  f64 clocks_per_op;
+
+  size = max_pow2 (4 * n_threads * n_objects * max_object_size);
+  size = clib_max (size, 64 << 20);
+
+  vec_resize (threads, n_threads);
+  vec_resize (tids, n_threads);
+
+  for (use_cache = 0; use_cache < 2; use_cache++)
+    {
+      flags = MHEAP_FLAG_THREAD_SAFE;
+#ifdef CLIB_HAVE_VEC128
+      flags |= MHEAP_FLAG_SMALL_OBJECT_CACHE;
+#endif
+      if (use_cache)
+	flags |= MHEAP_FLAG_CPU_CACHE;
+
+      heap = mheap_alloc_with_flags (0, size, flags);
+      if (! heap)
+	return 1;
+
+      vec_foreach (t, threads)
+	{
+	  memset (t, 0, sizeof (t[0]));
+	  t->heap = heap;
+	  t->cpu = 1 + t - threads;
+	  t->n_iterations = n_iterations;
+	  t->max_object_size = max_object_size;
+	  t->seed = seed + t->cpu;
+	  vec_validate_init_empty (t->objects, n_objects - 1, ~0);
+	}
+
+      for (i = 0; i < n_threads; i++)
+	if (pthread_create (&tids[i], 0, test_mheap_thread, &threads[i]))
+	  {
+	    clib_warning ("pthread_create failed");
+	    return 1;
+	  }
+
+      clocks_per_op = 0;
+      for (i = 0; i < n_threads; i++)
+	{
+	  pthread_join (tids[i], 0);
+	  clocks_per_op += (f64) threads[i].n_clocks / n_iterations;
+	}
+
+      /* Free what is left from this thread: frees of other cpus' objects. */
+      vec_foreach (t, threads)
+	{
+	  for (j = 0; j < vec_len (t->objects); j++)
+	    if (t->objects[j] != ~0)
+	      mheap_put (heap, t->objects[j]);
+	  vec_free (t->objects);
+	}
+
+      mheap_validate (heap);
+
+      fformat (stdout, "%d threads, per-cpu cache %s: %.2f clocks/op\n",
+	       n_threads, use_cache ? "on" : "off",
+	       clocks_per_op / n_threads);
+      if (verbose)
+	fformat (stdout, "%U\n", format_mheap, heap, 1);
+
+      mheap_free (heap);
+    }
+
+  vec_free (threads);
+  vec_free (tids);
+  return 0;
+}
+#endif /* CLIB_UNIX */
+
 int test_mheap_main (unformat_input_t * input)
 {
   int i, j, k, n_iterations;
   void * h, * h_mem;
   uword * objects = 0;
   u32 objects_used, really_verbose, n_objects, max_object_size;
-  u32 check_mask, seed, trace, use_vm;
+  u32 check_mask, seed, trace, use_vm, n_threads;
   u32 print_every = 0;
   u32 * data;
   mheap_t * mh;
@@ -77,6 +209,7 @@ int test_mheap_main (unformat_input_t * input)
   trace = 0;
   really_verbose = 0;
   use_vm = 0;
+  n_threads = 0;
 
   while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
     {
@@ -92,6 +225,7 @@ int test_mheap_main (unformat_input_t * input)
 	  && 0 == unformat (input, "verbose %=", &really_verbose, 1)
 	  && 0 == unformat (input, "trace %=", &trace, 1)
 	  && 0 == unformat (input, "vm %=", &use_vm, 1)
+	  && 0 == unformat (input, "threads %d", &n_threads)
 	  && 0 == unformat (input, "align %|", &check_mask, CHECK_ALIGN))
 	{
 	  clib_warning ("unknown input `%U'", format_unformat_error, input);
@@ -103,6 +237,12 @@ int test_mheap_main (unformat_input_t * input)
   if (! seed)
     seed = random_default_seed ();
 
+#ifdef CLIB_UNIX
+  if (n_threads > 0)
+    return test_mheap_threads (n_threads, n_iterations, n_objects,
+			       max_object_size, seed);
+#endif
+
   if_verbose   ("testing %d iterations, %d %saligned objects, max. size %d, seed %d",
 		n_iterations,
 		n_objects,
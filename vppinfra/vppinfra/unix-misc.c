@@ -38,9 +38,11 @@
 #include <vppinfra/error.h>
 #include <vppinfra/os.h>
 #include <vppinfra/unix.h>
+#include <vppinfra/mheap.h>
 
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/syscall.h>
 #include <sys/uio.h>		/* writev */
 #include <fcntl.h>
 #include <stdio.h>		/* for sprintf */
@@ -205,3 +207,129 @@ void os_out_of_memory (void)
 uword os_get_cpu_number (void) __attribute__ ((weak));
 uword os_get_cpu_number (void)
 { return os_get_cpu_number_inline(); }
+
+/* From linux/mempolicy.h and linux/mman.h, not always installed */
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+#define CLIB_MEM_MAX_NUMA_NODES 64
+
+int clib_mem_cpu_numa_node (uword cpu)
+{
+  char path[128];
+  int node;
+
+  for (node = 0; node < CLIB_MEM_MAX_NUMA_NODES; node++)
+    {
+      snprintf (path, sizeof (path), "/sys/devices/system/cpu/cpu%d/node%d",
+		(int) cpu, node);
+      if (access (path, F_OK) == 0)
+	return node;
+    }
+  return -1;
+}
+
+void * clib_mem_vm_alloc_numa (uword * size, int numa_node,
+			       uword * log2_page_size)
+{
+  void * addr = MAP_FAILED;
+  uword flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  uword n_bytes;
+
+  if (*log2_page_size > 0)
+    {
+      n_bytes = round_pow2 (*size, (uword) 1 << *log2_page_size);
+      addr = mmap (0, n_bytes, PROT_READ | PROT_WRITE,
+		   flags | MAP_HUGETLB | (*log2_page_size << MAP_HUGE_SHIFT),
+		   -1, 0);
+      if (addr != MAP_FAILED)
+	*size = n_bytes;
+    }
+
+  /* No huge pages reserved, or none asked for */
+  if (addr == MAP_FAILED)
+    {
+      *log2_page_size = 0;
+      addr = mmap (0, *size, PROT_READ | PROT_WRITE, flags, -1, 0);
+      if (addr == MAP_FAILED)
+	return 0;
+    }
+
+  if (numa_node >= 0 && numa_node < CLIB_MEM_MAX_NUMA_NODES)
+    {
+      uword mask = (uword) 1 << numa_node;
+
+      /* Nothing is faulted in yet, so every page follows the policy.
+	 Preferred rather than bind: running short on one node should
+	 cost latency, not an out of memory panic. */
+      if (syscall (SYS_mbind, addr, *size, MPOL_PREFERRED, &mask,
+		   BITS (mask) + 1, 0) < 0)
+	clib_unix_warning ("mbind node %d", numa_node);
+    }
+
+  return addr;
+}
+
+int clib_mem_vm_get_numa_pages (void * addr, uword size,
+				uword log2_page_size, uword ** pages_by_node)
+{
+  void * pages[256];
+  int status[ARRAY_LEN (pages)];
+  uword page_size, n_pages, i, n;
+
+  if (log2_page_size == 0)
+    log2_page_size = min_log2 (clib_mem_get_page_size ());
+  page_size = (uword) 1 << log2_page_size;
+  n_pages = size >> log2_page_size;
+
+  while (n_pages > 0)
+    {
+      n = clib_min (n_pages, ARRAY_LEN (pages));
+      for (i = 0; i < n; i++)
+	pages[i] = addr + i * page_size;
+
+      /* With no target nodes move_pages only reports where pages are */
+      if (syscall (SYS_move_pages, 0, n, pages, 0, status, 0) < 0)
+	return -1;
+
+      /* Pages never touched come back as -ENOENT */
+      for (i = 0; i < n; i++)
+	if (status[i] >= 0)
+	  {
+	    vec_validate (pages_by_node[0], status[i]);
+	    pages_by_node[0][status[i]]++;
+	  }
+
+      addr += n * page_size;
+      n_pages -= n;
+    }
+
+  return 0;
+}
+
+clib_mem_table_policy_t clib_mem_table_policy = { .numa_node = -1, };
+
+void * clib_mem_table_heap_alloc (uword size)
+{
+  clib_mem_table_policy_t * p = &clib_mem_table_policy;
+  uword log2_page_size = p->log2_page_size;
+  void * memory;
+
+  if (p->numa_node < 0 && log2_page_size == 0)
+    return mheap_alloc (0 /* use VM */, size);
+
+  memory = clib_mem_vm_alloc_numa (&size, p->numa_node, &log2_page_size);
+  if (! memory)
+    return 0;
+
+  /* Caller provided memory: mheap never remaps it, which would drop
+     the huge pages and the memory policy. */
+  return mheap_alloc (memory, size);
+}
@@ -89,4 +89,36 @@ always_inline void * clib_mem_vm_map (void * addr, uword size)
   return mmap_addr;
 }
 
+/* NUMA node of the given cpu, -1 if unknown. */
+int clib_mem_cpu_numa_node (uword cpu);
+
+/* Allocate address space backed by 1 << *log2_page_size pages and
+   preferably placed on numa_node.  A numa_node < 0 means no preference,
+   a *log2_page_size of 0 means normal pages.  If the huge pages cannot
+   be had, falls back to normal pages; *size and *log2_page_size are
+   updated to describe what was actually mapped.  Free with
+   clib_mem_vm_free. */
+void * clib_mem_vm_alloc_numa (uword * size, int numa_node,
+			       uword * log2_page_size);
+
+/* Count resident pages of [addr, addr + size) by the node they are on.
+   Returns 0 on success, -1 if the kernel cannot tell. */
+int clib_mem_vm_get_numa_pages (void * addr, uword size,
+				uword log2_page_size, uword ** pages_by_node);
+
+/* Placement of large tables (bihash, classify) which live in their own
+   heaps. */
+typedef struct {
+  /* Preferred node, -1 for none */
+  int numa_node;
+
+  /* Backing page size, 0 for normal pages */
+  uword log2_page_size;
+} clib_mem_table_policy_t;
+
+extern clib_mem_table_policy_t clib_mem_table_policy;
+
+/* Create a table heap according to clib_mem_table_policy. */
+void * clib_mem_table_heap_alloc (uword size);
+
 #endif /* included_vm_unix_h */